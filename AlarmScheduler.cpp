@@ -0,0 +1,430 @@
+#include "AlarmScheduler.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+constexpr uint8_t AlarmScheduler::ONCE;
+constexpr uint8_t AlarmScheduler::DAILY;
+constexpr uint8_t AlarmScheduler::WEEKDAYS;
+constexpr uint8_t AlarmScheduler::WEEKENDS;
+constexpr std::chrono::seconds AlarmScheduler::LATE_GRACE;
+
+namespace
+{
+	constexpr int64_t NS_PER_SECOND = 1000000000;
+	// A virtual sleep needs a finite deadline; time only jumps this far once every other attached thread sleeps longer
+	constexpr std::chrono::hours VIRTUAL_IDLE{24};
+
+	timespec toTimespec(int64_t ns)
+	{
+		timespec ts;
+		ts.tv_sec = static_cast<time_t>(ns / NS_PER_SECOND);
+		ts.tv_nsec = static_cast<long>(ns % NS_PER_SECOND);
+		return ts;
+	}
+}
+
+AlarmScheduler::AlarmScheduler(Clock &clock)
+		: m_clock(clock),
+			m_missedCount(MetricsRegistry::instance().counter("alarm_missed_total")),
+			m_clockChangeCount(MetricsRegistry::instance().counter("alarm_clock_changes_total"))
+{
+}
+
+AlarmScheduler::~AlarmScheduler()
+{
+	stop();
+	if (m_timerFd >= 0)
+	{
+		close(m_timerFd);
+	}
+	if (m_stopFd >= 0)
+	{
+		close(m_stopFd);
+	}
+}
+
+bool AlarmScheduler::initialize()
+{
+	if (m_clock.isVirtual() || m_timerFd >= 0)
+	{
+		return true;
+	}
+	m_timerFd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_timerFd < 0 || m_stopFd < 0)
+	{
+		if (m_errorCallback)
+		{
+			m_errorCallback("Failed to create alarm timer: " + std::string(strerror(errno)));
+		}
+		if (m_timerFd >= 0)
+		{
+			close(m_timerFd);
+			m_timerFd = -1;
+		}
+		if (m_stopFd >= 0)
+		{
+			close(m_stopFd);
+			m_stopFd = -1;
+		}
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	armLocked();
+	return true;
+}
+
+bool AlarmScheduler::setAlarm(const Alarm &alarm)
+{
+	if (alarm.name.empty() || alarm.hour < 0 || alarm.hour > 23 || alarm.minute < 0 || alarm.minute > 59 ||
+			(alarm.days & ~DAILY) != 0)
+	{
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Entry &entry = m_alarms[alarm.name];
+	entry.alarm = alarm;
+	entry.lastDue = std::chrono::system_clock::time_point::min();
+	scheduleLocked(entry, m_clock.wallNow());
+	armLocked();
+	return true;
+}
+
+bool AlarmScheduler::removeAlarm(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_alarms.erase(name) == 0)
+	{
+		return false;
+	}
+	armLocked();
+	return true;
+}
+
+bool AlarmScheduler::getAlarm(const std::string &name, Alarm &alarm) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_alarms.find(name);
+	if (it == m_alarms.end())
+	{
+		return false;
+	}
+	alarm = it->second.alarm;
+	return true;
+}
+
+std::vector<AlarmScheduler::Alarm> AlarmScheduler::getAlarms() const
+{
+	std::vector<const Entry *> entries;
+	std::vector<Alarm> alarms;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (const auto &item : m_alarms)
+	{
+		entries.push_back(&item.second);
+	}
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry *a, const Entry *b)
+									 { return a->due < b->due; });
+	for (const Entry *entry : entries)
+	{
+		alarms.push_back(entry->alarm);
+	}
+	return alarms;
+}
+
+std::chrono::system_clock::time_point AlarmScheduler::getNextTrigger(const std::string &name) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_alarms.find(name);
+	return it == m_alarms.end() ? std::chrono::system_clock::time_point::max() : it->second.due;
+}
+
+std::chrono::system_clock::time_point AlarmScheduler::nextOccurrence(const Alarm &alarm,
+																																		 std::chrono::system_clock::time_point after)
+{
+	std::time_t seconds = std::chrono::system_clock::to_time_t(after);
+	std::tm local = {};
+	localtime_r(&seconds, &local);
+	// Today's time of day may already have passed, so a repeating alarm can be up to 7 days away
+	for (int day = 0; day <= 7; ++day)
+	{
+		std::tm candidate = local;
+		candidate.tm_mday += day;
+		candidate.tm_hour = alarm.hour;
+		candidate.tm_min = alarm.minute;
+		candidate.tm_sec = 0;
+		candidate.tm_isdst = -1; // Let mktime pick the DST offset of that day
+		std::time_t trigger = std::mktime(&candidate);
+		if (trigger == static_cast<std::time_t>(-1))
+		{
+			continue;
+		}
+		auto when = std::chrono::system_clock::from_time_t(trigger);
+		if (when > after && (alarm.days == ONCE || (alarm.days & (1u << candidate.tm_wday)) != 0))
+		{
+			return when;
+		}
+	}
+	return std::chrono::system_clock::time_point::max();
+}
+
+void AlarmScheduler::start()
+{
+	if (m_running.load())
+	{
+		return;
+	}
+	if (!initialize())
+	{
+		return;
+	}
+	if (m_stopFd >= 0)
+	{
+		uint64_t pending;
+		ssize_t drained = read(m_stopFd, &pending, sizeof(pending));
+		(void)drained;
+	}
+	m_stopRequested.store(false);
+	m_running.store(true);
+	// Virtual time must not run ahead of the thread before it computes its first deadline
+	m_clock.attach();
+	m_thread = std::make_unique<std::thread>(&AlarmScheduler::schedulerThread, this);
+}
+
+void AlarmScheduler::stop()
+{
+	m_stopRequested.store(true);
+	if (m_stopFd >= 0)
+	{
+		uint64_t one = 1;
+		ssize_t written = write(m_stopFd, &one, sizeof(one));
+		(void)written;
+	}
+	m_changed.store(true);
+	m_clock.interrupt();
+	if (m_thread && m_thread->joinable())
+	{
+		m_thread->join();
+	}
+	m_thread.reset();
+	m_running.store(false);
+}
+
+bool AlarmScheduler::isRunning() const
+{
+	return m_running.load();
+}
+
+int AlarmScheduler::getTimerFd() const
+{
+	return m_timerFd;
+}
+
+void AlarmScheduler::dispatch()
+{
+	bool clockChanged = false;
+	if (m_timerFd >= 0)
+	{
+		uint64_t expirations;
+		if (read(m_timerFd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED)
+		{
+			clockChanged = true;
+		}
+	}
+
+	std::vector<std::pair<Alarm, bool>> triggered;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto now = m_clock.wallNow();
+		if (clockChanged)
+		{
+			m_clockChangeCount.increment();
+			resyncLocked(now);
+		}
+		while (true)
+		{
+			pruneLocked();
+			if (m_queue.empty() || m_queue.front().due > now)
+			{
+				break;
+			}
+			std::pop_heap(m_queue.begin(), m_queue.end(), LaterDue());
+			QueueEntry top = std::move(m_queue.back());
+			m_queue.pop_back();
+
+			auto it = m_alarms.find(top.name);
+			Entry &entry = it->second;
+			bool missed = now - top.due > LATE_GRACE;
+			if (missed)
+			{
+				m_missedCount.increment();
+			}
+			triggered.emplace_back(entry.alarm, missed);
+			entry.lastDue = top.due;
+			if (entry.alarm.days == ONCE)
+			{
+				m_alarms.erase(it);
+			}
+			else
+			{
+				// After a long gap (suspend) the next trigger is the first one still in the grace window
+				scheduleLocked(entry, std::max(top.due, now - LATE_GRACE));
+			}
+		}
+		// Also clears a cancelled timer, which stays readable until it is set again
+		armLocked();
+	}
+
+	if (m_triggerCallback)
+	{
+		for (const auto &trigger : triggered)
+		{
+			m_triggerCallback(trigger.first, trigger.second);
+		}
+	}
+}
+
+uint64_t AlarmScheduler::getWakeupCount() const
+{
+	return m_wakeups.load();
+}
+
+void AlarmScheduler::registerTriggerCallback(TriggerCallback callback)
+{
+	m_triggerCallback = callback;
+}
+
+void AlarmScheduler::registerErrorCallback(ErrorCallback callback)
+{
+	m_errorCallback = callback;
+}
+
+void AlarmScheduler::scheduleLocked(Entry &entry, std::chrono::system_clock::time_point after)
+{
+	entry.due = nextOccurrence(entry.alarm, std::max(after, entry.lastDue));
+	entry.generation = m_nextGeneration++;
+	if (entry.due != std::chrono::system_clock::time_point::max())
+	{
+		m_queue.push_back({entry.due, entry.generation, entry.alarm.name});
+		std::push_heap(m_queue.begin(), m_queue.end(), LaterDue());
+	}
+	// Replaced alarms leave entries behind that are only dropped once they reach the top
+	if (m_queue.size() > 2 * m_alarms.size() + 8)
+	{
+		m_queue.clear();
+		for (const auto &item : m_alarms)
+		{
+			if (item.second.due != std::chrono::system_clock::time_point::max())
+			{
+				m_queue.push_back({item.second.due, item.second.generation, item.first});
+			}
+		}
+		std::make_heap(m_queue.begin(), m_queue.end(), LaterDue());
+	}
+}
+
+void AlarmScheduler::resyncLocked(std::chrono::system_clock::time_point now)
+{
+	// Triggers are absolute times computed on the old clock; redo them from each alarm's
+	// time of day. A trigger the step jumped over by less than LATE_GRACE still fires,
+	// and lastDue keeps a backward step from repeating one that already fired.
+	m_queue.clear();
+	for (auto &item : m_alarms)
+	{
+		scheduleLocked(item.second, now - LATE_GRACE);
+	}
+}
+
+void AlarmScheduler::pruneLocked()
+{
+	while (!m_queue.empty())
+	{
+		const QueueEntry &top = m_queue.front();
+		auto it = m_alarms.find(top.name);
+		if (it != m_alarms.end() && it->second.generation == top.generation)
+		{
+			return;
+		}
+		std::pop_heap(m_queue.begin(), m_queue.end(), LaterDue());
+		m_queue.pop_back();
+	}
+}
+
+void AlarmScheduler::armLocked()
+{
+	pruneLocked();
+	if (m_clock.isVirtual())
+	{
+		m_changed.store(true);
+		m_clock.interrupt();
+		return;
+	}
+	if (m_timerFd < 0)
+	{
+		return;
+	}
+	// A zero it_value disarms, so an empty schedule leaves the thread asleep until the next change
+	itimerspec spec = {};
+	if (!m_queue.empty())
+	{
+		int64_t dueNs = std::chrono::duration_cast<std::chrono::nanoseconds>(m_queue.front().due.time_since_epoch()).count();
+		spec.it_value = toTimespec(std::max<int64_t>(dueNs, 1));
+	}
+	if (timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, nullptr) < 0 && m_errorCallback)
+	{
+		m_errorCallback("Failed to arm alarm timer: " + std::string(strerror(errno)));
+	}
+}
+
+bool AlarmScheduler::waitForTrigger()
+{
+	if (m_clock.isVirtual())
+	{
+		// Cleared before the deadline is read, so a change made after that cuts the sleep short
+		m_changed.store(false);
+		Clock::time_point deadline;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			pruneLocked();
+			// Wall time first, so the deadline lands at or just after the trigger
+			auto wall = m_clock.wallNow();
+			auto now = m_clock.now();
+			deadline = m_queue.empty() ? now + VIRTUAL_IDLE
+																 : now + std::chrono::duration_cast<Clock::time_point::duration>(m_queue.front().due - wall);
+		}
+		m_clock.sleepUntil(deadline, &m_changed);
+		m_wakeups.fetch_add(1);
+		return !m_stopRequested.load();
+	}
+
+	pollfd fds[2] = {{m_timerFd, POLLIN, 0}, {m_stopFd, POLLIN, 0}};
+	while (poll(fds, 2, -1) < 0)
+	{
+		if (errno != EINTR)
+		{
+			if (m_errorCallback)
+			{
+				m_errorCallback("Alarm wait failed: " + std::string(strerror(errno)));
+			}
+			return false;
+		}
+	}
+	m_wakeups.fetch_add(1);
+	return !m_stopRequested.load() && !(fds[1].revents & POLLIN);
+}
+
+void AlarmScheduler::schedulerThread()
+{
+	MetricsRegistry::ThreadScope scope("alarm");
+	m_clock.bindThread();
+	while (waitForTrigger())
+	{
+		dispatch();
+	}
+	m_clock.unbindThread();
+}
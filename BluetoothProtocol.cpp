@@ -0,0 +1,233 @@
+#include "BluetoothProtocol.h"
+#include <algorithm>
+#include <cstring>
+
+namespace bluetooth
+{
+	namespace
+	{
+		constexpr uint8_t CRC_POLYNOMIAL = 0x07;
+		constexpr uint8_t NO_CURTAIN = 0xFF;
+		constexpr size_t ALARM_FIXED_BYTES = 5;
+
+		const std::array<uint8_t, 256> &crcTable()
+		{
+			static const std::array<uint8_t, 256> table = []
+			{
+				std::array<uint8_t, 256> entries;
+				for (int value = 0; value < 256; ++value)
+				{
+					uint8_t crc = static_cast<uint8_t>(value);
+					for (int bit = 0; bit < 8; ++bit)
+					{
+						crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ CRC_POLYNOMIAL : crc << 1);
+					}
+					entries[value] = crc;
+				}
+				return entries;
+			}();
+			return table;
+		}
+	}
+
+	uint8_t crc8(const uint8_t *data, size_t length)
+	{
+		const std::array<uint8_t, 256> &table = crcTable();
+		uint8_t crc = 0;
+		for (size_t i = 0; i < length; ++i)
+		{
+			crc = table[crc ^ data[i]];
+		}
+		return crc;
+	}
+
+	bool encodeFrame(Command command, const uint8_t *payload, size_t length, std::vector<uint8_t> &out)
+	{
+		if (length > MAX_PAYLOAD)
+		{
+			return false;
+		}
+		size_t start = out.size();
+		out.push_back(FRAME_START);
+		out.push_back(static_cast<uint8_t>(command));
+		out.push_back(static_cast<uint8_t>(length));
+		out.insert(out.end(), payload, payload + length);
+		out.push_back(crc8(out.data() + start + 1, length + 2));
+		return true;
+	}
+
+	bool encodeFrame(const Frame &frame, std::vector<uint8_t> &out)
+	{
+		return encodeFrame(frame.command, frame.payload.data(), frame.length, out);
+	}
+
+	Frame encodeAlarm(Command command, const AlarmScheduler::Alarm &alarm)
+	{
+		Frame frame;
+		frame.command = command;
+		frame.payload[0] = static_cast<uint8_t>(alarm.hour);
+		frame.payload[1] = static_cast<uint8_t>(alarm.minute);
+		frame.payload[2] = alarm.days;
+		frame.payload[3] = alarm.buzzer ? 1 : 0;
+		frame.payload[4] = alarm.curtainPercent < 0 ? NO_CURTAIN : static_cast<uint8_t>(std::min(alarm.curtainPercent, 100));
+		size_t nameLength = std::min(alarm.name.size(), MAX_ALARM_NAME);
+		std::memcpy(frame.payload.data() + ALARM_FIXED_BYTES, alarm.name.data(), nameLength);
+		frame.length = static_cast<uint8_t>(ALARM_FIXED_BYTES + nameLength);
+		return frame;
+	}
+
+	bool decodeAlarm(const Frame &frame, AlarmScheduler::Alarm &alarm)
+	{
+		if (frame.length <= ALARM_FIXED_BYTES || frame.payload[3] > 1 ||
+				(frame.payload[4] > 100 && frame.payload[4] != NO_CURTAIN))
+		{
+			return false;
+		}
+		alarm.hour = frame.payload[0];
+		alarm.minute = frame.payload[1];
+		alarm.days = frame.payload[2];
+		alarm.buzzer = frame.payload[3] != 0;
+		alarm.curtainPercent = frame.payload[4] == NO_CURTAIN ? -1 : frame.payload[4];
+		alarm.name.assign(reinterpret_cast<const char *>(frame.payload.data() + ALARM_FIXED_BYTES),
+											frame.length - ALARM_FIXED_BYTES);
+		return true;
+	}
+
+	bool applyTelemetry(const Frame &frame, StatusFields &fields)
+	{
+		if (frame.command != Command::TELEMETRY || frame.length == 0)
+		{
+			return false;
+		}
+		uint8_t mask = frame.payload[0];
+		size_t next = 1;
+		for (size_t field = 0; field < STATUS_FIELDS; ++field)
+		{
+			if ((mask & (1u << field)) == 0)
+			{
+				continue;
+			}
+			if (next >= frame.length)
+			{
+				return false;
+			}
+			fields[field] = frame.payload[next++];
+		}
+		return next == frame.length && (mask >> STATUS_FIELDS) == 0;
+	}
+
+	TelemetryEncoder::TelemetryEncoder()
+	{
+		m_sent.fill(0);
+	}
+
+	bool TelemetryEncoder::encode(const StatusFields &fields, Frame &frame)
+	{
+		uint8_t mask = 0;
+		size_t length = 1;
+		for (size_t field = 0; field < STATUS_FIELDS; ++field)
+		{
+			if (m_keyframe || fields[field] != m_sent[field])
+			{
+				mask |= static_cast<uint8_t>(1u << field);
+				frame.payload[length++] = fields[field];
+			}
+		}
+		if (mask == 0)
+		{
+			return false;
+		}
+		frame.command = Command::TELEMETRY;
+		frame.payload[0] = mask;
+		frame.length = static_cast<uint8_t>(length);
+		m_sent = fields;
+		m_keyframe = false;
+		return true;
+	}
+
+	void TelemetryEncoder::reset()
+	{
+		m_keyframe = true;
+	}
+
+	FrameParser::FrameParser()
+			: m_stats{0, 0, 0}
+	{
+	}
+
+	size_t FrameParser::feed(const uint8_t *data, size_t length, const FrameHandler &handler)
+	{
+		size_t frames = 0;
+		while (length > 0)
+		{
+			// drain() always leaves less than one frame behind, so there is room for more
+			size_t chunk = std::min(length, m_buffer.size() - m_size);
+			std::memcpy(m_buffer.data() + m_size, data, chunk);
+			m_size += chunk;
+			data += chunk;
+			length -= chunk;
+			frames += drain(handler);
+		}
+		return frames;
+	}
+
+	void FrameParser::reset()
+	{
+		m_size = 0;
+	}
+
+	FrameParser::Stats FrameParser::getStats() const
+	{
+		return m_stats;
+	}
+
+	size_t FrameParser::drain(const FrameHandler &handler)
+	{
+		size_t frames = 0;
+		size_t pos = 0;
+		while (true)
+		{
+			const uint8_t *start = static_cast<const uint8_t *>(std::memchr(m_buffer.data() + pos, FRAME_START, m_size - pos));
+			size_t found = start ? static_cast<size_t>(start - m_buffer.data()) : m_size;
+			m_stats.discardedBytes += found - pos;
+			pos = found;
+			if (m_size - pos < 3)
+			{
+				break;
+			}
+			size_t length = m_buffer[pos + 2];
+			if (length > MAX_PAYLOAD)
+			{
+				// Not a real header; resynchronize on the next START
+				++pos;
+				++m_stats.discardedBytes;
+				continue;
+			}
+			if (m_size - pos < length + FRAME_OVERHEAD)
+			{
+				break;
+			}
+			if (crc8(&m_buffer[pos + 1], length + 2) != m_buffer[pos + 3 + length])
+			{
+				++m_stats.checksumErrors;
+				++pos;
+				++m_stats.discardedBytes;
+				continue;
+			}
+			Frame frame;
+			frame.command = static_cast<Command>(m_buffer[pos + 1]);
+			frame.length = static_cast<uint8_t>(length);
+			std::memcpy(frame.payload.data(), &m_buffer[pos + 3], length);
+			pos += length + FRAME_OVERHEAD;
+			++m_stats.frames;
+			++frames;
+			handler(frame);
+		}
+		if (pos > 0)
+		{
+			std::memmove(m_buffer.data(), m_buffer.data() + pos, m_size - pos);
+			m_size -= pos;
+		}
+		return frames;
+	}
+}
@@ -0,0 +1,265 @@
+#include "Clock.h"
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+
+namespace
+{
+	// Virtual clock the calling thread holds time for, and how many scopes bound it
+	thread_local const Clock *t_boundClock = nullptr;
+	thread_local int t_bindDepth = 0;
+
+	timespec toTimespec(Clock::time_point time)
+	{
+		// steady_clock is CLOCK_MONOTONIC on Linux
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+		timespec ts;
+		ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+		ts.tv_nsec = static_cast<long>(ns % 1000000000);
+		return ts;
+	}
+
+	class SystemClock : public Clock
+	{
+	public:
+		time_point now() override
+		{
+			return std::chrono::steady_clock::now();
+		}
+
+		std::chrono::system_clock::time_point wallNow() override
+		{
+			return std::chrono::system_clock::now();
+		}
+
+		bool sleepUntil(time_point deadline, const std::atomic<bool> *cancel) override
+		{
+			if (!cancel)
+			{
+				// A plain absolute sleep: the spin of delay_until() is kept for the sites that need its precision
+				timespec ts = toTimespec(deadline);
+				while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+				{
+				}
+				return true;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return !m_wake.wait_until(lock, deadline, [cancel]
+																{ return cancel->load(); });
+		}
+
+		void interrupt() override
+		{
+			// Taking the mutex orders the caller's flag store before any sleeper's check
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+			}
+			m_wake.notify_all();
+		}
+
+		bool isVirtual() const override
+		{
+			return false;
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+	};
+}
+
+Clock &Clock::system()
+{
+	static Clock *clock = new SystemClock();
+	return *clock;
+}
+
+void Clock::attach()
+{
+}
+
+void Clock::bindThread()
+{
+}
+
+void Clock::unbindThread()
+{
+}
+
+void Clock::detach()
+{
+}
+
+void Clock::sleepFor(std::chrono::nanoseconds duration)
+{
+	sleepUntil(now() + duration);
+}
+
+VirtualClock::Scope::Scope(Clock &clock) : m_clock(clock)
+{
+	// Slots are interchangeable; taking one of our own leaves those of starting threads alone
+	m_clock.attach();
+	m_clock.bindThread();
+}
+
+VirtualClock::Scope::~Scope()
+{
+	m_clock.unbindThread();
+}
+
+VirtualClock::VirtualClock(std::chrono::system_clock::time_point wallStart, std::chrono::nanoseconds readCost)
+		: m_start(std::chrono::steady_clock::now()), m_wallStart(wallStart), m_readCost(readCost), m_now(m_start)
+{
+}
+
+VirtualClock::time_point VirtualClock::now()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_now += m_readCost;
+	return m_now;
+}
+
+std::chrono::system_clock::time_point VirtualClock::wallNow()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_wallStart + std::chrono::duration_cast<std::chrono::system_clock::duration>(m_now - m_start);
+}
+
+bool VirtualClock::sleepUntil(time_point deadline, const std::atomic<bool> *cancel)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (deadline <= m_now)
+	{
+		return true;
+	}
+	if (cancel && cancel->load())
+	{
+		return false;
+	}
+	Sleeper self;
+	self.deadline = deadline;
+	self.sequence = m_nextSequence++;
+	self.attached = isBound();
+	self.woken = false;
+	m_sleepers.insert(&self);
+	if (self.attached)
+	{
+		--m_running;
+	}
+	dispatchLocked();
+	self.wake.wait(lock, [&self, cancel]
+								 { return self.woken || (cancel && cancel->load()); });
+	if (!self.woken)
+	{
+		m_sleepers.erase(&self);
+		if (self.attached)
+		{
+			++m_running;
+		}
+		return false;
+	}
+	return true;
+}
+
+void VirtualClock::interrupt()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (Sleeper *sleeper : m_sleepers)
+	{
+		sleeper->wake.notify_one();
+	}
+}
+
+bool VirtualClock::isVirtual() const
+{
+	return true;
+}
+
+void VirtualClock::attach()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	++m_running;
+	++m_unbound;
+}
+
+void VirtualClock::bindThread()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	bool reserved = m_unbound > 0;
+	if (reserved)
+	{
+		--m_unbound;
+	}
+	if (t_boundClock == this)
+	{
+		// Already holding time; a second slot would never be released by a sleep
+		++t_bindDepth;
+		if (reserved)
+		{
+			--m_running;
+		}
+		return;
+	}
+	t_boundClock = this;
+	t_bindDepth = 1;
+	if (!reserved)
+	{
+		++m_running;
+	}
+}
+
+void VirtualClock::unbindThread()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (t_boundClock != this || --t_bindDepth > 0)
+	{
+		return;
+	}
+	t_boundClock = nullptr;
+	--m_running;
+	dispatchLocked();
+}
+
+void VirtualClock::detach()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_unbound == 0)
+	{
+		return;
+	}
+	--m_unbound;
+	--m_running;
+	dispatchLocked();
+}
+
+std::chrono::nanoseconds VirtualClock::elapsed() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_now - m_start;
+}
+
+bool VirtualClock::isBound() const
+{
+	return t_boundClock == this;
+}
+
+void VirtualClock::dispatchLocked()
+{
+	while (!m_sleepers.empty())
+	{
+		Sleeper *next = *m_sleepers.begin();
+		// While an attached thread runs only unattached sleepers that are already due may go
+		if (m_running > 0 && (next->attached || next->deadline > m_now))
+		{
+			break;
+		}
+		m_sleepers.erase(m_sleepers.begin());
+		m_now = std::max(m_now, next->deadline);
+		next->woken = true;
+		if (next->attached)
+		{
+			++m_running;
+		}
+		next->wake.notify_one();
+	}
+}
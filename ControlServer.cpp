@@ -0,0 +1,608 @@
+#include "ControlServer.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace
+{
+	// Input taken from one client per loop turn; other ready clients run before it gets more
+	constexpr size_t READ_BUDGET = 256;
+	// Connections accepted per turn, so a connect storm does not hold up connected clients
+	constexpr int ACCEPT_BUDGET = 16;
+	// Outgoing bytes kept per client; above the high-water mark its requests are left unread
+	constexpr size_t QUEUE_BYTES = 2048;
+	constexpr size_t HIGH_WATER = 1024;
+
+	std::string describe(const std::string &what)
+	{
+		return what + ": " + strerror(errno);
+	}
+}
+
+ControlServer::Replies::Replies(std::vector<bluetooth::Frame> &captured, Transport transport)
+		: m_server(nullptr), m_client(nullptr), m_captured(&captured), m_transport(transport)
+{
+}
+
+bool ControlServer::Replies::send(bluetooth::Command command, const uint8_t *payload, size_t length)
+{
+	if (!m_captured)
+	{
+		return m_server->queueFrame(*m_client, command, payload, length);
+	}
+	if (length > bluetooth::MAX_PAYLOAD)
+	{
+		return false;
+	}
+	bluetooth::Frame frame;
+	frame.command = command;
+	frame.length = static_cast<uint8_t>(length);
+	std::copy(payload, payload + length, frame.payload.begin());
+	m_captured->push_back(frame);
+	return true;
+}
+
+bool ControlServer::Replies::send(const bluetooth::Frame &frame)
+{
+	return send(frame.command, frame.payload.data(), frame.length);
+}
+
+ControlServer::Transport ControlServer::Replies::transport() const
+{
+	return m_transport;
+}
+
+ControlServer::Replies::Replies(ControlServer &server, Client &client)
+		: m_server(&server), m_client(&client), m_captured(nullptr), m_transport(client.transport)
+{
+}
+
+ControlServer::ControlServer(const Config &config)
+		: m_config(config),
+			m_metrics{MetricsRegistry::instance().counter("control_clients_accepted_total"),
+								MetricsRegistry::instance().counter("control_clients_rejected_total"),
+								MetricsRegistry::instance().counter("control_requests_total"),
+								MetricsRegistry::instance().counter("control_bytes_total"),
+								MetricsRegistry::instance().counter("control_checksum_errors_total"),
+								MetricsRegistry::instance().counter("control_dropped_reply_bytes_total"),
+								MetricsRegistry::instance().counter("control_telemetry_frames_total"),
+								MetricsRegistry::instance().counter("control_telemetry_coalesced_total"),
+								MetricsRegistry::instance().histogram("control_request_us")}
+{
+}
+
+ControlServer::~ControlServer()
+{
+	stop();
+	if (m_wakeFd >= 0)
+	{
+		close(m_wakeFd);
+	}
+}
+
+bool ControlServer::open()
+{
+	// Lives until destruction: notifyChange() may signal it from any thread at any time
+	if (m_wakeFd < 0)
+	{
+		m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_wakeFd < 0)
+		{
+			if (m_errorCallback)
+			{
+				m_errorCallback(describe("Control server eventfd unavailable"));
+			}
+			return false;
+		}
+	}
+	if (!m_config.ttyDevice.empty() && m_ttyFd < 0 && !openTty() && m_errorCallback)
+	{
+		m_errorCallback(describe("Control link " + m_config.ttyDevice + " unavailable"));
+	}
+	if (!m_config.socketPath.empty() && m_unixFd < 0 && !openUnix() && m_errorCallback)
+	{
+		m_errorCallback(describe("Control socket " + m_config.socketPath + " unavailable"));
+	}
+	if (m_config.tcpPort >= 0 && m_tcpFd < 0 && !openTcp() && m_errorCallback)
+	{
+		m_errorCallback(describe("Control port " + std::to_string(m_config.tcpPort) + " unavailable"));
+	}
+	return isOpen();
+}
+
+bool ControlServer::start()
+{
+	if (m_serverThread)
+	{
+		return true;
+	}
+	if (!isOpen() && !open())
+	{
+		return false;
+	}
+	m_ownLoop = std::make_unique<EventLoop>();
+	if (!m_ownLoop->initialize() || !attach(*m_ownLoop))
+	{
+		stop();
+		return false;
+	}
+	m_serverThread = std::make_unique<std::thread>([this]
+																								 {
+		MetricsRegistry::ThreadScope scope("control_server");
+		m_ownLoop->run(); });
+	return true;
+}
+
+bool ControlServer::attach(EventLoop &loop)
+{
+	if (m_loop)
+	{
+		return m_loop == &loop;
+	}
+	m_loop = &loop;
+	bool attached = loop.addFd(m_wakeFd, EPOLLIN, [this](uint32_t)
+														 { dispatchChange(); });
+	if (m_unixFd >= 0)
+	{
+		attached &= loop.addFd(m_unixFd, EPOLLIN, [this](uint32_t)
+													 { acceptClients(m_unixFd, Transport::UNIX); });
+	}
+	if (m_tcpFd >= 0)
+	{
+		attached &= loop.addFd(m_tcpFd, EPOLLIN, [this](uint32_t)
+													 { acceptClients(m_tcpFd, Transport::TCP); });
+	}
+	if (m_ttyFd >= 0)
+	{
+		attached &= addClient(m_ttyFd, Transport::RFCOMM);
+	}
+	return attached;
+}
+
+void ControlServer::stop()
+{
+	if (m_serverThread)
+	{
+		m_ownLoop->stop();
+		if (m_serverThread->joinable())
+		{
+			m_serverThread->join();
+		}
+		m_serverThread.reset();
+	}
+	while (!m_clients.empty())
+	{
+		removeClient(m_clients.begin()->first);
+	}
+	if (m_ttyFd >= 0)
+	{
+		close(m_ttyFd);
+		m_ttyFd = -1;
+	}
+	if (m_unixFd >= 0)
+	{
+		unlink(m_config.socketPath.c_str());
+	}
+	for (int *fd : {&m_unixFd, &m_tcpFd})
+	{
+		if (*fd < 0)
+		{
+			continue;
+		}
+		if (m_loop)
+		{
+			m_loop->removeFd(*fd);
+		}
+		close(*fd);
+		*fd = -1;
+	}
+	if (m_loop && m_wakeFd >= 0)
+	{
+		m_loop->removeFd(m_wakeFd);
+	}
+	m_loop = nullptr;
+	m_ownLoop.reset();
+	m_tcpPort = -1;
+	m_changePending.store(false);
+}
+
+bool ControlServer::isOpen() const
+{
+	return m_ttyFd >= 0 || m_unixFd >= 0 || m_tcpFd >= 0;
+}
+
+void ControlServer::notifyChange()
+{
+	// Subscribers only exist once the loop runs, which orders m_wakeFd before this read
+	if (m_subscribers.load() == 0)
+	{
+		return;
+	}
+	if (m_changePending.exchange(true))
+	{
+		m_metrics.telemetryCoalesced.increment();
+	}
+	else if (m_wakeFd >= 0)
+	{
+		uint64_t one = 1;
+		ssize_t written = write(m_wakeFd, &one, sizeof(one));
+		(void)written;
+	}
+}
+
+int ControlServer::getTcpPort() const
+{
+	return m_tcpPort;
+}
+
+size_t ControlServer::getClientCount() const
+{
+	return m_clientCount.load();
+}
+
+void ControlServer::registerRequestHandler(RequestHandler handler)
+{
+	m_requestHandler = handler;
+}
+
+void ControlServer::registerTelemetrySource(TelemetrySource source)
+{
+	m_telemetrySource = source;
+}
+
+void ControlServer::registerErrorCallback(ErrorCallback callback)
+{
+	m_errorCallback = callback;
+}
+
+bool ControlServer::openTty()
+{
+	int fd = ::open(m_config.ttyDevice.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return false;
+	}
+	// Frames are binary: no echo, CR/LF translation or signal characters on the tty
+	termios mode;
+	if (tcgetattr(fd, &mode) == 0)
+	{
+		cfmakeraw(&mode);
+		tcsetattr(fd, TCSANOW, &mode);
+	}
+	m_ttyFd = fd;
+	return true;
+}
+
+bool ControlServer::openUnix()
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (m_config.socketPath.size() >= sizeof(address.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return false;
+	}
+	strncpy(address.sun_path, m_config.socketPath.c_str(), sizeof(address.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+	// A previous run that was killed leaves its socket file behind
+	unlink(m_config.socketPath.c_str());
+	if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0)
+	{
+		int error = errno;
+		close(fd);
+		errno = error;
+		return false;
+	}
+	m_unixFd = fd;
+	return true;
+}
+
+bool ControlServer::openTcp()
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	// Loopback only: the port is for local daemons, remote phones come in over rfcomm
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(static_cast<uint16_t>(m_config.tcpPort));
+	socklen_t length = sizeof(address);
+	if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0 ||
+			getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) != 0)
+	{
+		int error = errno;
+		close(fd);
+		errno = error;
+		return false;
+	}
+	m_tcpFd = fd;
+	m_tcpPort = ntohs(address.sin_port);
+	return true;
+}
+
+bool ControlServer::addClient(int fd, Transport transport)
+{
+	auto client = std::make_unique<Client>();
+	client->fd = fd;
+	client->transport = transport;
+	client->events = EPOLLIN;
+	if (!m_loop->addFd(fd, client->events, [this, fd](uint32_t events)
+										 { serviceClient(fd, events); }))
+	{
+		if (fd == m_ttyFd)
+		{
+			m_ttyFd = -1;
+		}
+		close(fd);
+		return false;
+	}
+	m_clients[fd] = std::move(client);
+	m_clientCount.store(m_clients.size());
+	return true;
+}
+
+void ControlServer::removeClient(int fd)
+{
+	auto it = m_clients.find(fd);
+	if (it == m_clients.end())
+	{
+		return;
+	}
+	if (it->second->subscribed)
+	{
+		m_subscribers.fetch_sub(1);
+	}
+	if (m_loop)
+	{
+		m_loop->removeFd(fd);
+	}
+	close(fd);
+	if (fd == m_ttyFd)
+	{
+		m_ttyFd = -1;
+	}
+	m_clients.erase(it);
+	m_clientCount.store(m_clients.size());
+}
+
+void ControlServer::acceptClients(int listenFd, Transport transport)
+{
+	for (int accepted = 0; accepted < ACCEPT_BUDGET; ++accepted)
+	{
+		int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		if (m_clients.size() >= m_config.maxClients)
+		{
+			m_metrics.rejected.increment();
+			close(fd);
+			continue;
+		}
+		if (transport == Transport::TCP)
+		{
+			// Frames are a few bytes each; Nagle would hold replies back for the previous ACK
+			int one = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		}
+		if (addClient(fd, transport))
+		{
+			m_metrics.accepted.increment();
+		}
+	}
+}
+
+void ControlServer::serviceClient(int fd, uint32_t events)
+{
+	auto it = m_clients.find(fd);
+	if (it == m_clients.end())
+	{
+		return;
+	}
+	Client &client = *it->second;
+	bool connected = true;
+	if (events & EPOLLIN)
+	{
+		// Reads what is left after a hangup too; the read that returns 0 or EIO ends the client
+		connected = readClient(client);
+	}
+	else if (events & (EPOLLHUP | EPOLLERR))
+	{
+		connected = false;
+	}
+	if (connected)
+	{
+		connected = pump(client);
+	}
+	if (!connected)
+	{
+		removeClient(fd);
+		return;
+	}
+	updateEvents(client);
+}
+
+bool ControlServer::readClient(Client &client)
+{
+	uint8_t buffer[READ_BUDGET];
+	ssize_t len = read(client.fd, buffer, sizeof(buffer));
+	if (len < 0)
+	{
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+	if (len == 0)
+	{
+		return false;
+	}
+	m_metrics.bytes.increment(static_cast<uint64_t>(len));
+	uint64_t checksumErrors = client.parser.getStats().checksumErrors;
+	client.parser.feed(buffer, static_cast<size_t>(len), [this, &client](const bluetooth::Frame &frame)
+										 {
+		auto requestStart = std::chrono::steady_clock::now();
+		m_metrics.requests.increment();
+		if (frame.command == bluetooth::Command::SUBSCRIBE)
+		{
+			subscribe(client, frame);
+		}
+		else if (m_requestHandler)
+		{
+			Replies replies(*this, client);
+			m_requestHandler(frame, replies);
+		}
+		m_metrics.requestTime.recordSince(requestStart); });
+	m_metrics.checksumErrors.increment(client.parser.getStats().checksumErrors - checksumErrors);
+	return true;
+}
+
+void ControlServer::subscribe(Client &client, const bluetooth::Frame &request)
+{
+	bluetooth::Status status = bluetooth::Status::OK;
+	if (request.length != 1 || request.payload[0] > 1)
+	{
+		status = bluetooth::Status::BAD_PAYLOAD;
+	}
+	else
+	{
+		bool subscribed = request.payload[0] == 1;
+		if (subscribed != client.subscribed)
+		{
+			m_subscribers.fetch_add(subscribed ? 1 : -1);
+		}
+		client.subscribed = subscribed;
+		// A new subscriber starts from a frame with every field; pump() sends it after the ACK
+		client.telemetry.reset();
+		client.telemetryDue = subscribed;
+	}
+	uint8_t ack[2] = {static_cast<uint8_t>(request.command), static_cast<uint8_t>(status)};
+	queueFrame(client, bluetooth::Command::ACK, ack, sizeof(ack));
+}
+
+bool ControlServer::queueFrame(Client &client, bluetooth::Command command, const uint8_t *payload, size_t length)
+{
+	if (client.out.size() + length + bluetooth::FRAME_OVERHEAD > QUEUE_BYTES)
+	{
+		// Dropping whole frames keeps the stream aligned for the client
+		m_metrics.droppedReplyBytes.increment(length + bluetooth::FRAME_OVERHEAD);
+		return false;
+	}
+	return bluetooth::encodeFrame(command, payload, length, client.out);
+}
+
+bool ControlServer::flush(Client &client)
+{
+	size_t sent = 0;
+	while (sent < client.out.size())
+	{
+		const uint8_t *data = client.out.data() + sent;
+		size_t length = client.out.size() - sent;
+		// MSG_NOSIGNAL turns a vanished socket peer into EPIPE instead of SIGPIPE
+		ssize_t written = client.transport == Transport::RFCOMM ? write(client.fd, data, length)
+																														: send(client.fd, data, length, MSG_NOSIGNAL);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			m_metrics.droppedReplyBytes.increment(client.out.size() - sent);
+			client.out.clear();
+			return false;
+		}
+		if (written <= 0)
+		{
+			break; // Full; the rest goes out when the client is writable again
+		}
+		sent += static_cast<size_t>(written);
+	}
+	client.out.erase(client.out.begin(), client.out.begin() + sent);
+	return true;
+}
+
+bool ControlServer::pump(Client &client)
+{
+	if (!flush(client))
+	{
+		return false;
+	}
+	// Waiting for an empty queue is what coalesces: a slow client gets the latest state, not every step to it
+	if (!client.out.empty() || !client.telemetryDue || !m_telemetrySource)
+	{
+		return true;
+	}
+	client.telemetryDue = false;
+	bluetooth::Frame frame;
+	if (client.telemetry.encode(m_telemetrySource(), frame) &&
+			queueFrame(client, frame.command, frame.payload.data(), frame.length))
+	{
+		m_metrics.telemetryFrames.increment();
+		return flush(client);
+	}
+	return true;
+}
+
+void ControlServer::updateEvents(Client &client)
+{
+	uint32_t events = client.out.size() < HIGH_WATER ? static_cast<uint32_t>(EPOLLIN) : 0;
+	if (!client.out.empty())
+	{
+		events |= EPOLLOUT;
+	}
+	if (events != client.events && m_loop->modifyFd(client.fd, events))
+	{
+		client.events = events;
+	}
+}
+
+void ControlServer::dispatchChange()
+{
+	uint64_t pending;
+	ssize_t drained = read(m_wakeFd, &pending, sizeof(pending));
+	(void)drained;
+	// Cleared before the state is read, so a change made while sending signals again
+	m_changePending.store(false);
+	std::vector<int> disconnected;
+	for (auto &entry : m_clients)
+	{
+		Client &client = *entry.second;
+		if (!client.subscribed)
+		{
+			continue;
+		}
+		client.telemetryDue = true;
+		if (pump(client))
+		{
+			updateEvents(client);
+		}
+		else
+		{
+			disconnected.push_back(entry.first);
+		}
+	}
+	for (int fd : disconnected)
+	{
+		removeClient(fd);
+	}
+}
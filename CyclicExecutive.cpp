@@ -0,0 +1,361 @@
+#include "CyclicExecutive.h"
+#include <pthread.h>
+#include <algorithm>
+#include <cstring>
+
+constexpr std::chrono::milliseconds CyclicExecutive::DEFAULT_MINOR_FRAME;
+constexpr uint32_t CyclicExecutive::MAX_MAJOR_FRAME;
+
+namespace
+{
+	uint64_t gcd(uint64_t a, uint64_t b)
+	{
+		while (b)
+		{
+			uint64_t rest = a % b;
+			a = b;
+			b = rest;
+		}
+		return a;
+	}
+}
+
+CyclicExecutive::CyclicExecutive(const std::string &name, std::chrono::nanoseconds minorFrame, Clock &clock)
+		: m_name(name), m_minorFrame(std::max(minorFrame, std::chrono::nanoseconds(1))), m_clock(clock),
+			m_frameCount(MetricsRegistry::instance().counter(name + "_frames_total")),
+			m_skippedCount(MetricsRegistry::instance().counter(name + "_skipped_frames_total")),
+			m_violationCount(MetricsRegistry::instance().counter(name + "_window_violations_total")),
+			m_lateness(MetricsRegistry::instance().histogram(name + "_frame_lateness_us")),
+			m_frameUtilization(MetricsRegistry::instance().histogram(name + "_frame_utilization_pct"))
+{
+}
+
+CyclicExecutive::~CyclicExecutive()
+{
+	stop();
+}
+
+bool CyclicExecutive::addTask(const std::string &name, uint32_t period, uint32_t offset, std::chrono::nanoseconds budget, Body body)
+{
+	if (period == 0 || offset >= period)
+	{
+		return false;
+	}
+	return place(Task{name, period, offset, 0, budget, body, nullptr, nullptr, 0, 0, 0, 0, 0, 0});
+}
+
+int CyclicExecutive::reserveWindow(const std::string &name, uint32_t period, std::chrono::nanoseconds length, Body body)
+{
+	const int64_t frameNs = m_minorFrame.count();
+	uint32_t frames = static_cast<uint32_t>(std::max<int64_t>((length.count() + frameNs - 1) / frameNs, 1));
+	if (period == 0 || frames > period)
+	{
+		return -1;
+	}
+	for (uint32_t offset = 0; offset < period; ++offset)
+	{
+		if (place(Task{name, period, offset, frames, length, body, nullptr, nullptr, 0, 0, 0, 0, 0, 0}))
+		{
+			return static_cast<int>(offset);
+		}
+	}
+	return -1;
+}
+
+bool CyclicExecutive::start()
+{
+	if (m_running.load() || m_tasks.empty())
+	{
+		return false;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_frames = 0;
+		m_skippedFrames = 0;
+		m_busyNs = 0;
+		m_peakFrameUtilization = 0.0;
+		m_maxLatenessNs = 0;
+		for (Task &task : m_tasks)
+		{
+			task.runs = task.missed = task.overruns = task.violations = 0;
+			task.maxRunNs = task.busyNs = 0;
+		}
+	}
+	m_stopRequested.store(false);
+	m_running.store(true);
+	// Virtual time must not run ahead of the thread before it first waits
+	m_clock.attach();
+	m_thread = std::make_unique<std::thread>(&CyclicExecutive::executiveThread, this);
+	return true;
+}
+
+void CyclicExecutive::stop()
+{
+	m_stopRequested.store(true);
+	m_clock.interrupt();
+	if (m_thread && m_thread->joinable())
+	{
+		m_thread->join();
+	}
+	m_thread.reset();
+	m_running.store(false);
+}
+
+bool CyclicExecutive::isRunning() const
+{
+	return m_running.load();
+}
+
+CyclicExecutive::Stats CyclicExecutive::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	const double elapsedNs = static_cast<double>(m_frames) * m_minorFrame.count();
+	Stats stats{m_frames, m_skippedFrames, 0, elapsedNs > 0 ? m_busyNs / elapsedNs : 0.0, m_peakFrameUtilization,
+							std::chrono::microseconds(m_maxLatenessNs / 1000), {}};
+	for (const Task &task : m_tasks)
+	{
+		stats.windowViolations += task.violations;
+		stats.tasks.push_back({task.name, task.frames > 0, task.period, task.offset, task.frames,
+													 std::chrono::duration_cast<std::chrono::microseconds>(task.budget), task.runs, task.missed,
+													 task.overruns, task.violations, std::chrono::microseconds(task.maxRunNs / 1000),
+													 elapsedNs > 0 ? task.busyNs / elapsedNs : 0.0});
+	}
+	return stats;
+}
+
+std::chrono::nanoseconds CyclicExecutive::getMinorFrame() const
+{
+	return m_minorFrame;
+}
+
+uint32_t CyclicExecutive::getMajorFrame() const
+{
+	return static_cast<uint32_t>(m_table.size());
+}
+
+std::shared_timed_mutex &CyclicExecutive::windowLock()
+{
+	return m_windowLock;
+}
+
+void CyclicExecutive::setRealtimePriority(int priority)
+{
+	m_rtPriority = priority;
+}
+
+void CyclicExecutive::registerErrorCallback(ErrorCallback callback)
+{
+	m_errorCallback = callback;
+}
+
+bool CyclicExecutive::buildTable(const std::vector<Task> &tasks, std::vector<Frame> &table) const
+{
+	uint64_t major = 1;
+	for (const Task &task : tasks)
+	{
+		major = major / gcd(major, task.period) * task.period;
+		if (major > MAX_MAJOR_FRAME)
+		{
+			return false;
+		}
+	}
+	table.assign(major, Frame());
+	std::vector<int64_t> load(major, 0);
+	for (size_t i = 0; i < tasks.size(); ++i)
+	{
+		const Task &task = tasks[i];
+		for (uint64_t release = task.offset; release < major; release += task.period)
+		{
+			if (task.frames == 0)
+			{
+				Frame &frame = table[release];
+				load[release] += task.budget.count();
+				if (frame.window >= 0 || load[release] > m_minorFrame.count())
+				{
+					return false;
+				}
+				frame.shared.push_back(i);
+				continue;
+			}
+			// A window near the end of the table carries on into the next major frame
+			for (uint32_t k = 0; k < task.frames; ++k)
+			{
+				Frame &frame = table[(release + k) % major];
+				if (frame.window >= 0 || !frame.shared.empty())
+				{
+					return false;
+				}
+				frame.window = static_cast<int>(i);
+				frame.windowStart = k == 0;
+			}
+		}
+	}
+	return true;
+}
+
+bool CyclicExecutive::place(Task task)
+{
+	if (m_running.load())
+	{
+		return false;
+	}
+	std::vector<Task> tasks = m_tasks;
+	tasks.push_back(task);
+	std::vector<Frame> table;
+	if (!buildTable(tasks, table))
+	{
+		return false;
+	}
+	MetricsRegistry &registry = MetricsRegistry::instance();
+	task.overrunCount = &registry.counter(m_name + "_" + task.name + "_overruns_total");
+	task.runTime = &registry.histogram(m_name + "_" + task.name + "_run_us");
+	m_tasks.push_back(task);
+	m_table.swap(table);
+	return true;
+}
+
+void CyclicExecutive::executiveThread()
+{
+	MetricsRegistry::ThreadScope scope(m_name);
+	m_clock.bindThread();
+	applyRealtimePriority();
+	const int64_t frameNs = m_minorFrame.count();
+	const uint64_t major = m_table.size();
+	const int64_t start = nowNs();
+	uint64_t frame = 0;
+	int64_t lastFinish = start;
+	while (true)
+	{
+		int64_t release = start + static_cast<int64_t>(frame) * frameNs;
+		if (!m_clock.sleepUntil(Clock::time_point(std::chrono::nanoseconds(release)), &m_stopRequested) ||
+				m_stopRequested.load())
+		{
+			break;
+		}
+		int64_t woke = nowNs();
+		if (woke - release >= frameNs)
+		{
+			// Frames that passed entirely are dropped along with their work; the current one runs late
+			uint64_t skipped = static_cast<uint64_t>((woke - release) / frameNs);
+			std::lock_guard<std::mutex> lock(m_statsMutex);
+			for (uint64_t k = 0; k < skipped; ++k)
+			{
+				const Frame &passed = m_table[(frame + k) % major];
+				for (size_t index : passed.shared)
+				{
+					++m_tasks[index].missed;
+				}
+				if (passed.windowStart)
+				{
+					Task &task = m_tasks[static_cast<size_t>(passed.window)];
+					++task.missed;
+					++task.violations;
+					m_violationCount.increment();
+				}
+			}
+			frame += skipped;
+			release += static_cast<int64_t>(skipped) * frameNs;
+			m_skippedFrames += skipped;
+			m_skippedCount.increment(skipped);
+		}
+		int64_t latenessNs = std::max<int64_t>(woke - release, 0);
+
+		const Frame &current = m_table[frame % major];
+		uint64_t span = 1;
+		int64_t busyNs = 0;
+		if (current.windowStart)
+		{
+			Task &task = m_tasks[static_cast<size_t>(current.window)];
+			span = task.frames;
+			// Work of the frame before that ran into this one shares the window with it
+			bool violated = lastFinish > release;
+			{
+				std::unique_lock<std::shared_timed_mutex> window(m_windowLock);
+				busyNs = runTask(task, task.budget.count());
+			}
+			violated |= nowNs() > release + static_cast<int64_t>(span) * frameNs;
+			if (violated)
+			{
+				std::lock_guard<std::mutex> lock(m_statsMutex);
+				++task.violations;
+				m_violationCount.increment();
+			}
+		}
+		else
+		{
+			for (size_t index : current.shared)
+			{
+				busyNs += runTask(m_tasks[index], m_tasks[index].budget.count());
+			}
+		}
+		lastFinish = nowNs();
+		frame += span;
+
+		double utilization = static_cast<double>(busyNs) / (static_cast<double>(span) * frameNs);
+		{
+			std::lock_guard<std::mutex> lock(m_statsMutex);
+			m_frames = frame;
+			m_busyNs += busyNs;
+			m_peakFrameUtilization = std::max(m_peakFrameUtilization, utilization);
+			m_maxLatenessNs = std::max(m_maxLatenessNs, latenessNs);
+		}
+		m_frameCount.increment(span);
+		m_lateness.record(static_cast<uint64_t>(latenessNs / 1000));
+		m_frameUtilization.record(static_cast<uint64_t>(utilization * 100));
+	}
+	m_clock.unbindThread();
+}
+
+int64_t CyclicExecutive::runTask(Task &task, int64_t limitNs)
+{
+	int64_t started = nowNs();
+	try
+	{
+		task.body();
+	}
+	catch (const std::exception &e)
+	{
+		if (m_errorCallback)
+		{
+			m_errorCallback("Task " + task.name + " failed: " + e.what());
+		}
+	}
+	int64_t runNs = nowNs() - started;
+	bool overran = runNs > limitNs;
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		++task.runs;
+		task.busyNs += runNs;
+		task.maxRunNs = std::max(task.maxRunNs, runNs);
+		if (overran)
+		{
+			++task.overruns;
+		}
+	}
+	if (overran)
+	{
+		task.overrunCount->increment();
+	}
+	task.runTime->record(static_cast<uint64_t>(runNs / 1000));
+	return runNs;
+}
+
+int64_t CyclicExecutive::nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(m_clock.now().time_since_epoch()).count();
+}
+
+void CyclicExecutive::applyRealtimePriority()
+{
+	if (m_rtPriority <= 0)
+	{
+		return;
+	}
+	sched_param param{};
+	param.sched_priority = m_rtPriority;
+	int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (err != 0 && m_errorCallback)
+	{
+		m_errorCallback("Real-time scheduling unavailable, using default policy: " + std::string(strerror(err)));
+	}
+}
@@ -2,23 +2,45 @@
 #include "Delay.h"
 #include <stdexcept>
 
-DHT11Sensor::DHT11Sensor(const std::string &chipName, int pin)
-		: m_chipName(chipName), m_pin(pin)
+namespace
 {
-	m_latestData = {0, 0, false, std::chrono::steady_clock::now()};
+	// A '0' bit holds the line high for 26-28us, a '1' bit for 70us
+	constexpr std::chrono::nanoseconds BIT_ONE_THRESHOLD{48000};
+	// Full frame takes ~4.5ms after the start signal is released
+	constexpr std::chrono::microseconds FRAME_TIMEOUT{8000};
 }
 
-DHT11Sensor::~DHT11Sensor()
+template <typename Gpio>
+BasicDHT11Sensor<Gpio>::BasicDHT11Sensor(const std::string &chipName, int pin, ReadMode mode, Clock &clock)
+		: m_chipName(chipName), m_pin(pin), m_clock(clock),
+			m_latestData(SensorData{0, 0, false, clock.now()}),
+			m_readMode(mode),
+			m_timing{std::chrono::nanoseconds::zero(), std::chrono::nanoseconds(-1)},
+			m_lastTiming(m_timing),
+			m_metrics(resolveMetrics(pin))
+{
+	m_edgeBuffer.reserve(FRAME_EDGE_COUNT);
+}
+
+template <typename Gpio>
+BasicDHT11Sensor<Gpio>::~BasicDHT11Sensor()
 {
 	stopMonitoring();
+	if (m_dataLine && m_dataLine->is_requested())
+	{
+		m_dataLine->release();
+	}
 }
 
-bool DHT11Sensor::initialize()
+template <typename Gpio>
+bool BasicDHT11Sensor<Gpio>::initialize()
 {
 	try
 	{
-		m_chip = std::make_unique<gpiod::chip>(m_chipName);
-		m_dataLine = std::make_unique<gpiod::line>(m_chip->get_line(m_pin));
+		m_chip = std::make_unique<typename Gpio::chip>(m_chipName);
+		m_dataLine = std::make_unique<typename Gpio::line>(m_chip->get_line(m_pin));
+		// Hold the line for the sensor's lifetime; reads only reconfigure it
+		claimLine(m_readMode.load());
 		return true;
 	}
 	catch (const std::exception &e)
@@ -31,7 +53,8 @@ bool DHT11Sensor::initialize()
 	}
 }
 
-void DHT11Sensor::startMonitoring(int intervalMs)
+template <typename Gpio>
+void BasicDHT11Sensor<Gpio>::startMonitoring(int intervalMs)
 {
 	if (m_monitoring.load())
 	{
@@ -45,12 +68,18 @@ void DHT11Sensor::startMonitoring(int intervalMs)
 		}
 	}
 	m_monitoring.store(true);
-	m_monitorThread = std::make_unique<std::thread>(&DHT11Sensor::monitoringThread, this, intervalMs);
+	m_monitorTask = std::make_unique<PeriodicTask>("dht11_pin" + std::to_string(m_pin), std::chrono::milliseconds(intervalMs), m_clock);
+	m_monitorThread = std::make_unique<std::thread>(&BasicDHT11Sensor::monitoringThread, this);
 }
 
-void DHT11Sensor::stopMonitoring()
+template <typename Gpio>
+void BasicDHT11Sensor<Gpio>::stopMonitoring()
 {
 	m_monitoring.store(false);
+	if (m_monitorTask)
+	{
+		m_monitorTask->stop();
+	}
 	if (m_monitorThread && m_monitorThread->joinable())
 	{
 		m_monitorThread->join();
@@ -58,91 +87,157 @@ void DHT11Sensor::stopMonitoring()
 	m_monitorThread.reset();
 }
 
-DHT11Sensor::SensorData DHT11Sensor::getLatestReading() const
+template <typename Gpio>
+typename BasicDHT11Sensor<Gpio>::SensorData BasicDHT11Sensor<Gpio>::getLatestReading() const
 {
-	std::lock_guard<std::mutex> lock(m_dataMutex);
-	return m_latestData;
+	return m_latestData.load();
 }
 
-void DHT11Sensor::registerDataCallback(SensorDataCallback callback)
+template <typename Gpio>
+void BasicDHT11Sensor<Gpio>::registerDataCallback(SensorDataCallback callback)
 {
+	std::lock_guard<std::mutex> lock(m_callbackMutex);
 	m_dataCallback = callback;
 }
 
-void DHT11Sensor::registerErrorCallback(ErrorCallback callback)
+template <typename Gpio>
+void BasicDHT11Sensor<Gpio>::registerErrorCallback(ErrorCallback callback)
 {
 	m_errorCallback = callback;
 }
 
-bool DHT11Sensor::isMonitoring() const
+template <typename Gpio>
+bool BasicDHT11Sensor<Gpio>::isMonitoring() const
 {
 	return m_monitoring.load();
 }
 
-void DHT11Sensor::monitoringThread(int intervalMs)
+template <typename Gpio>
+void BasicDHT11Sensor<Gpio>::setReadMode(ReadMode mode)
+{
+	m_readMode.store(mode);
+}
+
+template <typename Gpio>
+typename BasicDHT11Sensor<Gpio>::ReadMode BasicDHT11Sensor<Gpio>::getReadMode() const
+{
+	return m_readMode.load();
+}
+
+template <typename Gpio>
+typename BasicDHT11Sensor<Gpio>::ResponseTiming BasicDHT11Sensor<Gpio>::getLastResponseTiming() const
+{
+	return m_lastTiming.load();
+}
+
+template <typename Gpio>
+typename BasicDHT11Sensor<Gpio>::SensorMetrics BasicDHT11Sensor<Gpio>::resolveMetrics(int pin)
+{
+	MetricsRegistry &registry = MetricsRegistry::instance();
+	std::string prefix = "dht11_pin" + std::to_string(pin) + "_";
+	return {registry.counter(prefix + "reads_total"),
+					registry.counter(prefix + "success_total"),
+					registry.counter(prefix + "checksum_errors_total"),
+					registry.counter(prefix + "start_signal_errors_total"),
+					registry.counter(prefix + "response_timeouts_total"),
+					registry.counter(prefix + "bit_timeouts_total"),
+					registry.counter(prefix + "incomplete_frames_total"),
+					registry.histogram(prefix + "read_us"),
+					registry.histogram(prefix + "callback_us")};
+}
+
+template <typename Gpio>
+bool BasicDHT11Sensor<Gpio>::readOnce()
 {
-	while (m_monitoring.load())
+	m_metrics.reads.increment();
+	try
 	{
-		try
-		{
-			auto rawData = readRawData();
-			bool isValid = validateChecksum(rawData);
+		auto readStart = std::chrono::steady_clock::now();
+		auto rawData = readRawData();
+		m_metrics.readTime.recordSince(readStart);
+		bool isValid = validateChecksum(rawData);
 
-			if (isValid)
-			{
-				int humidity = rawData[0];
-				int temperature = rawData[2];
+		if (isValid)
+		{
+			int humidity = rawData[0];
+			int temperature = rawData[2];
 
-				{
-					std::lock_guard<std::mutex> lock(m_dataMutex);
-					m_latestData = {temperature, humidity, true, std::chrono::steady_clock::now()};
-				}
+			m_latestData.store({temperature, humidity, true, m_clock.now()});
+			m_metrics.successes.increment();
 
+			{
+				std::lock_guard<std::mutex> lock(m_callbackMutex);
 				if (m_dataCallback)
 				{
+					auto callbackStart = std::chrono::steady_clock::now();
 					m_dataCallback(temperature, humidity, true);
+					m_metrics.callbackTime.recordSince(callbackStart);
 				}
 			}
-			else
-			{
-				{
-					std::lock_guard<std::mutex> lock(m_dataMutex);
-					m_latestData.isValid = false;
-					m_latestData.timestamp = std::chrono::steady_clock::now();
-				}
+			return true;
+		}
 
-				if (m_dataCallback)
-				{
-					m_dataCallback(0, 0, false);
-				}
+		m_metrics.checksumErrors.increment();
+
+		SensorData stale = m_latestData.load();
+		stale.isValid = false;
+		stale.timestamp = m_clock.now();
+		m_latestData.store(stale);
 
-				if (m_errorCallback)
-				{
-					m_errorCallback("DHT11 checksum validation failed");
-				}
-			}
-		}
-		catch (const std::exception &e)
 		{
-			if (m_errorCallback)
+			std::lock_guard<std::mutex> lock(m_callbackMutex);
+			if (m_dataCallback)
 			{
-				m_errorCallback("DHT11 reading error: " + std::string(e.what()));
+				m_dataCallback(0, 0, false);
 			}
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+
+		if (m_errorCallback)
+		{
+			m_errorCallback("DHT11 checksum validation failed");
+		}
 	}
+	catch (const std::exception &e)
+	{
+		if (m_errorCallback)
+		{
+			m_errorCallback("DHT11 reading error: " + std::string(e.what()));
+		}
+	}
+	return false;
+}
+
+template <typename Gpio>
+void BasicDHT11Sensor<Gpio>::monitoringThread()
+{
+	MetricsRegistry::ThreadScope scope("dht11_pin" + std::to_string(m_pin));
+	m_monitorTask->run([this]
+										 { readOnce(); });
 }
 
-std::array<uint8_t, 5> DHT11Sensor::readRawData()
+template <typename Gpio>
+std::array<uint8_t, 5> BasicDHT11Sensor<Gpio>::readRawData()
+{
+	if (m_readMode.load() == ReadMode::EDGE_EVENTS)
+	{
+		return readRawDataEdges();
+	}
+	return readRawDataPolling();
+}
+
+template <typename Gpio>
+std::array<uint8_t, 5> BasicDHT11Sensor<Gpio>::readRawDataPolling()
 {
 	std::array<uint8_t, 5> data = {0};
-	if (!sendStartSignal())
+	if (!sendStartSignal(ReadMode::POLLING))
 	{
+		m_metrics.startSignalErrors.increment();
 		throw std::runtime_error("Failed to send start signal to DHT11");
 	}
 
 	if (!waitForResponse())
 	{
+		m_metrics.responseTimeouts.increment();
 		throw std::runtime_error("DHT11 did not respond");
 	}
 	// Read 40 bits of data
@@ -154,6 +249,7 @@ std::array<uint8_t, 5> DHT11Sensor::readRawData()
 			int bit = readBit();
 			if (bit < 0)
 			{
+				m_metrics.bitTimeouts.increment();
 				throw std::runtime_error("Failed to read bit from DHT11");
 			}
 			byte |= (bit << bitIdx);
@@ -163,24 +259,149 @@ std::array<uint8_t, 5> DHT11Sensor::readRawData()
 	return data;
 }
 
-bool DHT11Sensor::validateChecksum(const std::array<uint8_t, 5> &data) const
+template <typename Gpio>
+std::array<uint8_t, 5> BasicDHT11Sensor<Gpio>::readRawDataEdges()
+{
+	std::array<uint8_t, 5> data = {0};
+	if (!sendStartSignal(ReadMode::EDGE_EVENTS))
+	{
+		m_metrics.startSignalErrors.increment();
+		throw std::runtime_error("Failed to send start signal to DHT11");
+	}
+	// Sleep in the kernel between edges; the timestamps come from the interrupt, not from us
+	m_edgeBuffer.clear();
+	auto deadline = m_clock.now() + FRAME_TIMEOUT;
+	while (m_edgeBuffer.size() < FRAME_EDGE_COUNT)
+	{
+		auto remaining = deadline - m_clock.now();
+		if (remaining <= std::chrono::nanoseconds::zero() || !m_dataLine->event_wait(remaining))
+		{
+			break;
+		}
+		for (const auto &event : m_dataLine->event_read_multiple())
+		{
+			m_edgeBuffer.push_back({event.timestamp, event.event_type == Gpio::line_event::RISING_EDGE});
+		}
+	}
+
+	std::chrono::nanoseconds turnaround(-1);
+	measureTurnaround(m_edgeBuffer, m_releaseTime.time_since_epoch(), turnaround);
+	m_timing.turnaround = turnaround;
+	m_lastTiming.store(m_timing);
+
+	if (!decodeEdges(m_edgeBuffer, data))
+	{
+		m_metrics.incompleteFrames.increment();
+		throw std::runtime_error("Incomplete DHT11 frame (" + std::to_string(m_edgeBuffer.size()) + " edges)");
+	}
+	return data;
+}
+
+template <typename Gpio>
+bool BasicDHT11Sensor<Gpio>::decodeEdges(const std::vector<EdgeEvent> &edges, std::array<uint8_t, 5> &data)
+{
+	// Collect the width of every high pulse (rising edge followed by falling edge)
+	std::array<std::chrono::nanoseconds, FRAME_EDGE_COUNT / 2> highPulses;
+	size_t pulseCount = 0;
+	for (size_t i = 1; i < edges.size() && pulseCount < highPulses.size(); ++i)
+	{
+		if (edges[i - 1].rising && !edges[i].rising)
+		{
+			highPulses[pulseCount++] = edges[i].timestamp - edges[i - 1].timestamp;
+		}
+	}
+	if (pulseCount < 40)
+	{
+		return false;
+	}
+	// The last 40 high pulses carry the data; anything before them is the response preamble
+	size_t first = pulseCount - 40;
+	data = {{0}};
+	for (size_t bit = 0; bit < 40; ++bit)
+	{
+		if (highPulses[first + bit] > BIT_ONE_THRESHOLD)
+		{
+			data[bit / 8] |= static_cast<uint8_t>(0x80 >> (bit % 8));
+		}
+	}
+	return true;
+}
+
+template <typename Gpio>
+bool BasicDHT11Sensor<Gpio>::measureTurnaround(const std::vector<EdgeEvent> &edges,
+																							 std::chrono::nanoseconds releaseTime,
+																							 std::chrono::nanoseconds &turnaround)
+{
+	for (const auto &edge : edges)
+	{
+		if (!edge.rising && edge.timestamp >= releaseTime)
+		{
+			turnaround = edge.timestamp - releaseTime;
+			return true;
+		}
+	}
+	return false;
+}
+
+template <typename Gpio>
+bool BasicDHT11Sensor<Gpio>::validateChecksum(const std::array<uint8_t, 5> &data) const
 {
 	uint16_t sum = data[0] + data[1] + data[2] + data[3];
 	return (sum & 0xFF) == data[4];
 }
 
-bool DHT11Sensor::sendStartSignal()
+template <typename Gpio>
+void BasicDHT11Sensor<Gpio>::claimLine(ReadMode mode)
 {
-	try
+	bool wantEvents = (mode == ReadMode::EDGE_EVENTS);
+	if (m_dataLine->is_requested())
 	{
-		// Set pin as output and pull low
-		m_dataLine->request({"DHT11", gpiod::line_request::DIRECTION_OUTPUT, 0});
-		delay_ms(18);
-		// Pull high
-		m_dataLine->set_value(1);
-		delay_us(30);
+		if (m_lineHoldsEvents == wantEvents)
+		{
+			return;
+		}
 		m_dataLine->release();
-		m_dataLine->request({"DHT11", gpiod::line_request::DIRECTION_INPUT});
+	}
+	if (wantEvents)
+	{
+		m_dataLine->request({"DHT11", Gpio::line_request::EVENT_BOTH_EDGES, 0});
+	}
+	else
+	{
+		// Open-drain: writing 1 releases the bus to the pull-up instead of driving it
+		m_dataLine->request({"DHT11", Gpio::line_request::DIRECTION_OUTPUT, Gpio::line_request::FLAG_OPEN_DRAIN}, 1);
+	}
+	m_lineHoldsEvents = wantEvents;
+}
+
+template <typename Gpio>
+bool BasicDHT11Sensor<Gpio>::sendStartSignal(ReadMode mode)
+{
+	try
+	{
+		// Event requests cannot drive the line, so edge mode borrows the open-drain request
+		claimLine(ReadMode::POLLING);
+		// Pull low for at least 18ms
+		m_dataLine->set_direction_output(0);
+		delay_ms(18, m_clock);
+		// Release the line; the sensor answers 20-40us later. Polling only flips the direction of the held
+		// request. libgpiod v1 cannot add edge events to an output request, so edge mode has to re-request
+		// the line inside that window, and directionSwitch shows what it costs
+		auto switchStart = m_clock.now();
+		if (mode == ReadMode::EDGE_EVENTS)
+		{
+			m_dataLine->set_value(1);
+			m_releaseTime = m_clock.now();
+			claimLine(ReadMode::EDGE_EVENTS);
+		}
+		else
+		{
+			m_dataLine->set_direction_input();
+			m_releaseTime = m_clock.now();
+		}
+		auto switchEnd = m_clock.now();
+		m_timing = {switchEnd - switchStart, std::chrono::nanoseconds(-1)};
+		m_lastTiming.store(m_timing);
 		return true;
 	}
 	catch (const std::exception &)
@@ -189,31 +410,34 @@ bool DHT11Sensor::sendStartSignal()
 	}
 }
 
-bool DHT11Sensor::waitForResponse()
+template <typename Gpio>
+bool BasicDHT11Sensor<Gpio>::waitForResponse()
 {
 	// Wait for DHT11 to pull line low
-	auto timeout = std::chrono::steady_clock::now() + std::chrono::microseconds(100);
+	auto timeout = m_clock.now() + std::chrono::microseconds(100);
 	while (m_dataLine->get_value() == 1)
 	{
-		if (std::chrono::steady_clock::now() > timeout)
+		if (m_clock.now() > timeout)
 		{
 			return false;
 		}
 	}
+	m_timing.turnaround = m_clock.now() - m_releaseTime;
+	m_lastTiming.store(m_timing);
 	// Wait for DHT11 to pull line high
-	timeout = std::chrono::steady_clock::now() + std::chrono::microseconds(100);
+	timeout = m_clock.now() + std::chrono::microseconds(100);
 	while (m_dataLine->get_value() == 0)
 	{
-		if (std::chrono::steady_clock::now() > timeout)
+		if (m_clock.now() > timeout)
 		{
 			return false;
 		}
 	}
 	// Wait for DHT11 to pull line low
-	timeout = std::chrono::steady_clock::now() + std::chrono::microseconds(100);
+	timeout = m_clock.now() + std::chrono::microseconds(100);
 	while (m_dataLine->get_value() == 1)
 	{
-		if (std::chrono::steady_clock::now() > timeout)
+		if (m_clock.now() > timeout)
 		{
 			return false;
 		}
@@ -222,28 +446,34 @@ bool DHT11Sensor::waitForResponse()
 	return true;
 }
 
-int DHT11Sensor::readBit()
+template <typename Gpio>
+int BasicDHT11Sensor<Gpio>::readBit()
 {
 	// Wait for line to go high
-	auto timeout = std::chrono::steady_clock::now() + std::chrono::microseconds(100);
+	auto timeout = m_clock.now() + std::chrono::microseconds(100);
 	while (m_dataLine->get_value() == 0)
 	{
-		if (std::chrono::steady_clock::now() > timeout)
+		if (m_clock.now() > timeout)
 		{
 			return -1;
 		}
 	}
 	// Measure how long line stays high
-	auto start = std::chrono::steady_clock::now();
+	auto start = m_clock.now();
 	timeout = start + std::chrono::microseconds(100);
 	while (m_dataLine->get_value() == 1)
 	{
-		if (std::chrono::steady_clock::now() > timeout)
+		if (m_clock.now() > timeout)
 		{
 			break;
 		}
 	}
-	auto end = std::chrono::steady_clock::now();
+	auto end = m_clock.now();
 	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 	return (duration.count() > 40) ? 1 : 0;
 }
+
+template class BasicDHT11Sensor<gpio::Simulated>;
+#ifdef SMART_CURTAIN_HAVE_LIBGPIOD
+template class BasicDHT11Sensor<gpio::Libgpiod>;
+#endif
@@ -0,0 +1,203 @@
+#include "DHT11Bus.h"
+#include <pthread.h>
+#include <cstring>
+#include <stdexcept>
+
+template <typename Gpio>
+BasicDHT11Bus<Gpio>::BasicDHT11Bus(const std::string &chipName, typename Sensor::ReadMode mode, Clock &clock)
+		: m_chipName(chipName), m_readMode(mode), m_clock(clock)
+{
+}
+
+template <typename Gpio>
+BasicDHT11Bus<Gpio>::~BasicDHT11Bus()
+{
+	stop();
+}
+
+template <typename Gpio>
+int BasicDHT11Bus<Gpio>::addSensor(int pin, SensorDataCallback callback)
+{
+	if (m_running.load())
+	{
+		return -1;
+	}
+	auto slot = std::make_unique<Slot>();
+	slot->pin = pin;
+	slot->sensor = std::make_unique<Sensor>(m_chipName, pin, m_readMode, m_clock);
+	slot->sensor->registerDataCallback(callback);
+	slot->sensor->registerErrorCallback(
+			[this, pin](const std::string &error)
+			{
+				if (m_errorCallback)
+				{
+					m_errorCallback("pin " + std::to_string(pin) + ": " + error);
+				}
+			});
+	m_slots.push_back(std::move(slot));
+	m_initialized = false;
+	return static_cast<int>(m_slots.size() - 1);
+}
+
+template <typename Gpio>
+bool BasicDHT11Bus<Gpio>::initialize()
+{
+	bool allInitialized = true;
+	for (auto &slot : m_slots)
+	{
+		allInitialized &= slot->sensor->initialize();
+	}
+	m_initialized = allInitialized;
+	return allInitialized;
+}
+
+template <typename Gpio>
+void BasicDHT11Bus<Gpio>::start(int intervalMs)
+{
+	if (m_running.load() || m_slots.empty() || intervalMs <= 0)
+	{
+		return;
+	}
+	if (!m_initialized && !initialize())
+	{
+		return;
+	}
+	auto now = m_clock.now();
+	for (size_t i = 0; i < m_slots.size(); ++i)
+	{
+		m_slots[i]->nextRead = now + staggerOffset(i, m_slots.size(), intervalMs);
+	}
+	m_stopRequested.store(false);
+	m_running.store(true);
+	// Virtual time must not run ahead of the thread before it first waits
+	m_clock.attach();
+	m_busThread = std::make_unique<std::thread>(&BasicDHT11Bus::schedulingThread, this, intervalMs);
+}
+
+template <typename Gpio>
+void BasicDHT11Bus<Gpio>::stop()
+{
+	m_stopRequested.store(true);
+	m_clock.interrupt();
+	if (m_busThread && m_busThread->joinable())
+	{
+		m_busThread->join();
+	}
+	m_busThread.reset();
+	m_running.store(false);
+}
+
+template <typename Gpio>
+bool BasicDHT11Bus<Gpio>::isRunning() const
+{
+	return m_running.load();
+}
+
+template <typename Gpio>
+size_t BasicDHT11Bus<Gpio>::sensorCount() const
+{
+	return m_slots.size();
+}
+
+template <typename Gpio>
+typename BasicDHT11Bus<Gpio>::SensorStats BasicDHT11Bus<Gpio>::getSensorStats(size_t index) const
+{
+	const Slot &slot = *m_slots.at(index);
+	uint64_t reads = slot.reads.load();
+	uint64_t successes = slot.successes.load();
+	double rate = reads ? static_cast<double>(successes) / reads : 0.0;
+	return {slot.pin, reads, successes, reads - successes, rate};
+}
+
+template <typename Gpio>
+typename BasicDHT11Bus<Gpio>::Sensor::SensorData BasicDHT11Bus<Gpio>::getLatestReading(size_t index) const
+{
+	return m_slots.at(index)->sensor->getLatestReading();
+}
+
+template <typename Gpio>
+void BasicDHT11Bus<Gpio>::registerErrorCallback(ErrorCallback callback)
+{
+	m_errorCallback = callback;
+}
+
+template <typename Gpio>
+void BasicDHT11Bus<Gpio>::setRealtimePriority(int priority)
+{
+	m_rtPriority = priority;
+}
+
+template <typename Gpio>
+std::chrono::microseconds BasicDHT11Bus<Gpio>::staggerOffset(size_t index, size_t count, int intervalMs)
+{
+	if (count == 0)
+	{
+		return std::chrono::microseconds::zero();
+	}
+	return std::chrono::microseconds(static_cast<int64_t>(intervalMs) * 1000 * index / count);
+}
+
+template <typename Gpio>
+void BasicDHT11Bus<Gpio>::applyRealtimePriority()
+{
+	if (m_rtPriority <= 0)
+	{
+		return;
+	}
+	sched_param param{};
+	param.sched_priority = m_rtPriority;
+	int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (err != 0 && m_errorCallback)
+	{
+		m_errorCallback("Real-time scheduling unavailable, using default policy: " + std::string(strerror(err)));
+	}
+}
+
+template <typename Gpio>
+void BasicDHT11Bus<Gpio>::schedulingThread(int intervalMs)
+{
+	MetricsRegistry::ThreadScope scope("dht11_bus");
+	m_clock.bindThread();
+	Histogram &wakeLateness = MetricsRegistry::instance().histogram("dht11_bus_wake_lateness_us");
+	applyRealtimePriority();
+	const auto interval = std::chrono::milliseconds(intervalMs);
+	while (true)
+	{
+		// Pick the sensor whose read is due first
+		Slot *due = m_slots.front().get();
+		for (auto &slot : m_slots)
+		{
+			if (slot->nextRead < due->nextRead)
+			{
+				due = slot.get();
+			}
+		}
+		if (!m_clock.sleepUntil(due->nextRead, &m_stopRequested) || m_stopRequested.load())
+		{
+			break;
+		}
+
+		auto lateness = std::chrono::duration_cast<std::chrono::microseconds>(m_clock.now() - due->nextRead);
+		wakeLateness.record(lateness.count() > 0 ? static_cast<uint64_t>(lateness.count()) : 0);
+		bool success = due->sensor->readOnce();
+		due->reads.fetch_add(1);
+		if (success)
+		{
+			due->successes.fetch_add(1);
+		}
+
+		// Advance on the absolute grid; skip missed periods instead of bursting
+		due->nextRead += interval;
+		auto now = m_clock.now();
+		while (due->nextRead <= now)
+		{
+			due->nextRead += interval;
+		}
+	}
+	m_clock.unbindThread();
+}
+
+template class BasicDHT11Bus<gpio::Simulated>;
+#ifdef SMART_CURTAIN_HAVE_LIBGPIOD
+template class BasicDHT11Bus<gpio::Libgpiod>;
+#endif
@@ -0,0 +1,56 @@
+#ifndef DHT11_WAVEFORM_H
+#define DHT11_WAVEFORM_H
+
+#include "DHT11.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Walk the edges a DHT11 drives on the data line for one frame
+ * Datasheet timing: 80us low/high preamble, 50us low before every bit, 27us
+ * high for a 0 and 70us for a 1, then a 50us end pulse. The simulated sensor,
+ * the tests and the benchmarks all build their frames from this one waveform;
+ * it lives beside them rather than with the system headers in include/.
+ * @param frame Frame bytes to encode
+ * @param start Time of the first falling edge
+ * @param emit Called with the time and direction (true = rising) of each edge
+ */
+template <typename Emit>
+void dht11Waveform(const std::array<uint8_t, 5> &frame, std::chrono::nanoseconds start, Emit emit)
+{
+	using std::chrono::microseconds;
+	auto t = start;
+	emit(t, false);
+	t += microseconds(80);
+	emit(t, true);
+	t += microseconds(80);
+	for (int bit = 0; bit < 40; ++bit)
+	{
+		emit(t, false);
+		t += microseconds(50);
+		emit(t, true);
+		t += microseconds((frame[bit / 8] & (0x80 >> (bit % 8))) ? 70 : 27);
+	}
+	emit(t, false);
+	t += microseconds(50);
+	emit(t, true);
+}
+
+/**
+ * @brief Build the edge trace a DHT11 produces for one frame
+ * @param frame Frame bytes to encode
+ * @param start Timestamp of the first response edge
+ * @return Edges as the kernel would report them
+ */
+inline std::vector<DHT11Sensor::EdgeEvent> makeDHT11Frame(const std::array<uint8_t, 5> &frame, std::chrono::nanoseconds start)
+{
+	std::vector<DHT11Sensor::EdgeEvent> edges;
+	edges.reserve(DHT11Sensor::FRAME_EDGE_COUNT);
+	dht11Waveform(frame, start, [&edges](std::chrono::nanoseconds time, bool rising)
+								{ edges.push_back({time, rising}); });
+	return edges;
+}
+
+#endif
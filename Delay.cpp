@@ -1,16 +1,200 @@
 #include <Delay.h>
+#include "Metrics.h"
+#include <sys/prctl.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <mutex>
+#include <vector>
 
-void delay_us(int n)
+namespace
 {
-	usleep(n);
+	constexpr int64_t NS_PER_SECOND = 1000000000;
+	// Spin at least this long so a wakeup that is a little later than calibrated still lands on time
+	constexpr int64_t SPIN_MARGIN_NS = 10000;
+	// Upper bound on the spun part, so one preempted sleep cannot turn later delays into busy waits
+	constexpr int64_t MAX_SPIN_NS = 200000;
+	constexpr int CALIBRATION_SLEEPS = 30;
+
+	std::atomic<bool> g_calibrated{false};
+	std::mutex g_calibrationMutex;
+	DelayCalibration g_calibration = {0, 0, 0};
+	std::atomic<int64_t> g_spinThresholdNs{100000};
+
+	std::atomic<uint64_t> g_delayCount{0};
+	std::atomic<uint64_t> g_errorSumNs{0};
+	std::atomic<int64_t> g_maxErrorNs{0};
+
+	int64_t monotonicNs()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<int64_t>(ts.tv_sec) * NS_PER_SECOND + ts.tv_nsec;
+	}
+
+	timespec toTimespec(int64_t ns)
+	{
+		timespec ts;
+		ts.tv_sec = static_cast<time_t>(ns / NS_PER_SECOND);
+		ts.tv_nsec = static_cast<long>(ns % NS_PER_SECOND);
+		return ts;
+	}
+
+	void sleepUntil(int64_t ns)
+	{
+		timespec deadline = toTimespec(ns);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+		{
+		}
+	}
+
+	void reduceTimerSlack()
+	{
+		// The default 50us slack lets the kernel batch our wakeup with others; it is most of usleep()'s overshoot
+		thread_local bool reduced = false;
+		if (!reduced)
+		{
+			prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+			reduced = true;
+		}
+	}
+
+	Histogram &errorHistogram()
+	{
+		static Histogram &histogram = MetricsRegistry::instance().histogram("delay_error_ns");
+		return histogram;
+	}
+
+	// Caller holds g_calibrationMutex
+	DelayCalibration calibrateLocked()
+	{
+		reduceTimerSlack();
+		const int reads = 1000;
+		int64_t start = monotonicNs();
+		for (int i = 0; i < reads; ++i)
+		{
+			monotonicNs();
+		}
+		int64_t clockReadNs = (monotonicNs() - start) / reads;
+
+		// Short sleeps show the fixed wakeup cost without being stretched by preemption
+		std::vector<int64_t> overshoots;
+		overshoots.reserve(CALIBRATION_SLEEPS);
+		for (int i = 0; i < CALIBRATION_SLEEPS; ++i)
+		{
+			int64_t deadline = monotonicNs() + 100000;
+			sleepUntil(deadline);
+			overshoots.push_back(std::max<int64_t>(monotonicNs() - deadline, 0));
+		}
+		std::sort(overshoots.begin(), overshoots.end());
+		int64_t overshootNs = overshoots[overshoots.size() * 9 / 10];
+
+		g_calibration = {clockReadNs, overshootNs, std::min(overshootNs + SPIN_MARGIN_NS, MAX_SPIN_NS)};
+		g_spinThresholdNs.store(g_calibration.spinThresholdNs, std::memory_order_relaxed);
+		g_calibrated.store(true, std::memory_order_release);
+		return g_calibration;
+	}
+
+	void ensureCalibrated()
+	{
+		if (!g_calibrated.load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> lock(g_calibrationMutex);
+			if (!g_calibrated.load(std::memory_order_relaxed))
+			{
+				calibrateLocked();
+			}
+		}
+	}
+
+	void delayUntilNs(int64_t deadline)
+	{
+		ensureCalibrated();
+		reduceTimerSlack();
+		int64_t now = monotonicNs();
+		int64_t sleepUntilNs = deadline - g_spinThresholdNs.load(std::memory_order_relaxed);
+		if (sleepUntilNs > now)
+		{
+			sleepUntil(sleepUntilNs);
+			// Keep tracking the overshoot: rise quickly when a wakeup ate into the spin, decay slowly otherwise
+			int64_t wanted = monotonicNs() - sleepUntilNs + SPIN_MARGIN_NS;
+			int64_t threshold = g_spinThresholdNs.load(std::memory_order_relaxed);
+			threshold += wanted > threshold ? (wanted - threshold) / 4 : (wanted - threshold) / 64;
+			g_spinThresholdNs.store(std::min(std::max(threshold, SPIN_MARGIN_NS), MAX_SPIN_NS), std::memory_order_relaxed);
+		}
+		while ((now = monotonicNs()) < deadline)
+		{
+		}
+
+		int64_t error = now - deadline;
+		g_delayCount.fetch_add(1, std::memory_order_relaxed);
+		g_errorSumNs.fetch_add(static_cast<uint64_t>(error), std::memory_order_relaxed);
+		int64_t max = g_maxErrorNs.load(std::memory_order_relaxed);
+		while (error > max && !g_maxErrorNs.compare_exchange_weak(max, error, std::memory_order_relaxed))
+		{
+		}
+		errorHistogram().record(static_cast<uint64_t>(error));
+	}
+}
+
+void delay_us(int n, Clock &clock)
+{
+	delay_until(clock.now() + std::chrono::microseconds(std::max(n, 0)), clock);
+}
+
+void delay_ms(int n, Clock &clock)
+{
+	delay_until(clock.now() + std::chrono::milliseconds(std::max(n, 0)), clock);
+}
+
+void delay_s(int n, Clock &clock)
+{
+	delay_until(clock.now() + std::chrono::seconds(std::max(n, 0)), clock);
+}
+
+void delay_until(std::chrono::steady_clock::time_point deadline, Clock &clock)
+{
+	if (!clock.isVirtual())
+	{
+		// steady_clock is CLOCK_MONOTONIC on Linux
+		delayUntilNs(std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count());
+		return;
+	}
+	// Virtual time has no wakeup overshoot to calibrate, and nothing to record
+	clock.sleepUntil(deadline - std::chrono::nanoseconds(MAX_SPIN_NS));
+	Clock::time_point previous = clock.now();
+	while (previous < deadline)
+	{
+		Clock::time_point current = clock.now();
+		if (current == previous)
+		{
+			// Reads are free on this clock, so spinning would never see the deadline; sleep to it instead
+			clock.sleepUntil(deadline);
+			return;
+		}
+		previous = current;
+	}
+}
+
+DelayCalibration delay_calibrate()
+{
+	std::lock_guard<std::mutex> lock(g_calibrationMutex);
+	return calibrateLocked();
 }
 
-void delay_ms(int n)
+DelayCalibration delay_get_calibration()
 {
-	usleep(n * 1000);
+	ensureCalibrated();
+	std::lock_guard<std::mutex> lock(g_calibrationMutex);
+	DelayCalibration calibration = g_calibration;
+	calibration.spinThresholdNs = g_spinThresholdNs.load(std::memory_order_relaxed);
+	return calibration;
 }
 
-void delay_s(int n)
+DelayStats delay_get_stats()
 {
-	sleep(n);
+	uint64_t count = g_delayCount.load(std::memory_order_relaxed);
+	int64_t mean = count ? static_cast<int64_t>(g_errorSumNs.load(std::memory_order_relaxed) / count) : 0;
+	return {count, mean, static_cast<int64_t>(errorHistogram().percentile(0.99)), g_maxErrorNs.load(std::memory_order_relaxed)};
 }
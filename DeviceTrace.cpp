@@ -0,0 +1,380 @@
+#include "DeviceTrace.h"
+#include "SystemController.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	const char MAGIC[8] = {'S', 'C', 'T', 'R', 'A', 'C', 'E', '1'};
+	// Magic and the wall-clock start in microseconds
+	constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(int64_t);
+	// Written out once the buffer holds this much
+	constexpr size_t FLUSH_BYTES = 64 * 1024;
+	// Kind byte, time delta and the largest event, a control frame
+	constexpr size_t MAX_EVENT_SIZE = 1 + 10 + 3 + bluetooth::MAX_PAYLOAD;
+
+	std::string describe(const std::string &what)
+	{
+		return what + ": " + strerror(errno);
+	}
+
+	uint64_t zigzag(int64_t value)
+	{
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+
+	int64_t unzigzag(uint64_t value)
+	{
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	void putVarint(std::vector<uint8_t> &out, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	// Decodes from the position onwards; false if the data ends first
+	bool getVarint(const std::vector<uint8_t> &data, size_t &position, uint64_t &value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && position < data.size(); shift += 7)
+		{
+			uint8_t byte = data[position++];
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+TraceRecorder::TraceRecorder(Clock &clock)
+		: m_clock(clock)
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	close();
+}
+
+bool TraceRecorder::open(const std::string &path)
+{
+	close();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (m_fd < 0)
+	{
+		if (m_errorCallback)
+		{
+			m_errorCallback(describe("Cannot create trace " + path));
+		}
+		return false;
+	}
+	m_buffer.reserve(FLUSH_BYTES + MAX_EVENT_SIZE);
+	m_buffer.resize(HEADER_SIZE);
+	int64_t start = std::chrono::duration_cast<std::chrono::microseconds>(m_clock.wallNow().time_since_epoch()).count();
+	std::memcpy(m_buffer.data(), MAGIC, sizeof(MAGIC));
+	std::memcpy(m_buffer.data() + sizeof(MAGIC), &start, sizeof(start));
+	m_last = m_clock.now();
+	m_eventCount = 0;
+	m_open.store(true);
+	return true;
+}
+
+void TraceRecorder::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_fd < 0)
+	{
+		return;
+	}
+	m_open.store(false);
+	writeBuffer();
+	::close(m_fd);
+	m_fd = -1;
+}
+
+bool TraceRecorder::isOpen() const
+{
+	return m_open.load();
+}
+
+void TraceRecorder::recordSensor(int temperature, int humidity, bool valid)
+{
+	if (!m_open.load())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_fd < 0)
+	{
+		return;
+	}
+	beginEvent(TraceEvent::Kind::SENSOR);
+	putVarint(m_buffer, zigzag(temperature));
+	putVarint(m_buffer, zigzag(humidity));
+	m_buffer.push_back(valid ? 1 : 0);
+	endEvent();
+}
+
+void TraceRecorder::recordKey(int row, int col, char key)
+{
+	if (!m_open.load())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_fd < 0)
+	{
+		return;
+	}
+	beginEvent(TraceEvent::Kind::KEY);
+	m_buffer.push_back(static_cast<uint8_t>(row));
+	m_buffer.push_back(static_cast<uint8_t>(col));
+	m_buffer.push_back(static_cast<uint8_t>(key));
+	endEvent();
+}
+
+void TraceRecorder::recordControl(const bluetooth::Frame &frame, ControlServer::Transport transport)
+{
+	if (!m_open.load())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_fd < 0)
+	{
+		return;
+	}
+	beginEvent(TraceEvent::Kind::CONTROL);
+	m_buffer.push_back(static_cast<uint8_t>(transport));
+	m_buffer.push_back(static_cast<uint8_t>(frame.command));
+	m_buffer.push_back(frame.length);
+	m_buffer.insert(m_buffer.end(), frame.payload.begin(), frame.payload.begin() + frame.length);
+	endEvent();
+}
+
+uint64_t TraceRecorder::getEventCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_eventCount;
+}
+
+void TraceRecorder::registerErrorCallback(ErrorCallback callback)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_errorCallback = callback;
+}
+
+void TraceRecorder::beginEvent(TraceEvent::Kind kind)
+{
+	// Callbacks from different threads may arrive out of order by a few microseconds
+	Clock::time_point now = std::max(m_clock.now(), m_last);
+	m_buffer.push_back(static_cast<uint8_t>(kind));
+	putVarint(m_buffer, std::chrono::duration_cast<std::chrono::microseconds>(now - m_last).count());
+	// Offsets are sums of whole microseconds; keep the remainder for the next delta
+	m_last += std::chrono::duration_cast<std::chrono::microseconds>(now - m_last);
+}
+
+void TraceRecorder::endEvent()
+{
+	++m_eventCount;
+	if (m_buffer.size() >= FLUSH_BYTES)
+	{
+		writeBuffer();
+	}
+}
+
+bool TraceRecorder::writeBuffer()
+{
+	size_t written = 0;
+	while (written < m_buffer.size())
+	{
+		ssize_t result = write(m_fd, m_buffer.data() + written, m_buffer.size() - written);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (result <= 0)
+		{
+			// Keep recording; the events of this buffer are lost but the trace stays readable up to them
+			m_buffer.clear();
+			if (m_errorCallback)
+			{
+				m_errorCallback(describe("Trace write failed"));
+			}
+			return false;
+		}
+		written += static_cast<size_t>(result);
+	}
+	m_buffer.clear();
+	return true;
+}
+
+bool TraceReader::open(const std::string &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	m_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	if (m_data.size() < HEADER_SIZE || !std::equal(MAGIC, MAGIC + sizeof(MAGIC), m_data.begin()))
+	{
+		m_data.clear();
+		return false;
+	}
+	int64_t start;
+	std::memcpy(&start, m_data.data() + sizeof(MAGIC), sizeof(start));
+	m_startTime = std::chrono::system_clock::time_point(
+			std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(start)));
+	rewind();
+	return true;
+}
+
+bool TraceReader::next(TraceEvent &event)
+{
+	if (m_position >= m_data.size())
+	{
+		return false;
+	}
+	size_t position = m_position;
+	uint8_t kind = m_data[position++];
+	uint64_t delta;
+	if (!getVarint(m_data, position, delta))
+	{
+		return false;
+	}
+	event.kind = static_cast<TraceEvent::Kind>(kind);
+	switch (event.kind)
+	{
+	case TraceEvent::Kind::SENSOR:
+	{
+		uint64_t temperature, humidity;
+		if (!getVarint(m_data, position, temperature) || !getVarint(m_data, position, humidity) ||
+				position >= m_data.size())
+		{
+			return false;
+		}
+		event.temperature = static_cast<int>(unzigzag(temperature));
+		event.humidity = static_cast<int>(unzigzag(humidity));
+		event.valid = m_data[position++] != 0;
+		break;
+	}
+	case TraceEvent::Kind::KEY:
+		if (m_data.size() - position < 3)
+		{
+			return false;
+		}
+		event.row = m_data[position];
+		event.col = m_data[position + 1];
+		event.key = static_cast<char>(m_data[position + 2]);
+		position += 3;
+		break;
+	case TraceEvent::Kind::CONTROL:
+	{
+		if (m_data.size() - position < 3)
+		{
+			return false;
+		}
+		event.transport = static_cast<ControlServer::Transport>(m_data[position]);
+		event.frame.command = static_cast<bluetooth::Command>(m_data[position + 1]);
+		event.frame.length = m_data[position + 2];
+		position += 3;
+		if (event.frame.length > bluetooth::MAX_PAYLOAD || m_data.size() - position < event.frame.length)
+		{
+			return false;
+		}
+		std::copy(m_data.begin() + position, m_data.begin() + position + event.frame.length, event.frame.payload.begin());
+		position += event.frame.length;
+		break;
+	}
+	default:
+		return false;
+	}
+	m_offset += std::chrono::microseconds(delta);
+	event.offset = m_offset;
+	m_position = position;
+	return true;
+}
+
+void TraceReader::rewind()
+{
+	m_position = HEADER_SIZE;
+	m_offset = std::chrono::microseconds(0);
+}
+
+std::chrono::system_clock::time_point TraceReader::getStartTime() const
+{
+	return m_startTime;
+}
+
+TraceReplayer::TraceReplayer(SystemController &controller, Clock &clock)
+		: m_controller(controller), m_clock(clock)
+{
+}
+
+TraceReplayer::Stats TraceReplayer::run(TraceReader &reader, Speed speed)
+{
+	Stats stats = {};
+	Clock::time_point start = m_clock.now();
+	TraceEvent event;
+	while (reader.next(event))
+	{
+		if (speed == Speed::ORIGINAL)
+		{
+			Clock::time_point due = start + event.offset;
+			m_clock.sleepUntil(due);
+			std::chrono::microseconds lateness = std::chrono::duration_cast<std::chrono::microseconds>(m_clock.now() - due);
+			stats.maxLateness = std::max(stats.maxLateness, lateness);
+		}
+		switch (event.kind)
+		{
+		case TraceEvent::Kind::SENSOR:
+			m_controller.handleSensorData(event.temperature, event.humidity, event.valid);
+			++stats.sensorEvents;
+			break;
+		case TraceEvent::Kind::KEY:
+			m_controller.handleKeypadInput(event.row, event.col, event.key);
+			++stats.keyEvents;
+			break;
+		case TraceEvent::Kind::CONTROL:
+		{
+			m_replies.clear();
+			ControlServer::Replies replies(m_replies, event.transport);
+			m_controller.handleControlRequest(event.frame, replies);
+			++stats.controlRequests;
+			stats.replyFrames += m_replies.size();
+			if (m_replyCallback)
+			{
+				for (const bluetooth::Frame &reply : m_replies)
+				{
+					m_replyCallback(reply);
+				}
+			}
+			break;
+		}
+		}
+		++stats.events;
+	}
+	stats.elapsed = m_clock.now() - start;
+	return stats;
+}
+
+void TraceReplayer::registerReplyCallback(ReplyCallback callback)
+{
+	m_replyCallback = callback;
+}
@@ -0,0 +1,265 @@
+#include "EventBus.h"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+
+constexpr size_t EventBus::MAX_EVENT_TYPES;
+constexpr size_t EventBus::MAX_SUBSCRIBERS;
+constexpr size_t EventBus::DEFAULT_CAPACITY;
+
+namespace
+{
+	std::atomic<size_t> g_nextTypeIndex{0};
+}
+
+EventBus::EventBus(Clock &clock)
+		: m_clock(clock)
+{
+}
+
+EventBus::~EventBus()
+{
+	std::vector<std::unique_ptr<Subscription>> subscriptions;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		subscriptions.swap(m_subscriptions);
+	}
+	for (auto &subscription : subscriptions)
+	{
+		for (auto &slot : m_topics[subscription->m_typeIndex].subscribers)
+		{
+			Subscription *expected = subscription.get();
+			slot.compare_exchange_strong(expected, nullptr);
+		}
+	}
+	for (auto &topic : m_topics)
+	{
+		while (topic.publishing.load() != 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+	for (auto &subscription : subscriptions)
+	{
+		subscription->stop();
+	}
+}
+
+void EventBus::unsubscribe(Subscription &subscription)
+{
+	std::unique_ptr<Subscription> removed;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto it = m_subscriptions.begin(); it != m_subscriptions.end(); ++it)
+		{
+			if (it->get() == &subscription)
+			{
+				removed = std::move(*it);
+				m_subscriptions.erase(it);
+				break;
+			}
+		}
+		if (!removed)
+		{
+			return;
+		}
+		Topic &topic = m_topics[removed->m_typeIndex];
+		for (auto &slot : topic.subscribers)
+		{
+			Subscription *expected = removed.get();
+			slot.compare_exchange_strong(expected, nullptr);
+		}
+		// A publisher that loaded the slot before it was cleared may still be pushing
+		while (topic.publishing.load() != 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+	removed->stop();
+}
+
+void EventBus::flush()
+{
+	std::vector<std::pair<Subscription *, uint64_t>> targets;
+	std::lock_guard<std::mutex> subscriptionsLock(m_mutex);
+	for (const auto &subscription : m_subscriptions)
+	{
+		targets.emplace_back(subscription.get(), subscription->m_published.load());
+	}
+	std::unique_lock<std::mutex> lock(m_flushMutex);
+	m_flushCondition.wait(lock, [&targets]
+												{
+		for (const auto &target : targets)
+		{
+			const Subscription &subscription = *target.first;
+			if (subscription.m_delivered.load() + subscription.m_discarded.load() < target.second)
+			{
+				return false;
+			}
+		}
+		return true; });
+}
+
+size_t EventBus::nextTypeIndex()
+{
+	return g_nextTypeIndex.fetch_add(1);
+}
+
+EventBus::Subscription &EventBus::add(std::unique_ptr<Subscription> subscription)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Topic &topic = m_topics[subscription->m_typeIndex];
+	for (auto &slot : topic.subscribers)
+	{
+		if (!slot.load())
+		{
+			subscription->m_flushMutex = &m_flushMutex;
+			subscription->m_flushCondition = &m_flushCondition;
+			subscription->start();
+			slot.store(subscription.get());
+			m_subscriptions.push_back(std::move(subscription));
+			return *m_subscriptions.back();
+		}
+	}
+	throw std::length_error("EventBus: too many subscribers of one event type");
+}
+
+EventBus::Subscription::Subscription(Clock &clock, const std::string &name, OverflowPolicy policy, size_t typeIndex)
+		: m_policy(policy),
+			m_latency(MetricsRegistry::instance().histogram("event_bus_" + name + "_latency_us")),
+			m_clock(clock),
+			m_name(name),
+			m_typeIndex(typeIndex),
+			m_discardedTotal(MetricsRegistry::instance().counter("event_bus_" + name + "_discarded_total"))
+{
+	m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_wakeFd < 0)
+	{
+		throw std::system_error(errno, std::generic_category(), "EventBus wakeup eventfd");
+	}
+}
+
+EventBus::Subscription::~Subscription()
+{
+	stop();
+	if (m_wakeFd >= 0)
+	{
+		close(m_wakeFd);
+	}
+}
+
+EventBus::Stats EventBus::Subscription::getStats() const
+{
+	uint64_t discarded = m_discarded.load();
+	bool coalescing = m_policy == OverflowPolicy::COALESCE_LATEST;
+	return {m_published.load(), m_delivered.load(), coalescing ? 0 : discarded, coalescing ? discarded : 0};
+}
+
+const std::string &EventBus::Subscription::getName() const
+{
+	return m_name;
+}
+
+void EventBus::Subscription::signal()
+{
+	// Pairs with the fence in wait(): either the worker sees the new event or we see it sleeping
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false))
+	{
+		// Holds virtual time from here until the worker binds, so it handles the event at this instant
+		m_clock.attach();
+		uint64_t one = 1;
+		ssize_t written = write(m_wakeFd, &one, sizeof(one));
+		(void)written;
+	}
+}
+
+void EventBus::Subscription::countDiscarded()
+{
+	m_discarded.fetch_add(1, std::memory_order_relaxed);
+	m_discardedTotal.increment();
+}
+
+void EventBus::Subscription::start()
+{
+	// Virtual time must not run ahead of the worker before it first waits
+	m_clock.attach();
+	m_worker = std::make_unique<std::thread>(&Subscription::workerThread, this);
+}
+
+void EventBus::Subscription::stop()
+{
+	if (!m_worker)
+	{
+		return;
+	}
+	m_stopRequested.store(true);
+	signal();
+	if (m_worker->joinable())
+	{
+		m_worker->join();
+	}
+	m_worker.reset();
+}
+
+void EventBus::Subscription::workerThread()
+{
+	MetricsRegistry::ThreadScope scope("event_" + m_name);
+	m_clock.bindThread();
+	while (true)
+	{
+		size_t count = 0;
+		while (deliverOne())
+		{
+			++count;
+		}
+		if (count && m_flushMutex)
+		{
+			// Taking the mutex orders the delivered count before any flush waiter's check
+			{
+				std::lock_guard<std::mutex> lock(*m_flushMutex);
+			}
+			m_flushCondition->notify_all();
+		}
+		if (m_stopRequested.load() && !hasPending())
+		{
+			break;
+		}
+		wait();
+	}
+	m_clock.unbindThread();
+}
+
+void EventBus::Subscription::wait()
+{
+	m_sleeping.store(true);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	bool idle = !hasPending() && !m_stopRequested.load();
+	if (!idle && m_sleeping.exchange(false))
+	{
+		return;
+	}
+	// Either idle, or a publisher already claimed the wakeup; its eventfd write follows its attach()
+	if (idle)
+	{
+		// Not waiting on the clock, so virtual time may pass while nothing is queued
+		m_clock.unbindThread();
+	}
+	pollfd pfd = {m_wakeFd, POLLIN, 0};
+	while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+	{
+	}
+	uint64_t value = 0;
+	ssize_t drained = read(m_wakeFd, &value, sizeof(value));
+	(void)drained;
+	if (idle)
+	{
+		m_clock.bindThread();
+	}
+	else
+	{
+		// Still bound; give back the slot the publisher reserved
+		m_clock.detach();
+	}
+}
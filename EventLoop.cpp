@@ -0,0 +1,259 @@
+#include "EventLoop.h"
+#include <algorithm>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace
+{
+	constexpr int MAX_EVENTS = 32;
+
+	timespec toTimespec(std::chrono::nanoseconds duration)
+	{
+		timespec ts;
+		ts.tv_sec = static_cast<time_t>(duration.count() / 1000000000);
+		ts.tv_nsec = static_cast<long>(duration.count() % 1000000000);
+		return ts;
+	}
+}
+
+EventLoop::EventLoop()
+{
+}
+
+EventLoop::~EventLoop()
+{
+	for (auto &entry : m_sources)
+	{
+		if (entry.second->ownsFd)
+		{
+			close(entry.first);
+		}
+	}
+	m_sources.clear();
+	if (m_wakeFd >= 0)
+	{
+		close(m_wakeFd);
+	}
+	if (m_epollFd >= 0)
+	{
+		close(m_epollFd);
+	}
+}
+
+bool EventLoop::initialize()
+{
+	if (m_epollFd >= 0)
+	{
+		return true;
+	}
+	m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (m_epollFd < 0)
+	{
+		return false;
+	}
+	m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_wakeFd < 0)
+	{
+		close(m_epollFd);
+		m_epollFd = -1;
+		return false;
+	}
+	// The wakeup source is registered first so stop and posted work always run before I/O
+	return addSource(m_wakeFd, EPOLLIN, false, [this](uint32_t)
+									 { runPostedTasks(); });
+}
+
+bool EventLoop::addFd(int fd, uint32_t events, FdHandler handler)
+{
+	return addSource(fd, events, false, std::move(handler));
+}
+
+bool EventLoop::modifyFd(int fd, uint32_t events)
+{
+	if (m_sources.find(fd) == m_sources.end())
+	{
+		return false;
+	}
+	epoll_event event{};
+	event.events = events;
+	event.data.fd = fd;
+	return epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void EventLoop::removeFd(int fd)
+{
+	auto it = m_sources.find(fd);
+	if (it == m_sources.end())
+	{
+		return;
+	}
+	epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	if (it->second->ownsFd)
+	{
+		close(fd);
+	}
+	m_sources.erase(it);
+}
+
+int EventLoop::addTimer(std::chrono::nanoseconds period, TimerHandler handler, std::chrono::nanoseconds initialDelay)
+{
+	int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timerFd < 0)
+	{
+		return -1;
+	}
+	itimerspec spec{};
+	spec.it_interval = toTimespec(period);
+	spec.it_value = toTimespec(initialDelay > std::chrono::nanoseconds::zero() ? initialDelay : period);
+	if (timerfd_settime(timerFd, 0, &spec, nullptr) < 0)
+	{
+		close(timerFd);
+		return -1;
+	}
+	bool added = addSource(timerFd, EPOLLIN, true, [timerFd, handler](uint32_t)
+												 {
+		uint64_t expirations = 0;
+		if (read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 0)
+		{
+			handler(expirations);
+		} });
+	if (!added)
+	{
+		close(timerFd);
+		return -1;
+	}
+	return timerFd;
+}
+
+void EventLoop::removeTimer(int timerFd)
+{
+	removeFd(timerFd);
+}
+
+void EventLoop::post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_taskMutex);
+		m_tasks.push_back(std::move(task));
+	}
+	uint64_t one = 1;
+	ssize_t written = write(m_wakeFd, &one, sizeof(one));
+	(void)written;
+}
+
+void EventLoop::run()
+{
+	if (m_epollFd < 0 && !initialize())
+	{
+		return;
+	}
+	m_running.store(true);
+	epoll_event events[MAX_EVENTS];
+	std::vector<std::pair<uint32_t, std::shared_ptr<Source>>> ready;
+	while (!m_stopRequested.load())
+	{
+		int count = epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		m_wakeups.fetch_add(1, std::memory_order_relaxed);
+
+		// Order ready sources by registration so dispatch does not depend on epoll's ordering
+		ready.clear();
+		for (int i = 0; i < count; ++i)
+		{
+			auto it = m_sources.find(events[i].data.fd);
+			if (it != m_sources.end())
+			{
+				uint32_t mask = events[i].events;
+				ready.emplace_back(mask, it->second);
+			}
+		}
+		std::sort(ready.begin(), ready.end(),
+							[](const std::pair<uint32_t, std::shared_ptr<Source>> &a, const std::pair<uint32_t, std::shared_ptr<Source>> &b)
+							{ return a.second->order < b.second->order; });
+		for (auto &entry : ready)
+		{
+			// Skip sources removed by an earlier handler in this batch
+			auto it = m_sources.find(entry.second->fd);
+			if (it == m_sources.end() || it->second != entry.second)
+			{
+				continue;
+			}
+			entry.second->handler(entry.first);
+			if (m_stopRequested.load())
+			{
+				break;
+			}
+		}
+	}
+	m_running.store(false);
+	m_stopRequested.store(false);
+}
+
+void EventLoop::stop()
+{
+	m_stopRequested.store(true);
+	if (m_wakeFd >= 0)
+	{
+		uint64_t one = 1;
+		ssize_t written = write(m_wakeFd, &one, sizeof(one));
+		(void)written;
+	}
+}
+
+bool EventLoop::isRunning() const
+{
+	return m_running.load();
+}
+
+uint64_t EventLoop::getWakeupCount() const
+{
+	return m_wakeups.load(std::memory_order_relaxed);
+}
+
+bool EventLoop::addSource(int fd, uint32_t events, bool ownsFd, FdHandler handler)
+{
+	if (m_epollFd < 0 || fd < 0 || m_sources.count(fd))
+	{
+		return false;
+	}
+	epoll_event event{};
+	event.events = events;
+	event.data.fd = fd;
+	if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+	{
+		return false;
+	}
+	auto source = std::make_shared<Source>();
+	source->fd = fd;
+	source->order = m_nextOrder++;
+	source->ownsFd = ownsFd;
+	source->handler = std::move(handler);
+	m_sources[fd] = source;
+	return true;
+}
+
+void EventLoop::runPostedTasks()
+{
+	uint64_t value = 0;
+	ssize_t drained = read(m_wakeFd, &value, sizeof(value));
+	(void)drained;
+	std::vector<std::function<void()>> tasks;
+	{
+		std::lock_guard<std::mutex> lock(m_taskMutex);
+		tasks.swap(m_tasks);
+	}
+	for (auto &task : tasks)
+	{
+		task();
+	}
+}
@@ -1,40 +1,65 @@
 #include "Key.h"
+#include <algorithm>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
 
-// Define the static constexpr array
-constexpr std::array<std::array<char, 4>, 4> MatrixKeypad::KEYPAD_LAYOUT;
-
-MatrixKeypad::MatrixKeypad(const std::string &chipName,
-													 const std::array<int, 4> &colPins,
-													 const std::array<int, 4> &rowPins)
-		: m_chipName(chipName), m_colPins(colPins), m_rowPins(rowPins)
+template <typename Gpio>
+BasicMatrixKeypad<Gpio>::BasicMatrixKeypad(const std::string &chipName,
+																					 const std::array<int, 4> &colPins,
+																					 const std::array<int, 4> &rowPins,
+																					 ScanMode mode,
+																					 Clock &clock)
+		: m_chipName(chipName), m_colPins(colPins), m_rowPins(rowPins), m_clock(clock),
+			// Row edges wake a poll() in real time, which would stall a virtual clock
+			m_scanMode(clock.isVirtual() ? ScanMode::POLLING : mode),
+			m_metrics(resolveMetrics())
 {
-	m_lastKeyData = {-1, -1, '\0', std::chrono::steady_clock::now(), false};
+	auto now = m_clock.now();
+	m_lastKeyData = {-1, -1, '\0', now, false, KeyEvent::RELEASE, std::chrono::milliseconds::zero()};
+	m_keyStates.fill({KeyPhase::IDLE, now, now, now, false});
 }
 
-MatrixKeypad::~MatrixKeypad()
+template <typename Gpio>
+BasicMatrixKeypad<Gpio>::~BasicMatrixKeypad()
 {
 	stopScanning();
+	if (m_stopFd >= 0)
+	{
+		close(m_stopFd);
+	}
 }
 
-bool MatrixKeypad::initialize()
+template <typename Gpio>
+bool BasicMatrixKeypad<Gpio>::initialize()
 {
 	try
 	{
-		m_chip = std::make_unique<gpiod::chip>(m_chipName);
-		// Initialize column pins as outputs
-		for (int i = 0; i < 4; ++i)
+		m_chip = std::make_unique<typename Gpio::chip>(m_chipName);
+		// Request columns and rows as one line set each so a scan step is a single ioctl
+		m_colLines = m_chip->get_lines(std::vector<unsigned int>(m_colPins.begin(), m_colPins.end()));
+		m_colLines.request({"keypad_col", Gpio::line_request::DIRECTION_OUTPUT, 0}, {0, 0, 0, 0});
+		m_rowLines = m_chip->get_lines(std::vector<unsigned int>(m_rowPins.begin(), m_rowPins.end()));
+		if (m_scanMode == ScanMode::INTERRUPT)
 		{
-			auto line = std::make_unique<gpiod::line>(m_chip->get_line(m_colPins[i]));
-			line->request({"keypad_col", gpiod::line_request::DIRECTION_OUTPUT, 0});
-			line->set_value(0);
-			m_colLines.push_back(std::move(line));
+			// Event requests can still be sampled during a scan, but one ioctl per line
+			m_rowLines.request({"keypad_row", Gpio::line_request::EVENT_RISING_EDGE, 0});
+			m_rowEventFds.clear();
+			for (unsigned int i = 0; i < m_rowLines.size(); ++i)
+			{
+				m_rowEventFds.push_back(m_rowLines[i].event_get_fd());
+			}
 		}
-		// Initialize row pins as inputs
-		for (int i = 0; i < 4; ++i)
+		else
 		{
-			auto line = std::make_unique<gpiod::line>(m_chip->get_line(m_rowPins[i]));
-			line->request({"keypad_row", gpiod::line_request::DIRECTION_INPUT});
-			m_rowLines.push_back(std::move(line));
+			m_rowLines.request({"keypad_row", Gpio::line_request::DIRECTION_INPUT, 0});
+		}
+		if (m_scanMode == ScanMode::INTERRUPT)
+		{
+			// Idle state: every column driven so any key press raises its row
+			setAllColumns(1);
 		}
 		return true;
 	}
@@ -48,7 +73,8 @@ bool MatrixKeypad::initialize()
 	}
 }
 
-void MatrixKeypad::startScanning(int scanIntervalMs)
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::startScanning(int scanIntervalMs)
 {
 	if (m_scanning.load())
 	{
@@ -61,42 +87,141 @@ void MatrixKeypad::startScanning(int scanIntervalMs)
 			return;
 		}
 	}
+	if (m_scanMode == ScanMode::INTERRUPT)
+	{
+		if (m_stopFd < 0)
+		{
+			m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (m_stopFd < 0)
+			{
+				if (m_errorCallback)
+				{
+					m_errorCallback("Failed to create keypad stop event: " + std::string(strerror(errno)));
+				}
+				return;
+			}
+		}
+		m_scanning.store(true);
+		m_scanThread = std::make_unique<std::thread>(&BasicMatrixKeypad::interruptScanningThread, this, scanIntervalMs);
+		return;
+	}
 	m_scanning.store(true);
-	m_scanThread = std::make_unique<std::thread>(&MatrixKeypad::scanningThread, this, scanIntervalMs);
+	m_scanTask = std::make_unique<PeriodicTask>("keypad_scan", std::chrono::milliseconds(scanIntervalMs), m_clock);
+	m_scanThread = std::make_unique<std::thread>(&BasicMatrixKeypad::scanningThread, this);
 }
 
-void MatrixKeypad::stopScanning()
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::stopScanning()
 {
 	m_scanning.store(false);
+	if (m_scanTask)
+	{
+		m_scanTask->stop();
+	}
+	if (m_stopFd >= 0)
+	{
+		uint64_t one = 1;
+		ssize_t written = write(m_stopFd, &one, sizeof(one));
+		(void)written;
+	}
 	if (m_scanThread && m_scanThread->joinable())
 	{
 		m_scanThread->join();
 	}
 	m_scanThread.reset();
+	if (m_stopFd >= 0)
+	{
+		uint64_t value;
+		ssize_t drained = read(m_stopFd, &value, sizeof(value));
+		(void)drained;
+	}
 }
 
-MatrixKeypad::KeyData MatrixKeypad::getLastKeyPress() const
+template <typename Gpio>
+typename BasicMatrixKeypad<Gpio>::KeyData BasicMatrixKeypad<Gpio>::getLastKeyPress() const
 {
 	std::lock_guard<std::mutex> lock(m_dataMutex);
 	return m_lastKeyData;
 }
 
-void MatrixKeypad::registerKeyPressCallback(KeyPressCallback callback)
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::registerKeyPressCallback(KeyPressCallback callback)
 {
+	std::lock_guard<std::mutex> lock(m_callbackMutex);
 	m_keyPressCallback = callback;
 }
 
-void MatrixKeypad::registerErrorCallback(ErrorCallback callback)
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::registerKeyEventCallback(KeyEventCallback callback)
+{
+	std::lock_guard<std::mutex> lock(m_callbackMutex);
+	m_keyEventCallback = callback;
+}
+
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::setKeyTiming(const KeyTiming &timing)
+{
+	std::lock_guard<std::mutex> lock(m_dataMutex);
+	m_timing = timing;
+}
+
+template <typename Gpio>
+typename BasicMatrixKeypad<Gpio>::KeyTiming BasicMatrixKeypad<Gpio>::getKeyTiming() const
+{
+	std::lock_guard<std::mutex> lock(m_dataMutex);
+	return m_timing;
+}
+
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::registerErrorCallback(ErrorCallback callback)
 {
 	m_errorCallback = callback;
 }
 
-bool MatrixKeypad::isScanning() const
+template <typename Gpio>
+bool BasicMatrixKeypad<Gpio>::isScanning() const
 {
 	return m_scanning.load();
 }
 
-char MatrixKeypad::getKeyChar(int row, int col) const
+template <typename Gpio>
+typename BasicMatrixKeypad<Gpio>::ScanMode BasicMatrixKeypad<Gpio>::getScanMode() const
+{
+	return m_scanMode;
+}
+
+template <typename Gpio>
+std::vector<int> BasicMatrixKeypad<Gpio>::getRowEventFds() const
+{
+	return m_rowEventFds;
+}
+
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::setBulkIo(bool enable)
+{
+	m_bulkIo.store(enable);
+}
+
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::setSettleTimeUs(int settleUs)
+{
+	m_settleUs.store(settleUs);
+}
+
+template <typename Gpio>
+uint64_t BasicMatrixKeypad<Gpio>::getGpioCallCount() const
+{
+	return m_gpioCalls.load(std::memory_order_relaxed);
+}
+
+template <typename Gpio>
+std::chrono::microseconds BasicMatrixKeypad<Gpio>::getLastPressLatency() const
+{
+	return std::chrono::microseconds(m_lastPressLatencyUs.load());
+}
+
+template <typename Gpio>
+char BasicMatrixKeypad<Gpio>::getKeyChar(int row, int col) const
 {
 	if (row >= 0 && row < 4 && col >= 0 && col < 4)
 	{
@@ -105,83 +230,340 @@ char MatrixKeypad::getKeyChar(int row, int col) const
 	return '\0';
 }
 
-void MatrixKeypad::scanningThread(int scanIntervalMs)
+template <typename Gpio>
+typename BasicMatrixKeypad<Gpio>::ScanMetrics BasicMatrixKeypad<Gpio>::resolveMetrics()
 {
-	while (m_scanning.load())
+	MetricsRegistry &registry = MetricsRegistry::instance();
+	return {registry.counter("keypad_scans_total"),
+					registry.counter("keypad_scan_errors_total"),
+					registry.counter("keypad_events_total"),
+					registry.histogram("keypad_scan_us"),
+					registry.histogram("keypad_callback_us"),
+					registry.histogram("keypad_press_latency_us")};
+}
+
+template <typename Gpio>
+bool BasicMatrixKeypad<Gpio>::scanOnce()
+{
+	m_metrics.scans.increment();
+	try
+	{
+		auto scanStart = std::chrono::steady_clock::now();
+		uint16_t pressedMask = scanMatrix();
+		m_metrics.scanTime.recordSince(scanStart);
+		return processScan(pressedMask, m_clock.now());
+	}
+	catch (const std::exception &e)
 	{
-		try
+		m_metrics.scanErrors.increment();
+		if (m_errorCallback)
 		{
-			KeyData keyData = scanMatrix();
-			if (keyData.isPressed && debounceKey(keyData.row, keyData.col))
+			m_errorCallback("Keypad scanning error: " + std::string(e.what()));
+		}
+	}
+	return false;
+}
+
+template <typename Gpio>
+bool BasicMatrixKeypad<Gpio>::processScan(uint16_t pressedMask, std::chrono::steady_clock::time_point now)
+{
+	KeyTiming timing = getKeyTiming();
+	bool active = false;
+	for (int index = 0; index < 16; ++index)
+	{
+		KeyState &state = m_keyStates[index];
+		bool closed = (pressedMask >> index) & 1;
+		switch (state.phase)
+		{
+		case KeyPhase::IDLE:
+			if (closed)
 			{
-				{
-					std::lock_guard<std::mutex> lock(m_dataMutex);
-					m_lastKeyData = keyData;
-				}
+				state.phase = KeyPhase::PRESS_DEBOUNCE;
+				state.changedAt = now;
+			}
+			break;
 
-				if (m_keyPressCallback)
-				{
-					m_keyPressCallback(keyData.row, keyData.col, keyData.keyChar);
-				}
+		case KeyPhase::PRESS_DEBOUNCE:
+			if (!closed)
+			{
+				state.phase = KeyPhase::IDLE;
+			}
+			else if (now - state.changedAt >= timing.pressDebounce)
+			{
+				state.phase = KeyPhase::HELD;
+				state.pressedAt = state.changedAt;
+				state.longPressSent = false;
+				emitKeyEvent(index, KeyEvent::PRESS, now);
+			}
+			break;
+
+		case KeyPhase::HELD:
+			if (!closed)
+			{
+				state.phase = KeyPhase::RELEASE_DEBOUNCE;
+				state.changedAt = now;
+			}
+			else if (!state.longPressSent && now - state.pressedAt >= timing.longPress)
+			{
+				state.longPressSent = true;
+				state.nextRepeat = now + timing.repeatInterval;
+				emitKeyEvent(index, KeyEvent::LONG_PRESS, now);
+			}
+			else if (state.longPressSent && timing.repeatInterval.count() > 0 && now >= state.nextRepeat)
+			{
+				state.nextRepeat += timing.repeatInterval;
+				emitKeyEvent(index, KeyEvent::REPEAT, now);
+			}
+			break;
+
+		case KeyPhase::RELEASE_DEBOUNCE:
+			if (closed)
+			{
+				// Contact bounce, still held
+				state.phase = KeyPhase::HELD;
+			}
+			else if (now - state.changedAt >= timing.releaseDebounce)
+			{
+				state.phase = KeyPhase::IDLE;
+				emitKeyEvent(index, KeyEvent::RELEASE, now);
 			}
+			break;
 		}
-		catch (const std::exception &e)
+		active |= (state.phase != KeyPhase::IDLE);
+	}
+	return active;
+}
+
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::emitKeyEvent(int index, KeyEvent event, std::chrono::steady_clock::time_point now)
+{
+	int row = index / 4;
+	int col = index % 4;
+	KeyData keyData = {row, col, getKeyChar(row, col), now, event != KeyEvent::RELEASE, event,
+										 std::chrono::duration_cast<std::chrono::milliseconds>(now - m_keyStates[index].pressedAt)};
+	if (event == KeyEvent::PRESS)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_dataMutex);
+			m_lastKeyData = keyData;
+		}
+		if (m_lastEdgeTime.count() > 0)
+		{
+			// Edge timestamps are CLOCK_MONOTONIC, same as steady_clock
+			auto latency = std::chrono::steady_clock::now().time_since_epoch() - m_lastEdgeTime;
+			int64_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+			m_lastPressLatencyUs.store(latencyUs);
+			m_metrics.pressLatency.record(latencyUs > 0 ? static_cast<uint64_t>(latencyUs) : 0);
+			m_lastEdgeTime = std::chrono::nanoseconds::zero();
+		}
+	}
+
+	m_metrics.events.increment();
+	auto callbackStart = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(m_callbackMutex);
+		if (m_keyEventCallback)
+		{
+			m_keyEventCallback(keyData);
+		}
+		if (event == KeyEvent::PRESS && m_keyPressCallback)
+		{
+			m_keyPressCallback(row, col, keyData.keyChar);
+		}
+	}
+	m_metrics.callbackTime.recordSince(callbackStart);
+}
+
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::scanningThread()
+{
+	MetricsRegistry::ThreadScope scope("keypad_scan");
+	m_scanTask->run([this]
+									{ scanOnce(); });
+}
+
+template <typename Gpio>
+bool BasicMatrixKeypad<Gpio>::processRowEvents()
+{
+	m_lastEdgeTime = std::chrono::nanoseconds::zero();
+	try
+	{
+		drainRowEvents(true);
+	}
+	catch (const std::exception &e)
+	{
+		if (m_errorCallback)
+		{
+			m_errorCallback("Keypad event error: " + std::string(e.what()));
+		}
+	}
+	return scanOnce();
+}
+
+template <typename Gpio>
+std::chrono::milliseconds BasicMatrixKeypad<Gpio>::activeTickInterval(std::chrono::milliseconds scanInterval) const
+{
+	KeyTiming timing = getKeyTiming();
+	auto now = m_clock.now();
+	std::chrono::milliseconds tick = scanInterval;
+	for (const KeyState &state : m_keyStates)
+	{
+		std::chrono::milliseconds window;
+		if (state.phase == KeyPhase::PRESS_DEBOUNCE)
+		{
+			window = timing.pressDebounce;
+		}
+		else if (state.phase == KeyPhase::RELEASE_DEBOUNCE)
+		{
+			window = timing.releaseDebounce;
+		}
+		else
+		{
+			continue;
+		}
+		// Round up so the tick never lands just short of the window's end
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				state.changedAt + window - now + std::chrono::milliseconds(1) - std::chrono::nanoseconds(1));
+		tick = std::min(tick, std::max(remaining, std::chrono::milliseconds(1)));
+	}
+	return tick;
+}
+
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::interruptScanningThread(int scanIntervalMs)
+{
+	MetricsRegistry::ThreadScope scope("keypad_scan");
+	std::vector<pollfd> fds;
+	for (int fd : getRowEventFds())
+	{
+		fds.push_back({fd, POLLIN, 0});
+	}
+	fds.push_back({m_stopFd, POLLIN, 0});
+	while (m_scanning.load())
+	{
+		// No timeout: the thread only wakes on a row edge or on stopScanning()
+		int ready = poll(fds.data(), fds.size(), -1);
+		if (ready < 0)
 		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
 			if (m_errorCallback)
 			{
-				m_errorCallback("Keypad scanning error: " + std::string(e.what()));
+				m_errorCallback("Keypad poll error: " + std::string(strerror(errno)));
+			}
+			break;
+		}
+		if (fds.back().revents & POLLIN)
+		{
+			break;
+		}
+		bool active = processRowEvents();
+		// Tick the state machines until every key is idle, then sleep on edges again
+		while (active && m_scanning.load())
+		{
+			pollfd stop = {m_stopFd, POLLIN, 0};
+			int timeoutMs = static_cast<int>(activeTickInterval(std::chrono::milliseconds(scanIntervalMs)).count());
+			if (poll(&stop, 1, timeoutMs) > 0)
+			{
+				break;
 			}
+			active = scanOnce();
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(scanIntervalMs));
 	}
 }
 
-MatrixKeypad::KeyData MatrixKeypad::scanMatrix()
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::setAllColumns(int value)
 {
-	KeyData keyData = {-1, -1, '\0', std::chrono::steady_clock::now(), false};
-	for (int col = 0; col < 4; ++col)
+	m_colLines.set_values({value, value, value, value});
+	m_gpioCalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Gpio>
+void BasicMatrixKeypad<Gpio>::drainRowEvents(bool recordEdge)
+{
+	for (unsigned int i = 0; i < m_rowLines.size(); ++i)
 	{
-		// Set current column high
-		m_colLines[col]->set_value(1);
-		delay_ms(1); // For signal propagation
-		// Check all rows for this column
-		for (int row = 0; row < 4; ++row)
+		while (m_rowLines[i].event_wait(std::chrono::nanoseconds::zero()))
 		{
-			if (m_rowLines[row]->get_value() == 1)
+			auto event = m_rowLines[i].event_read();
+			if (recordEdge && (m_lastEdgeTime.count() == 0 || event.timestamp < m_lastEdgeTime))
 			{
-				keyData.row = row;
-				keyData.col = col;
-				keyData.keyChar = getKeyChar(row, col);
-				keyData.isPressed = true;
-				keyData.timestamp = std::chrono::steady_clock::now();
-				// Wait for key release
-				while (m_rowLines[row]->get_value() == 1)
-				{
-					delay_ms(10);
-				}
-				// Set column to low before returning
-				m_colLines[col]->set_value(0);
-				return keyData;
+				m_lastEdgeTime = event.timestamp;
 			}
 		}
-		// Set column to low
-		m_colLines[col]->set_value(0);
 	}
-
-	return keyData;
 }
 
-bool MatrixKeypad::debounceKey(int row, int col)
+template <typename Gpio>
+uint16_t BasicMatrixKeypad<Gpio>::scanMatrix()
 {
-	// Ensure key is still pressed
-	delay_ms(20);
-	if (row < 0 || row >= 4 || col < 0 || col >= 4)
+	uint16_t pressedMask = 0;
+	int settleUs = m_settleUs.load();
+	bool interrupt = (m_scanMode == ScanMode::INTERRUPT);
+	// Event-requested rows live on separate handles, so their reads cost one ioctl each
+	uint64_t rowReadCost = interrupt ? m_rowLines.size() : 1;
+	if (m_bulkIo.load())
 	{
-		return false;
+		std::vector<int> columns(4, 0);
+		for (int col = 0; col < 4; ++col)
+		{
+			// One write selects this column and deselects the previous one (or the idle pattern)
+			std::fill(columns.begin(), columns.end(), 0);
+			columns[col] = 1;
+			m_colLines.set_values(columns);
+			delay_us(settleUs, m_clock);
+			std::vector<int> rows = m_rowLines.get_values();
+			for (int row = 0; row < 4; ++row)
+			{
+				if (rows[row] == 1)
+				{
+					pressedMask |= static_cast<uint16_t>(1u << (row * 4 + col));
+				}
+			}
+			m_gpioCalls.fetch_add(1 + rowReadCost, std::memory_order_relaxed);
+		}
+		setAllColumns(interrupt ? 1 : 0);
 	}
-	m_colLines[col]->set_value(1);
-	delay_ms(1);
-	bool isPressed = (m_rowLines[row]->get_value() == 1);
-	m_colLines[col]->set_value(0);
-	return isPressed;
+	else
+	{
+		if (interrupt)
+		{
+			setAllColumns(0);
+		}
+		for (int col = 0; col < 4; ++col)
+		{
+			// Set current column high
+			m_colLines[col].set_value(1);
+			delay_us(settleUs, m_clock); // For signal propagation
+			// Check all rows for this column
+			for (int row = 0; row < 4; ++row)
+			{
+				if (m_rowLines[row].get_value() == 1)
+				{
+					pressedMask |= static_cast<uint16_t>(1u << (row * 4 + col));
+				}
+			}
+			// Set column to low
+			m_colLines[col].set_value(0);
+			m_gpioCalls.fetch_add(2 + 4, std::memory_order_relaxed);
+		}
+		if (interrupt)
+		{
+			setAllColumns(1);
+		}
+	}
+	if (interrupt)
+	{
+		// The column walk queued row edges of its own
+		drainRowEvents(false);
+	}
+	return pressedMask;
 }
+
+template class BasicMatrixKeypad<gpio::Simulated>;
+#ifdef SMART_CURTAIN_HAVE_LIBGPIOD
+template class BasicMatrixKeypad<gpio::Libgpiod>;
+#endif
@@ -0,0 +1,403 @@
+#include "Logger.h"
+#include "Metrics.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+constexpr size_t Logger::RING_CAPACITY;
+constexpr size_t Logger::MAX_ARGS;
+constexpr size_t Logger::TEXT_BYTES;
+
+namespace
+{
+	// Loggers are told apart by id, not address, so a stale cache entry never matches a new logger
+	std::atomic<uint64_t> g_nextLoggerId{1};
+
+	struct CachedRing
+	{
+		uint64_t loggerId;
+		std::shared_ptr<void> ring;
+		void *raw;
+		std::atomic<bool> *retired;
+	};
+
+	// Retires the thread's rings when it exits; each consumer then drops its ring after the last records
+	struct RingCache
+	{
+		std::vector<CachedRing> rings;
+
+		~RingCache()
+		{
+			for (const CachedRing &cached : rings)
+			{
+				cached.retired->store(true, std::memory_order_release);
+			}
+		}
+	};
+	thread_local RingCache t_rings;
+
+	const char *levelName(Logger::Level level)
+	{
+		switch (level)
+		{
+		case Logger::Level::DEBUG:
+			return "DEBUG";
+		case Logger::Level::INFO:
+			return "INFO ";
+		case Logger::Level::WARN:
+			return "WARN ";
+		case Logger::Level::ERROR:
+			return "ERROR";
+		}
+		return "?    ";
+	}
+
+	void writeAll(int fd, const std::string &data)
+	{
+		size_t offset = 0;
+		while (offset < data.size())
+		{
+			ssize_t written = write(fd, data.data() + offset, data.size() - offset);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return;
+			}
+			offset += static_cast<size_t>(written);
+		}
+	}
+}
+
+Logger::Logger(int fd)
+		: m_fd(fd), m_id(g_nextLoggerId.fetch_add(1))
+{
+	m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	m_consumerThread = std::make_unique<std::thread>(&Logger::consumerThread, this);
+}
+
+Logger::~Logger()
+{
+	m_stopRequested.store(true);
+	signalConsumer();
+	if (m_consumerThread && m_consumerThread->joinable())
+	{
+		m_consumerThread->join();
+	}
+	if (m_wakeFd >= 0)
+	{
+		close(m_wakeFd);
+	}
+}
+
+Logger &Logger::instance()
+{
+	// Never destroyed: threads and static destructors may still log while the process exits
+	static Logger *logger = new Logger();
+	return *logger;
+}
+
+void Logger::setLevel(Level level)
+{
+	m_minLevel.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+}
+
+Logger::Level Logger::getLevel() const
+{
+	return static_cast<Level>(m_minLevel.load(std::memory_order_relaxed));
+}
+
+void Logger::flush()
+{
+	std::vector<std::pair<std::shared_ptr<Ring>, uint64_t>> targets;
+	{
+		std::lock_guard<std::mutex> lock(m_ringsMutex);
+		for (const auto &ring : m_rings)
+		{
+			targets.emplace_back(ring, ring->tail.load(std::memory_order_acquire));
+		}
+	}
+	signalConsumer();
+	std::unique_lock<std::mutex> lock(m_flushMutex);
+	m_flushCondition.wait(lock, [&targets]
+												{
+		for (const auto &target : targets)
+		{
+			if (target.first->written.load(std::memory_order_acquire) < target.second)
+			{
+				return false;
+			}
+		}
+		return true; });
+}
+
+uint64_t Logger::getDroppedCount() const
+{
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::getWrittenCount() const
+{
+	return m_written.load(std::memory_order_relaxed);
+}
+
+size_t Logger::getRingCount()
+{
+	std::lock_guard<std::mutex> lock(m_ringsMutex);
+	return m_rings.size();
+}
+
+Logger::Ring *Logger::localRing()
+{
+	for (const auto &cached : t_rings.rings)
+	{
+		if (cached.loggerId == m_id)
+		{
+			return static_cast<Ring *>(cached.raw);
+		}
+	}
+	// First record from this thread: the only time a producer takes a lock
+	std::shared_ptr<Ring> ring;
+	try
+	{
+		ring = std::make_shared<Ring>();
+	}
+	catch (const std::bad_alloc &)
+	{
+		return nullptr;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_ringsMutex);
+		m_rings.push_back(ring);
+	}
+	t_rings.rings.push_back({m_id, ring, ring.get(), &ring->retired});
+	return ring.get();
+}
+
+void Logger::signalConsumer()
+{
+	if (m_wakeFd >= 0)
+	{
+		uint64_t one = 1;
+		ssize_t written = write(m_wakeFd, &one, sizeof(one));
+		(void)written;
+	}
+}
+
+void Logger::consumerThread()
+{
+	MetricsRegistry::ThreadScope scope("logger");
+	std::string batch;
+	batch.reserve(16384);
+	std::vector<std::shared_ptr<Ring>> rings;
+	std::vector<uint64_t> consumed;
+	std::vector<Ring *> finished;
+	uint64_t reportedDrops = 0;
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_ringsMutex);
+			rings = m_rings;
+		}
+		consumed.assign(rings.size(), 0);
+		size_t count = 0;
+		for (size_t i = 0; i < rings.size(); ++i)
+		{
+			Ring &ring = *rings[i];
+			// Read before the tail: once the owner has exited, the tail seen next is its last
+			bool retired = ring.retired.load(std::memory_order_acquire);
+			uint64_t head = ring.head.load(std::memory_order_relaxed);
+			uint64_t tail = ring.tail.load(std::memory_order_acquire);
+			for (; head != tail; ++head)
+			{
+				formatRecord(ring.slots[head & (RING_CAPACITY - 1)], batch);
+				++count;
+			}
+			// Slots are free once formatted; producers can refill them during the write
+			ring.head.store(head, std::memory_order_release);
+			consumed[i] = head;
+			if (retired)
+			{
+				finished.push_back(&ring);
+			}
+		}
+		if (!finished.empty())
+		{
+			// The local snapshot keeps these alive until their written counts are published below
+			std::lock_guard<std::mutex> lock(m_ringsMutex);
+			m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [&finished](const std::shared_ptr<Ring> &ring)
+																	 { return std::find(finished.begin(), finished.end(), ring.get()) != finished.end(); }),
+										m_rings.end());
+			finished.clear();
+		}
+		uint64_t drops = m_dropped.load(std::memory_order_relaxed);
+		if (drops != reportedDrops)
+		{
+			char line[96];
+			snprintf(line, sizeof(line), "[Logger] %llu records dropped (ring full)\n",
+							 static_cast<unsigned long long>(drops - reportedDrops));
+			batch += line;
+			reportedDrops = drops;
+		}
+		if (!batch.empty())
+		{
+			writeAll(m_fd, batch);
+			batch.clear();
+		}
+		if (count)
+		{
+			m_written.fetch_add(count, std::memory_order_relaxed);
+			{
+				std::lock_guard<std::mutex> lock(m_flushMutex);
+				for (size_t i = 0; i < rings.size(); ++i)
+				{
+					rings[i]->written.store(consumed[i], std::memory_order_release);
+				}
+			}
+			m_flushCondition.notify_all();
+			continue;
+		}
+		if (m_stopRequested.load())
+		{
+			break;
+		}
+
+		m_consumerSleeping.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool pending = false;
+		for (const auto &ring : rings)
+		{
+			pending |= ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_relaxed);
+		}
+		{
+			// A ring registered after the snapshot may already hold records; one may also have replaced a retired one
+			std::lock_guard<std::mutex> lock(m_ringsMutex);
+			pending |= m_rings != rings;
+		}
+		if (!pending)
+		{
+			pollfd pfd = {m_wakeFd, POLLIN, 0};
+			while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+			{
+			}
+			uint64_t value = 0;
+			ssize_t drained = read(m_wakeFd, &value, sizeof(value));
+			(void)drained;
+		}
+		m_consumerSleeping.store(false);
+	}
+}
+
+void Logger::formatRecord(const Record &record, std::string &out)
+{
+	char buffer[512];
+	int64_t ticks = record.timestamp;
+	std::chrono::system_clock::duration since(ticks);
+	auto micros = std::chrono::duration_cast<std::chrono::microseconds>(since).count();
+	time_t seconds = static_cast<time_t>(micros / 1000000);
+	tm local;
+	localtime_r(&seconds, &local);
+	int length = snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d.%06lld %s [%s] ",
+												local.tm_hour, local.tm_min, local.tm_sec,
+												static_cast<long long>(micros % 1000000), levelName(record.level), record.tag);
+	if (length > 0)
+	{
+		out.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+	}
+
+	size_t argIndex = 0;
+	for (const char *p = record.format; *p; ++p)
+	{
+		if (*p != '%')
+		{
+			out += *p;
+			continue;
+		}
+		if (p[1] == '%')
+		{
+			out += '%';
+			++p;
+			continue;
+		}
+		// Keep flags, width and precision; the argument's recorded type picks the length modifier
+		std::string spec = "%";
+		const char *q = p + 1;
+		while (*q && strchr("-+ #0123456789.", *q))
+		{
+			spec += *q++;
+		}
+		while (*q && strchr("hlLqjzt", *q))
+		{
+			++q;
+		}
+		char conversion = *q;
+		if (!conversion)
+		{
+			out.append(p);
+			break;
+		}
+		p = q;
+		if (argIndex >= record.argCount)
+		{
+			out += spec;
+			out += conversion;
+			continue;
+		}
+		const Arg &arg = record.args[argIndex++];
+		length = 0;
+		switch (arg.type)
+		{
+		case Arg::Type::INT:
+		case Arg::Type::UINT:
+		{
+			long long signedValue = arg.type == Arg::Type::INT ? static_cast<long long>(arg.i) : static_cast<long long>(arg.u);
+			unsigned long long unsignedValue = arg.type == Arg::Type::INT ? static_cast<unsigned long long>(arg.i) : static_cast<unsigned long long>(arg.u);
+			if (conversion == 'c')
+			{
+				length = snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), static_cast<int>(signedValue));
+			}
+			else if (strchr("ouxX", conversion))
+			{
+				length = snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), unsignedValue);
+			}
+			else if (strchr("fFeEgGaA", conversion))
+			{
+				length = snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), static_cast<double>(signedValue));
+			}
+			else if (arg.type == Arg::Type::UINT)
+			{
+				length = snprintf(buffer, sizeof(buffer), (spec + "llu").c_str(), unsignedValue);
+			}
+			else
+			{
+				length = snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(), signedValue);
+			}
+			break;
+		}
+		case Arg::Type::DOUBLE:
+			if (strchr("fFeEgGaA", conversion))
+			{
+				length = snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), arg.d);
+			}
+			else
+			{
+				length = snprintf(buffer, sizeof(buffer), (spec + "g").c_str(), arg.d);
+			}
+			break;
+		case Arg::Type::TEXT:
+			length = snprintf(buffer, sizeof(buffer), (spec + "s").c_str(),
+												arg.textOffset < TEXT_BYTES ? record.text + arg.textOffset : "");
+			break;
+		}
+		if (length > 0)
+		{
+			out.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+		}
+	}
+	out += '\n';
+}
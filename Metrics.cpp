@@ -0,0 +1,353 @@
+#include "Metrics.h"
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+constexpr int Histogram::SUB_BUCKET_BITS;
+constexpr size_t Histogram::SUB_BUCKETS;
+constexpr size_t Histogram::BUCKET_COUNT;
+
+namespace
+{
+	const double REPORTED_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+	uint64_t cpuTimeUs(clockid_t clock)
+	{
+		timespec ts;
+		if (clock_gettime(clock, &ts) != 0)
+		{
+			return 0;
+		}
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000 + static_cast<uint64_t>(ts.tv_nsec) / 1000;
+	}
+
+	void appendLine(std::string &out, const std::string &name, const char *suffix, uint64_t value)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), " %llu\n", static_cast<unsigned long long>(value));
+		out += name;
+		out += suffix;
+		out += buffer;
+	}
+}
+
+Histogram::Histogram()
+{
+	for (auto &bucket : m_buckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+uint64_t Histogram::count() const
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::sum() const
+{
+	return m_sum.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::max() const
+{
+	return m_max.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::percentile(double quantile) const
+{
+	uint64_t total = count();
+	if (total == 0)
+	{
+		return 0;
+	}
+	quantile = std::min(1.0, std::max(0.0, quantile));
+	uint64_t rank = static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(total)));
+	rank = std::max<uint64_t>(rank, 1);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		seen += m_buckets[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+		{
+			// The bucket bound may overstate the largest sample actually seen
+			return std::min(bucketUpperBound(i), max());
+		}
+	}
+	// Buckets were still being updated while we read them
+	return max();
+}
+
+uint64_t Histogram::bucketUpperBound(size_t index)
+{
+	if (index < SUB_BUCKETS)
+	{
+		return index;
+	}
+	int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+	uint64_t mantissa = SUB_BUCKETS + index % SUB_BUCKETS;
+	// Wraps to UINT64_MAX for the top bucket
+	return ((mantissa + 1) << shift) - 1;
+}
+
+MetricsRegistry::ThreadScope::ThreadScope(const std::string &name)
+{
+	MetricsRegistry::instance().registerThread(name);
+}
+
+MetricsRegistry::ThreadScope::~ThreadScope()
+{
+	MetricsRegistry::instance().unregisterThread();
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+	// Never destroyed: device threads keep references to their metrics until the process exits
+	static MetricsRegistry *registry = new MetricsRegistry();
+	return *registry;
+}
+
+Counter &MetricsRegistry::counter(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto &slot = m_counters[name];
+	if (!slot)
+	{
+		slot.reset(new Counter());
+	}
+	return *slot;
+}
+
+Histogram &MetricsRegistry::histogram(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto &slot = m_histograms[name];
+	if (!slot)
+	{
+		slot.reset(new Histogram());
+	}
+	return *slot;
+}
+
+void MetricsRegistry::registerThread(const std::string &name)
+{
+	clockid_t clock;
+	if (pthread_getcpuclockid(pthread_self(), &clock) != 0)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_threads[std::this_thread::get_id()] = {name, clock};
+}
+
+void MetricsRegistry::unregisterThread()
+{
+	// CPU time is read under the lock so render() never samples a clock of an exited thread
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_threads.find(std::this_thread::get_id());
+	if (it == m_threads.end())
+	{
+		return;
+	}
+	m_exitedThreadCpuUs[it->second.name] += cpuTimeUs(it->second.clock);
+	m_threads.erase(it);
+}
+
+std::string MetricsRegistry::render() const
+{
+	std::string out;
+	out.reserve(4096);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (const auto &entry : m_counters)
+	{
+		appendLine(out, entry.first, "", entry.second->value());
+	}
+	for (const auto &entry : m_histograms)
+	{
+		const Histogram &histogram = *entry.second;
+		appendLine(out, entry.first, "_count", histogram.count());
+		appendLine(out, entry.first, "_sum", histogram.sum());
+		appendLine(out, entry.first, "_max", histogram.max());
+		for (double quantile : REPORTED_QUANTILES)
+		{
+			char suffix[32];
+			snprintf(suffix, sizeof(suffix), "{quantile=\"%g\"}", quantile);
+			appendLine(out, entry.first, suffix, histogram.percentile(quantile));
+		}
+	}
+
+	// Threads of the same name (e.g. restarted ones) are summed
+	std::map<std::string, uint64_t> cpu = m_exitedThreadCpuUs;
+	for (const auto &entry : m_threads)
+	{
+		cpu[entry.second.name] += cpuTimeUs(entry.second.clock);
+	}
+	for (const auto &entry : cpu)
+	{
+		appendLine(out, "thread_cpu_us{thread=\"" + entry.first + "\"}", "", entry.second);
+	}
+	return out;
+}
+
+MetricsServer::MetricsServer(MetricsRegistry &registry, const std::string &socketPath)
+		: m_registry(registry), m_socketPath(socketPath)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+	stop();
+}
+
+bool MetricsServer::open()
+{
+	if (m_listenFd >= 0)
+	{
+		return true;
+	}
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (m_socketPath.empty() || m_socketPath.size() >= sizeof(address.sun_path))
+	{
+		return false;
+	}
+	strncpy(address.sun_path, m_socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+	// A previous run that was killed leaves its socket file behind
+	unlink(m_socketPath.c_str());
+	if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 8) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	m_listenFd = fd;
+	return true;
+}
+
+bool MetricsServer::start()
+{
+	if (m_serverThread)
+	{
+		return true;
+	}
+	if (!open())
+	{
+		return false;
+	}
+	m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_stopFd < 0)
+	{
+		stop();
+		return false;
+	}
+	m_serverThread = std::make_unique<std::thread>(&MetricsServer::serverThread, this);
+	return true;
+}
+
+void MetricsServer::stop()
+{
+	if (m_serverThread)
+	{
+		uint64_t one = 1;
+		ssize_t written = write(m_stopFd, &one, sizeof(one));
+		(void)written;
+		if (m_serverThread->joinable())
+		{
+			m_serverThread->join();
+		}
+		m_serverThread.reset();
+	}
+	if (m_stopFd >= 0)
+	{
+		close(m_stopFd);
+		m_stopFd = -1;
+	}
+	if (m_listenFd >= 0)
+	{
+		close(m_listenFd);
+		m_listenFd = -1;
+		unlink(m_socketPath.c_str());
+	}
+}
+
+int MetricsServer::getListenFd() const
+{
+	return m_listenFd;
+}
+
+int MetricsServer::servePending()
+{
+	int served = 0;
+	while (m_listenFd >= 0)
+	{
+		int client = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (client < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		// The report fits in the socket buffer; a client that does not read gets a partial report
+		std::string report = m_registry.render();
+		int flags = fcntl(client, F_GETFL);
+		fcntl(client, F_SETFL, flags | O_NONBLOCK);
+		size_t offset = 0;
+		while (offset < report.size())
+		{
+			ssize_t written = send(client, report.data() + offset, report.size() - offset, MSG_NOSIGNAL);
+			if (written < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (written <= 0)
+			{
+				break;
+			}
+			offset += static_cast<size_t>(written);
+		}
+		close(client);
+		++served;
+	}
+	return served;
+}
+
+void MetricsServer::serverThread()
+{
+	MetricsRegistry::ThreadScope scope("metrics_server");
+	pollfd fds[2] = {{m_listenFd, POLLIN, 0}, {m_stopFd, POLLIN, 0}};
+	while (true)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		if (fds[1].revents)
+		{
+			break;
+		}
+		if (fds[0].revents & POLLIN)
+		{
+			servePending();
+		}
+	}
+}
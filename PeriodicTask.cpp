@@ -0,0 +1,200 @@
+#include "PeriodicTask.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+
+namespace
+{
+	constexpr int64_t NS_PER_SECOND = 1000000000;
+
+	int64_t monotonicNs()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<int64_t>(ts.tv_sec) * NS_PER_SECOND + ts.tv_nsec;
+	}
+
+	timespec toTimespec(int64_t ns)
+	{
+		timespec ts;
+		ts.tv_sec = static_cast<time_t>(ns / NS_PER_SECOND);
+		ts.tv_nsec = static_cast<long>(ns % NS_PER_SECOND);
+		return ts;
+	}
+}
+
+PeriodicTask::PeriodicTask(const std::string &name, std::chrono::nanoseconds period, Clock &clock)
+		: m_name(name), m_period(std::max(period, std::chrono::nanoseconds(1))), m_clock(clock),
+			m_stats(Stats{0, 0, 0, std::chrono::microseconds::zero(), std::chrono::microseconds::zero(), std::chrono::microseconds::zero()}),
+			m_activationCount(MetricsRegistry::instance().counter(name + "_task_activations_total")),
+			m_missedCount(MetricsRegistry::instance().counter(name + "_task_missed_deadlines_total")),
+			m_overrunCount(MetricsRegistry::instance().counter(name + "_task_overruns_total")),
+			m_jitter(MetricsRegistry::instance().histogram(name + "_task_jitter_us")),
+			m_runTime(MetricsRegistry::instance().histogram(name + "_task_run_us"))
+{
+	// Without these the task still keeps its grid with clock_nanosleep, but stop() waits out the sleep
+	m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	// Virtual time must not run ahead of the thread that is about to call run()
+	m_clock.attach();
+}
+
+PeriodicTask::~PeriodicTask()
+{
+	if (!m_slotTaken.exchange(true))
+	{
+		m_clock.detach();
+	}
+	if (m_timerFd >= 0)
+	{
+		close(m_timerFd);
+	}
+	if (m_stopFd >= 0)
+	{
+		close(m_stopFd);
+	}
+}
+
+void PeriodicTask::run(const std::function<void()> &body)
+{
+	const int64_t period = m_period.count();
+	bool bound = !m_slotTaken.exchange(true);
+	if (bound)
+	{
+		m_clock.bindThread();
+	}
+	Stats stats = m_stats.load();
+	int64_t release = nowNs();
+	while (!m_stopRequested.load())
+	{
+		int64_t woke = nowNs();
+		if (woke - release >= period)
+		{
+			// Releases that passed entirely are dropped; the latest one runs now
+			int64_t skipped = (woke - release) / period;
+			release += skipped * period;
+			stats.missedDeadlines += static_cast<uint64_t>(skipped);
+			m_missedCount.increment(static_cast<uint64_t>(skipped));
+		}
+		int64_t jitterNs = std::max<int64_t>(woke - release, 0);
+
+		body();
+
+		int64_t finished = nowNs();
+		int64_t runNs = finished - woke;
+		release += period;
+		if (finished > release)
+		{
+			++stats.overruns;
+			m_overrunCount.increment();
+		}
+		++stats.activations;
+		stats.lastJitter = std::chrono::microseconds(jitterNs / 1000);
+		stats.maxJitter = std::max(stats.maxJitter, stats.lastJitter);
+		stats.maxRunTime = std::max(stats.maxRunTime, std::chrono::microseconds(runNs / 1000));
+		m_stats.store(stats);
+		m_activationCount.increment();
+		m_jitter.record(static_cast<uint64_t>(jitterNs / 1000));
+		m_runTime.record(static_cast<uint64_t>(runNs / 1000));
+
+		if (!waitUntil(release))
+		{
+			break;
+		}
+	}
+	if (bound)
+	{
+		m_clock.unbindThread();
+	}
+}
+
+void PeriodicTask::stop()
+{
+	m_stopRequested.store(true);
+	if (m_stopFd >= 0)
+	{
+		uint64_t one = 1;
+		ssize_t written = write(m_stopFd, &one, sizeof(one));
+		(void)written;
+	}
+	m_clock.interrupt();
+}
+
+bool PeriodicTask::isStopped() const
+{
+	return m_stopRequested.load();
+}
+
+PeriodicTask::Stats PeriodicTask::getStats() const
+{
+	return m_stats.load();
+}
+
+std::chrono::nanoseconds PeriodicTask::getPeriod() const
+{
+	return m_period;
+}
+
+int64_t PeriodicTask::nowNs()
+{
+	if (!m_clock.isVirtual())
+	{
+		return monotonicNs();
+	}
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(m_clock.now().time_since_epoch()).count();
+}
+
+bool PeriodicTask::waitUntil(int64_t releaseNs)
+{
+	if (m_clock.isVirtual())
+	{
+		// The timerfd runs on CLOCK_MONOTONIC; a virtual release is a sleep on the clock itself
+		Clock::time_point release{std::chrono::nanoseconds(releaseNs)};
+		return m_clock.sleepUntil(release, &m_stopRequested) && !m_stopRequested.load();
+	}
+	timespec deadline = toTimespec(releaseNs);
+	if (m_timerFd < 0 || m_stopFd < 0)
+	{
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+		{
+		}
+		return !m_stopRequested.load();
+	}
+
+	// A release already in the past fires immediately
+	itimerspec spec = {};
+	spec.it_value = deadline;
+	timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+	pollfd fds[2] = {{m_timerFd, POLLIN, 0}, {m_stopFd, POLLIN, 0}};
+	while (true)
+	{
+		int ready = poll(fds, 2, -1);
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			// Poll is unusable; fall back to sleeping so the grid still holds
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+			{
+			}
+			return !m_stopRequested.load();
+		}
+		if (fds[1].revents)
+		{
+			return false;
+		}
+		if (fds[0].revents & POLLIN)
+		{
+			uint64_t expirations;
+			ssize_t drained = read(m_timerFd, &expirations, sizeof(expirations));
+			(void)drained;
+			return !m_stopRequested.load();
+		}
+	}
+}
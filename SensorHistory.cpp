@@ -0,0 +1,296 @@
+#include "SensorHistory.h"
+#include <algorithm>
+#include <ctime>
+
+constexpr size_t SensorHistory::TIER_COUNT;
+
+namespace
+{
+	// Days since 1970-01-01 of a civil date (proleptic Gregorian)
+	int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+	{
+		year -= month <= 2;
+		const int64_t era = (year >= 0 ? year : year - 399) / 400;
+		const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+		const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+		const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+		return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+	}
+
+	int64_t floorDiv(int64_t value, int64_t divisor)
+	{
+		return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+	}
+}
+
+SensorHistory::SensorHistory(const Config &config)
+		: m_raw(std::max<size_t>(config.rawSamples, 1))
+{
+	const size_t capacities[TIER_COUNT] = {config.minutes, config.hours, config.days};
+	for (size_t tier = 0; tier < TIER_COUNT; ++tier)
+	{
+		TierState &state = m_tiers[tier];
+		size_t capacity = std::max<size_t>(capacities[tier], 1);
+		state.buckets.assign(capacity, Bucket{INT64_MIN, 0, 0, 0, 0, 0, 0, 0});
+		for (MonotonicQueue &queue : state.extremes)
+		{
+			queue.slots.assign(capacity, 0);
+		}
+	}
+}
+
+void SensorHistory::add(std::chrono::system_clock::time_point time, int temperature, int humidity)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_raw[m_rawNext] = {time, temperature, humidity};
+	m_rawNext = (m_rawNext + 1) % m_raw.size();
+	++m_sampleCount;
+
+	for (size_t tier = 0; tier < TIER_COUNT; ++tier)
+	{
+		TierState &state = m_tiers[tier];
+		// Most readings land in the current bucket, which costs one comparison
+		if (state.current == INT64_MIN || time >= state.end)
+		{
+			std::chrono::system_clock::time_point start;
+			std::chrono::system_clock::time_point end;
+			int64_t index = locate(static_cast<Tier>(tier), time, start, end);
+			if (index > state.current)
+			{
+				advance(state, index);
+				state.start = start;
+				state.end = end;
+			}
+		}
+		Bucket &bucket = state.buckets[static_cast<size_t>(state.current) % state.buckets.size()];
+		if (bucket.count == 0)
+		{
+			bucket.minTemperature = bucket.maxTemperature = temperature;
+			bucket.minHumidity = bucket.maxHumidity = humidity;
+		}
+		++bucket.count;
+		bucket.temperatureSum += temperature;
+		bucket.humiditySum += humidity;
+		bucket.minTemperature = std::min(bucket.minTemperature, temperature);
+		bucket.maxTemperature = std::max(bucket.maxTemperature, temperature);
+		bucket.minHumidity = std::min(bucket.minHumidity, humidity);
+		bucket.maxHumidity = std::max(bucket.maxHumidity, humidity);
+	}
+}
+
+SensorHistory::Summary SensorHistory::current(Tier tier) const
+{
+	return bucket(tier, 0);
+}
+
+SensorHistory::Summary SensorHistory::window(Tier tier) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const TierState &state = m_tiers[static_cast<size_t>(tier)];
+	Summary summary = {};
+	if (state.current == INT64_MIN)
+	{
+		return summary;
+	}
+	const size_t capacity = state.buckets.size();
+	const Bucket &latest = state.buckets[static_cast<size_t>(state.current) % capacity];
+	summary.count = state.count + latest.count;
+	if (summary.count == 0)
+	{
+		return summary;
+	}
+	int extremes[EXTREME_COUNT];
+	for (int extreme = 0; extreme < EXTREME_COUNT; ++extreme)
+	{
+		const MonotonicQueue &queue = state.extremes[extreme];
+		// The front of each queue is the extreme of the completed buckets in the window
+		const Bucket *best = queue.size > 0 ? &state.buckets[static_cast<size_t>(queue.slots[queue.head]) % capacity] : &latest;
+		int value = extremeOf(*best, static_cast<Extreme>(extreme));
+		if (latest.count > 0)
+		{
+			int candidate = extremeOf(latest, static_cast<Extreme>(extreme));
+			value = (extreme == MIN_TEMPERATURE || extreme == MIN_HUMIDITY) ? std::min(value, candidate) : std::max(value, candidate);
+		}
+		extremes[extreme] = value;
+	}
+	summary.minTemperature = extremes[MIN_TEMPERATURE];
+	summary.maxTemperature = extremes[MAX_TEMPERATURE];
+	summary.minHumidity = extremes[MIN_HUMIDITY];
+	summary.maxHumidity = extremes[MAX_HUMIDITY];
+	summary.meanTemperature = static_cast<double>(state.temperatureSum + latest.temperatureSum) / summary.count;
+	summary.meanHumidity = static_cast<double>(state.humiditySum + latest.humiditySum) / summary.count;
+	return summary;
+}
+
+SensorHistory::Summary SensorHistory::bucket(Tier tier, size_t ago) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const TierState &state = m_tiers[static_cast<size_t>(tier)];
+	const size_t capacity = state.buckets.size();
+	if (state.current == INT64_MIN || ago >= capacity)
+	{
+		return Summary();
+	}
+	int64_t index = state.current - static_cast<int64_t>(ago);
+	const Bucket &slot = state.buckets[static_cast<size_t>(index) % capacity];
+	return slot.index == index ? summarize(slot) : Summary();
+}
+
+size_t SensorHistory::rawSamples(Sample *out, size_t max) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t stored = static_cast<size_t>(std::min<uint64_t>(m_sampleCount, m_raw.size()));
+	size_t count = std::min(stored, max);
+	size_t first = (m_rawNext + m_raw.size() - count) % m_raw.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		out[i] = m_raw[(first + i) % m_raw.size()];
+	}
+	return count;
+}
+
+uint64_t SensorHistory::getSampleCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_sampleCount;
+}
+
+size_t SensorHistory::memoryFootprint() const
+{
+	size_t bytes = sizeof(*this) + m_raw.capacity() * sizeof(Sample);
+	for (const TierState &state : m_tiers)
+	{
+		bytes += state.buckets.capacity() * sizeof(Bucket);
+		for (const MonotonicQueue &queue : state.extremes)
+		{
+			bytes += queue.slots.capacity() * sizeof(int64_t);
+		}
+	}
+	return bytes;
+}
+
+int64_t SensorHistory::locate(Tier tier, std::chrono::system_clock::time_point time,
+															std::chrono::system_clock::time_point &start, std::chrono::system_clock::time_point &end)
+{
+	using std::chrono::system_clock;
+	if (tier != Tier::DAY)
+	{
+		const int64_t width = tier == Tier::MINUTE ? 60 : 3600;
+		int64_t seconds = std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+		int64_t index = floorDiv(seconds, width);
+		start = system_clock::time_point(std::chrono::seconds(index * width));
+		end = start + std::chrono::seconds(width);
+		return index;
+	}
+	// Days follow local midnight, so they are 23 or 25 hours long across a DST change
+	std::time_t seconds = system_clock::to_time_t(time);
+	std::tm local = {};
+	localtime_r(&seconds, &local);
+	int64_t index = daysFromCivil(local.tm_year + 1900, static_cast<unsigned>(local.tm_mon + 1), static_cast<unsigned>(local.tm_mday));
+	local.tm_hour = 0;
+	local.tm_min = 0;
+	local.tm_sec = 0;
+	local.tm_isdst = -1;
+	start = system_clock::from_time_t(std::mktime(&local));
+	local.tm_mday += 1;
+	local.tm_isdst = -1;
+	end = system_clock::from_time_t(std::mktime(&local));
+	return index;
+}
+
+void SensorHistory::advance(TierState &state, int64_t next)
+{
+	const size_t capacity = state.buckets.size();
+	if (state.current != INT64_MIN)
+	{
+		const Bucket &completed = state.buckets[static_cast<size_t>(state.current) % capacity];
+		if (completed.count > 0)
+		{
+			state.count += completed.count;
+			state.temperatureSum += completed.temperatureSum;
+			state.humiditySum += completed.humiditySum;
+			for (int extreme = 0; extreme < EXTREME_COUNT; ++extreme)
+			{
+				MonotonicQueue &queue = state.extremes[extreme];
+				bool keepSmaller = extreme == MIN_TEMPERATURE || extreme == MIN_HUMIDITY;
+				int value = extremeOf(completed, static_cast<Extreme>(extreme));
+				// Buckets that can no longer be the extreme before they expire are dropped from the back
+				while (queue.size > 0)
+				{
+					size_t back = (queue.head + queue.size - 1) % capacity;
+					int other = extremeOf(state.buckets[static_cast<size_t>(queue.slots[back]) % capacity], static_cast<Extreme>(extreme));
+					if (keepSmaller ? other < value : other > value)
+					{
+						break;
+					}
+					--queue.size;
+				}
+				queue.slots[(queue.head + queue.size) % capacity] = state.current;
+				++queue.size;
+			}
+		}
+
+		// Buckets numbered below oldest leave the window once next opens
+		int64_t oldest = next - static_cast<int64_t>(capacity) + 1;
+		if (oldest > state.current)
+		{
+			state.count = 0;
+			state.temperatureSum = 0;
+			state.humiditySum = 0;
+		}
+		else
+		{
+			for (int64_t index = state.current - static_cast<int64_t>(capacity) + 1; index < oldest; ++index)
+			{
+				const Bucket &expired = state.buckets[static_cast<size_t>(index) % capacity];
+				if (expired.index == index)
+				{
+					state.count -= expired.count;
+					state.temperatureSum -= expired.temperatureSum;
+					state.humiditySum -= expired.humiditySum;
+				}
+			}
+		}
+		for (MonotonicQueue &queue : state.extremes)
+		{
+			while (queue.size > 0 && queue.slots[queue.head] < oldest)
+			{
+				queue.head = (queue.head + 1) % capacity;
+				--queue.size;
+			}
+		}
+	}
+	state.current = next;
+	state.buckets[static_cast<size_t>(next) % capacity] = Bucket{next, 0, 0, 0, 0, 0, 0, 0};
+}
+
+int SensorHistory::extremeOf(const Bucket &bucket, Extreme extreme)
+{
+	switch (extreme)
+	{
+	case MIN_TEMPERATURE:
+		return bucket.minTemperature;
+	case MAX_TEMPERATURE:
+		return bucket.maxTemperature;
+	case MIN_HUMIDITY:
+		return bucket.minHumidity;
+	default:
+		return bucket.maxHumidity;
+	}
+}
+
+SensorHistory::Summary SensorHistory::summarize(const Bucket &bucket)
+{
+	Summary summary = {};
+	summary.count = bucket.count;
+	if (bucket.count > 0)
+	{
+		summary.minTemperature = bucket.minTemperature;
+		summary.maxTemperature = bucket.maxTemperature;
+		summary.minHumidity = bucket.minHumidity;
+		summary.maxHumidity = bucket.maxHumidity;
+		summary.meanTemperature = static_cast<double>(bucket.temperatureSum) / bucket.count;
+		summary.meanHumidity = static_cast<double>(bucket.humiditySum) / bucket.count;
+	}
+	return summary;
+}
@@ -0,0 +1,780 @@
+#include "SensorLog.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	const char MAGIC[8] = {'S', 'C', 'L', 'O', 'G', '0', '0', '1'};
+	// Data starts here; the header itself is smaller
+	constexpr size_t HEADER_SIZE = 128;
+	// Kind byte, time delta and two value deltas at their longest
+	constexpr size_t MAX_RECORD_SIZE = 1 + 10 + 2 * 5;
+	constexpr uint8_t KIND_FIRST = static_cast<uint8_t>(SensorLog::Kind::SENSOR);
+	constexpr uint8_t KIND_LAST = static_cast<uint8_t>(SensorLog::Kind::BUZZER);
+
+	// Written once, when the segment is full; a segment without one is read batch by batch to its end
+	struct SealRecord
+	{
+		uint32_t length; // Data bytes, batch headers included
+		uint32_t records;
+		int64_t minTimeMs;
+		int64_t maxTimeMs;
+		uint32_t reserved;
+		uint32_t sealCrc; // CRC-32 of the fields above
+	};
+
+	// Written once, before the segment file gets its final name
+	struct SegmentHeader
+	{
+		char magic[8];
+		uint64_t sequence;
+		int64_t baseTimeMs; // Time of the first record
+		uint32_t segmentSize;
+		uint32_t headerCrc; // CRC-32 of the fields above
+		SealRecord seal;
+	};
+
+	// Precedes each batch of records; reserved as zeros and filled in when the batch is committed
+	struct BatchHeader
+	{
+		uint32_t length; // Record bytes in the batch, 0 while it is open
+		uint32_t crc;		 // CRC-32 of the record bytes
+	};
+	static_assert(sizeof(SealRecord) == 32, "seal layout is part of the file format");
+	static_assert(sizeof(SegmentHeader) <= HEADER_SIZE, "segment header must fit before the data");
+
+	// Previous record of the segment; every record is stored as the difference from it
+	struct DeltaState
+	{
+		int64_t timeMs;
+		int32_t values[KIND_LAST + 1][2]; // Last values of each kind
+	};
+
+	std::string describe(const std::string &what)
+	{
+		return what + ": " + strerror(errno);
+	}
+
+	uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length)
+	{
+		static const std::array<uint32_t, 256> table = []
+		{
+			std::array<uint32_t, 256> entries;
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t value = i;
+				for (int bit = 0; bit < 8; ++bit)
+				{
+					value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+				}
+				entries[i] = value;
+			}
+			return entries;
+		}();
+		crc = ~crc;
+		for (size_t i = 0; i < length; ++i)
+		{
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	template <typename T>
+	uint32_t crcUpTo(const T &object, size_t offset)
+	{
+		return crc32(0, reinterpret_cast<const uint8_t *>(&object), offset);
+	}
+
+	int64_t toMilliseconds(std::chrono::system_clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+	}
+
+	uint64_t zigzag(int64_t value)
+	{
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+
+	int64_t unzigzag(uint64_t value)
+	{
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	size_t putVarint(uint8_t *out, uint64_t value)
+	{
+		size_t length = 0;
+		while (value >= 0x80)
+		{
+			out[length++] = static_cast<uint8_t>(value | 0x80);
+			value >>= 7;
+		}
+		out[length++] = static_cast<uint8_t>(value);
+		return length;
+	}
+
+	bool getVarint(const uint8_t *&cursor, const uint8_t *end, uint64_t &value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && cursor < end; shift += 7)
+		{
+			uint8_t byte = *cursor++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	size_t valueCount(uint8_t kind)
+	{
+		return kind == static_cast<uint8_t>(SensorLog::Kind::SENSOR) ? 2 : 1;
+	}
+
+	void resetState(DeltaState &state, int64_t baseTimeMs)
+	{
+		state.timeMs = baseTimeMs;
+		std::memset(state.values, 0, sizeof(state.values));
+	}
+
+	size_t encodeRecord(DeltaState &state, uint8_t kind, int64_t timeMs, const int32_t *values, uint8_t *out)
+	{
+		size_t length = 0;
+		out[length++] = kind;
+		length += putVarint(out + length, zigzag(timeMs - state.timeMs));
+		state.timeMs = timeMs;
+		for (size_t i = 0; i < valueCount(kind); ++i)
+		{
+			length += putVarint(out + length, zigzag(static_cast<int64_t>(values[i]) - state.values[kind][i]));
+			state.values[kind][i] = values[i];
+		}
+		return length;
+	}
+
+	bool decodeRecord(DeltaState &state, const uint8_t *&cursor, const uint8_t *end, SensorLog::Record &record)
+	{
+		uint8_t kind = *cursor++;
+		uint64_t delta;
+		if (kind < KIND_FIRST || kind > KIND_LAST || !getVarint(cursor, end, delta))
+		{
+			return false;
+		}
+		state.timeMs += unzigzag(delta);
+		record.kind = static_cast<SensorLog::Kind>(kind);
+		record.time = std::chrono::system_clock::time_point(
+				std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(state.timeMs)));
+		record.values[1] = 0;
+		for (size_t i = 0; i < valueCount(kind); ++i)
+		{
+			if (!getVarint(cursor, end, delta))
+			{
+				return false;
+			}
+			state.values[kind][i] = static_cast<int32_t>(state.values[kind][i] + unzigzag(delta));
+			record.values[i] = state.values[kind][i];
+		}
+		return true;
+	}
+
+	bool validHeader(const SegmentHeader &header, size_t fileSize)
+	{
+		return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.headerCrc == crcUpTo(header, offsetof(SegmentHeader, headerCrc)) && header.segmentSize == fileSize;
+	}
+
+	bool readSeal(const SegmentHeader &header, size_t fileSize, SealRecord &seal)
+	{
+		std::memcpy(&seal, &header.seal, sizeof(seal));
+		return seal.sealCrc == crcUpTo(seal, offsetof(SealRecord, sealCrc)) && seal.length <= fileSize - HEADER_SIZE;
+	}
+
+	// Decodes the committed batches of a segment in order; stops at the first open, torn or malformed one
+	template <typename Visitor>
+	size_t forEachCommitted(const uint8_t *data, size_t capacity, DeltaState &state, Visitor visit)
+	{
+		size_t offset = 0;
+		SensorLog::Record record;
+		while (offset + sizeof(BatchHeader) <= capacity)
+		{
+			BatchHeader batch;
+			std::memcpy(&batch, data + offset, sizeof(batch));
+			const uint8_t *cursor = data + offset + sizeof(batch);
+			if (batch.length == 0 || batch.length > capacity - offset - sizeof(batch) || crc32(0, cursor, batch.length) != batch.crc)
+			{
+				break;
+			}
+			// A batch that passes its CRC was written whole by the encoder, so it decodes to its end
+			const uint8_t *end = cursor + batch.length;
+			while (cursor < end)
+			{
+				if (!decodeRecord(state, cursor, end, record) || !visit(record, state.timeMs))
+				{
+					return offset;
+				}
+			}
+			offset += sizeof(batch) + batch.length;
+		}
+		return offset;
+	}
+
+	std::string segmentName(uint64_t sequence)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "segment-%016llx.log", static_cast<unsigned long long>(sequence));
+		return name;
+	}
+
+	// Sequence numbers of the segment files in a directory, ascending; optionally deletes half-created ones
+	bool listSegments(const std::string &directory, std::vector<uint64_t> &sequences, bool removeTemporary)
+	{
+		DIR *dir = opendir(directory.c_str());
+		if (!dir)
+		{
+			return false;
+		}
+		const std::string prefix = "segment-";
+		const std::string suffix = ".log";
+		while (dirent *entry = readdir(dir))
+		{
+			std::string name = entry->d_name;
+			if (name.compare(0, prefix.size(), prefix) != 0)
+			{
+				continue;
+			}
+			if (removeTemporary && name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+			{
+				unlink((directory + "/" + name).c_str());
+				continue;
+			}
+			if (name.size() != prefix.size() + 16 + suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+			{
+				continue;
+			}
+			std::string digits = name.substr(prefix.size(), 16);
+			if (digits.find_first_not_of("0123456789abcdef") == std::string::npos)
+			{
+				sequences.push_back(std::strtoull(digits.c_str(), nullptr, 16));
+			}
+		}
+		closedir(dir);
+		std::sort(sequences.begin(), sequences.end());
+		return true;
+	}
+
+	// Makes a rename durable
+	void syncDirectory(const std::string &directory)
+	{
+		int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd >= 0)
+		{
+			fsync(fd);
+			::close(fd);
+		}
+	}
+
+	// Read-only view of a segment file for scanning
+	struct ReadMapping
+	{
+		int fd = -1;
+		const uint8_t *base = nullptr;
+		size_t size = 0;
+
+		~ReadMapping()
+		{
+			if (base)
+			{
+				munmap(const_cast<uint8_t *>(base), size);
+			}
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+		}
+
+		bool map(const std::string &path)
+		{
+			struct stat info;
+			fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0 || fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < HEADER_SIZE)
+			{
+				return false;
+			}
+			size = static_cast<size_t>(info.st_size);
+			void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+			if (mapped == MAP_FAILED)
+			{
+				return false;
+			}
+			base = static_cast<const uint8_t *>(mapped);
+			madvise(mapped, size, MADV_SEQUENTIAL);
+			return true;
+		}
+	};
+}
+
+struct SensorLog::Segment
+{
+	uint64_t sequence = 0;
+	int fd = -1;
+	uint8_t *base = nullptr;
+	size_t size = 0;
+	// Write state, under m_mutex
+	size_t written = 0;		 // Data bytes after the header, batch headers included
+	size_t batchStart = 0; // Header of the open batch
+	bool batchOpen = false;
+	uint32_t batchCrc = 0; // CRC-32 of the open batch's records
+	uint32_t records = 0;
+	int64_t minTimeMs = INT64_MAX;
+	int64_t maxTimeMs = INT64_MIN;
+	DeltaState state;
+	// Under m_syncMutex
+	size_t flushed = 0; // Data bytes already msynced
+
+	~Segment()
+	{
+		if (base)
+		{
+			munmap(base, size);
+		}
+		if (fd >= 0)
+		{
+			::close(fd);
+		}
+	}
+
+	SegmentHeader &header()
+	{
+		return *reinterpret_cast<SegmentHeader *>(base);
+	}
+
+	uint8_t *data()
+	{
+		return base + HEADER_SIZE;
+	}
+
+	size_t capacity() const
+	{
+		return size - HEADER_SIZE;
+	}
+
+	// Makes the records appended so far visible to readers; they become durable with the next msync
+	void closeBatch()
+	{
+		if (batchOpen)
+		{
+			BatchHeader batch = {static_cast<uint32_t>(written - batchStart - sizeof(BatchHeader)), batchCrc};
+			std::memcpy(data() + batchStart, &batch, sizeof(batch));
+			batchOpen = false;
+		}
+	}
+};
+
+SensorLog::SensorLog(const Config &config)
+		: m_config(config),
+			m_pageSize(static_cast<size_t>(sysconf(_SC_PAGESIZE))),
+			m_metrics{MetricsRegistry::instance().counter("sensor_log_records_total"),
+								MetricsRegistry::instance().counter("sensor_log_record_bytes_total"),
+								MetricsRegistry::instance().counter("sensor_log_synced_bytes_total"),
+								MetricsRegistry::instance().histogram("sensor_log_sync_us")}
+{
+	// Whole pages, room for the header and a batch, and lengths that fit the 32-bit header fields
+	size_t size = std::min<size_t>(std::max(m_config.segmentSize, 2 * m_pageSize), size_t(1) << 30);
+	m_config.segmentSize = (size + m_pageSize - 1) / m_pageSize * m_pageSize;
+	m_config.maxSegments = std::max<size_t>(m_config.maxSegments, 1);
+	m_config.syncInterval = std::max(m_config.syncInterval, std::chrono::milliseconds(1));
+}
+
+SensorLog::~SensorLog()
+{
+	close();
+}
+
+bool SensorLog::open()
+{
+	std::lock_guard<std::mutex> syncLock(m_syncMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_open)
+		{
+			return true;
+		}
+	}
+	if (m_config.directory.empty())
+	{
+		return false;
+	}
+	std::vector<uint64_t> sequences;
+	if ((mkdir(m_config.directory.c_str(), 0755) != 0 && errno != EEXIST) || !listSegments(m_config.directory, sequences, true))
+	{
+		reportError(describe("Sensor log directory " + m_config.directory + " unavailable"));
+		return false;
+	}
+	m_firstSequence = sequences.empty() ? 0 : sequences.front();
+	m_nextSequence = sequences.empty() ? 0 : sequences.back() + 1;
+	if (!sequences.empty() && !recover(sequences.back()))
+	{
+		reportError("Sensor log " + segmentPath(sequences.back()) + " is damaged, continuing in a new segment");
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats = {};
+		m_open = true;
+	}
+	m_syncTask = std::make_unique<PeriodicTask>("sensor_log_sync", m_config.syncInterval);
+	m_syncThread = std::make_unique<std::thread>(&SensorLog::syncThread, this);
+	return true;
+}
+
+void SensorLog::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_open)
+		{
+			return;
+		}
+		m_open = false;
+	}
+	if (m_syncTask)
+	{
+		m_syncTask->stop();
+	}
+	if (m_syncThread && m_syncThread->joinable())
+	{
+		m_syncThread->join();
+	}
+	m_syncThread.reset();
+	m_syncTask.reset();
+	sync();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_active.reset();
+	m_sealed.clear();
+}
+
+bool SensorLog::isOpen() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_open;
+}
+
+bool SensorLog::append(const Record &record)
+{
+	uint8_t kind = static_cast<uint8_t>(record.kind);
+	if (kind < KIND_FIRST || kind > KIND_LAST)
+	{
+		return false;
+	}
+	int64_t timeMs = toMilliseconds(record.time);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_open)
+	{
+		return false;
+	}
+	size_t needed = MAX_RECORD_SIZE + (m_active && m_active->batchOpen ? 0 : sizeof(BatchHeader));
+	if ((!m_active || m_active->written + needed > m_active->capacity()) && !createSegment(timeMs))
+	{
+		return false;
+	}
+	Segment &segment = *m_active;
+	if (!segment.batchOpen)
+	{
+		// Zeros mark the batch open for readers, whatever a crash left in this spot
+		segment.batchStart = segment.written;
+		std::memset(segment.data() + segment.batchStart, 0, sizeof(BatchHeader));
+		segment.written += sizeof(BatchHeader);
+		segment.batchCrc = 0;
+		segment.batchOpen = true;
+	}
+	uint8_t *out = segment.data() + segment.written;
+	size_t length = encodeRecord(segment.state, kind, timeMs, record.values, out);
+	segment.batchCrc = crc32(segment.batchCrc, out, length);
+	segment.written += length;
+	++segment.records;
+	segment.minTimeMs = std::min(segment.minTimeMs, timeMs);
+	segment.maxTimeMs = std::max(segment.maxTimeMs, timeMs);
+	++m_stats.records;
+	m_stats.recordBytes += length;
+	m_metrics.records.increment();
+	m_metrics.recordBytes.increment(length);
+	return true;
+}
+
+bool SensorLog::sync()
+{
+	std::lock_guard<std::mutex> syncLock(m_syncMutex);
+	std::vector<std::shared_ptr<Segment>> sealed;
+	std::shared_ptr<Segment> active;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		sealed.swap(m_sealed);
+		active = m_active;
+	}
+	// Older segments first, so a crash never leaves a gap before committed records
+	bool committed = true;
+	for (const auto &segment : sealed)
+	{
+		committed = commit(*segment, true) && committed;
+	}
+	if (active)
+	{
+		committed = commit(*active, false) && committed;
+	}
+	return committed;
+}
+
+SensorLog::Stats SensorLog::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void SensorLog::registerErrorCallback(ErrorCallback callback)
+{
+	m_errorCallback = callback;
+}
+
+uint64_t SensorLog::scan(const std::string &directory, std::chrono::system_clock::time_point from,
+												 std::chrono::system_clock::time_point to, const RecordCallback &callback)
+{
+	std::vector<uint64_t> sequences;
+	if (!listSegments(directory, sequences, false))
+	{
+		return 0;
+	}
+	const int64_t fromMs = toMilliseconds(from);
+	const int64_t toMs = toMilliseconds(to);
+	uint64_t visited = 0;
+	bool stopped = false;
+	for (size_t i = 0; i < sequences.size() && !stopped; ++i)
+	{
+		// A segment deleted by retention since the listing is skipped
+		ReadMapping mapping;
+		if (!mapping.map(directory + "/" + segmentName(sequences[i])))
+		{
+			continue;
+		}
+		const SegmentHeader &header = *reinterpret_cast<const SegmentHeader *>(mapping.base);
+		if (!validHeader(header, mapping.size))
+		{
+			continue;
+		}
+		// Sealed segments outside the range are skipped without decoding
+		SealRecord seal;
+		if (readSeal(header, mapping.size, seal) && (seal.records == 0 || seal.maxTimeMs < fromMs || seal.minTimeMs > toMs))
+		{
+			continue;
+		}
+		DeltaState state;
+		resetState(state, header.baseTimeMs);
+		forEachCommitted(mapping.base + HEADER_SIZE, mapping.size - HEADER_SIZE, state,
+										 [&](const Record &record, int64_t timeMs)
+										 {
+											 if (timeMs < fromMs || timeMs > toMs)
+											 {
+												 return true;
+											 }
+											 ++visited;
+											 stopped = !callback(record);
+											 return !stopped;
+										 });
+	}
+	return visited;
+}
+
+void SensorLog::syncThread()
+{
+	MetricsRegistry::ThreadScope scope("sensor_log");
+	// The first release is at open(), when there is nothing to commit yet
+	bool opened = true;
+	m_syncTask->run([this, &opened]
+									{
+										if (!opened)
+										{
+											sync();
+										}
+										opened = false; });
+}
+
+bool SensorLog::recover(uint64_t sequence)
+{
+	auto segment = std::make_shared<Segment>();
+	segment->sequence = sequence;
+	segment->fd = ::open(segmentPath(sequence).c_str(), O_RDWR | O_CLOEXEC);
+	struct stat info;
+	if (segment->fd < 0 || fstat(segment->fd, &info) != 0 || static_cast<size_t>(info.st_size) < HEADER_SIZE + MAX_RECORD_SIZE)
+	{
+		return false;
+	}
+	segment->size = static_cast<size_t>(info.st_size);
+	void *base = mmap(nullptr, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+	if (base == MAP_FAILED)
+	{
+		return false;
+	}
+	segment->base = static_cast<uint8_t *>(base);
+	const SegmentHeader &header = segment->header();
+	if (!validHeader(header, segment->size) || header.sequence != sequence)
+	{
+		return false;
+	}
+	SealRecord seal;
+	if (readSeal(header, segment->size, seal))
+	{
+		return true; // Full; the next record opens a new segment
+	}
+
+	// Replay the committed batches so appending continues their deltas; anything after them is overwritten
+	resetState(segment->state, header.baseTimeMs);
+	size_t end = forEachCommitted(segment->data(), segment->capacity(), segment->state,
+																[&segment](const Record &, int64_t timeMs)
+																{
+																	++segment->records;
+																	segment->minTimeMs = std::min(segment->minTimeMs, timeMs);
+																	segment->maxTimeMs = std::max(segment->maxTimeMs, timeMs);
+																	return true;
+																});
+	segment->written = segment->flushed = end;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_active = segment;
+	return true;
+}
+
+bool SensorLog::createSegment(int64_t baseTimeMs)
+{
+	const uint64_t sequence = m_nextSequence;
+	const std::string path = segmentPath(sequence);
+	const std::string temporary = path + ".tmp";
+	auto segment = std::make_shared<Segment>();
+	segment->sequence = sequence;
+	segment->size = m_config.segmentSize;
+	segment->fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (segment->fd < 0)
+	{
+		reportError(describe("Sensor log segment " + temporary + " could not be created"));
+		return false;
+	}
+	// Reserving the blocks up front turns a full card into this error instead of SIGBUS on a mapped write
+	int error = posix_fallocate(segment->fd, 0, static_cast<off_t>(segment->size));
+	void *base = error == 0 ? mmap(nullptr, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0) : MAP_FAILED;
+	if (base == MAP_FAILED)
+	{
+		errno = error != 0 ? error : errno;
+		reportError(describe("Sensor log segment " + temporary + " could not be allocated"));
+		unlink(temporary.c_str());
+		return false;
+	}
+	segment->base = static_cast<uint8_t *>(base);
+
+	SegmentHeader &header = segment->header();
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.sequence = sequence;
+	header.baseTimeMs = baseTimeMs;
+	header.segmentSize = static_cast<uint32_t>(segment->size);
+	header.headerCrc = crcUpTo(header, offsetof(SegmentHeader, headerCrc));
+	// The header is on the card before the file gets its name, so every named segment has a valid one
+	if (msync(segment->base, m_pageSize, MS_SYNC) != 0 || rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		reportError(describe("Sensor log segment " + path + " could not be created"));
+		unlink(temporary.c_str());
+		return false;
+	}
+	syncDirectory(m_config.directory);
+	resetState(segment->state, baseTimeMs);
+
+	if (m_active)
+	{
+		m_active->closeBatch();
+		m_sealed.push_back(std::move(m_active));
+	}
+	m_active = segment;
+	++m_nextSequence;
+	++m_stats.segments;
+	m_stats.syncedBytes += m_pageSize;
+	m_metrics.syncedBytes.increment(m_pageSize);
+	enforceRetention();
+	return true;
+}
+
+bool SensorLog::commit(Segment &segment, bool seal)
+{
+	size_t end;
+	SealRecord record;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		segment.closeBatch();
+		end = segment.written;
+		record = {static_cast<uint32_t>(end), segment.records, segment.minTimeMs, segment.maxTimeMs, 0, 0};
+	}
+	uint64_t synced = 0;
+	auto started = std::chrono::steady_clock::now();
+	if (end > segment.flushed)
+	{
+		// Only the pages written since the last commit; the closed batch headers are among them
+		size_t from = (HEADER_SIZE + segment.flushed) / m_pageSize * m_pageSize;
+		size_t to = HEADER_SIZE + end;
+		if (msync(segment.base + from, to - from, MS_SYNC) != 0)
+		{
+			reportError(describe("Sensor log " + segmentPath(segment.sequence) + " flush failed"));
+			return false;
+		}
+		segment.flushed = end;
+		synced += (to + m_pageSize - 1) / m_pageSize * m_pageSize - from;
+	}
+	if (seal)
+	{
+		record.sealCrc = crcUpTo(record, offsetof(SealRecord, sealCrc));
+		std::memcpy(&segment.header().seal, &record, sizeof(record));
+		if (msync(segment.base, m_pageSize, MS_SYNC) != 0)
+		{
+			reportError(describe("Sensor log " + segmentPath(segment.sequence) + " seal failed"));
+			return false;
+		}
+		synced += m_pageSize;
+	}
+	if (synced == 0)
+	{
+		return true;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_stats.syncs;
+		m_stats.syncedBytes += synced;
+	}
+	m_metrics.syncedBytes.increment(synced);
+	m_metrics.syncTime.recordSince(started);
+	return true;
+}
+
+void SensorLog::enforceRetention()
+{
+	// A sealed segment still waiting for its commit keeps its mapping; only the name goes
+	while (m_nextSequence - m_firstSequence > m_config.maxSegments)
+	{
+		unlink(segmentPath(m_firstSequence).c_str());
+		++m_firstSequence;
+	}
+}
+
+std::string SensorLog::segmentPath(uint64_t sequence) const
+{
+	return m_config.directory + "/" + segmentName(sequence);
+}
+
+void SensorLog::reportError(const std::string &error)
+{
+	if (m_errorCallback)
+	{
+		m_errorCallback(error);
+	}
+}
@@ -0,0 +1,940 @@
+#include "SimulatedGpio.h"
+#include "DHT11Waveform.h"
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace gpio
+{
+	namespace sim
+	{
+		const std::bitset<32> line_request::FLAG_ACTIVE_LOW(1);
+		const std::bitset<32> line_request::FLAG_OPEN_SOURCE(2);
+		const std::bitset<32> line_request::FLAG_OPEN_DRAIN(4);
+
+		namespace detail
+		{
+			constexpr int64_t NEVER = std::numeric_limits<int64_t>::max();
+
+			// Externally driven level over time; before the first point the line floats
+			struct Timeline
+			{
+				std::vector<std::pair<int64_t, int>> points;
+
+				int levelAt(int64_t t, int idle) const
+				{
+					auto it = std::upper_bound(points.begin(), points.end(), t,
+																		 [](int64_t value, const std::pair<int64_t, int> &point)
+																		 { return value < point.first; });
+					return it == points.begin() ? idle : std::prev(it)->second;
+				}
+
+				int64_t nextAfter(int64_t t) const
+				{
+					auto it = std::upper_bound(points.begin(), points.end(), t,
+																		 [](int64_t value, const std::pair<int64_t, int> &point)
+																		 { return value < point.first; });
+					return it == points.end() ? NEVER : it->first;
+				}
+
+				void insert(int64_t t, int level)
+				{
+					auto it = std::upper_bound(points.begin(), points.end(), t,
+																		 [](int64_t value, const std::pair<int64_t, int> &point)
+																		 { return value < point.first; });
+					points.insert(it, {t, level});
+				}
+
+				// Forget history before t, keeping the point that sets the level at t
+				void prune(int64_t t)
+				{
+					auto it = std::upper_bound(points.begin(), points.end(), t,
+																		 [](int64_t value, const std::pair<int64_t, int> &point)
+																		 { return value < point.first; });
+					if (it - points.begin() > 1)
+					{
+						points.erase(points.begin(), std::prev(it));
+					}
+				}
+			};
+
+			struct LineState
+			{
+				bool requested = false;
+				bool output = false;
+				bool openDrain = false;
+				int value = 0;
+				bool risingEvents = false;
+				bool fallingEvents = false;
+				int pull = 0;
+				Timeline drive;
+				int keypadRow = -1;
+				uint64_t writes = 0;
+				const ChipHandle *owner = nullptr;
+
+				// Edge detection state, valid while events are requested
+				int64_t evaluatedAt = 0;
+				int lastLevel = 0;
+				std::deque<line_event> events;
+				int eventFd = -1;
+
+				// Attached DHT11
+				bool dht11 = false;
+				int64_t responseDelayNs = 30000;
+				std::array<uint8_t, 5> frame = {{0}};
+				int64_t hostLowSince = -1;
+				uint64_t responses = 0;
+
+				LineState() = default;
+				LineState(const LineState &) = delete;
+				LineState &operator=(const LineState &) = delete;
+
+				~LineState()
+				{
+					if (eventFd >= 0)
+					{
+						close(eventFd);
+					}
+				}
+			};
+
+			struct Keypad
+			{
+				std::array<unsigned int, 4> cols;
+				std::array<unsigned int, 4> rows;
+				std::array<Timeline, 16> contacts;
+			};
+
+			struct ChipState
+			{
+				std::string name;
+				std::array<LineState, LINE_COUNT> lines;
+				std::unique_ptr<Keypad> keypad;
+				unsigned int edgeLines = 0; // Lines requested for events; without any, writes skip the edge bookkeeping
+			};
+
+			// One opening of a chip; releases its requests when the last chip or line object goes
+			struct ChipHandle
+			{
+				std::shared_ptr<ChipState> state;
+
+				explicit ChipHandle(std::shared_ptr<ChipState> chipState) : state(std::move(chipState)) {}
+				ChipHandle(const ChipHandle &) = delete;
+				ChipHandle &operator=(const ChipHandle &) = delete;
+				~ChipHandle();
+			};
+		}
+
+		namespace
+		{
+			using detail::ChipHandle;
+			using detail::ChipState;
+			using detail::LineState;
+			using detail::NEVER;
+
+			constexpr int64_t NS_PER_SECOND = 1000000000;
+			// The kernel keeps a small FIFO per line; the simulation is generous but still bounded
+			constexpr size_t EVENT_QUEUE_LIMIT = 1024;
+			// gpiod reads at most this many events per call
+			constexpr size_t EVENT_READ_BATCH = 16;
+			constexpr int64_t DHT11_MIN_START_NS = 18000000;
+
+			// One lock for every chip: devices like the keypad couple lines, and nothing here is a hot path
+			std::mutex &boardMutex()
+			{
+				static std::mutex *mutex = new std::mutex();
+				return *mutex;
+			}
+
+			std::map<std::string, std::shared_ptr<ChipState>> &chips()
+			{
+				static auto *registry = new std::map<std::string, std::shared_ptr<ChipState>>();
+				return *registry;
+			}
+
+			std::atomic<Clock *> &boardClock()
+			{
+				static auto *clock = new std::atomic<Clock *>(&Clock::system());
+				return *clock;
+			}
+
+			int64_t toNs(Board::time_point t)
+			{
+				// steady_clock is CLOCK_MONOTONIC on Linux
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+			}
+
+			int64_t nowNs()
+			{
+				return toNs(boardClock().load()->now());
+			}
+
+			void throwErrno(int error, const std::string &what)
+			{
+				throw std::system_error(error, std::system_category(), what);
+			}
+
+			/**
+			 * @brief Level the host forces onto a line
+			 * @return 0 or 1, or -1 if the line is an input or a released open-drain output
+			 */
+			int hostDrive(const LineState &line)
+			{
+				if (!line.requested || !line.output || (line.openDrain && line.value != 0))
+				{
+					return -1;
+				}
+				return line.value;
+			}
+
+			int externalLevel(const ChipState &chip, const LineState &line, int64_t t)
+			{
+				if (line.keypadRow >= 0 && chip.keypad)
+				{
+					for (int col = 0; col < 4; ++col)
+					{
+						const LineState &column = chip.lines[chip.keypad->cols[col]];
+						if (hostDrive(column) == 1 && chip.keypad->contacts[line.keypadRow * 4 + col].levelAt(t, 0))
+						{
+							return 1;
+						}
+					}
+					return line.pull;
+				}
+				return line.drive.levelAt(t, line.pull);
+			}
+
+			int levelAt(const ChipState &chip, const LineState &line, int64_t t)
+			{
+				int driven = hostDrive(line);
+				return driven >= 0 ? driven : externalLevel(chip, line, t);
+			}
+
+			int64_t nextChange(const ChipState &chip, const LineState &line, int64_t after)
+			{
+				if (line.keypadRow >= 0 && chip.keypad)
+				{
+					int64_t next = NEVER;
+					for (int col = 0; col < 4; ++col)
+					{
+						next = std::min(next, chip.keypad->contacts[line.keypadRow * 4 + col].nextAfter(after));
+					}
+					return next;
+				}
+				return line.drive.nextAfter(after);
+			}
+
+			bool watchesEdges(const LineState &line)
+			{
+				return line.requested && (line.risingEvents || line.fallingEvents);
+			}
+
+			void recordLevel(LineState &line, int64_t t, int level)
+			{
+				if (level == line.lastLevel)
+				{
+					return;
+				}
+				line.lastLevel = level;
+				if (((level && line.risingEvents) || (!level && line.fallingEvents)) && line.events.size() < EVENT_QUEUE_LIMIT)
+				{
+					line.events.push_back({std::chrono::nanoseconds(t), level ? line_event::RISING_EDGE : line_event::FALLING_EDGE});
+				}
+			}
+
+			// Queue the edges of every scripted change up to now
+			void advance(const ChipState &chip, LineState &line, int64_t now)
+			{
+				if (!watchesEdges(line))
+				{
+					return;
+				}
+				for (int64_t t = nextChange(chip, line, line.evaluatedAt); t <= now; t = nextChange(chip, line, t))
+				{
+					recordLevel(line, t, levelAt(chip, line, t));
+				}
+				line.evaluatedAt = std::max(line.evaluatedAt, now);
+			}
+
+			// Make the event fd readable now if events wait, else at the next scripted change
+			void rearm(const ChipState &chip, LineState &line, int64_t now)
+			{
+				if (line.eventFd < 0)
+				{
+					return;
+				}
+				uint64_t expirations;
+				ssize_t drained = read(line.eventFd, &expirations, sizeof(expirations));
+				(void)drained;
+				int64_t at = 1;
+				if (line.events.empty())
+				{
+					// The timerfd runs on CLOCK_MONOTONIC, which virtual scripts have nothing to do with
+					at = boardClock().load()->isVirtual() ? NEVER : nextChange(chip, line, now);
+				}
+				itimerspec spec = {};
+				if (at != NEVER)
+				{
+					spec.it_value.tv_sec = static_cast<time_t>(at / NS_PER_SECOND);
+					spec.it_value.tv_nsec = static_cast<long>(at % NS_PER_SECOND);
+				}
+				timerfd_settime(line.eventFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+			}
+
+			void advanceAll(ChipState &chip, int64_t now)
+			{
+				if (chip.edgeLines == 0)
+				{
+					return;
+				}
+				for (auto &line : chip.lines)
+				{
+					advance(chip, line, now);
+				}
+			}
+
+			// After a host write or a new script: catch immediate level changes and re-arm every event fd
+			void settleAll(ChipState &chip, int64_t now)
+			{
+				if (chip.edgeLines == 0)
+				{
+					return;
+				}
+				for (auto &line : chip.lines)
+				{
+					if (watchesEdges(line))
+					{
+						recordLevel(line, now, levelAt(chip, line, now));
+						rearm(chip, line, now);
+					}
+				}
+			}
+
+			void scheduleDHT11Response(LineState &line, int64_t release)
+			{
+				line.drive.points.clear();
+				dht11Waveform(line.frame, std::chrono::nanoseconds(release + line.responseDelayNs),
+											[&line](std::chrono::nanoseconds time, bool rising)
+											{ line.drive.insert(time.count(), rising ? 1 : 0); });
+				++line.responses;
+			}
+
+			void trackDHT11StartSignal(LineState &line, int64_t now)
+			{
+				if (!line.dht11)
+				{
+					return;
+				}
+				bool low = hostDrive(line) == 0;
+				if (low && line.hostLowSince < 0)
+				{
+					line.hostLowSince = now;
+				}
+				else if (!low && line.hostLowSince >= 0)
+				{
+					bool started = now - line.hostLowSince >= DHT11_MIN_START_NS;
+					line.hostLowSince = -1;
+					if (started)
+					{
+						scheduleDHT11Response(line, now);
+					}
+				}
+			}
+
+			/**
+			 * @brief Apply a host-side change to lines of one chip at the current time
+			 * @param change Mutates the lines; runs with every earlier scripted edge already queued
+			 */
+			template <typename Change>
+			void hostUpdate(ChipState &chip, const std::vector<unsigned int> &offsets, Change change)
+			{
+				int64_t now = nowNs();
+				advanceAll(chip, now);
+				change();
+				for (unsigned int offset : offsets)
+				{
+					trackDHT11StartSignal(chip.lines[offset], now);
+				}
+				settleAll(chip, now);
+			}
+
+			// Device-side scripting: queue what happened so far, change the script, re-arm
+			template <typename Change>
+			void scriptUpdate(ChipState &chip, Change change)
+			{
+				int64_t now = nowNs();
+				advanceAll(chip, now);
+				change(now);
+				settleAll(chip, now);
+			}
+
+			void requestLocked(const ChipHandle &handle, unsigned int offset, const line_request &config, int defaultValue)
+			{
+				ChipState &chip = *handle.state;
+				LineState &line = chip.lines[offset];
+				if (line.requested)
+				{
+					throwErrno(EBUSY, "line " + std::to_string(offset) + " already requested");
+				}
+				bool events = config.request_type == line_request::EVENT_RISING_EDGE ||
+											config.request_type == line_request::EVENT_FALLING_EDGE ||
+											config.request_type == line_request::EVENT_BOTH_EDGES;
+				if (events && line.eventFd < 0)
+				{
+					line.eventFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+					if (line.eventFd < 0)
+					{
+						throwErrno(errno, "timerfd_create failed");
+					}
+				}
+				hostUpdate(chip, {offset}, [&]
+									 {
+					line.requested = true;
+					line.owner = &handle;
+					line.output = config.request_type == line_request::DIRECTION_OUTPUT;
+					line.openDrain = (config.flags & line_request::FLAG_OPEN_DRAIN).any();
+					line.value = defaultValue ? 1 : 0;
+					line.risingEvents = config.request_type == line_request::EVENT_RISING_EDGE ||
+															config.request_type == line_request::EVENT_BOTH_EDGES;
+					line.fallingEvents = config.request_type == line_request::EVENT_FALLING_EDGE ||
+															 config.request_type == line_request::EVENT_BOTH_EDGES;
+					if (watchesEdges(line))
+					{
+						++chip.edgeLines;
+					}
+					line.events.clear();
+					line.evaluatedAt = nowNs();
+					line.lastLevel = levelAt(chip, line, line.evaluatedAt); });
+			}
+
+			void releaseLocked(ChipState &chip, unsigned int offset)
+			{
+				LineState &line = chip.lines[offset];
+				if (!line.requested)
+				{
+					return;
+				}
+				hostUpdate(chip, {offset}, [&]
+									 {
+					if (watchesEdges(line))
+					{
+						--chip.edgeLines;
+					}
+					line.requested = false;
+					line.owner = nullptr;
+					line.output = false;
+					line.risingEvents = false;
+					line.fallingEvents = false;
+					line.events.clear(); });
+				if (line.eventFd >= 0)
+				{
+					// Kept for the next event request; a disarmed, drained timerfd never polls readable
+					itimerspec disarm = {};
+					timerfd_settime(line.eventFd, 0, &disarm, nullptr);
+					uint64_t expirations;
+					ssize_t drained = read(line.eventFd, &expirations, sizeof(expirations));
+					(void)drained;
+				}
+			}
+
+			LineState &requireRequested(ChipState &chip, unsigned int offset)
+			{
+				LineState &line = chip.lines[offset];
+				if (!line.requested)
+				{
+					throwErrno(EPERM, "line " + std::to_string(offset) + " not requested");
+				}
+				return line;
+			}
+
+			LineState &requireOutput(ChipState &chip, unsigned int offset)
+			{
+				LineState &line = requireRequested(chip, offset);
+				if (!line.output)
+				{
+					throwErrno(EPERM, "line " + std::to_string(offset) + " is not an output");
+				}
+				return line;
+			}
+
+			LineState &requireEvents(ChipState &chip, unsigned int offset)
+			{
+				LineState &line = requireRequested(chip, offset);
+				if (!watchesEdges(line))
+				{
+					throwErrno(EPERM, "line " + std::to_string(offset) + " not requested for events");
+				}
+				return line;
+			}
+
+			void checkOffset(unsigned int offset)
+			{
+				if (offset >= LINE_COUNT)
+				{
+					throw std::out_of_range("line offset " + std::to_string(offset) + " out of range");
+				}
+			}
+		}
+
+		detail::ChipHandle::~ChipHandle()
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			for (unsigned int offset = 0; offset < LINE_COUNT; ++offset)
+			{
+				if (state->lines[offset].owner == this)
+				{
+					releaseLocked(*state, offset);
+				}
+			}
+		}
+
+		// ---- line ----
+
+		line::line() : m_chip(nullptr), m_offset(0)
+		{
+		}
+
+		line::line(std::shared_ptr<detail::ChipHandle> chip, unsigned int offset)
+				: m_chip(std::move(chip)), m_offset(offset)
+		{
+		}
+
+		unsigned int line::offset() const
+		{
+			return m_offset;
+		}
+
+		void line::request(const line_request &config, int default_val) const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			requestLocked(*m_chip, m_offset, config, default_val);
+		}
+
+		void line::release() const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			releaseLocked(*m_chip->state, m_offset);
+		}
+
+		bool line::is_requested() const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			return m_chip->state->lines[m_offset].requested;
+		}
+
+		int line::get_value() const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			const LineState &state = requireRequested(*m_chip->state, m_offset);
+			return levelAt(*m_chip->state, state, nowNs());
+		}
+
+		void line::set_value(int val) const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			LineState &state = requireOutput(*m_chip->state, m_offset);
+			hostUpdate(*m_chip->state, {m_offset}, [&]
+								 {
+				state.value = val ? 1 : 0;
+				++state.writes; });
+		}
+
+		void line::set_direction_input() const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			LineState &state = requireRequested(*m_chip->state, m_offset);
+			hostUpdate(*m_chip->state, {m_offset}, [&]
+								 { state.output = false; });
+		}
+
+		void line::set_direction_output(int val) const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			LineState &state = requireRequested(*m_chip->state, m_offset);
+			hostUpdate(*m_chip->state, {m_offset}, [&]
+								 {
+				state.output = true;
+				state.value = val ? 1 : 0;
+				++state.writes; });
+		}
+
+		bool line::event_wait(const std::chrono::nanoseconds &timeout) const
+		{
+			Clock &clock = *boardClock().load();
+			int64_t deadline = toNs(clock.now()) + timeout.count();
+			while (true)
+			{
+				int fd;
+				int64_t next;
+				{
+					std::lock_guard<std::mutex> lock(boardMutex());
+					LineState &state = requireEvents(*m_chip->state, m_offset);
+					int64_t now = toNs(clock.now());
+					advance(*m_chip->state, state, now);
+					if (!state.events.empty())
+					{
+						return true;
+					}
+					rearm(*m_chip->state, state, now);
+					fd = state.eventFd;
+					next = nextChange(*m_chip->state, state, now);
+				}
+				int64_t remaining = deadline - toNs(clock.now());
+				if (remaining <= 0)
+				{
+					return false;
+				}
+				if (clock.isVirtual())
+				{
+					clock.sleepUntil(Board::time_point(std::chrono::nanoseconds(std::min(next, deadline))));
+					continue;
+				}
+				// The timer fires at the next scripted change, which may turn out not to be an edge
+				pollfd pfd = {fd, POLLIN, 0};
+				timespec wait = {static_cast<time_t>(remaining / NS_PER_SECOND), static_cast<long>(remaining % NS_PER_SECOND)};
+				if (ppoll(&pfd, 1, &wait, nullptr) < 0 && errno != EINTR)
+				{
+					throwErrno(errno, "event poll failed");
+				}
+			}
+		}
+
+		line_event line::event_read() const
+		{
+			while (!event_wait(std::chrono::seconds(1)))
+			{
+			}
+			std::lock_guard<std::mutex> lock(boardMutex());
+			LineState &state = requireEvents(*m_chip->state, m_offset);
+			line_event event = state.events.front();
+			state.events.pop_front();
+			rearm(*m_chip->state, state, nowNs());
+			return event;
+		}
+
+		std::vector<line_event> line::event_read_multiple() const
+		{
+			while (!event_wait(std::chrono::seconds(1)))
+			{
+			}
+			std::lock_guard<std::mutex> lock(boardMutex());
+			LineState &state = requireEvents(*m_chip->state, m_offset);
+			size_t count = std::min(state.events.size(), EVENT_READ_BATCH);
+			std::vector<line_event> events(state.events.begin(), state.events.begin() + count);
+			state.events.erase(state.events.begin(), state.events.begin() + count);
+			rearm(*m_chip->state, state, nowNs());
+			return events;
+		}
+
+		int line::event_get_fd() const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			return requireEvents(*m_chip->state, m_offset).eventFd;
+		}
+
+		// ---- line_bulk ----
+
+		line_bulk::line_bulk(const std::vector<line> &lines) : m_lines(lines)
+		{
+		}
+
+		void line_bulk::append(const line &new_line)
+		{
+			m_lines.push_back(new_line);
+		}
+
+		line &line_bulk::operator[](unsigned int index)
+		{
+			return m_lines.at(index);
+		}
+
+		unsigned int line_bulk::size() const
+		{
+			return static_cast<unsigned int>(m_lines.size());
+		}
+
+		bool line_bulk::empty() const
+		{
+			return m_lines.empty();
+		}
+
+		void line_bulk::request(const line_request &config, const std::vector<int> &default_vals) const
+		{
+			if (m_lines.empty())
+			{
+				return;
+			}
+			std::lock_guard<std::mutex> lock(boardMutex());
+			for (const auto &member : m_lines)
+			{
+				if (member.m_chip->state->lines[member.m_offset].requested)
+				{
+					throwErrno(EBUSY, "line " + std::to_string(member.m_offset) + " already requested");
+				}
+			}
+			for (size_t i = 0; i < m_lines.size(); ++i)
+			{
+				requestLocked(*m_lines[i].m_chip, m_lines[i].m_offset, config, i < default_vals.size() ? default_vals[i] : 0);
+			}
+		}
+
+		void line_bulk::release() const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			for (const auto &member : m_lines)
+			{
+				releaseLocked(*member.m_chip->state, member.m_offset);
+			}
+		}
+
+		std::vector<int> line_bulk::get_values() const
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			int64_t now = nowNs();
+			std::vector<int> values;
+			values.reserve(m_lines.size());
+			for (const auto &member : m_lines)
+			{
+				values.push_back(levelAt(*member.m_chip->state, requireRequested(*member.m_chip->state, member.m_offset), now));
+			}
+			return values;
+		}
+
+		void line_bulk::set_values(const std::vector<int> &values) const
+		{
+			if (m_lines.empty())
+			{
+				return;
+			}
+			if (values.size() != m_lines.size())
+			{
+				throw std::invalid_argument("value count does not match line count");
+			}
+			std::lock_guard<std::mutex> lock(boardMutex());
+			std::vector<unsigned int> offsets;
+			for (const auto &member : m_lines)
+			{
+				requireOutput(*member.m_chip->state, member.m_offset);
+				offsets.push_back(member.m_offset);
+			}
+			// All members share one chip state; the writes land at a single instant like one ioctl
+			ChipState &chip = *m_lines.front().m_chip->state;
+			hostUpdate(chip, offsets, [&]
+								 {
+				for (size_t i = 0; i < m_lines.size(); ++i)
+				{
+					LineState &state = m_lines[i].m_chip->state->lines[m_lines[i].m_offset];
+					state.value = values[i] ? 1 : 0;
+					++state.writes;
+				} });
+		}
+
+		// ---- chip ----
+
+		chip::chip(const std::string &name) : m_chip(std::make_shared<detail::ChipHandle>(Board::instance().open(name)))
+		{
+		}
+
+		std::string chip::name() const
+		{
+			return m_chip->state->name;
+		}
+
+		unsigned int chip::num_lines() const
+		{
+			return LINE_COUNT;
+		}
+
+		line chip::get_line(unsigned int offset) const
+		{
+			checkOffset(offset);
+			return line(m_chip, offset);
+		}
+
+		line_bulk chip::get_lines(const std::vector<unsigned int> &offsets) const
+		{
+			line_bulk bulk;
+			for (unsigned int offset : offsets)
+			{
+				bulk.append(get_line(offset));
+			}
+			return bulk;
+		}
+
+		// ---- Board ----
+
+		Board &Board::instance()
+		{
+			static Board *board = new Board();
+			return *board;
+		}
+
+		std::shared_ptr<detail::ChipState> Board::open(const std::string &chipName)
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			auto &chip = chips()[chipName];
+			if (!chip)
+			{
+				chip = std::make_shared<ChipState>();
+				chip->name = chipName;
+			}
+			return chip;
+		}
+
+		void Board::reset()
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			chips().clear();
+			boardClock().store(&Clock::system());
+		}
+
+		void Board::setClock(Clock &clock)
+		{
+			std::lock_guard<std::mutex> lock(boardMutex());
+			boardClock().store(&clock);
+		}
+
+		void Board::setPull(const std::string &chipName, unsigned int offset, int level)
+		{
+			checkOffset(offset);
+			auto chip = open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			scriptUpdate(*chip, [&](int64_t)
+									 { chip->lines[offset].pull = level ? 1 : 0; });
+		}
+
+		void Board::drive(const std::string &chipName, unsigned int offset, time_point at, int level)
+		{
+			checkOffset(offset);
+			auto chip = open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			scriptUpdate(*chip, [&](int64_t now)
+									 {
+				detail::Timeline &timeline = chip->lines[offset].drive;
+				timeline.prune(now);
+				timeline.insert(toNs(at), level ? 1 : 0); });
+		}
+
+		void Board::attachDHT11(const std::string &chipName, unsigned int offset, std::chrono::microseconds responseDelay)
+		{
+			checkOffset(offset);
+			auto chip = open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			scriptUpdate(*chip, [&](int64_t)
+									 {
+				LineState &line = chip->lines[offset];
+				line.dht11 = true;
+				line.pull = 1;
+				line.responseDelayNs = std::chrono::duration_cast<std::chrono::nanoseconds>(responseDelay).count(); });
+		}
+
+		void Board::setDHT11Reading(const std::string &chipName, unsigned int offset, int humidity, int temperature)
+		{
+			std::array<uint8_t, 5> frame = {{static_cast<uint8_t>(humidity), 0, static_cast<uint8_t>(temperature), 0, 0}};
+			frame[4] = static_cast<uint8_t>(frame[0] + frame[1] + frame[2] + frame[3]);
+			setDHT11Frame(chipName, offset, frame);
+		}
+
+		void Board::setDHT11Frame(const std::string &chipName, unsigned int offset, const std::array<uint8_t, 5> &frame)
+		{
+			checkOffset(offset);
+			auto chip = open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			// Takes effect from the next start signal, like a sensor that converts on request
+			chip->lines[offset].frame = frame;
+		}
+
+		uint64_t Board::getDHT11ResponseCount(const std::string &chipName, unsigned int offset) const
+		{
+			checkOffset(offset);
+			auto chip = Board::instance().open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			return chip->lines[offset].responses;
+		}
+
+		void Board::attachKeypad(const std::string &chipName, const std::array<int, 4> &colPins, const std::array<int, 4> &rowPins)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				checkOffset(static_cast<unsigned int>(colPins[i]));
+				checkOffset(static_cast<unsigned int>(rowPins[i]));
+			}
+			auto chip = open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			scriptUpdate(*chip, [&](int64_t)
+									 {
+				chip->keypad.reset(new detail::Keypad());
+				for (int i = 0; i < 4; ++i)
+				{
+					chip->keypad->cols[i] = static_cast<unsigned int>(colPins[i]);
+					chip->keypad->rows[i] = static_cast<unsigned int>(rowPins[i]);
+					chip->lines[rowPins[i]].keypadRow = i;
+					chip->lines[rowPins[i]].pull = 0;
+				} });
+		}
+
+		void Board::setKey(const std::string &chipName, int row, int col, time_point at, bool closed)
+		{
+			if (row < 0 || row >= 4 || col < 0 || col >= 4)
+			{
+				throw std::out_of_range("key position out of range");
+			}
+			auto chip = open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			if (!chip->keypad)
+			{
+				throw std::logic_error("no keypad attached to " + chipName);
+			}
+			scriptUpdate(*chip, [&](int64_t now)
+									 {
+				detail::Timeline &contact = chip->keypad->contacts[row * 4 + col];
+				contact.prune(now);
+				contact.insert(toNs(at), closed ? 1 : 0); });
+		}
+
+		void Board::pressKey(const std::string &chipName, int row, int col, time_point at,
+												 std::chrono::microseconds hold, int bounces, std::chrono::microseconds bounceInterval)
+		{
+			setKey(chipName, row, col, at, true);
+			for (int i = 0; i < bounces; ++i)
+			{
+				setKey(chipName, row, col, at + bounceInterval * (2 * i + 1), false);
+				setKey(chipName, row, col, at + bounceInterval * (2 * i + 2), true);
+			}
+			time_point release = at + hold;
+			setKey(chipName, row, col, release, false);
+			for (int i = 0; i < bounces; ++i)
+			{
+				setKey(chipName, row, col, release + bounceInterval * (2 * i + 1), true);
+				setKey(chipName, row, col, release + bounceInterval * (2 * i + 2), false);
+			}
+		}
+
+		int Board::getOutput(const std::string &chipName, unsigned int offset) const
+		{
+			checkOffset(offset);
+			auto chip = Board::instance().open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			return hostDrive(chip->lines[offset]);
+		}
+
+		uint64_t Board::getWriteCount(const std::string &chipName, unsigned int offset) const
+		{
+			checkOffset(offset);
+			auto chip = Board::instance().open(chipName);
+			std::lock_guard<std::mutex> lock(boardMutex());
+			return chip->lines[offset].writes;
+		}
+	}
+}
@@ -0,0 +1,549 @@
+#include "StepperMotor.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+
+constexpr int32_t StepperMotor::STEPS_PER_REVOLUTION;
+
+namespace
+{
+	constexpr int64_t NS_PER_SECOND = 1000000000;
+
+	// Half-step coil patterns for IN1-IN4, kept as vectors so a step does not allocate
+	const std::vector<int> HALF_STEP_SEQUENCE[8] = {{1, 0, 0, 0},
+																									{1, 1, 0, 0},
+																									{0, 1, 0, 0},
+																									{0, 1, 1, 0},
+																									{0, 0, 1, 0},
+																									{0, 0, 1, 1},
+																									{0, 0, 0, 1},
+																									{1, 0, 0, 1}};
+
+	void advance(timespec &ts, int64_t ns)
+	{
+		ts.tv_nsec += ns;
+		while (ts.tv_nsec >= NS_PER_SECOND)
+		{
+			ts.tv_nsec -= NS_PER_SECOND;
+			++ts.tv_sec;
+		}
+	}
+
+	int64_t toNs(const timespec &ts)
+	{
+		return static_cast<int64_t>(ts.tv_sec) * NS_PER_SECOND + ts.tv_nsec;
+	}
+}
+
+StepperMotor::StepperMotor(const std::string &chipName,
+													 const std::array<int, 4> &pins,
+													 const MotionProfile &profile)
+		: m_chipName(chipName), m_pins(pins), m_profile(profile),
+			m_control(std::make_shared<MotionControl>()),
+			m_lastMoveStats{0, std::chrono::microseconds::zero(), std::chrono::microseconds::zero()}
+{
+	buildRampTable();
+}
+
+StepperMotor::~StepperMotor()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_control->mutex);
+		m_control->stopRequested = true;
+	}
+	m_control->changed.notify_all();
+	if (m_motionThread && m_motionThread->joinable())
+	{
+		m_motionThread->join();
+	}
+	try
+	{
+		releaseCoils();
+	}
+	catch (...)
+	{
+	}
+}
+
+bool StepperMotor::initialize()
+{
+	if (m_motionThread)
+	{
+		return true;
+	}
+	try
+	{
+		m_chip = std::make_unique<gpio::Default::chip>(m_chipName);
+		// One line set so every half-step is a single ioctl
+		m_coils = m_chip->get_lines(std::vector<unsigned int>(m_pins.begin(), m_pins.end()));
+		m_coils.request({"stepper", gpio::Default::line_request::DIRECTION_OUTPUT, 0}, {0, 0, 0, 0});
+		m_motionThread = std::make_unique<std::thread>(&StepperMotor::motionThread, this);
+		return true;
+	}
+	catch (const std::exception &e)
+	{
+		if (m_errorCallback)
+		{
+			m_errorCallback("Failed to initialize stepper: " + std::string(e.what()));
+		}
+		return false;
+	}
+}
+
+StepperMotor::MoveHandle StepperMotor::moveToAsync(int32_t targetStep, CompletionCallback callback)
+{
+	auto move = std::make_shared<MoveState>();
+	move->target = targetStep;
+	move->issuedAt = std::chrono::steady_clock::now();
+	move->cancelled = false;
+	move->stopping = false;
+	move->done = false;
+	move->result = MoveResult::FAILED;
+	move->finalPosition = m_position.load();
+	move->callback = callback;
+
+	std::unique_lock<std::mutex> lock(m_control->mutex);
+	move->id = m_control->nextId++;
+	if (!m_motionThread)
+	{
+		move->done = true;
+		lock.unlock();
+		if (m_errorCallback)
+		{
+			m_errorCallback("Stepper not initialized");
+		}
+		if (callback)
+		{
+			callback(MoveResult::FAILED, move->finalPosition);
+		}
+		return MoveHandle(m_control, move);
+	}
+	// The motion thread finishes the superseded move and carries its velocity into this one
+	m_control->active = move;
+	lock.unlock();
+	m_control->changed.notify_all();
+	return MoveHandle(m_control, move);
+}
+
+bool StepperMotor::moveTo(int32_t targetStep)
+{
+	MoveHandle handle = moveToAsync(targetStep);
+	handle.wait();
+	return handle.getResult() == MoveResult::COMPLETED;
+}
+
+int32_t StepperMotor::getPosition() const
+{
+	return m_position.load();
+}
+
+void StepperMotor::setPosition(int32_t step)
+{
+	m_position.store(step);
+}
+
+bool StepperMotor::isMoving() const
+{
+	return m_moving.load();
+}
+
+void StepperMotor::releaseCoils()
+{
+	if (!m_coils.empty())
+	{
+		m_coils.set_values({0, 0, 0, 0});
+	}
+}
+
+StepperMotor::MoveStats StepperMotor::getLastMoveStats() const
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	return m_lastMoveStats;
+}
+
+std::chrono::microseconds StepperMotor::getLastStartLatency() const
+{
+	return std::chrono::microseconds(m_lastStartLatencyUs.load());
+}
+
+std::chrono::nanoseconds StepperMotor::stepInterval(size_t stepIndex, size_t totalSteps) const
+{
+	// Distance from the nearer end of the move picks the ramp entry; short moves never reach cruise
+	size_t fromEnd = totalSteps > stepIndex ? totalSteps - 1 - stepIndex : 0;
+	return intervalForLevel(std::min(stepIndex, fromEnd));
+}
+
+int StepperMotor::planStep(int level, int direction, int32_t remaining, int &nextDirection) const
+{
+	nextDirection = direction;
+	if (level <= 0)
+	{
+		// At the start rate the motor can stop or reverse within one step
+		if (remaining == 0)
+		{
+			return -1;
+		}
+		nextDirection = remaining > 0 ? 1 : -1;
+		if (nextDirection != direction)
+		{
+			level = -1;
+		}
+	}
+	else if (static_cast<int64_t>(remaining) * direction <= 0)
+	{
+		// Target reached or behind: brake along the ramp before reversing
+		return level - 1;
+	}
+	// Accelerate one level per step, but never faster than can still be braked before the target
+	int64_t next = std::min<int64_t>(level + 1, static_cast<int64_t>(m_rampTable.size()));
+	next = std::min<int64_t>(next, std::abs(static_cast<int64_t>(remaining)) - 1);
+	return static_cast<int>(std::max<int64_t>(next, level - 1));
+}
+
+size_t StepperMotor::rampLength() const
+{
+	return m_rampTable.size();
+}
+
+void StepperMotor::setExclusiveWindows(std::shared_timed_mutex *windows)
+{
+	m_windows.store(windows);
+}
+
+void StepperMotor::registerErrorCallback(ErrorCallback callback)
+{
+	m_errorCallback = callback;
+}
+
+void StepperMotor::buildRampTable()
+{
+	const double startRate = m_profile.startStepRate > 0 ? m_profile.startStepRate : 1;
+	const double maxRate = m_profile.maxStepRate > startRate ? m_profile.maxStepRate : startRate;
+	m_cruiseIntervalNs = static_cast<uint32_t>(NS_PER_SECOND / maxRate);
+	m_rampTable.clear();
+	if (m_profile.acceleration <= 0)
+	{
+		return;
+	}
+	// Constant acceleration: v(k)^2 = v0^2 + 2ak after k steps
+	for (size_t k = 0;; ++k)
+	{
+		double rate = std::sqrt(startRate * startRate + 2.0 * m_profile.acceleration * k);
+		if (rate >= maxRate)
+		{
+			break;
+		}
+		m_rampTable.push_back(static_cast<uint32_t>(NS_PER_SECOND / rate));
+	}
+}
+
+std::chrono::nanoseconds StepperMotor::intervalForLevel(size_t level) const
+{
+	if (level < m_rampTable.size())
+	{
+		return std::chrono::nanoseconds(m_rampTable[level]);
+	}
+	return std::chrono::nanoseconds(m_cruiseIntervalNs);
+}
+
+void StepperMotor::writePhase(int32_t step)
+{
+	// Positive modulo so negative positions keep the sequence continuous
+	m_coils.set_values(HALF_STEP_SEQUENCE[((step % 8) + 8) % 8]);
+}
+
+void StepperMotor::motionThread()
+{
+	MetricsRegistry::ThreadScope scope("stepper_motion");
+	MetricsRegistry &registry = MetricsRegistry::instance();
+	Counter &stepCount = registry.counter("stepper_steps_total");
+	Counter &stepErrors = registry.counter("stepper_step_errors_total");
+	Histogram &stepLateness = registry.histogram("stepper_step_lateness_us");
+	Histogram &startLatency = registry.histogram("stepper_start_latency_us");
+	Histogram &windowHold = registry.histogram("stepper_window_hold_us");
+
+	std::shared_ptr<MotionControl> control = m_control;
+	std::shared_ptr<MoveState> current;
+	int32_t position = m_position.load();
+	int direction = 0;
+	int level = -1;
+	timespec deadline{};
+	timespec moveStart{};
+	MoveStats stats{0, std::chrono::microseconds::zero(), std::chrono::microseconds::zero()};
+	int64_t maxLatenessNs = 0;
+
+	auto elapsedSince = [](const timespec &start)
+	{
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return std::chrono::microseconds((toNs(now) - toNs(start)) / 1000);
+	};
+
+	std::unique_lock<std::mutex> lock(control->mutex);
+	while (!control->stopRequested)
+	{
+		if (level < 0)
+		{
+			control->changed.wait(lock, [&control]
+														{ return control->stopRequested || (control->active && !control->active->done); });
+			if (control->stopRequested)
+			{
+				break;
+			}
+			position = m_position.load();
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+		}
+		// A newer command supersedes the current move; motion carries on toward its target
+		if (control->active != current)
+		{
+			if (current && !current->done)
+			{
+				stats.duration = elapsedSince(moveStart);
+				stats.maxLateness = std::chrono::microseconds(maxLatenessNs / 1000);
+				finishMove(lock, current, MoveResult::RETARGETED, position, stats);
+			}
+			current = control->active;
+			clock_gettime(CLOCK_MONOTONIC, &moveStart);
+			stats.steps = 0;
+			maxLatenessNs = 0;
+		}
+		if (current->cancelled && !current->stopping)
+		{
+			// Stopping distance at a ramp level is that many steps
+			current->stopping = true;
+			current->target = level > 0 ? position + direction * level : position;
+		}
+
+		int nextDirection = direction;
+		int next = planStep(level, direction, current->target - position, nextDirection);
+		if (next < 0)
+		{
+			level = -1;
+			direction = 0;
+			m_moving.store(false);
+			lock.unlock();
+			try
+			{
+				// The curtain holds by friction; an energised 28BYJ-48 only heats up
+				releaseCoils();
+			}
+			catch (const std::exception &e)
+			{
+				if (m_errorCallback)
+				{
+					m_errorCallback("Stepper release failed: " + std::string(e.what()));
+				}
+			}
+			lock.lock();
+			stats.duration = elapsedSince(moveStart);
+			stats.maxLateness = std::chrono::microseconds(maxLatenessNs / 1000);
+			finishMove(lock, current, current->cancelled ? MoveResult::CANCELLED : MoveResult::COMPLETED, position, stats);
+			continue;
+		}
+		const bool starting = level < 0;
+		const auto issuedAt = current->issuedAt;
+		direction = nextDirection;
+		m_moving.store(true);
+		lock.unlock();
+
+		bool stepped = true;
+		try
+		{
+			std::shared_lock<std::shared_timed_mutex> window;
+			if (std::shared_timed_mutex *windows = m_windows.load())
+			{
+				window = std::shared_lock<std::shared_timed_mutex>(*windows, std::try_to_lock);
+				if (!window.owns_lock())
+				{
+					timespec heldFrom;
+					clock_gettime(CLOCK_MONOTONIC, &heldFrom);
+					window.lock();
+					clock_gettime(CLOCK_MONOTONIC, &deadline);
+					windowHold.record(static_cast<uint64_t>((toNs(deadline) - toNs(heldFrom)) / 1000));
+				}
+			}
+			writePhase(position + direction);
+		}
+		catch (const std::exception &e)
+		{
+			stepped = false;
+			stepErrors.increment();
+			if (m_errorCallback)
+			{
+				m_errorCallback("Stepper move failed: " + std::string(e.what()));
+			}
+		}
+		if (stepped)
+		{
+			if (starting)
+			{
+				auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - issuedAt);
+				m_lastStartLatencyUs.store(latency.count());
+				startLatency.record(static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0)));
+			}
+			position += direction;
+			m_position.store(position);
+			// Deadlines advance from the previous deadline, not from wakeup, so lateness never accumulates;
+			// after a held step the grid restarts from the end of the window
+			advance(deadline, intervalForLevel(static_cast<size_t>(next)).count());
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+			{
+			}
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			int64_t latenessNs = toNs(now) - toNs(deadline);
+			maxLatenessNs = std::max(maxLatenessNs, latenessNs);
+			stepLateness.record(static_cast<uint64_t>(std::max<int64_t>(latenessNs, 0) / 1000));
+			stepCount.increment();
+		}
+
+		lock.lock();
+		if (!stepped)
+		{
+			level = -1;
+			direction = 0;
+			m_moving.store(false);
+			stats.duration = elapsedSince(moveStart);
+			stats.maxLateness = std::chrono::microseconds(maxLatenessNs / 1000);
+			finishMove(lock, current, MoveResult::FAILED, position, stats);
+			continue;
+		}
+		level = next;
+		++stats.steps;
+	}
+	if (current && !current->done)
+	{
+		stats.duration = elapsedSince(moveStart);
+		stats.maxLateness = std::chrono::microseconds(maxLatenessNs / 1000);
+		finishMove(lock, current, MoveResult::CANCELLED, position, stats);
+	}
+	m_moving.store(false);
+}
+
+void StepperMotor::finishMove(std::unique_lock<std::mutex> &lock, const std::shared_ptr<MoveState> &move,
+															MoveResult result, int32_t position, const MoveStats &stats)
+{
+	move->done = true;
+	move->result = result;
+	move->finalPosition = position;
+	CompletionCallback callback = move->callback;
+	{
+		std::lock_guard<std::mutex> statsLock(m_statsMutex);
+		m_lastMoveStats = stats;
+	}
+	m_control->changed.notify_all();
+	// Callbacks may start the next move, so they run without the motion lock
+	lock.unlock();
+	if (callback)
+	{
+		callback(result, position);
+	}
+	lock.lock();
+}
+
+StepperMotor::MoveHandle::MoveHandle()
+{
+}
+
+StepperMotor::MoveHandle::MoveHandle(std::shared_ptr<MotionControl> control, std::shared_ptr<MoveState> move)
+		: m_control(std::move(control)), m_move(std::move(move))
+{
+}
+
+bool StepperMotor::MoveHandle::valid() const
+{
+	return m_move != nullptr;
+}
+
+uint64_t StepperMotor::MoveHandle::id() const
+{
+	return m_move ? m_move->id : 0;
+}
+
+bool StepperMotor::MoveHandle::retarget(int32_t targetStep)
+{
+	if (!m_move)
+	{
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(m_control->mutex);
+	if (m_move->done || m_move->cancelled)
+	{
+		return false;
+	}
+	m_move->target = targetStep;
+	return true;
+}
+
+bool StepperMotor::MoveHandle::cancel()
+{
+	if (!m_move)
+	{
+		return false;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_control->mutex);
+		if (m_move->done || m_move->cancelled)
+		{
+			return false;
+		}
+		m_move->cancelled = true;
+	}
+	m_control->changed.notify_all();
+	return true;
+}
+
+void StepperMotor::MoveHandle::wait() const
+{
+	if (!m_move)
+	{
+		return;
+	}
+	std::unique_lock<std::mutex> lock(m_control->mutex);
+	m_control->changed.wait(lock, [this]
+													{ return m_move->done; });
+}
+
+bool StepperMotor::MoveHandle::waitFor(std::chrono::milliseconds timeout) const
+{
+	if (!m_move)
+	{
+		return true;
+	}
+	std::unique_lock<std::mutex> lock(m_control->mutex);
+	return m_control->changed.wait_for(lock, timeout, [this]
+																		 { return m_move->done; });
+}
+
+bool StepperMotor::MoveHandle::isDone() const
+{
+	if (!m_move)
+	{
+		return true;
+	}
+	std::lock_guard<std::mutex> lock(m_control->mutex);
+	return m_move->done;
+}
+
+StepperMotor::MoveResult StepperMotor::MoveHandle::getResult() const
+{
+	if (!m_move)
+	{
+		return MoveResult::FAILED;
+	}
+	std::lock_guard<std::mutex> lock(m_control->mutex);
+	return m_move->result;
+}
+
+int32_t StepperMotor::MoveHandle::getFinalPosition() const
+{
+	if (!m_move)
+	{
+		return 0;
+	}
+	std::lock_guard<std::mutex> lock(m_control->mutex);
+	return m_move->finalPosition;
+}
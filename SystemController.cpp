@@ -1,42 +1,112 @@
 #include "SystemController.h"
-#include <iostream>
+#include <algorithm>
 #include <fcntl.h>
 #include <unistd.h>
 #include <ctime>
+#include <sys/epoll.h>
 
-SystemController::SystemController(const SystemConfig &config)
-		: m_config(config)
+namespace
 {
+	std::tm localTime(std::chrono::system_clock::time_point time)
+	{
+		std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+		std::tm local = {};
+		localtime_r(&seconds, &local);
+		return local;
+	}
+
+	// Alarm set from the keypad and setAlarmTime(), mirrored in the snapshot
+	const char *const KEYPAD_ALARM = "keypad";
+
+	// A DHT11 read: 18 ms start pulse, then up to 8 ms of response and frame
+	constexpr std::chrono::milliseconds DHT11_READ_WINDOW{30};
+	// Time a keypad scan may take in its frame
+	constexpr std::chrono::milliseconds KEYPAD_SCAN_BUDGET{2};
+}
+
+SystemController::SystemController(const SystemConfig &config, Clock &clock)
+		: m_config(config),
+			m_clock(clock),
+			m_log(Logger::instance()),
+			m_pendingSnapshot{0, {0, 0, false, clock.now()}, CurtainState::CLOSED, 0, SystemState::MANUAL_MODE, false, 0, 0, 0, 0, false},
+			m_snapshot(m_pendingSnapshot),
+			m_history(config.history),
+			m_sensorLog(config.sensorLog),
+			m_trace(clock),
+			m_metrics{MetricsRegistry::instance().counter("control_unknown_commands_total"),
+								MetricsRegistry::instance().counter("curtain_moves_total"),
+								MetricsRegistry::instance().counter("alarm_triggers_total")}
+{
+	m_events = std::make_unique<EventBus>(m_clock);
+	m_events->subscribe<DHT11Sensor::SensorData>("sensor", [this](const DHT11Sensor::SensorData &data)
+																							 { handleSensorData(data.temperature, data.humidity, data.isValid); });
+	m_events->subscribe<KeyPress>("keypad", [this](const KeyPress &press)
+																{ handleKeypadInput(press.row, press.col, press.key); });
+
+	// Exists before initialize() so alarms can be set at any time
+	m_alarms = std::make_unique<AlarmScheduler>(m_clock);
+	m_alarms->registerTriggerCallback([this](const AlarmScheduler::Alarm &alarm, bool missed)
+																		{ handleAlarm(alarm, missed); });
+	m_alarms->registerErrorCallback([this](const std::string &error)
+																	{ handleError(error); });
+
+	ControlServer::Config control;
+	control.ttyDevice = m_config.bluetoothDevice;
+	control.socketPath = m_config.controlSocketPath;
+	control.tcpPort = m_config.controlTcpPort;
+	m_controlServer = std::make_unique<ControlServer>(control);
+	m_controlServer->registerRequestHandler([this](const bluetooth::Frame &frame, ControlServer::Replies &replies)
+																					{
+																						m_trace.recordControl(frame, replies.transport());
+																						handleControlRequest(frame, replies); });
+	m_controlServer->registerTelemetrySource([this]
+																					 { return statusFields(); });
+	m_sensorLog.registerErrorCallback([this](const std::string &error)
+																		{ m_log.warn("SystemController", "%s", error); });
+	m_trace.registerErrorCallback([this](const std::string &error)
+																{ m_log.warn("SystemController", "%s", error); });
+
+	// A missing rfcomm device is normal off the Pi, so transport failures are warnings
+	m_controlServer->registerErrorCallback([this](const std::string &error)
+																				 { m_log.warn("SystemController", "%s", error); });
 }
 
 SystemController::~SystemController()
 {
 	stop();
+	// Handlers use the whole controller, the stepper included
+	m_events.reset();
+	// The motion thread publishes from its completion callbacks, so it must end before the rest of the controller
+	m_stepper.reset();
 }
 
 bool SystemController::initialize()
 {
-	std::cout << "[SystemController] Initializing system..." << std::endl;
+	m_log.info("SystemController", "Initializing system...");
 	if (!initializeGPIO())
 	{
-		std::cerr << "[SystemController] Failed to initialize GPIO" << std::endl;
+		m_log.error("SystemController", "Failed to initialize GPIO");
 		return false;
 	}
 	if (!initializeSensors())
 	{
-		std::cerr << "[SystemController] Failed to initialize sensors" << std::endl;
+		m_log.error("SystemController", "Failed to initialize sensors");
 		return false;
 	}
 	if (!initializeKeypad())
 	{
-		std::cerr << "[SystemController] Failed to initialize keypad" << std::endl;
+		m_log.error("SystemController", "Failed to initialize keypad");
 		return false;
 	}
-	if (!initializeBluetooth())
+	if (!m_alarms->initialize())
+	{
+		m_log.warn("SystemController", "Alarm timer unavailable, alarms will not trigger");
+	}
+	if (!initializeMotor())
 	{
-		std::cout << "[SystemController] Warning: Bluetooth initialization failed, continuing without it" << std::endl;
+		m_log.warn("SystemController", "Stepper initialization failed, curtain position is not driven");
 	}
-	std::cout << "[SystemController] System initialized successfully" << std::endl;
+	m_log.info("SystemController", "System initialized successfully");
 	return true;
 }
 
@@ -46,27 +116,75 @@ void SystemController::start()
 	{
 		return;
 	}
-	std::cout << "[SystemController] Starting system..." << std::endl;
+	m_log.info("SystemController", "Starting system...");
 	m_running.store(true);
+	if (!m_config.metricsSocketPath.empty())
+	{
+		m_metricsServer = std::make_unique<MetricsServer>(MetricsRegistry::instance(), m_config.metricsSocketPath);
+		if (!m_metricsServer->open())
+		{
+			m_log.warn("SystemController", "Metrics socket %s unavailable", m_config.metricsSocketPath);
+			m_metricsServer.reset();
+		}
+	}
+	if (!m_config.sensorLog.directory.empty() && !m_sensorLog.open())
+	{
+		m_log.warn("SystemController", "Sensor log %s unavailable, readings are not persisted", m_config.sensorLog.directory);
+	}
+	else if (m_sensorLog.isOpen())
+	{
+		// Each run starts from the full state, so a scan never needs changes from before it
+		std::lock_guard<std::mutex> lock(m_publishMutex);
+		logChanges(nullptr, m_pendingSnapshot);
+	}
+	if (!m_config.tracePath.empty() && !m_trace.open(m_config.tracePath))
+	{
+		m_log.warn("SystemController", "Trace %s unavailable, device events are not recorded", m_config.tracePath);
+	}
+	if (!m_controlServer->open())
+	{
+		m_log.warn("SystemController", "No control transport available, continuing without remote control");
+	}
+	if (m_config.useCyclicExecutive && !startExecutive())
+	{
+		m_log.error("SystemController", "Cyclic schedule does not fit, keypad and sensor keep their own timing");
+	}
+	if (m_config.useReactor && m_clock.isVirtual())
+	{
+		m_log.warn("SystemController", "Reactor timers follow CLOCK_MONOTONIC, using component threads on a virtual clock");
+	}
+	else if (m_config.useReactor)
+	{
+		if (startReactor())
+		{
+			m_log.info("SystemController", "System started successfully (reactor mode)");
+			return;
+		}
+		m_log.error("SystemController", "Reactor unavailable, falling back to component threads");
+	}
+	if (m_metricsServer)
+	{
+		m_metricsServer->start();
+	}
 	// Start sensor monitoring
-	if (m_dht11Sensor)
+	if (m_dht11Sensor && !m_executive)
 	{
 		m_dht11Sensor->startMonitoring(m_config.sensorReadInterval);
 	}
 	// Start keypad scanning
-	if (m_keypad)
+	if (m_keypad && !m_executive)
 	{
 		m_keypad->startScanning(m_config.keypadScanInterval);
 	}
 	// Start alarm monitoring
-	m_alarmThread = std::make_unique<std::thread>(&SystemController::alarmMonitoringThread, this);
-	// Start Bluetooth communication if available
-	if (m_bluetoothFd >= 0)
+	m_alarms->start();
+	// Serve remote control clients if any transport is open
+	if (m_controlServer->isOpen())
 	{
-		m_bluetoothThread = std::make_unique<std::thread>(&SystemController::bluetoothReceiverThread, this);
+		m_controlServer->start();
 	}
 
-	std::cout << "[SystemController] System started successfully" << std::endl;
+	m_log.info("SystemController", "System started successfully");
 }
 
 void SystemController::stop()
@@ -75,8 +193,12 @@ void SystemController::stop()
 	{
 		return;
 	}
-	std::cout << "[SystemController] Stopping system..." << std::endl;
+	m_log.info("SystemController", "Stopping system...");
 	m_running.store(false);
+	stopReactor();
+	stopExecutive();
+	m_metricsServer.reset();
+	m_controlServer->stop();
 	// Stop components
 	if (m_dht11Sensor)
 	{
@@ -87,26 +209,16 @@ void SystemController::stop()
 		m_keypad->stopScanning();
 	}
 	// Stop threads
-	if (m_alarmThread && m_alarmThread->joinable())
-	{
-		m_alarmThread->join();
-	}
-	m_alarmThread.reset();
-	if (m_bluetoothThread && m_bluetoothThread->joinable())
-	{
-		m_bluetoothThread->join();
-	}
-	m_bluetoothThread.reset();
-	// Close Bluetooth connection
-	if (m_bluetoothFd >= 0)
-	{
-		close(m_bluetoothFd);
-		m_bluetoothFd = -1;
-	}
+	m_alarms->stop();
+	// Readings and key presses still queued are handled before the log closes
+	m_events->flush();
 	// Turn off buzzer
 	setBuzzer(false);
+	m_trace.close();
+	// Last, so it commits the final state changes too
+	m_sensorLog.close();
 
-	std::cout << "[SystemController] System stopped successfully" << std::endl;
+	m_log.info("SystemController", "System stopped successfully");
 }
 
 bool SystemController::isRunning() const
@@ -124,46 +236,249 @@ SystemController::CurtainState SystemController::getCurtainState() const
 	return m_curtainState.load();
 }
 
+StepperMotor::MoveHandle SystemController::moveTo(int percent, StepperMotor::CompletionCallback callback)
+{
+	percent = std::max(0, std::min(100, percent));
+	// The commanded state is published now, the reached opening when the motor stops
+	CurtainState newState = percent > 0 ? CurtainState::OPEN : CurtainState::CLOSED;
+	m_curtainTarget.store(percent);
+	m_metrics.curtainMoves.increment();
+	if (m_curtainState.exchange(newState) != newState)
+	{
+		publishChange([newState](SystemSnapshot &snapshot)
+									{ snapshot.curtainState = newState; });
+	}
+	if (!m_stepper)
+	{
+		if (getSnapshot().curtainPosition != percent)
+		{
+			publishChange([percent](SystemSnapshot &snapshot)
+										{ snapshot.curtainPosition = percent; });
+		}
+		return StepperMotor::MoveHandle();
+	}
+	int32_t target = static_cast<int32_t>(static_cast<int64_t>(m_config.curtainTravelSteps) * percent / 100);
+	return m_stepper->moveToAsync(target,
+																[this, callback](StepperMotor::MoveResult result, int32_t position)
+																{
+																	publishCurtainPosition(position);
+																	if (result == StepperMotor::MoveResult::CANCELLED || result == StepperMotor::MoveResult::FAILED)
+																	{
+																		// Stopped short: a repeat of the same command must move again
+																		m_curtainTarget.store(getSnapshot().curtainPosition);
+																	}
+																	if (result == StepperMotor::MoveResult::COMPLETED)
+																	{
+																		StepperMotor::MoveStats stats = m_stepper->getLastMoveStats();
+																		m_log.info("SystemController", "Curtain moved %d steps in %lld ms (max step lateness %lld us)",
+																							 stats.steps, static_cast<long long>(stats.duration.count() / 1000),
+																							 static_cast<long long>(stats.maxLateness.count()));
+																	}
+																	if (callback)
+																	{
+																		callback(result, position);
+																	}
+																});
+}
+
+int SystemController::getCurtainPosition() const
+{
+	if (m_stepper && m_config.curtainTravelSteps > 0)
+	{
+		return static_cast<int>(static_cast<int64_t>(m_stepper->getPosition()) * 100 / m_config.curtainTravelSteps);
+	}
+	return getSnapshot().curtainPosition;
+}
+
+void SystemController::publishCurtainPosition(int32_t position)
+{
+	if (m_config.curtainTravelSteps <= 0)
+	{
+		return;
+	}
+	int percent = static_cast<int>(static_cast<int64_t>(position) * 100 / m_config.curtainTravelSteps);
+	if (getSnapshot().curtainPosition != percent)
+	{
+		publishChange([percent](SystemSnapshot &snapshot)
+									{ snapshot.curtainPosition = percent; });
+	}
+}
+
 DHT11Sensor::SensorData SystemController::getLatestSensorData() const
 {
 	if (m_dht11Sensor)
 	{
 		return m_dht11Sensor->getLatestReading();
 	}
-	return {0, 0, false, std::chrono::steady_clock::now()};
+	return {0, 0, false, m_clock.now()};
+}
+
+SystemController::SystemSnapshot SystemController::getSnapshot() const
+{
+	uint64_t version = 0;
+	SystemSnapshot snapshot = m_snapshot.load(&version);
+	snapshot.version = version;
+	return snapshot;
+}
+
+const SensorHistory &SystemController::getSensorHistory() const
+{
+	return m_history;
+}
+
+SystemController::SystemSnapshot SystemController::waitForChange(uint64_t lastVersion, std::chrono::milliseconds timeout) const
+{
+	{
+		std::unique_lock<std::mutex> lock(m_changeMutex);
+		m_changeCondition.wait_for(lock, timeout, [this, lastVersion]
+															 { return m_snapshot.version() != lastVersion; });
+	}
+	return getSnapshot();
+}
+
+void SystemController::publishChange(const std::function<void(SystemSnapshot &)> &mutation)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_publishMutex);
+		SystemSnapshot previous = m_pendingSnapshot;
+		mutation(m_pendingSnapshot);
+		m_snapshot.store(m_pendingSnapshot);
+		// Under the publish lock, so the log holds changes in the order they were published
+		logChanges(&previous, m_pendingSnapshot);
+	}
+	// Taking the mutex orders the store before any waiter's predicate check
+	{
+		std::lock_guard<std::mutex> lock(m_changeMutex);
+	}
+	m_changeCondition.notify_all();
+	// Only signals; telemetry is encoded on the control loop, so publishing never waits for a client
+	m_controlServer->notifyChange();
+}
+
+void SystemController::logChanges(const SystemSnapshot *previous, const SystemSnapshot &current)
+{
+	if (!m_sensorLog.isOpen())
+	{
+		return;
+	}
+	auto now = m_clock.wallNow();
+	if (!previous || current.curtainPosition != previous->curtainPosition)
+	{
+		m_sensorLog.append({SensorLog::Kind::CURTAIN, now, {current.curtainPosition, 0}});
+	}
+	if (!previous || current.systemState != previous->systemState)
+	{
+		m_sensorLog.append({SensorLog::Kind::MODE, now, {static_cast<int32_t>(current.systemState), 0}});
+	}
+	if (!previous || current.alarmEnabled != previous->alarmEnabled || current.alarmHour != previous->alarmHour || current.alarmMinute != previous->alarmMinute)
+	{
+		int32_t alarm = current.alarmEnabled ? current.alarmHour * 60 + current.alarmMinute : -1;
+		m_sensorLog.append({SensorLog::Kind::ALARM, now, {alarm, 0}});
+	}
+	if (!previous || current.buzzerOn != previous->buzzerOn)
+	{
+		m_sensorLog.append({SensorLog::Kind::BUZZER, now, {current.buzzerOn ? 1 : 0, 0}});
+	}
+}
+
+int SystemController::getControlTcpPort() const
+{
+	return m_controlServer->getTcpPort();
+}
+
+size_t SystemController::getControlClientCount() const
+{
+	return m_controlServer->getClientCount();
+}
+
+uint64_t SystemController::getReactorWakeupCount() const
+{
+	return m_eventLoop ? m_eventLoop->getWakeupCount() : 0;
 }
 
 void SystemController::setAlarmTime(int hours, int minutes)
 {
-	std::lock_guard<std::mutex> lock(m_alarmMutex);
-	m_alarmHour = hours;
-	m_alarmMinute = minutes;
-	m_alarmEnabled = true;
-	std::cout << "[SystemController] Alarm set for " << hours << ":" << minutes << std::endl;
+	AlarmScheduler::Alarm alarm;
+	alarm.name = KEYPAD_ALARM;
+	alarm.hour = hours;
+	alarm.minute = minutes;
+	if (!addAlarm(alarm))
+	{
+		m_log.warn("SystemController", "Invalid alarm time %d:%d", hours, minutes);
+	}
 }
 
 void SystemController::clearAlarm()
 {
 	std::lock_guard<std::mutex> lock(m_alarmMutex);
-	m_alarmEnabled = false;
+	m_alarms->removeAlarm(KEYPAD_ALARM);
+	publishChange([](SystemSnapshot &snapshot)
+								{ snapshot.alarmEnabled = false; });
 	setBuzzer(false);
-	std::cout << "[SystemController] Alarm cleared" << std::endl;
+	m_log.info("SystemController", "Alarm cleared");
+}
+
+bool SystemController::addAlarm(const AlarmScheduler::Alarm &alarm)
+{
+	if (alarm.name != KEYPAD_ALARM)
+	{
+		if (!m_alarms->setAlarm(alarm))
+		{
+			return false;
+		}
+		m_log.info("SystemController", "Alarm '%s' set for %d:%d", alarm.name, alarm.hour, alarm.minute);
+		return true;
+	}
+	std::lock_guard<std::mutex> lock(m_alarmMutex);
+	if (!m_alarms->setAlarm(alarm))
+	{
+		return false;
+	}
+	int hours = alarm.hour;
+	int minutes = alarm.minute;
+	m_alarmHour = hours;
+	m_alarmMinute = minutes;
+	publishChange([hours, minutes](SystemSnapshot &snapshot)
+								{
+									snapshot.alarmEnabled = true;
+									snapshot.alarmHour = hours;
+									snapshot.alarmMinute = minutes;
+									snapshot.pendingAlarmHour = hours;
+									snapshot.pendingAlarmMinute = minutes; });
+	m_log.info("SystemController", "Alarm set for %d:%d", hours, minutes);
+	return true;
+}
+
+bool SystemController::removeAlarm(const std::string &name)
+{
+	if (name == KEYPAD_ALARM)
+	{
+		bool existed = m_alarms->getNextTrigger(name) != std::chrono::system_clock::time_point::max();
+		clearAlarm();
+		return existed;
+	}
+	return m_alarms->removeAlarm(name);
+}
+
+std::vector<AlarmScheduler::Alarm> SystemController::getAlarms() const
+{
+	return m_alarms->getAlarms();
 }
 
 bool SystemController::initializeGPIO()
 {
 	try
 	{
-		m_gpioChip = std::make_unique<gpiod::chip>(m_config.gpioChipName);
+		m_gpioChip = std::make_unique<gpio::Default::chip>(m_config.gpioChipName);
 		// Initialize buzzer
-		m_buzzerLine = std::make_unique<gpiod::line>(m_gpioChip->get_line(m_config.buzzerPin));
-		m_buzzerLine->request({"buzzer", gpiod::line_request::DIRECTION_OUTPUT, 0});
+		m_buzzerLine = std::make_unique<gpio::Default::line>(m_gpioChip->get_line(m_config.buzzerPin));
+		m_buzzerLine->request({"buzzer", gpio::Default::line_request::DIRECTION_OUTPUT, 0});
 
 		return true;
 	}
 	catch (const std::exception &e)
 	{
-		std::cerr << "[SystemController] GPIO initialization error: " << e.what() << std::endl;
+		m_log.error("SystemController", "GPIO initialization error: %s", e.what());
 		return false;
 	}
 }
@@ -172,12 +487,14 @@ bool SystemController::initializeSensors()
 {
 	try
 	{
-		m_dht11Sensor = std::make_unique<DHT11Sensor>(m_config.gpioChipName, m_config.dht11Pin);
+		m_dht11Sensor = std::make_unique<DHT11Sensor>(m_config.gpioChipName, m_config.dht11Pin,
+																									m_config.dht11ReadMode, m_clock);
 		// Register sensor callback
 		m_dht11Sensor->registerDataCallback(
 				[this](int temp, int hum, bool valid)
 				{
-					handleSensorData(temp, hum, valid);
+					m_trace.recordSensor(temp, hum, valid);
+					m_events->publish(DHT11Sensor::SensorData{temp, hum, valid, m_clock.now()});
 				});
 		// Register error callback
 		m_dht11Sensor->registerErrorCallback(
@@ -190,7 +507,7 @@ bool SystemController::initializeSensors()
 	}
 	catch (const std::exception &e)
 	{
-		std::cerr << "[SystemController] Sensor initialization error: " << e.what() << std::endl;
+		m_log.error("SystemController", "Sensor initialization error: %s", e.what());
 		return false;
 	}
 }
@@ -201,12 +518,15 @@ bool SystemController::initializeKeypad()
 	{
 		m_keypad = std::make_unique<MatrixKeypad>(m_config.gpioChipName,
 																							m_config.keypadCols,
-																							m_config.keypadRows);
+																							m_config.keypadRows,
+																							m_config.keypadScanMode,
+																							m_clock);
 		// Register keypad callback
 		m_keypad->registerKeyPressCallback(
 				[this](int row, int col, char key)
 				{
-					handleKeypadInput(row, col, key);
+					m_trace.recordKey(row, col, key);
+					m_events->publish(KeyPress{row, col, key});
 				});
 		// Register error callback
 		m_keypad->registerErrorCallback(
@@ -218,20 +538,34 @@ bool SystemController::initializeKeypad()
 	}
 	catch (const std::exception &e)
 	{
-		std::cerr << "[SystemController] Keypad initialization error: " << e.what() << std::endl;
+		m_log.error("SystemController", "Keypad initialization error: %s", e.what());
 		return false;
 	}
 }
 
-bool SystemController::initializeBluetooth()
+bool SystemController::initializeMotor()
 {
 	try
 	{
-		m_bluetoothFd = open("/dev/rfcomm0", O_RDWR | O_NOCTTY | O_NONBLOCK);
-		return (m_bluetoothFd >= 0);
+		m_stepper = std::make_unique<StepperMotor>(m_config.gpioChipName, m_config.stepperPins);
+		m_stepper->registerErrorCallback(
+				[this](const std::string &error)
+				{
+					handleError("Stepper Error: " + error);
+				});
+		if (!m_stepper->initialize())
+		{
+			m_stepper.reset();
+			return false;
+		}
+		// The curtain is assumed closed at power-up
+		m_stepper->setPosition(0);
+		return true;
 	}
-	catch (...)
+	catch (const std::exception &e)
 	{
+		m_log.error("SystemController", "Stepper initialization error: %s", e.what());
+		m_stepper.reset();
 		return false;
 	}
 }
@@ -240,15 +574,33 @@ void SystemController::handleSensorData(int temperature, int humidity, bool isVa
 {
 	if (!isValid)
 	{
-		std::cout << "[SystemController] Invalid sensor data received" << std::endl;
+		if (getSnapshot().sensorData.isValid)
+		{
+			auto now = m_clock.now();
+			publishChange([now](SystemSnapshot &snapshot)
+										{
+											snapshot.sensorData.isValid = false;
+											snapshot.sensorData.timestamp = now; });
+		}
+		m_log.info("SystemController", "Invalid sensor data received");
 		return;
 	}
-	std::cout << "[SystemController] Sensor data: " << temperature << "°C, " << humidity << "%" << std::endl;
+	auto readAt = m_clock.wallNow();
+	m_history.add(readAt, temperature, humidity);
+	m_sensorLog.append({SensorLog::Kind::SENSOR, readAt, {temperature, humidity}});
+	DHT11Sensor::SensorData published = getSnapshot().sensorData;
+	if (!published.isValid || published.temperature != temperature || published.humidity != humidity)
+	{
+		DHT11Sensor::SensorData sensorData = {temperature, humidity, true, m_clock.now()};
+		publishChange([&sensorData](SystemSnapshot &snapshot)
+									{ snapshot.sensorData = sensorData; });
+	}
+	m_log.info("SystemController", "Sensor data: %d°C, %d%%", temperature, humidity);
 	// Temperature-based buzzer control
 	if (temperature > m_config.tempThreshold)
 	{
 		setBuzzer(true);
-		std::cout << "[SystemController] High temperature alert!" << std::endl;
+		m_log.warn("SystemController", "High temperature alert!");
 	}
 	else
 	{
@@ -263,20 +615,20 @@ void SystemController::handleSensorData(int temperature, int humidity, bool isVa
 
 void SystemController::handleKeypadInput(int row, int col, char key)
 {
-	std::cout << "[SystemController] Key pressed: " << key << " (row=" << row << ", col=" << col << ")" << std::endl;
+	m_log.info("SystemController", "Key pressed: %c (row=%d, col=%d)", key, row, col);
 
 	switch (key)
 	{
 	case '1': // Manual mode
-		m_systemState.store(SystemState::MANUAL_MODE);
-		std::cout << "[SystemController] Switched to manual mode" << std::endl;
+		setSystemState(SystemState::MANUAL_MODE);
+		m_log.info("SystemController", "Switched to manual mode");
 		break;
 
 	case '2': // Manual close
 		if (m_systemState.load() == SystemState::MANUAL_MODE)
 		{
 			setCurtainState(CurtainState::CLOSED);
-			std::cout << "[SystemController] Manual close curtain" << std::endl;
+			m_log.info("SystemController", "Manual close curtain");
 		}
 		break;
 
@@ -284,28 +636,22 @@ void SystemController::handleKeypadInput(int row, int col, char key)
 		if (m_systemState.load() == SystemState::MANUAL_MODE)
 		{
 			setCurtainState(CurtainState::OPEN);
-			std::cout << "[SystemController] Manual open curtain" << std::endl;
+			m_log.info("SystemController", "Manual open curtain");
 		}
 		break;
 
 	case '4': // Auto mode
-	{
-		m_systemState.store(SystemState::AUTO_MODE);
-		std::cout << "[SystemController] Switched to auto mode" << std::endl;
-		// Immediately evaluate conditions
-		auto sensorData = getLatestSensorData();
-		if (sensorData.isValid)
-		{
-			evaluateAutoMode(sensorData.temperature, sensorData.humidity);
-		}
-	}
-	break;
+		enterAutoMode();
+		break;
 
 	case '5': // Alarm hour +
 	{
 		std::lock_guard<std::mutex> lock(m_alarmMutex);
 		m_alarmHour = (m_alarmHour + 1) % 24;
-		std::cout << "[SystemController] Alarm time: " << m_alarmHour << ":" << m_alarmMinute << std::endl;
+		int hour = m_alarmHour;
+		publishChange([hour](SystemSnapshot &snapshot)
+									{ snapshot.pendingAlarmHour = hour; });
+		m_log.info("SystemController", "Alarm time: %d:%d", m_alarmHour, m_alarmMinute);
 	}
 	break;
 
@@ -313,20 +659,27 @@ void SystemController::handleKeypadInput(int row, int col, char key)
 	{
 		std::lock_guard<std::mutex> lock(m_alarmMutex);
 		m_alarmMinute = (m_alarmMinute + 30) % 60;
-		std::cout << "[SystemController] Alarm time: " << m_alarmHour << ":" << m_alarmMinute << std::endl;
+		int minute = m_alarmMinute;
+		publishChange([minute](SystemSnapshot &snapshot)
+									{ snapshot.pendingAlarmMinute = minute; });
+		m_log.info("SystemController", "Alarm time: %d:%d", m_alarmHour, m_alarmMinute);
 	}
 	break;
 
 	case '7': // Set alarm
 	{
-		std::time_t now = std::time(nullptr);
-		std::tm *localTime = std::localtime(&now);
-		int currentHour = localTime->tm_hour;
-		int currentMinute = localTime->tm_min;
+		std::tm now = localTime(m_clock.wallNow());
+		int currentHour = now.tm_hour;
+		int currentMinute = now.tm_min;
 
-		std::lock_guard<std::mutex> lock(m_alarmMutex);
-		int finalHour = (currentHour + m_alarmHour + (currentMinute + m_alarmMinute) / 60) % 24;
-		int finalMinute = (currentMinute + m_alarmMinute) % 60;
+		int finalHour;
+		int finalMinute;
+		{
+			std::lock_guard<std::mutex> lock(m_alarmMutex);
+			finalHour = (currentHour + m_alarmHour + (currentMinute + m_alarmMinute) / 60) % 24;
+			finalMinute = (currentMinute + m_alarmMinute) % 60;
+		}
+		// setAlarmTime() takes m_alarmMutex itself
 		setAlarmTime(finalHour, finalMinute);
 	}
 	break;
@@ -336,37 +689,155 @@ void SystemController::handleKeypadInput(int row, int col, char key)
 		break;
 
 	default:
-		std::cout << "[SystemController] Unhandled key: " << key << std::endl;
+		m_log.info("SystemController", "Unhandled key: %c", key);
 		break;
 	}
 }
 
-void SystemController::handleBluetoothCommand(char command)
+void SystemController::handleControlRequest(const bluetooth::Frame &frame, ControlServer::Replies &replies)
 {
-	std::cout << "[SystemController] Bluetooth command: " << (int)command << std::endl;
+	using bluetooth::Command;
+	using bluetooth::Status;
+	Status status = Status::OK;
+	switch (frame.command)
+	{
+	case Command::SET_MODE:
+		if (frame.length != 1 || frame.payload[0] > 1)
+		{
+			status = Status::BAD_PAYLOAD;
+		}
+		else if (frame.payload[0] == 0)
+		{
+			setSystemState(SystemState::MANUAL_MODE);
+			m_log.info("SystemController", "Remote: switched to manual mode");
+		}
+		else
+		{
+			enterAutoMode();
+		}
+		break;
+
+	case Command::MOVE_TO:
+		if (frame.length != 1 || frame.payload[0] > 100)
+		{
+			status = Status::BAD_PAYLOAD;
+			break;
+		}
+		m_log.info("SystemController", "Remote: move curtain to %d%%", frame.payload[0]);
+		moveTo(frame.payload[0]);
+		break;
 
-	switch (command)
+	case Command::SET_ALARM:
 	{
-	case 0:
-		setCurtainState(CurtainState::CLOSED);
+		AlarmScheduler::Alarm alarm;
+		if (!bluetooth::decodeAlarm(frame, alarm))
+		{
+			status = Status::BAD_PAYLOAD;
+		}
+		else if (!addAlarm(alarm))
+		{
+			status = Status::REJECTED;
+		}
+	}
+	break;
+
+	case Command::REMOVE_ALARM:
+		if (frame.length == 0)
+		{
+			status = Status::BAD_PAYLOAD;
+		}
+		else if (!removeAlarm(std::string(reinterpret_cast<const char *>(frame.payload.data()), frame.length)))
+		{
+			status = Status::REJECTED;
+		}
 		break;
-	case 1:
-		setCurtainState(CurtainState::OPEN);
+
+	case Command::GET_STATUS:
+	{
+		if (frame.length != 0)
+		{
+			status = Status::BAD_PAYLOAD;
+			break;
+		}
+		bluetooth::StatusFields fields = statusFields();
+		replies.send(Command::STATUS, fields.data(), fields.size());
+	}
+		return;
+
+	case Command::LIST_ALARMS:
+		if (frame.length != 0)
+		{
+			status = Status::BAD_PAYLOAD;
+			break;
+		}
+		// The ACK that follows marks the end of the list
+		for (const auto &alarm : getAlarms())
+		{
+			replies.send(bluetooth::encodeAlarm(Command::ALARM, alarm));
+		}
+		break;
+
+	case Command::STOP_BUZZER:
+		setBuzzer(false);
 		break;
+
 	default:
-		std::cout << "[SystemController] Unknown Bluetooth command: " << (int)command << std::endl;
+		m_metrics.unknownCommands.increment();
+		m_log.warn("SystemController", "Unknown control command: 0x%02x", static_cast<unsigned int>(frame.command));
+		status = Status::UNKNOWN_COMMAND;
 		break;
 	}
+	uint8_t ack[2] = {static_cast<uint8_t>(frame.command), static_cast<uint8_t>(status)};
+	replies.send(Command::ACK, ack, sizeof(ack));
+}
+
+bluetooth::StatusFields SystemController::statusFields() const
+{
+	SystemSnapshot snapshot = getSnapshot();
+	uint8_t flags = 0;
+	flags |= snapshot.sensorData.isValid ? bluetooth::STATUS_SENSOR_VALID : 0;
+	flags |= snapshot.curtainState == CurtainState::OPEN ? bluetooth::STATUS_CURTAIN_OPEN : 0;
+	flags |= snapshot.buzzerOn ? bluetooth::STATUS_BUZZER_ON : 0;
+	flags |= snapshot.alarmEnabled ? bluetooth::STATUS_ALARM_ENABLED : 0;
+	return {{static_cast<uint8_t>(static_cast<int8_t>(snapshot.sensorData.temperature)),
+					 static_cast<uint8_t>(snapshot.sensorData.humidity),
+					 flags,
+					 static_cast<uint8_t>(snapshot.curtainPosition),
+					 static_cast<uint8_t>(snapshot.systemState),
+					 static_cast<uint8_t>(snapshot.alarmHour),
+					 static_cast<uint8_t>(snapshot.alarmMinute)}};
+}
+
+void SystemController::enterAutoMode()
+{
+	setSystemState(SystemState::AUTO_MODE);
+	m_log.info("SystemController", "Switched to auto mode");
+	// Immediately evaluate conditions
+	auto sensorData = getLatestSensorData();
+	if (sensorData.isValid)
+	{
+		evaluateAutoMode(sensorData.temperature, sensorData.humidity);
+	}
+}
+
+StepperMotor::MoveHandle SystemController::setCurtainState(CurtainState newState)
+{
+	int target = newState == CurtainState::OPEN ? 100 : 0;
+	// Auto mode repeats its decision on every reading; a move already heading there is left alone
+	if (m_curtainTarget.load() == target)
+	{
+		return StepperMotor::MoveHandle();
+	}
+	m_log.info("SystemController", "Curtain state changed to: %s", newState == CurtainState::OPEN ? "OPEN" : "CLOSED");
+	return moveTo(target);
 }
 
-void SystemController::setCurtainState(CurtainState newState)
+void SystemController::setSystemState(SystemState newState)
 {
-	CurtainState currentState = m_curtainState.load();
-	if (currentState != newState)
+	if (m_systemState.exchange(newState) != newState)
 	{
-		m_curtainState.store(newState);
-		std::cout << "[SystemController] Curtain state changed to: "
-							<< (newState == CurtainState::OPEN ? "OPEN" : "CLOSED") << std::endl;
+		publishChange([newState](SystemSnapshot &snapshot)
+									{ snapshot.systemState = newState; });
 	}
 }
 
@@ -378,10 +849,15 @@ void SystemController::setBuzzer(bool enable)
 		{
 			m_buzzerLine->set_value(enable ? 1 : 0);
 		}
+		if (m_buzzerOn.exchange(enable) != enable)
+		{
+			publishChange([enable](SystemSnapshot &snapshot)
+										{ snapshot.buzzerOn = enable; });
+		}
 	}
 	catch (const std::exception &e)
 	{
-		std::cerr << "[SystemController] Buzzer control error: " << e.what() << std::endl;
+		m_log.error("SystemController", "Buzzer control error: %s", e.what());
 	}
 }
 
@@ -391,60 +867,248 @@ void SystemController::evaluateAutoMode(int temperature, int humidity)
 	if (temperature > 20 && humidity > m_config.humidityThreshold)
 	{
 		setCurtainState(CurtainState::OPEN);
-		std::cout << "[SystemController] Auto mode: Opening curtain (T=" << temperature
-							<< "°C, H=" << humidity << "%)" << std::endl;
+		m_log.info("SystemController", "Auto mode: Opening curtain (T=%d°C, H=%d%%)", temperature, humidity);
 	}
 	else
 	{
 		setCurtainState(CurtainState::CLOSED);
-		std::cout << "[SystemController] Auto mode: Closing curtain (T=" << temperature
-							<< "°C, H=" << humidity << "%)" << std::endl;
+		m_log.info("SystemController", "Auto mode: Closing curtain (T=%d°C, H=%d%%)", temperature, humidity);
 	}
 }
 
-void SystemController::bluetoothReceiverThread()
+bool SystemController::startReactor()
 {
-	char buffer[256];
-	while (m_running.load())
+	m_eventLoop = std::make_unique<EventLoop>();
+	if (!m_eventLoop->initialize())
 	{
-		if (m_bluetoothFd >= 0)
+		m_eventLoop.reset();
+		return false;
+	}
+	// Registration order is dispatch order when several sources are ready together
+	// With the executive running, keypad and sensor are on its frame table instead
+	if (!m_executive && m_keypad && m_keypad->getScanMode() == MatrixKeypad::ScanMode::INTERRUPT)
+	{
+		// Idle keypad costs nothing: the loop only wakes on a row edge, then ticks until keys settle
+		for (int fd : m_keypad->getRowEventFds())
 		{
-			int len = read(m_bluetoothFd, buffer, sizeof(buffer) - 1);
-			if (len > 0)
-			{
-				buffer[len] = '\0';
-				handleBluetoothCommand(buffer[0]);
-			}
+			m_eventLoop->addFd(fd, EPOLLIN,
+												 [this](uint32_t)
+												 { armKeypadTick(m_keypad->processRowEvents()); });
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
 	}
+	else if (!m_executive && m_keypad)
+	{
+		m_eventLoop->addTimer(std::chrono::milliseconds(m_config.keypadScanInterval),
+													[this](uint64_t)
+													{ m_keypad->scanOnce(); });
+	}
+	// The control server adds its clients as they connect
+	if (m_controlServer->isOpen() && !m_controlServer->attach(*m_eventLoop))
+	{
+		m_log.error("SystemController", "Control server could not join the reactor");
+	}
+	// The alarm timerfd only becomes readable when an alarm is due or the wall clock is set
+	if (m_alarms->initialize())
+	{
+		m_eventLoop->addFd(m_alarms->getTimerFd(), EPOLLIN,
+											 [this](uint32_t)
+											 { m_alarms->dispatch(); });
+	}
+	if (m_dht11Sensor && !m_executive)
+	{
+		m_sensorReadRequested = false;
+		m_sensorWorkerStop = false;
+		m_sensorReadPending = false;
+		m_sensorWorker = std::make_unique<std::thread>(&SystemController::sensorWorkerThread, this);
+		m_eventLoop->addTimer(std::chrono::milliseconds(m_config.sensorReadInterval),
+													[this](uint64_t)
+													{
+														// A read still running when the next one is due is not queued behind it
+														if (m_sensorReadPending)
+														{
+															return;
+														}
+														m_sensorReadPending = true;
+														{
+															std::lock_guard<std::mutex> lock(m_sensorWorkMutex);
+															m_sensorReadRequested = true;
+														}
+														m_sensorWork.notify_one();
+													});
+	}
+	if (m_metricsServer)
+	{
+		m_eventLoop->addFd(m_metricsServer->getListenFd(), EPOLLIN,
+											 [this](uint32_t)
+											 { m_metricsServer->servePending(); });
+	}
+	m_reactorThread = std::make_unique<std::thread>([this]
+																									{
+		MetricsRegistry::ThreadScope scope("reactor");
+		m_eventLoop->run(); });
+	return true;
 }
 
-void SystemController::alarmMonitoringThread()
+void SystemController::stopReactor()
 {
-	while (m_running.load())
+	if (!m_eventLoop)
+	{
+		return;
+	}
+	// The worker posts to the loop, so it finishes before the loop goes away
+	if (m_sensorWorker)
 	{
 		{
-			std::lock_guard<std::mutex> lock(m_alarmMutex);
-			if (m_alarmEnabled)
-			{
-				std::time_t now = std::time(nullptr);
-				std::tm *localTime = std::localtime(&now);
+			std::lock_guard<std::mutex> lock(m_sensorWorkMutex);
+			m_sensorWorkerStop = true;
+		}
+		m_sensorWork.notify_one();
+		m_sensorWorker->join();
+		m_sensorWorker.reset();
+	}
+	m_eventLoop->stop();
+	if (m_reactorThread && m_reactorThread->joinable())
+	{
+		m_reactorThread->join();
+	}
+	m_reactorThread.reset();
+	// Its descriptors are registered with the loop, so it lets go of them first
+	m_controlServer->stop();
+	m_eventLoop.reset();
+	m_keypadTimerFd = -1;
+	m_keypadTickInterval = std::chrono::milliseconds(0);
+}
 
-				if (localTime->tm_hour == m_alarmHour && localTime->tm_min == m_alarmMinute)
-				{
-					std::cout << "[SystemController] Alarm triggered!" << std::endl;
-					setBuzzer(true);
-					m_alarmEnabled = false; // Disable alarm after triggering
-				}
-			}
+void SystemController::sensorWorkerThread()
+{
+	MetricsRegistry::ThreadScope scope("reactor_sensor");
+	std::unique_lock<std::mutex> lock(m_sensorWorkMutex);
+	while (true)
+	{
+		m_sensorWork.wait(lock, [this]
+											{ return m_sensorReadRequested || m_sensorWorkerStop; });
+		if (m_sensorWorkerStop)
+		{
+			break;
 		}
-		std::this_thread::sleep_for(std::chrono::seconds(1));
+		m_sensorReadRequested = false;
+		lock.unlock();
+		// Readings reach the rest of the system through the sensor's data callback
+		m_dht11Sensor->readOnce();
+		m_eventLoop->post([this]
+											{ m_sensorReadPending = false; });
+		lock.lock();
+	}
+}
+
+void SystemController::armKeypadTick(bool active)
+{
+	std::chrono::milliseconds interval =
+			active ? m_keypad->activeTickInterval(std::chrono::milliseconds(m_config.keypadScanInterval))
+						 : std::chrono::milliseconds(0);
+	if (m_keypadTimerFd >= 0 && interval == m_keypadTickInterval)
+	{
+		return;
+	}
+	// A debouncing key ticks when its window ends, a held key at the scan interval
+	if (m_keypadTimerFd >= 0)
+	{
+		m_eventLoop->removeTimer(m_keypadTimerFd);
+		m_keypadTimerFd = -1;
+	}
+	m_keypadTickInterval = interval;
+	if (active)
+	{
+		m_keypadTimerFd = m_eventLoop->addTimer(interval, [this](uint64_t)
+																						{ armKeypadTick(m_keypad->scanOnce()); });
+	}
+}
+
+bool SystemController::startExecutive()
+{
+	if (!m_dht11Sensor && !m_keypad)
+	{
+		return false;
+	}
+	m_executive = std::make_unique<CyclicExecutive>("cyclic", CyclicExecutive::DEFAULT_MINOR_FRAME, m_clock);
+	m_executive->registerErrorCallback([this](const std::string &error)
+																		 { handleError(error); });
+	const int frameMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(CyclicExecutive::DEFAULT_MINOR_FRAME).count());
+	// The keypad polls in its frames whatever its scan mode; row edges are not watched here
+	if (m_keypad && !m_executive->addTask("keypad", static_cast<uint32_t>(std::max(m_config.keypadScanInterval / frameMs, 1)), 0,
+																				KEYPAD_SCAN_BUDGET, [this]
+																				{ m_keypad->scanOnce(); }))
+	{
+		m_executive.reset();
+		return false;
+	}
+	// Placed after the scans, in the first frames none of them uses
+	if (m_dht11Sensor && m_executive->reserveWindow("dht11", static_cast<uint32_t>(std::max(m_config.sensorReadInterval / frameMs, 1)),
+																									 DHT11_READ_WINDOW, [this]
+																									 { m_dht11Sensor->readOnce(); }) < 0)
+	{
+		m_executive.reset();
+		return false;
+	}
+	if (m_stepper)
+	{
+		m_stepper->setExclusiveWindows(&m_executive->windowLock());
+	}
+	m_executive->start();
+	m_log.info("SystemController", "Cyclic executive running %u frames of %d ms", m_executive->getMajorFrame(), frameMs);
+	return true;
+}
+
+void SystemController::stopExecutive()
+{
+	if (!m_executive)
+	{
+		return;
+	}
+	m_executive->stop();
+	if (m_stepper)
+	{
+		m_stepper->setExclusiveWindows(nullptr);
+	}
+	m_executive.reset();
+}
+
+CyclicExecutive::Stats SystemController::getScheduleStats() const
+{
+	if (!m_executive)
+	{
+		return CyclicExecutive::Stats{0, 0, 0, 0.0, 0.0, std::chrono::microseconds::zero(), {}};
+	}
+	return m_executive->getStats();
+}
+
+void SystemController::handleAlarm(const AlarmScheduler::Alarm &alarm, bool missed)
+{
+	if (alarm.name == KEYPAD_ALARM && alarm.days == AlarmScheduler::ONCE)
+	{
+		// Gone from the scheduler whether it fired or was missed
+		publishChange([](SystemSnapshot &snapshot)
+									{ snapshot.alarmEnabled = false; });
+	}
+	if (missed)
+	{
+		m_log.warn("SystemController", "Alarm '%s' (%d:%d) missed", alarm.name, alarm.hour, alarm.minute);
+		return;
+	}
+	m_log.info("SystemController", "Alarm '%s' triggered!", alarm.name);
+	m_metrics.alarmTriggers.increment();
+	if (alarm.buzzer)
+	{
+		setBuzzer(true);
+	}
+	if (alarm.curtainPercent >= 0)
+	{
+		moveTo(alarm.curtainPercent);
 	}
 }
 
 void SystemController::handleError(const std::string &error)
 {
-	std::cerr << "[SystemController] Error: " << error << std::endl;
+	m_log.error("SystemController", "%s", error);
 }
 
@@ -0,0 +1,1149 @@
+#include "../include/DHT11.h"
+#include "../include/Key.h"
+#include "../include/StepperMotor.h"
+#include "../include/Logger.h"
+#include "../include/Metrics.h"
+#include "../include/Delay.h"
+#include "../include/SimulatedGpio.h"
+#include "DHT11Waveform.h"
+#include "../include/BluetoothProtocol.h"
+#include "../include/ControlServer.h"
+#include "../include/SensorHistory.h"
+#include "../include/SensorLog.h"
+#include "../include/DeviceTrace.h"
+#include "../include/EventBus.h"
+#include "../include/CyclicExecutive.h"
+#include "../include/SystemController.h"
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <ctime>
+#include <cerrno>
+#include <algorithm>
+#include <fstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * @brief Get CPU time consumed by the calling thread
+ * @return CPU time in microseconds
+ */
+static double threadCpuUs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * @brief Get bytes this process caused to be written to storage
+ * @return write_bytes from /proc/self/io, -1 if the kernel does not account it
+ */
+static long long storageWriteBytes()
+{
+	std::ifstream io("/proc/self/io");
+	std::string key;
+	long long value;
+	while (io >> key >> value)
+	{
+		if (key == "write_bytes:")
+		{
+			return value;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Delete a scratch directory and the files in it
+ * @param path Directory path
+ */
+static void removeScratchDirectory(const std::string &path)
+{
+	if (DIR *dir = opendir(path.c_str()))
+	{
+		while (dirent *entry = readdir(dir))
+		{
+			if (entry->d_name[0] != '.')
+			{
+				unlink((path + "/" + entry->d_name).c_str());
+			}
+		}
+		closedir(dir);
+	}
+	rmdir(path.c_str());
+}
+
+/**
+ * @brief Benchmark suite for the Smart Curtain System
+ */
+class BenchmarkSuite
+{
+public:
+	/**
+	 * @brief Run all benchmarks
+	 */
+	void runAllBenchmarks()
+	{
+		std::cout << "=== Smart Curtain System Benchmarks ===" << std::endl;
+
+		benchDHT11EdgeDecoder();
+		benchDHT11ReadModes();
+		benchKeypadScan();
+		benchStepScheduling();
+		benchDelayAccuracy();
+		benchStepperMove();
+		benchLoggerProducer();
+		benchMetricsRecord();
+		benchEventBus();
+		benchCyclicExecutive();
+		benchSensorHistory();
+		benchSensorLog();
+		benchTraceReplay();
+		benchBluetoothLink();
+		benchControlServerLoad();
+	}
+
+private:
+	/**
+	 * @brief Measure CPU cost of rebuilding a frame from edge timestamps
+	 */
+	void benchDHT11EdgeDecoder()
+	{
+		std::cout << "\n--- DHT11 Edge Decoder ---" << std::endl;
+		std::array<uint8_t, 5> frame = {{55, 0, 24, 0, 79}};
+		std::array<uint8_t, 5> decoded = {{0}};
+		auto edges = makeDHT11Frame(frame, std::chrono::microseconds(0));
+		const int iterations = 200000;
+		int ok = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; ++i)
+		{
+			ok += DHT11Sensor::decodeEdges(edges, decoded) ? 1 : 0;
+		}
+		auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+		std::cout << "decodeEdges: " << std::fixed << std::setprecision(1)
+							<< elapsed.count() / iterations << " ns/frame (" << ok << "/" << iterations << " ok)" << std::endl;
+	}
+
+	/**
+	 * @brief Compare CPU time and success rate of polling vs edge-event reads
+	 */
+	void benchDHT11ReadModes()
+	{
+		std::cout << "\n--- DHT11 Polling vs Edge Events ---" << std::endl;
+		if (gpio::Default::simulated)
+		{
+			// Off the Pi the read paths run against a scripted sensor
+			gpio::sim::Board::instance().attachDHT11("gpiochip0", 17);
+			gpio::sim::Board::instance().setDHT11Reading("gpiochip0", 17, 55, 24);
+		}
+		DHT11Sensor sensor("gpiochip0", 17);
+		if (!sensor.initialize())
+		{
+			std::cout << "Hardware-dependent benchmark skipped (requires actual DHT11 sensor)" << std::endl;
+			return;
+		}
+		const int reads = 10;
+		const DHT11Sensor::ReadMode modes[] = {DHT11Sensor::ReadMode::POLLING, DHT11Sensor::ReadMode::EDGE_EVENTS};
+		for (auto mode : modes)
+		{
+			sensor.setReadMode(mode);
+			int successes = 0;
+			double cpuUs = 0;
+			double wallUs = 0;
+			double turnaroundUs = 0;
+			for (int i = 0; i < reads; ++i)
+			{
+				// DHT11 needs at least 1s between conversions; the simulated one does not
+				std::this_thread::sleep_for(std::chrono::milliseconds(gpio::Default::simulated ? 50 : 1200));
+				double cpuStart = threadCpuUs();
+				auto wallStart = std::chrono::steady_clock::now();
+				successes += sensor.readOnce() ? 1 : 0;
+				wallUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - wallStart).count();
+				cpuUs += threadCpuUs() - cpuStart;
+				turnaroundUs += std::chrono::duration<double, std::micro>(sensor.getLastResponseTiming().turnaround).count();
+			}
+			std::cout << (mode == DHT11Sensor::ReadMode::POLLING ? "POLLING    " : "EDGE_EVENTS")
+								<< ": success " << successes << "/" << reads
+								<< ", cpu " << std::fixed << std::setprecision(0) << cpuUs / reads << " us/read"
+								<< ", wall " << wallUs / reads << " us/read"
+								<< ", turnaround " << turnaroundUs / reads << " us" << std::endl;
+		}
+	}
+
+	/**
+	 * @brief Compare GPIO calls and wall time per scan for per-line vs bulk access
+	 */
+	void benchKeypadScan()
+	{
+		std::cout << "\n--- Keypad Scan: Per-line vs Bulk ---" << std::endl;
+		std::array<int, 4> cols = {{26, 19, 13, 6}};
+		std::array<int, 4> rows = {{21, 20, 16, 12}};
+		if (gpio::Default::simulated)
+		{
+			gpio::sim::Board::instance().attachKeypad("gpiochip0", cols, rows);
+		}
+		MatrixKeypad keypad("gpiochip0", cols, rows);
+		if (!keypad.initialize())
+		{
+			std::cout << "Hardware-dependent benchmark skipped (requires actual keypad)" << std::endl;
+			return;
+		}
+		struct Variant
+		{
+			const char *name;
+			bool bulk;
+			int settleUs;
+		};
+		const Variant variants[] = {{"per-line, 1ms settle", false, 1000},
+																{"per-line, 20us settle", false, 20},
+																{"bulk, 20us settle", true, 20}};
+		const int scans = 200;
+		for (const auto &variant : variants)
+		{
+			keypad.setBulkIo(variant.bulk);
+			keypad.setSettleTimeUs(variant.settleUs);
+			uint64_t callsBefore = keypad.getGpioCallCount();
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < scans; ++i)
+			{
+				keypad.scanOnce();
+			}
+			auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+			std::cout << std::left << std::setw(24) << variant.name << std::right
+								<< ": " << std::fixed << std::setprecision(1)
+								<< static_cast<double>(keypad.getGpioCallCount() - callsBefore) / scans << " ioctls/scan, "
+								<< elapsed.count() / scans << " us/scan" << std::endl;
+		}
+	}
+
+	/**
+	 * @brief Compare relative sleeps with absolute deadlines for a 1 kHz step train
+	 */
+	void benchStepScheduling()
+	{
+		std::cout << "\n--- Step Scheduling: Relative Sleep vs Absolute Deadline ---" << std::endl;
+		const int steps = 1000;
+		const long periodNs = 1000000;
+
+		// Relative sleeps: every wakeup's lateness is added to the next step
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < steps; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::nanoseconds(periodNs));
+		}
+		double relativeUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+		// Absolute deadlines: lateness of one step does not move the next
+		timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		double maxLateUs = 0;
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < steps; ++i)
+		{
+			deadline.tv_nsec += periodNs;
+			if (deadline.tv_nsec >= 1000000000)
+			{
+				deadline.tv_nsec -= 1000000000;
+				deadline.tv_sec++;
+			}
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+			{
+			}
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			maxLateUs = std::max(maxLateUs, (now.tv_sec - deadline.tv_sec) * 1e6 + (now.tv_nsec - deadline.tv_nsec) / 1e3);
+		}
+		double absoluteUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+		const double idealUs = steps * periodNs / 1e3;
+		std::cout << std::fixed << std::setprecision(0)
+							<< "sleep_for      : drift " << relativeUs - idealUs << " us over " << steps << " steps" << std::endl
+							<< "clock_nanosleep: drift " << absoluteUs - idealUs << " us over " << steps << " steps, max step lateness "
+							<< maxLateUs << " us" << std::endl;
+	}
+
+	/**
+	 * @brief Measure command-to-first-step latency, travel timing and a mid-move retarget
+	 */
+	void benchStepperMove()
+	{
+		std::cout << "\n--- Stepper Moves ---" << std::endl;
+		StepperMotor motor("gpiochip0", {{27, 22, 24, 25}});
+		if (!motor.initialize())
+		{
+			std::cout << "Hardware-dependent benchmark skipped (requires actual stepper motor)" << std::endl;
+			return;
+		}
+		const int32_t travel = 2 * StepperMotor::STEPS_PER_REVOLUTION;
+
+		// Command-to-first-step latency from rest, short moves back and forth
+		const int starts = 20;
+		double totalLatencyUs = 0;
+		double worstLatencyUs = 0;
+		for (int i = 0; i < starts; ++i)
+		{
+			motor.moveToAsync((i % 2) ? 0 : 64).wait();
+			double latencyUs = static_cast<double>(motor.getLastStartLatency().count());
+			totalLatencyUs += latencyUs;
+			worstLatencyUs = std::max(worstLatencyUs, latencyUs);
+		}
+		std::cout << std::fixed << std::setprecision(0)
+							<< "command-to-first-step: " << totalLatencyUs / starts << " us average, "
+							<< worstLatencyUs << " us worst (" << starts << " starts)" << std::endl;
+
+		// Full travel, then retarget halfway through the return without stopping
+		motor.moveToAsync(travel).wait();
+		StepperMotor::MoveStats stats = motor.getLastMoveStats();
+		std::cout << "full travel: " << stats.steps << " steps in " << stats.duration.count() / 1000 << " ms, "
+							<< stats.steps * 1e6 / std::max<int64_t>(1, stats.duration.count()) << " steps/s average, "
+							<< "max step lateness " << stats.maxLateness.count() << " us" << std::endl;
+
+		auto close = motor.moveToAsync(0);
+		while (motor.getPosition() > travel / 2)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		auto retargetAt = std::chrono::steady_clock::now();
+		auto reopen = motor.moveToAsync(travel);
+		reopen.wait();
+		double blendMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - retargetAt).count();
+		std::cout << "retarget at " << (close.getResult() == StepperMotor::MoveResult::RETARGETED ? "half travel" : "?")
+							<< ": back at " << reopen.getFinalPosition() << " after " << blendMs << " ms, max step lateness "
+							<< motor.getLastMoveStats().maxLateness.count() << " us" << std::endl;
+		motor.moveTo(0);
+	}
+
+	/**
+	 * @brief Compare producer-side cost of an async log call with a flushed stream write
+	 */
+	void benchLoggerProducer()
+	{
+		std::cout << "\n--- Logger Producer Cost ---" << std::endl;
+		const int bursts = 200;
+		const int burstSize = 200; // Below the ring capacity so nothing is dropped
+		int devNull = open("/dev/null", O_WRONLY);
+		if (devNull < 0)
+		{
+			std::cout << "Benchmark skipped (cannot open /dev/null)" << std::endl;
+			return;
+		}
+		double asyncNs = 0;
+		uint64_t dropped = 0;
+		{
+			Logger logger(devNull);
+			for (int b = 0; b < bursts; ++b)
+			{
+				auto start = std::chrono::steady_clock::now();
+				for (int i = 0; i < burstSize; ++i)
+				{
+					logger.info("SystemController", "Sensor data: %d°C, %d%%", 25 + (i & 7), 40 + (i & 15));
+				}
+				asyncNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+				logger.flush();
+			}
+			dropped = logger.getDroppedCount();
+		}
+		close(devNull);
+
+		std::ofstream stream("/dev/null");
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < bursts * burstSize; ++i)
+		{
+			stream << "[SystemController] Sensor data: " << 25 + (i & 7) << "°C, " << 40 + (i & 15) << "%" << std::endl;
+		}
+		double streamNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		const int calls = bursts * burstSize;
+		std::cout << std::fixed << std::setprecision(1)
+							<< "Logger::info        : " << asyncNs / calls << " ns/call (" << dropped << " dropped)" << std::endl
+							<< "ostream + std::endl : " << streamNs / calls << " ns/call (to /dev/null)" << std::endl;
+	}
+
+	/**
+	 * @brief Compare the error distribution of usleep() and the calibrated delay for 1us-20ms requests
+	 */
+	void benchDelayAccuracy()
+	{
+		std::cout << "\n--- Delay Accuracy: usleep vs Calibrated Hybrid ---" << std::endl;
+		DelayCalibration calibration = delay_calibrate();
+		std::cout << "Calibration: sleep overshoot " << calibration.sleepOvershootNs / 1000 << " us, spin threshold "
+							<< calibration.spinThresholdNs / 1000 << " us, clock read " << calibration.clockReadNs << " ns" << std::endl;
+
+		// Error in microseconds past the requested duration: median, 99th percentile, worst
+		auto measure = [](int requestUs, int samples, bool hybrid)
+		{
+			std::vector<double> errors;
+			errors.reserve(samples);
+			for (int i = 0; i < samples; ++i)
+			{
+				auto start = std::chrono::steady_clock::now();
+				if (hybrid)
+				{
+					delay_us(requestUs);
+				}
+				else
+				{
+					usleep(static_cast<useconds_t>(requestUs));
+				}
+				errors.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() - requestUs);
+			}
+			std::sort(errors.begin(), errors.end());
+			return std::array<double, 3>{{errors[errors.size() / 2], errors[errors.size() * 99 / 100], errors.back()}};
+		};
+
+		std::cout << "request     usleep p50/p99/max (us)      delay_us p50/p99/max (us)" << std::endl;
+		const int requestsUs[] = {1, 10, 30, 100, 500, 1000, 5000, 20000};
+		for (int requestUs : requestsUs)
+		{
+			int samples = requestUs >= 5000 ? 40 : 200;
+			// Fresh threads so usleep() runs with the default 50us timer slack, as it did before
+			std::array<double, 3> coarse;
+			std::array<double, 3> hybrid;
+			std::thread([&] { coarse = measure(requestUs, samples, false); }).join();
+			std::thread([&] { hybrid = measure(requestUs, samples, true); }).join();
+			std::cout << std::setw(6) << requestUs << " us  " << std::fixed << std::setprecision(1)
+								<< std::setw(8) << coarse[0] << std::setw(8) << coarse[1] << std::setw(8) << coarse[2] << "       "
+								<< std::setw(8) << hybrid[0] << std::setw(8) << hybrid[1] << std::setw(8) << hybrid[2] << std::endl;
+		}
+		DelayStats stats = delay_get_stats();
+		std::cout << "delay_get_stats: " << stats.count << " delays, mean error " << stats.meanErrorNs << " ns, p99 "
+							<< stats.p99ErrorNs << " ns, max " << stats.maxErrorNs << " ns" << std::endl;
+	}
+
+	/**
+	 * @brief Measure hot-path cost of counters and histograms, alone and contended
+	 */
+	void benchMetricsRecord()
+	{
+		std::cout << "\n--- Metrics Record Cost ---" << std::endl;
+		MetricsRegistry &registry = MetricsRegistry::instance();
+		Counter &counter = registry.counter("bench_events_total");
+		Histogram &histogram = registry.histogram("bench_latency_us");
+		const int iterations = 1000000;
+
+		auto timeLoop = [iterations](const auto &body)
+		{
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; ++i)
+			{
+				body(i);
+			}
+			return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+		};
+		double counterNs = timeLoop([&counter](int)
+																{ counter.increment(); });
+		double recordNs = timeLoop([&histogram](int i)
+															 { histogram.record(static_cast<uint64_t>(i & 1023)); });
+		double timedNs = timeLoop([&histogram](int)
+															{ histogram.recordSince(std::chrono::steady_clock::now()); });
+
+		// Every device thread records into its own histograms; this is the worst case of sharing one
+		const int threads = 4;
+		std::vector<std::thread> workers;
+		auto start = std::chrono::steady_clock::now();
+		for (int t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&histogram, iterations]
+													 {
+				for (int i = 0; i < iterations; ++i)
+				{
+					histogram.record(static_cast<uint64_t>(i & 1023));
+				} });
+		}
+		for (auto &worker : workers)
+		{
+			worker.join();
+		}
+		double contendedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+		start = std::chrono::steady_clock::now();
+		std::string report = registry.render();
+		double renderUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << std::fixed << std::setprecision(1)
+							<< "Counter::increment        : " << counterNs << " ns" << std::endl
+							<< "Histogram::record         : " << recordNs << " ns" << std::endl
+							<< "Histogram::recordSince    : " << timedNs << " ns (includes clock read)" << std::endl
+							<< "record, " << threads << " threads shared : " << contendedNs << " ns/iteration" << std::endl
+							<< "render                    : " << renderUs << " us (" << report.size() << " bytes)" << std::endl;
+	}
+
+	/**
+	 * @brief Measure the cost of recording a reading and of querying each tier with the default capacities
+	 */
+	void benchSensorHistory()
+	{
+		std::cout << "\n--- Sensor History ---" << std::endl;
+		using Tier = SensorHistory::Tier;
+		SensorHistory history;
+		const int iterations = 1000000;
+		// Readings every 2 s, so the minute and hour tiers roll over and expire buckets along the way
+		auto t0 = std::chrono::system_clock::now();
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; ++i)
+		{
+			history.add(t0 + std::chrono::seconds(2 * i), 15 + i % 17, 30 + i % 53);
+		}
+		double addNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+		double queryNs[SensorHistory::TIER_COUNT];
+		uint64_t counted[SensorHistory::TIER_COUNT] = {};
+		for (size_t tier = 0; tier < SensorHistory::TIER_COUNT; ++tier)
+		{
+			start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; ++i)
+			{
+				counted[tier] += history.window(static_cast<Tier>(tier)).count;
+			}
+			queryNs[tier] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+		}
+
+		std::cout << std::fixed << std::setprecision(1)
+							<< "add                       : " << addNs << " ns" << std::endl
+							<< "window(MINUTE)            : " << queryNs[0] << " ns" << std::endl
+							<< "window(HOUR)              : " << queryNs[1] << " ns" << std::endl
+							<< "window(DAY)               : " << queryNs[2] << " ns" << std::endl
+							<< "footprint                 : " << history.memoryFootprint() << " bytes, " << counted[1] / iterations << " readings in the last day" << std::endl;
+	}
+
+	/**
+	 * @brief Measure storage writes per reading against a synced text log, and scan throughput
+	 */
+	void benchSensorLog()
+	{
+		std::cout << "\n--- Sensor Log ---" << std::endl;
+		std::string directory = "/tmp/smart_curtain_bench_logXXXXXX";
+		if (!mkdtemp(&directory[0]))
+		{
+			std::cout << "Benchmark skipped (cannot create scratch directory)" << std::endl;
+			return;
+		}
+		using std::chrono::milliseconds;
+		auto t0 = std::chrono::system_clock::now();
+		auto reading = [t0](int i)
+		{
+			return SensorLog::Record{SensorLog::Kind::SENSOR, t0 + milliseconds(2000LL * i), {22 + (i / 300) % 5, 45 + (i / 120) % 9}};
+		};
+
+		// An hour of readings every 2 s, committed at several cadences; the text log appends the Logger line and fdatasyncs
+		const int readings = 1800;
+		std::cout << "sync every | log bytes/reading | log storage/reading | text storage/reading" << std::endl;
+		for (int every : {1, 5, 30, 150})
+		{
+			SensorLog::Config config;
+			config.directory = directory;
+			config.syncInterval = std::chrono::hours(1);
+			long long logWritten = storageWriteBytes();
+			SensorLog::Stats stats;
+			{
+				SensorLog log(config);
+				log.open();
+				for (int i = 0; i < readings; ++i)
+				{
+					log.append(reading(i));
+					if ((i + 1) % every == 0)
+					{
+						log.sync();
+					}
+				}
+				stats = log.getStats();
+			}
+			logWritten = storageWriteBytes() - logWritten;
+			removeScratchDirectory(directory);
+			mkdir(directory.c_str(), 0700);
+
+			std::string textPath = directory + "/sensor.txt";
+			int text = open(textPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+			long long textWritten = storageWriteBytes();
+			for (int i = 0; i < readings; ++i)
+			{
+				char line[96];
+				SensorLog::Record record = reading(i);
+				int length = snprintf(line, sizeof(line), "12:00:%02d.%06d INFO  [SystemController] Sensor data: %d°C, %d%%\n",
+															i % 60, i * 7919 % 1000000, record.values[0], record.values[1]);
+				if (write(text, line, static_cast<size_t>(length)) < 0 || ((i + 1) % every == 0 && fdatasync(text) != 0))
+				{
+					break;
+				}
+			}
+			close(text);
+			textWritten = storageWriteBytes() - textWritten;
+			unlink(textPath.c_str());
+
+			std::cout << std::fixed << std::setprecision(1) << std::setw(7) << every * 2 << " s  | "
+								<< std::setw(17) << static_cast<double>(stats.recordBytes) / readings << " | ";
+			if (logWritten < 0)
+			{
+				std::cout << "msync " << static_cast<double>(stats.syncedBytes) / readings << " (no /proc/self/io)" << std::endl;
+				continue;
+			}
+			std::cout << std::setw(19) << static_cast<double>(logWritten) / readings << " | "
+								<< static_cast<double>(textWritten) / readings << std::endl;
+		}
+
+		// Scan throughput over about three months of readings in 1 MiB segments
+		const int months = 4000000;
+		SensorLog::Config config;
+		config.directory = directory;
+		config.syncInterval = std::chrono::hours(1);
+		SensorLog::Stats stats;
+		auto start = std::chrono::steady_clock::now();
+		{
+			SensorLog log(config);
+			log.open();
+			for (int i = 0; i < months; ++i)
+			{
+				log.append(reading(i));
+			}
+			stats = log.getStats();
+		}
+		double appendNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / months;
+
+		int64_t temperatureSum = 0;
+		start = std::chrono::steady_clock::now();
+		uint64_t scanned = SensorLog::scan(directory, std::chrono::system_clock::time_point::min(), std::chrono::system_clock::time_point::max(),
+																			 [&temperatureSum](const SensorLog::Record &record)
+																			 { temperatureSum += record.values[0]; return true; });
+		double scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto lastHour = t0 + milliseconds(2000LL * (months - 1800));
+		start = std::chrono::steady_clock::now();
+		uint64_t recent = SensorLog::scan(directory, lastHour, std::chrono::system_clock::time_point::max(), [](const SensorLog::Record &)
+																			{ return true; });
+		double recentUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		removeScratchDirectory(directory);
+
+		std::cout << std::fixed << std::setprecision(1)
+							<< "append (no sync)           : " << appendNs << " ns, " << static_cast<double>(stats.recordBytes) / months
+							<< " bytes/reading, " << stats.segments << " segments" << std::endl
+							<< "scan all                   : " << scanned / scanSeconds / 1e6 << " M records/s, "
+							<< stats.recordBytes / scanSeconds / 1e6 << " MB/s (mean " << static_cast<double>(temperatureSum) / scanned << " C)" << std::endl
+							<< "scan last hour             : " << recentUs << " us for " << recent << " records" << std::endl;
+	}
+
+	/**
+	 * @brief Measure publish cost and how much of a slow handler the device thread still pays
+	 */
+	void benchEventBus()
+	{
+		std::cout << "\n--- Event Bus ---" << std::endl;
+		struct Reading
+		{
+			int temperature;
+			int humidity;
+		};
+		const int iterations = 1000000;
+		{
+			EventBus bus;
+			std::atomic<int64_t> sum{0};
+			EventBus::Subscription &subscription = bus.subscribe<Reading>("bench_fast", [&sum](const Reading &reading)
+																																		{ sum.fetch_add(reading.temperature, std::memory_order_relaxed); }, EventBus::OverflowPolicy::DROP_OLDEST, 1024);
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; ++i)
+			{
+				bus.publish(Reading{i % 40, 50});
+			}
+			double publishNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+			bus.flush();
+			EventBus::Stats stats = subscription.getStats();
+			std::cout << std::fixed << std::setprecision(1)
+								<< "publish, 1 subscriber     : " << publishNs << " ns (" << stats.delivered << " delivered, "
+								<< stats.dropped << " dropped)" << std::endl;
+		}
+
+		// A handler doing 2 ms of work, fed at the 50 ms keypad scan rate compressed to 1 ms
+		auto slowWork = []
+		{
+			auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+			while (std::chrono::steady_clock::now() < until)
+			{
+			}
+		};
+		const int events = 200;
+		auto deviceLoop = [events](const std::function<void(int)> &deliver)
+		{
+			Histogram cost;
+			auto next = std::chrono::steady_clock::now();
+			for (int i = 0; i < events; ++i)
+			{
+				next += std::chrono::milliseconds(1);
+				std::this_thread::sleep_until(next);
+				auto start = std::chrono::steady_clock::now();
+				deliver(i);
+				cost.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+			}
+			return std::make_pair(cost.percentile(0.5), cost.max());
+		};
+		auto direct = deviceLoop([&slowWork](int)
+														 { slowWork(); });
+		std::pair<uint64_t, uint64_t> published;
+		EventBus::Stats latest;
+		{
+			EventBus bus;
+			EventBus::Subscription &subscription = bus.subscribe<Reading>("bench_slow", [&slowWork](const Reading &)
+																																		{ slowWork(); }, EventBus::OverflowPolicy::COALESCE_LATEST);
+			published = deviceLoop([&bus](int i)
+														 { bus.publish(Reading{i, 0}); });
+			bus.flush();
+			latest = subscription.getStats();
+		}
+		std::cout << "device thread, direct call: p50 " << direct.first / 1000.0 << " us, max " << direct.second / 1000.0 << " us" << std::endl
+							<< "device thread, published : p50 " << published.first / 1000.0 << " us, max " << published.second / 1000.0
+							<< " us (" << latest.delivered << " handled, " << latest.coalesced << " coalesced)" << std::endl;
+	}
+
+	/**
+	 * @brief Measure how many motor steps land inside DHT11 windows with and without the window lock
+	 */
+	void benchCyclicExecutive()
+	{
+		std::cout << "\n--- Cyclic Executive ---" << std::endl;
+		auto spin = [](std::chrono::microseconds duration)
+		{
+			auto until = std::chrono::steady_clock::now() + duration;
+			while (std::chrono::steady_clock::now() < until)
+			{
+			}
+		};
+		// A 200 us keypad scan every 50 ms and a 5 ms bit-banged read every 200 ms, next to a motor stepping at 1 kHz
+		const auto runFor = std::chrono::seconds(2);
+		for (bool fenced : {false, true})
+		{
+			CyclicExecutive executive(fenced ? "bench_cyclic_fenced" : "bench_cyclic_free");
+			std::atomic<bool> inWindow{false};
+			executive.addTask("scan", 5, 0, std::chrono::milliseconds(1), [&spin]
+												{ spin(std::chrono::microseconds(200)); });
+			executive.reserveWindow("read", 20, std::chrono::milliseconds(5), [&spin, &inWindow]
+															{
+				inWindow.store(true);
+				spin(std::chrono::milliseconds(5));
+				inWindow.store(false); });
+			std::atomic<bool> stepping{true};
+			uint64_t steps = 0;
+			uint64_t overlapping = 0;
+			Histogram held;
+			std::thread motor([&]
+												{
+				auto deadline = std::chrono::steady_clock::now();
+				while (stepping.load())
+				{
+					std::shared_lock<std::shared_timed_mutex> window;
+					if (fenced)
+					{
+						window = std::shared_lock<std::shared_timed_mutex>(executive.windowLock(), std::try_to_lock);
+						if (!window.owns_lock())
+						{
+							auto heldFrom = std::chrono::steady_clock::now();
+							window.lock();
+							deadline = std::chrono::steady_clock::now();
+							held.recordSince(heldFrom);
+						}
+					}
+					++steps;
+					overlapping += inWindow.load() ? 1 : 0;
+					window = std::shared_lock<std::shared_timed_mutex>();
+					deadline += std::chrono::milliseconds(1);
+					std::this_thread::sleep_until(deadline);
+				} });
+			executive.start();
+			std::this_thread::sleep_for(runFor);
+			executive.stop();
+			stepping.store(false);
+			motor.join();
+			CyclicExecutive::Stats stats = executive.getStats();
+			std::cout << std::fixed << std::setprecision(1) << (fenced ? "fenced motor" : "free motor  ") << ": " << overlapping << " of "
+								<< steps << " steps inside a window";
+			if (fenced)
+			{
+				std::cout << ", held " << held.count() << " steps up to " << held.max() << " us";
+			}
+			std::cout << std::endl
+								<< "  frames " << stats.frames << ", utilization " << stats.utilization * 100 << "%, busiest frame "
+								<< stats.peakFrameUtilization * 100 << "%, max frame lateness " << stats.maxLateness.count() << " us, "
+								<< stats.windowViolations << " window violations" << std::endl;
+		}
+	}
+
+	/**
+	 * @brief Measure trace size and recording cost, and how much faster than real time a trace replays
+	 */
+	void benchTraceReplay()
+	{
+		std::cout << "\n--- Trace Replay ---" << std::endl;
+		char path[] = "/tmp/smart_curtain_bench_traceXXXXXX";
+		int fd = mkstemp(path);
+		if (fd < 0)
+		{
+			std::cout << "Benchmark skipped (cannot create scratch file)" << std::endl;
+			return;
+		}
+		close(fd);
+
+		// A week of readings every 2 s, a key press every half hour and a status request every 15 minutes
+		const int events = 300000;
+		VirtualClock clock(std::chrono::system_clock::now());
+		TraceRecorder recorder(clock);
+		recorder.open(path);
+		const char keys[] = {'4', '1', '3', '2'};
+		bluetooth::Frame status = {bluetooth::Command::GET_STATUS, 0, {{0}}};
+		std::chrono::nanoseconds recording(0);
+		for (int i = 0; i < events; ++i)
+		{
+			clock.sleepFor(std::chrono::seconds(2));
+			auto start = std::chrono::steady_clock::now();
+			if (i % 900 == 0)
+			{
+				recorder.recordKey(i / 900 % 4, 0, keys[i / 900 % 4]);
+			}
+			else if (i % 450 == 0)
+			{
+				recorder.recordControl(status, ControlServer::Transport::RFCOMM);
+			}
+			else
+			{
+				recorder.recordSensor(22 + (i / 300) % 5, 45 + (i / 120) % 9, i % 97 != 0);
+			}
+			recording += std::chrono::steady_clock::now() - start;
+		}
+		recorder.close();
+		struct stat info;
+		stat(path, &info);
+
+		TraceReader reader;
+		reader.open(path);
+		SystemController::SystemConfig config;
+		config.metricsSocketPath = "";
+		Logger::Level level = Logger::instance().getLevel();
+		Logger::instance().setLevel(Logger::Level::WARN);
+		TraceReplayer::Stats stats;
+		std::chrono::steady_clock::duration replaying;
+		{
+			VirtualClock replayClock(reader.getStartTime());
+			SystemController controller(config, replayClock);
+			auto start = std::chrono::steady_clock::now();
+			stats = TraceReplayer(controller, replayClock).run(reader, TraceReplayer::Speed::AS_FAST_AS_POSSIBLE);
+			replaying = std::chrono::steady_clock::now() - start;
+		}
+		Logger::instance().setLevel(level);
+		unlink(path);
+
+		double replaySeconds = std::chrono::duration<double>(replaying).count();
+		double traced = std::chrono::duration<double>(std::chrono::seconds(2) * events).count();
+		std::cout << std::fixed << std::setprecision(1)
+							<< "trace size                : " << static_cast<double>(info.st_size) / events << " bytes/event, "
+							<< info.st_size / 1024 << " KiB for " << traced / 86400 << " days" << std::endl
+							<< "record                    : " << std::chrono::duration<double, std::nano>(recording).count() / events << " ns/event" << std::endl
+							<< "replay                    : " << stats.events / replaySeconds / 1e3 << " k events/s ("
+							<< stats.sensorEvents << " readings, " << stats.keyEvents << " keys, " << stats.controlRequests << " requests, "
+							<< stats.replyFrames << " replies)" << std::endl
+							<< "speedup over real time    : " << std::setprecision(0) << traced / replaySeconds << "x" << std::endl;
+	}
+
+	/**
+	 * @brief Measure frame throughput and request latency over a pty standing in for /dev/rfcomm0
+	 */
+	void benchBluetoothLink()
+	{
+		std::cout << "\n--- Bluetooth Link over a pty ---" << std::endl;
+		int master = posix_openpt(O_RDWR | O_NOCTTY);
+		if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+		{
+			std::cout << "Benchmark skipped (no pty available)" << std::endl;
+			if (master >= 0)
+			{
+				close(master);
+			}
+			return;
+		}
+		int slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+		termios mode;
+		if (slave < 0 || tcgetattr(slave, &mode) != 0)
+		{
+			std::cout << "Benchmark skipped (cannot open pty slave)" << std::endl;
+			close(master);
+			return;
+		}
+		cfmakeraw(&mode);
+		tcsetattr(slave, TCSANOW, &mode);
+
+		// Throughput: the phone writes bursts of frames, the receiver polls, reads 256 bytes at a time and decodes
+		const int frameCount = 100000;
+		std::vector<uint8_t> stream;
+		for (int i = 0; i < frameCount; ++i)
+		{
+			uint8_t percent = static_cast<uint8_t>(i % 101);
+			bluetooth::encodeFrame(i % 4 == 0 ? bluetooth::Command::GET_STATUS : bluetooth::Command::MOVE_TO, &percent,
+														 i % 4 == 0 ? 0 : 1, stream);
+		}
+		std::thread writer([master, &stream]
+											 {
+			size_t sent = 0;
+			while (sent < stream.size())
+			{
+				ssize_t written = write(master, stream.data() + sent, std::min<size_t>(4096, stream.size() - sent));
+				if (written <= 0)
+				{
+					break;
+				}
+				sent += static_cast<size_t>(written);
+			} });
+		bluetooth::FrameParser parser;
+		int received = 0;
+		int wakeups = 0;
+		auto start = std::chrono::steady_clock::now();
+		while (received < frameCount)
+		{
+			pollfd pfd = {slave, POLLIN, 0};
+			if (poll(&pfd, 1, 1000) <= 0)
+			{
+				break;
+			}
+			++wakeups;
+			uint8_t buffer[256];
+			ssize_t len;
+			while ((len = read(slave, buffer, sizeof(buffer))) > 0)
+			{
+				received += static_cast<int>(parser.feed(buffer, static_cast<size_t>(len), [](const bluetooth::Frame &) {}));
+			}
+		}
+		double elapsedS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		writer.join();
+		std::cout << std::fixed << std::setprecision(1)
+							<< "Framed receive : " << received << "/" << frameCount << " frames, " << received / elapsedS / 1000 << "k frames/s, "
+							<< stream.size() / elapsedS / 1e6 << " MB/s, " << static_cast<double>(received) / std::max(wakeups, 1)
+							<< " frames/wakeup, " << parser.getStats().checksumErrors << " checksum errors" << std::endl;
+
+		// Round trip of a status request: poll-driven responder vs the old 10 ms sleep loop
+		auto roundTrips = [master, slave](bool polling, int count)
+		{
+			std::atomic<bool> running{true};
+			std::thread responder([slave, polling, &running]
+														{
+				bluetooth::FrameParser responderParser;
+				std::vector<uint8_t> reply;
+				uint8_t status[7] = {22, 50, 0x03, 100, 1, 7, 30};
+				while (running.load())
+				{
+					if (polling)
+					{
+						pollfd pfd = {slave, POLLIN, 0};
+						poll(&pfd, 1, 50);
+					}
+					else
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(10));
+					}
+					uint8_t buffer[256];
+					ssize_t len = read(slave, buffer, sizeof(buffer));
+					if (len > 0)
+					{
+						responderParser.feed(buffer, static_cast<size_t>(len), [&reply, &status](const bluetooth::Frame &)
+																 { bluetooth::encodeFrame(bluetooth::Command::STATUS, status, sizeof(status), reply); });
+						ssize_t written = write(slave, reply.data(), reply.size());
+						(void)written;
+						reply.clear();
+					}
+				} });
+			std::vector<uint8_t> request;
+			bluetooth::encodeFrame(bluetooth::Command::GET_STATUS, nullptr, 0, request);
+			std::vector<double> latencies;
+			bluetooth::FrameParser replyParser;
+			for (int i = 0; i < count; ++i)
+			{
+				auto sentAt = std::chrono::steady_clock::now();
+				ssize_t written = write(master, request.data(), request.size());
+				(void)written;
+				size_t replies = 0;
+				while (replies == 0)
+				{
+					uint8_t buffer[64];
+					ssize_t len = read(master, buffer, sizeof(buffer));
+					if (len <= 0)
+					{
+						break;
+					}
+					replies = replyParser.feed(buffer, static_cast<size_t>(len), [](const bluetooth::Frame &) {});
+				}
+				latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sentAt).count());
+			}
+			running.store(false);
+			responder.join();
+			std::sort(latencies.begin(), latencies.end());
+			return std::array<double, 2>{{latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]}};
+		};
+		std::array<double, 2> polled = roundTrips(true, 2000);
+		std::array<double, 2> slept = roundTrips(false, 100);
+		std::cout << "Status round trip, poll()     : p50 " << polled[0] << " us, p99 " << polled[1] << " us" << std::endl
+							<< "Status round trip, 10 ms sleep: p50 " << slept[0] << " us, p99 " << slept[1] << " us" << std::endl;
+
+		close(slave);
+		close(master);
+	}
+
+	/**
+	 * @brief Measure request latency with hundreds of concurrent control clients
+	 * Each simulated client keeps one GET_STATUS in flight and sends the next as soon as the reply arrives.
+	 */
+	void benchControlServerLoad()
+	{
+		std::cout << "\n--- Control Server under Load ---" << std::endl;
+		ControlServer::Config config;
+		config.socketPath = "/tmp/smart_curtain_bench_control.sock";
+		config.tcpPort = 0;
+		config.maxClients = 1024;
+		ControlServer server(config);
+		server.registerRequestHandler([](const bluetooth::Frame &, ControlServer::Replies &replies)
+																	{
+			const uint8_t status[7] = {22, 50, 0x03, 100, 1, 7, 30};
+			replies.send(bluetooth::Command::STATUS, status, sizeof(status)); });
+		if (!server.start())
+		{
+			std::cout << "Benchmark skipped (cannot open control sockets)" << std::endl;
+			return;
+		}
+
+		auto connectClient = [&config, &server](bool tcp)
+		{
+			int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			int result;
+			if (tcp)
+			{
+				sockaddr_in address = {};
+				address.sin_family = AF_INET;
+				address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+				address.sin_port = htons(static_cast<uint16_t>(server.getTcpPort()));
+				result = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+			}
+			else
+			{
+				sockaddr_un address = {};
+				address.sun_family = AF_UNIX;
+				strncpy(address.sun_path, config.socketPath.c_str(), sizeof(address.sun_path) - 1);
+				result = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+			}
+			if (result != 0)
+			{
+				close(fd);
+				return -1;
+			}
+			return fd;
+		};
+
+		std::vector<uint8_t> request;
+		bluetooth::encodeFrame(bluetooth::Command::GET_STATUS, nullptr, 0, request);
+		for (int clientCount : {1, 64, 256, 512})
+		{
+			for (bool tcp : {false, true})
+			{
+				struct Client
+				{
+					int fd;
+					int remaining;
+					std::chrono::steady_clock::time_point sentAt;
+					bluetooth::FrameParser parser;
+				};
+				const int requestsPerClient = std::max(20, 20000 / clientCount);
+				std::vector<std::unique_ptr<Client>> clients;
+				int epollFd = epoll_create1(EPOLL_CLOEXEC);
+				for (int i = 0; i < clientCount; ++i)
+				{
+					int fd = connectClient(tcp);
+					if (fd < 0)
+					{
+						break;
+					}
+					clients.push_back(std::unique_ptr<Client>(new Client{fd, requestsPerClient, {}, {}}));
+					epoll_event event{};
+					event.events = EPOLLIN;
+					event.data.ptr = clients.back().get();
+					epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+				}
+				// Let the server accept everyone before timing starts
+				while (server.getClientCount() < clients.size())
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+
+				std::vector<double> latencies;
+				latencies.reserve(clients.size() * requestsPerClient);
+				size_t outstanding = clients.size();
+				auto start = std::chrono::steady_clock::now();
+				for (auto &client : clients)
+				{
+					client->sentAt = std::chrono::steady_clock::now();
+					ssize_t written = write(client->fd, request.data(), request.size());
+					(void)written;
+				}
+				epoll_event events[64];
+				while (outstanding > 0)
+				{
+					int count = epoll_wait(epollFd, events, 64, 1000);
+					if (count <= 0)
+					{
+						break;
+					}
+					for (int i = 0; i < count; ++i)
+					{
+						Client &client = *static_cast<Client *>(events[i].data.ptr);
+						uint8_t buffer[256];
+						ssize_t len = read(client.fd, buffer, sizeof(buffer));
+						if (len <= 0 || client.parser.feed(buffer, static_cast<size_t>(len), [](const bluetooth::Frame &) {}) == 0)
+						{
+							continue;
+						}
+						auto now = std::chrono::steady_clock::now();
+						latencies.push_back(std::chrono::duration<double, std::micro>(now - client.sentAt).count());
+						if (--client.remaining == 0)
+						{
+							--outstanding;
+							continue;
+						}
+						client.sentAt = now;
+						ssize_t written = write(client.fd, request.data(), request.size());
+						(void)written;
+					}
+				}
+				double elapsedS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				for (auto &client : clients)
+				{
+					close(client->fd);
+				}
+				close(epollFd);
+				while (server.getClientCount() > 0)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				if (latencies.empty())
+				{
+					continue;
+				}
+				std::sort(latencies.begin(), latencies.end());
+				std::cout << std::fixed << std::setprecision(1) << std::setw(4) << clients.size() << (tcp ? " TCP " : " Unix")
+									<< " clients: " << latencies.size() / elapsedS / 1000 << "k requests/s, p50 "
+									<< latencies[latencies.size() / 2] << " us, p99 " << latencies[latencies.size() * 99 / 100]
+									<< " us, max " << latencies.back() << " us" << std::endl;
+			}
+		}
+		server.stop();
+	}
+};
+
+int main()
+{
+	BenchmarkSuite benchmarkSuite;
+	benchmarkSuite.runAllBenchmarks();
+	return 0;
+}
@@ -0,0 +1,246 @@
+#ifndef ALARM_SCHEDULER_H
+#define ALARM_SCHEDULER_H
+
+#include "Clock.h"
+#include "Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Named wall-clock alarms, one-shot or repeating on chosen weekdays
+ * Pending triggers are kept in a min-heap and the earliest one arms a single
+ * absolute CLOCK_REALTIME timerfd, so the scheduler only wakes when an alarm is
+ * due. The timer is armed with TFD_TIMER_CANCEL_ON_SET: when the wall clock is
+ * set (NTP step, manual change) every alarm is recomputed from its local time
+ * of day instead of firing early, late or twice. On a virtual clock the
+ * scheduler sleeps on the clock itself.
+ */
+class AlarmScheduler
+{
+public:
+	// Bit n of Alarm::days selects tm_wday n (0 = Sunday)
+	static constexpr uint8_t ONCE = 0;
+	static constexpr uint8_t DAILY = 0x7F;
+	static constexpr uint8_t WEEKDAYS = 0x3E;
+	static constexpr uint8_t WEEKENDS = 0x41;
+
+	// A trigger this much past its time still fires; older ones are reported as missed
+	static constexpr std::chrono::seconds LATE_GRACE{60};
+
+	struct Alarm
+	{
+		std::string name;
+		int hour;						// 0-23, local time
+		int minute;					// 0-59
+		uint8_t days;				// Weekdays it repeats on, ONCE to fire a single time
+		bool buzzer;				// Sound the buzzer
+		int curtainPercent; // Curtain opening to move to, -1 to leave the curtain
+
+		Alarm()
+				: hour(0), minute(0), days(ONCE), buzzer(true), curtainPercent(-1) {}
+	};
+
+	// Called with missed = true for a trigger skipped because it was more than LATE_GRACE late
+	using TriggerCallback = std::function<void(const Alarm &alarm, bool missed)>;
+	using ErrorCallback = std::function<void(const std::string &error)>;
+
+	/**
+	 * @brief Constructor
+	 * @param clock Clock the alarms are scheduled on
+	 */
+	explicit AlarmScheduler(Clock &clock = Clock::system());
+
+	/**
+	 * @brief Destructor
+	 */
+	~AlarmScheduler();
+
+	AlarmScheduler(const AlarmScheduler &) = delete;
+	AlarmScheduler &operator=(const AlarmScheduler &) = delete;
+
+	/**
+	 * @brief Create the realtime timerfd; not needed on a virtual clock
+	 * @return true if initialization successful
+	 */
+	bool initialize();
+
+	/**
+	 * @brief Add an alarm, replacing any alarm of the same name
+	 * @param alarm Alarm to schedule
+	 * @return false if the name is empty or the time is out of range
+	 */
+	bool setAlarm(const Alarm &alarm);
+
+	/**
+	 * @brief Remove an alarm
+	 * @param name Alarm name
+	 * @return true if the alarm existed
+	 */
+	bool removeAlarm(const std::string &name);
+
+	/**
+	 * @brief Look up an alarm
+	 * @param name Alarm name
+	 * @param alarm Receives the alarm
+	 * @return true if the alarm exists
+	 */
+	bool getAlarm(const std::string &name, Alarm &alarm) const;
+
+	/**
+	 * @brief Get all scheduled alarms
+	 * @return Alarms in trigger order
+	 */
+	std::vector<Alarm> getAlarms() const;
+
+	/**
+	 * @brief Get the next trigger time of an alarm
+	 * @param name Alarm name
+	 * @return Trigger time, time_point::max() if there is no such alarm
+	 */
+	std::chrono::system_clock::time_point getNextTrigger(const std::string &name) const;
+
+	/**
+	 * @brief Compute the first trigger of an alarm after a point in time
+	 * @param alarm Alarm with the local time of day and weekdays
+	 * @param after Time the trigger must come after
+	 * @return Trigger time, time_point::max() if the alarm never triggers
+	 */
+	static std::chrono::system_clock::time_point nextOccurrence(const Alarm &alarm,
+																															std::chrono::system_clock::time_point after);
+
+	/**
+	 * @brief Start the scheduler thread
+	 */
+	void start();
+
+	/**
+	 * @brief Stop the scheduler thread; wakes it at once
+	 */
+	void stop();
+
+	/**
+	 * @brief Check if the scheduler thread is running
+	 * @return true between start() and stop()
+	 */
+	bool isRunning() const;
+
+	/**
+	 * @brief Get the timerfd that becomes readable when an alarm is due, for an external event loop
+	 * @return timerfd, -1 before initialize() or on a virtual clock
+	 */
+	int getTimerFd() const;
+
+	/**
+	 * @brief Fire the alarms that are due and re-arm the timer; called when the timerfd is readable
+	 */
+	void dispatch();
+
+	/**
+	 * @brief Get number of times the scheduler thread woke up
+	 * @return Wakeup count
+	 */
+	uint64_t getWakeupCount() const;
+
+	/**
+	 * @brief Register callback for alarm triggers
+	 * @param callback Function to call on the scheduler thread when an alarm triggers
+	 */
+	void registerTriggerCallback(TriggerCallback callback);
+
+	/**
+	 * @brief Register callback for error handling
+	 * @param callback Function to call when errors occur
+	 */
+	void registerErrorCallback(ErrorCallback callback);
+
+private:
+	struct Entry
+	{
+		Alarm alarm;
+		std::chrono::system_clock::time_point due;
+		std::chrono::system_clock::time_point lastDue; // Trigger handled last, never repeated after a clock change
+		uint64_t generation;													 // Heap entries of older generations are stale
+	};
+
+	struct QueueEntry
+	{
+		std::chrono::system_clock::time_point due;
+		uint64_t generation;
+		std::string name;
+	};
+
+	struct LaterDue
+	{
+		bool operator()(const QueueEntry &a, const QueueEntry &b) const
+		{
+			return a.due != b.due ? a.due > b.due : a.generation > b.generation;
+		}
+	};
+
+	Clock &m_clock;
+	int m_timerFd = -1;
+	int m_stopFd = -1;
+
+	mutable std::mutex m_mutex;
+	std::map<std::string, Entry> m_alarms;
+	std::vector<QueueEntry> m_queue; // Min-heap on due time
+	uint64_t m_nextGeneration = 1;
+
+	std::atomic<bool> m_running{false};
+	std::atomic<bool> m_stopRequested{false};
+	std::atomic<bool> m_changed{false}; // Wakes a virtual-clock sleep when the schedule changes
+	std::atomic<uint64_t> m_wakeups{0};
+	std::unique_ptr<std::thread> m_thread;
+
+	TriggerCallback m_triggerCallback;
+	ErrorCallback m_errorCallback;
+
+	Counter &m_missedCount;
+	Counter &m_clockChangeCount;
+
+	/**
+	 * @brief Compute an entry's next trigger and queue it
+	 * @param entry Alarm entry; caller holds m_mutex
+	 * @param after Time the trigger must come after
+	 */
+	void scheduleLocked(Entry &entry, std::chrono::system_clock::time_point after);
+
+	/**
+	 * @brief Recompute every trigger after the wall clock was set
+	 * @param now Current wall-clock time; caller holds m_mutex
+	 */
+	void resyncLocked(std::chrono::system_clock::time_point now);
+
+	/**
+	 * @brief Drop stale heap entries so the top is the next valid trigger
+	 * Caller holds m_mutex.
+	 */
+	void pruneLocked();
+
+	/**
+	 * @brief Arm the timerfd, or wake a virtual-clock sleep, for the earliest trigger
+	 * Caller holds m_mutex.
+	 */
+	void armLocked();
+
+	/**
+	 * @brief Wait for the next trigger, a schedule change or stop()
+	 * @return false if stopped
+	 */
+	bool waitForTrigger();
+
+	/**
+	 * @brief Scheduler thread function
+	 */
+	void schedulerThread();
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef BLUETOOTH_PROTOCOL_H
+#define BLUETOOTH_PROTOCOL_H
+
+#include "AlarmScheduler.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Framed binary protocol spoken over the rfcomm link
+ * Every message is START, command, payload length, payload, CRC-8. The CRC
+ * (polynomial 0x07) covers command, length and payload. A receiver that loses
+ * sync or sees a bad CRC drops one byte and looks for the next START, so noise
+ * costs at most the frames it overlaps. Requests are answered with ACK, or
+ * with STATUS / ALARM frames for queries. A subscribed client is also sent
+ * TELEMETRY frames carrying only the STATUS fields that changed.
+ */
+namespace bluetooth
+{
+	constexpr uint8_t FRAME_START = 0xAA;
+	constexpr size_t MAX_PAYLOAD = 32;
+	// START, command, length, payload, CRC
+	constexpr size_t FRAME_OVERHEAD = 4;
+	constexpr size_t MAX_FRAME = MAX_PAYLOAD + FRAME_OVERHEAD;
+	// Longest alarm name that fits an ALARM payload
+	constexpr size_t MAX_ALARM_NAME = MAX_PAYLOAD - 5;
+
+	enum class Command : uint8_t
+	{
+		// Requests
+		SET_MODE = 0x01,		 // [mode: 0 manual, 1 auto]
+		MOVE_TO = 0x02,			 // [percent 0-100]
+		SET_ALARM = 0x03,		 // Alarm payload, see encodeAlarm()
+		REMOVE_ALARM = 0x04, // [name...]
+		GET_STATUS = 0x05,	 // [] -> STATUS
+		LIST_ALARMS = 0x06,	 // [] -> one ALARM per alarm, then ACK
+		STOP_BUZZER = 0x07,	 // []
+		SUBSCRIBE = 0x08,		 // [0 off, 1 on] -> ACK, then TELEMETRY on every state change
+
+		// Replies
+		ACK = 0x80,		 // [request command, Status]
+		STATUS = 0x81, // [temperature (signed), humidity, flags, curtain %, system state, alarm hour, alarm minute]
+		ALARM = 0x82,	 // Alarm payload
+		TELEMETRY = 0x83 // [field mask, changed STATUS fields in order]; bit n of the mask is STATUS field n
+	};
+
+	enum class Status : uint8_t
+	{
+		OK = 0,
+		BAD_PAYLOAD = 1,		 // Wrong length or value out of range
+		UNKNOWN_COMMAND = 2, // Not a request this side understands
+		REJECTED = 3				 // Valid but not applicable, e.g. removing an alarm that does not exist
+	};
+
+	// STATUS flags byte
+	constexpr uint8_t STATUS_SENSOR_VALID = 0x01;
+	constexpr uint8_t STATUS_CURTAIN_OPEN = 0x02;
+	constexpr uint8_t STATUS_BUZZER_ON = 0x04;
+	constexpr uint8_t STATUS_ALARM_ENABLED = 0x08;
+
+	// STATUS payload, also the state TELEMETRY frames update field by field
+	constexpr size_t STATUS_FIELDS = 7;
+	using StatusFields = std::array<uint8_t, STATUS_FIELDS>;
+
+	struct Frame
+	{
+		Command command;
+		uint8_t length;
+		std::array<uint8_t, MAX_PAYLOAD> payload;
+	};
+
+	/**
+	 * @brief Compute the frame CRC
+	 * @param data Bytes to cover
+	 * @param length Number of bytes
+	 * @return CRC-8, polynomial 0x07, initial value 0
+	 */
+	uint8_t crc8(const uint8_t *data, size_t length);
+
+	/**
+	 * @brief Append an encoded frame to a byte buffer
+	 * @param command Frame command
+	 * @param payload Payload bytes, may be null when length is 0
+	 * @param length Payload length, at most MAX_PAYLOAD
+	 * @param out Buffer the frame is appended to
+	 * @return false if the payload is too long
+	 */
+	bool encodeFrame(Command command, const uint8_t *payload, size_t length, std::vector<uint8_t> &out);
+
+	/**
+	 * @brief Append an encoded frame to a byte buffer
+	 * @param frame Frame to encode
+	 * @param out Buffer the frame is appended to
+	 * @return false if the payload is too long
+	 */
+	bool encodeFrame(const Frame &frame, std::vector<uint8_t> &out);
+
+	/**
+	 * @brief Build a SET_ALARM or ALARM frame
+	 * Payload: hour, minute, weekday mask, buzzer (0/1), curtain % (0xFF to leave it), name.
+	 * @param command SET_ALARM or ALARM
+	 * @param alarm Alarm to encode; the name is cut to MAX_ALARM_NAME bytes
+	 * @return Frame with the alarm payload
+	 */
+	Frame encodeAlarm(Command command, const AlarmScheduler::Alarm &alarm);
+
+	/**
+	 * @brief Read the alarm out of a SET_ALARM or ALARM frame
+	 * @param frame Received frame
+	 * @param alarm Receives the alarm
+	 * @return false if the payload is malformed
+	 */
+	bool decodeAlarm(const Frame &frame, AlarmScheduler::Alarm &alarm);
+
+	/**
+	 * @brief Apply a TELEMETRY frame to a copy of the STATUS fields
+	 * @param frame Received frame
+	 * @param fields Fields to update
+	 * @return false if the frame is not well-formed telemetry
+	 */
+	bool applyTelemetry(const Frame &frame, StatusFields &fields);
+
+	/**
+	 * @brief Builds TELEMETRY frames as deltas against what the client was last sent
+	 * Only the latest state matters: a sender that falls behind encodes once it can
+	 * write again, and the delta then covers every change it skipped.
+	 */
+	class TelemetryEncoder
+	{
+	public:
+		TelemetryEncoder();
+
+		/**
+		 * @brief Encode the fields that differ from the last frame and remember them as sent
+		 * @param fields Current state
+		 * @param frame Receives the TELEMETRY frame
+		 * @return false if nothing changed
+		 */
+		bool encode(const StatusFields &fields, Frame &frame);
+
+		/**
+		 * @brief Make the next frame carry every field, e.g. for a new subscriber
+		 */
+		void reset();
+
+	private:
+		StatusFields m_sent;
+		bool m_keyframe = true;
+	};
+
+	/**
+	 * @brief Incremental frame decoder for a byte stream
+	 * Accepts the stream in pieces of any size, so frames split across reads and
+	 * several frames in one read both decode. Not thread-safe; one per stream.
+	 */
+	class FrameParser
+	{
+	public:
+		using FrameHandler = std::function<void(const Frame &frame)>;
+
+		// Accounting since construction
+		struct Stats
+		{
+			uint64_t frames;
+			uint64_t checksumErrors;
+			uint64_t discardedBytes; // Bytes skipped while looking for a valid frame
+		};
+
+		FrameParser();
+
+		/**
+		 * @brief Decode the next piece of the stream
+		 * @param data Received bytes
+		 * @param length Number of bytes
+		 * @param handler Function to call for each complete, valid frame
+		 * @return Number of frames decoded
+		 */
+		size_t feed(const uint8_t *data, size_t length, const FrameHandler &handler);
+
+		/**
+		 * @brief Drop any partial frame, e.g. after the link reconnects
+		 */
+		void reset();
+
+		/**
+		 * @brief Get decoder accounting
+		 * @return Stats since construction
+		 */
+		Stats getStats() const;
+
+	private:
+		// Room for several frames so a large read is copied in few steps
+		std::array<uint8_t, 8 * MAX_FRAME> m_buffer;
+		size_t m_size = 0;
+		Stats m_stats;
+
+		/**
+		 * @brief Decode every complete frame in the buffer and keep the incomplete tail
+		 * @param handler Function to call for each frame
+		 * @return Number of frames decoded
+		 */
+		size_t drain(const FrameHandler &handler);
+	};
+}
+
+#endif
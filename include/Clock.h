@@ -0,0 +1,185 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+
+/**
+ * @brief Source of time and sleeps for the device loops
+ * Components take a Clock so a simulation can run them on VirtualClock instead
+ * of the kernel clocks. Time points of a virtual clock only compare with readings
+ * of the same clock.
+ */
+class Clock
+{
+public:
+	using time_point = std::chrono::steady_clock::time_point;
+
+	virtual ~Clock() = default;
+
+	/**
+	 * @brief Get the clock shared by everything that runs in real time
+	 * @return steady_clock/system_clock backed clock, never destroyed
+	 */
+	static Clock &system();
+
+	/**
+	 * @brief Read monotonic time, for deadlines and intervals
+	 * @return Current time
+	 */
+	virtual time_point now() = 0;
+
+	/**
+	 * @brief Read wall-clock time, for alarms
+	 * @return Current calendar time
+	 */
+	virtual std::chrono::system_clock::time_point wallNow() = 0;
+
+	/**
+	 * @brief Block until a monotonic deadline; returns at once if it has passed
+	 * @param deadline Time to return at
+	 * @param cancel Flag that ends the sleep early once set and followed by interrupt()
+	 * @return true if the deadline was reached, false if cancelled
+	 */
+	virtual bool sleepUntil(time_point deadline, const std::atomic<bool> *cancel = nullptr) = 0;
+
+	/**
+	 * @brief Wake cancellable sleepers so they re-check their flags
+	 */
+	virtual void interrupt() = 0;
+
+	/**
+	 * @brief Check if time only moves under the clock's own control
+	 * @return true for a VirtualClock
+	 */
+	virtual bool isVirtual() const = 0;
+
+	/**
+	 * @brief Reserve a thread slot that holds virtual time until its owner first sleeps
+	 * Taken on the creating thread before a device thread starts, so time cannot
+	 * jump ahead of a thread that has not reached its loop yet. No-op in real time.
+	 */
+	virtual void attach();
+
+	/**
+	 * @brief Make the calling thread hold virtual time while it runs, in a slot taken with attach()
+	 */
+	virtual void bindThread();
+
+	/**
+	 * @brief Give back the slot the calling thread is bound to
+	 */
+	virtual void unbindThread();
+
+	/**
+	 * @brief Give back a slot from attach() that no thread was bound to
+	 */
+	virtual void detach();
+
+	/**
+	 * @brief Sleep for a duration
+	 * @param duration Time to sleep
+	 */
+	void sleepFor(std::chrono::nanoseconds duration);
+};
+
+/**
+ * @brief Deterministic clock for running scenarios faster than real time
+ * Threads that take part are attached: time stands still while any of them runs
+ * and jumps to the earliest deadline once all of them sleep, waking one attached
+ * sleeper at a time in deadline order. Every now() costs readCost of virtual time,
+ * so busy-wait loops make progress as they would on a CPU. An attached thread must
+ * not block on anything but this clock, e.g. join a device thread, or time stops
+ * for good; detach first. Unattached threads never hold time back.
+ */
+class VirtualClock : public Clock
+{
+public:
+	/**
+	 * @brief Binds the calling thread for its lifetime, e.g. the thread driving a scenario
+	 */
+	class Scope
+	{
+	public:
+		explicit Scope(Clock &clock);
+		~Scope();
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+	private:
+		Clock &m_clock;
+	};
+
+	/**
+	 * @brief Constructor
+	 * @param wallStart Calendar time of the start
+	 * @param readCost Virtual time consumed by every now()
+	 */
+	explicit VirtualClock(std::chrono::system_clock::time_point wallStart = std::chrono::system_clock::now(),
+												std::chrono::nanoseconds readCost = std::chrono::microseconds(1));
+
+	VirtualClock(const VirtualClock &) = delete;
+	VirtualClock &operator=(const VirtualClock &) = delete;
+
+	time_point now() override;
+	std::chrono::system_clock::time_point wallNow() override;
+	bool sleepUntil(time_point deadline, const std::atomic<bool> *cancel = nullptr) override;
+	void interrupt() override;
+	bool isVirtual() const override;
+	void attach() override;
+	void bindThread() override;
+	void unbindThread() override;
+	void detach() override;
+
+	/**
+	 * @brief Get time elapsed since construction without spending readCost
+	 * @return Virtual time since the start
+	 */
+	std::chrono::nanoseconds elapsed() const;
+
+private:
+	struct Sleeper
+	{
+		time_point deadline;
+		uint64_t sequence;
+		bool attached;
+		bool woken;
+		std::condition_variable wake; // Per sleeper, so a handoff wakes one thread only
+	};
+	struct EarlierDeadline
+	{
+		bool operator()(const Sleeper *a, const Sleeper *b) const
+		{
+			return a->deadline != b->deadline ? a->deadline < b->deadline : a->sequence < b->sequence;
+		}
+	};
+
+	mutable std::mutex m_mutex;
+	const time_point m_start;
+	const std::chrono::system_clock::time_point m_wallStart;
+	const std::chrono::nanoseconds m_readCost;
+	time_point m_now;
+	int m_running = 0; // Attached threads not sleeping, plus slots not bound yet
+	int m_unbound = 0; // Slots from attach() waiting for bindThread()
+	uint64_t m_nextSequence = 0;
+	std::set<Sleeper *, EarlierDeadline> m_sleepers;
+
+	/**
+	 * @brief Check if the calling thread holds a slot of this clock
+	 * @return true if bound
+	 */
+	bool isBound() const;
+
+	/**
+	 * @brief Move time forward while no attached thread runs and wake the sleepers it reaches
+	 * Caller holds m_mutex.
+	 */
+	void dispatchLocked();
+};
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include "BluetoothProtocol.h"
+#include "EventLoop.h"
+#include "Metrics.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Serves the framed control protocol to many clients at once
+ * Clients reach the same command set over the rfcomm tty, a Unix domain socket
+ * and a loopback TCP port. Every descriptor is driven by one epoll loop, either
+ * the server's own thread or an EventLoop it is attached to. Each client has
+ * its own frame parser, bounded outgoing queue and telemetry state. A ready
+ * client gets one bounded read per loop turn, and one whose replies back up is
+ * not read until it drains them, so a busy or stalled client cannot starve the
+ * others.
+ */
+class ControlServer
+{
+	struct Client;
+
+public:
+	enum class Transport
+	{
+		RFCOMM,
+		UNIX,
+		TCP
+	};
+
+	struct Config
+	{
+		std::string ttyDevice;	// rfcomm tty, empty to disable
+		std::string socketPath; // Unix socket path, empty to disable
+		int tcpPort;						// Loopback TCP port, 0 for any free port, -1 to disable
+		size_t maxClients;			// Further connections are closed at once
+
+		Config()
+				: tcpPort(-1), maxClients(256) {}
+	};
+
+	/**
+	 * @brief Queues reply frames to the client whose request is being handled
+	 */
+	class Replies
+	{
+	public:
+		/**
+		 * @brief Collect replies outside any connection, e.g. to replay recorded requests
+		 * @param captured Receives every frame sent
+		 * @param transport Transport reported to the handler
+		 */
+		Replies(std::vector<bluetooth::Frame> &captured, Transport transport);
+
+		/**
+		 * @brief Queue a reply frame
+		 * @param command Frame command
+		 * @param payload Payload bytes, may be null when length is 0
+		 * @param length Payload length
+		 * @return false if the client's queue is full and the frame was dropped, or the payload is too long
+		 */
+		bool send(bluetooth::Command command, const uint8_t *payload = nullptr, size_t length = 0);
+
+		/**
+		 * @brief Queue a reply frame
+		 * @param frame Frame to send
+		 * @return false if the client's queue is full and the frame was dropped
+		 */
+		bool send(const bluetooth::Frame &frame);
+
+		/**
+		 * @brief Get the transport of the requesting client
+		 * @return Transport the request arrived on
+		 */
+		Transport transport() const;
+
+	private:
+		friend class ControlServer;
+		Replies(ControlServer &server, Client &client);
+
+		ControlServer *m_server;
+		Client *m_client;
+		std::vector<bluetooth::Frame> *m_captured; // Set instead of the client when collecting
+		Transport m_transport;
+	};
+
+	// Handles every request except SUBSCRIBE, which the server answers per client
+	using RequestHandler = std::function<void(const bluetooth::Frame &request, Replies &replies)>;
+	// Current STATUS fields, read on the loop thread when telemetry is due
+	using TelemetrySource = std::function<bluetooth::StatusFields()>;
+	using ErrorCallback = std::function<void(const std::string &error)>;
+
+	/**
+	 * @brief Constructor
+	 * @param config Transports to serve
+	 */
+	explicit ControlServer(const Config &config);
+
+	/**
+	 * @brief Destructor
+	 */
+	~ControlServer();
+
+	ControlServer(const ControlServer &) = delete;
+	ControlServer &operator=(const ControlServer &) = delete;
+
+	/**
+	 * @brief Open the configured transports; each one that fails is reported to the error callback
+	 * @return true if at least one transport is open
+	 */
+	bool open();
+
+	/**
+	 * @brief Serve clients from a background thread with its own event loop
+	 * @return true if the server is running
+	 */
+	bool start();
+
+	/**
+	 * @brief Serve clients from an existing event loop; call before it runs or on its thread
+	 * @param loop Loop to register the descriptors with
+	 * @return true if every descriptor was registered
+	 */
+	bool attach(EventLoop &loop);
+
+	/**
+	 * @brief Stop serving, disconnect every client and close the transports
+	 * With an attached loop, call after that loop stopped and before it is destroyed.
+	 */
+	void stop();
+
+	/**
+	 * @brief Check if any transport is open
+	 * @return true between open() and stop()
+	 */
+	bool isOpen() const;
+
+	/**
+	 * @brief Tell subscribed clients that the state changed; safe to call from any thread, never blocks
+	 * Changes signalled before the loop gets to them are sent as one frame.
+	 */
+	void notifyChange();
+
+	/**
+	 * @brief Get the TCP port actually bound
+	 * @return Port number, -1 if TCP is not open
+	 */
+	int getTcpPort() const;
+
+	/**
+	 * @brief Get number of connected clients, the rfcomm link included
+	 * @return Client count
+	 */
+	size_t getClientCount() const;
+
+	/**
+	 * @brief Register the handler for client requests
+	 * @param handler Function to call on the loop thread for each request
+	 */
+	void registerRequestHandler(RequestHandler handler);
+
+	/**
+	 * @brief Register the source of telemetry state
+	 * @param source Function returning the current STATUS fields
+	 */
+	void registerTelemetrySource(TelemetrySource source);
+
+	/**
+	 * @brief Register callback for error handling
+	 * @param callback Function to call when errors occur
+	 */
+	void registerErrorCallback(ErrorCallback callback);
+
+private:
+	struct Client
+	{
+		int fd;
+		Transport transport;
+		bluetooth::FrameParser parser;
+		std::vector<uint8_t> out; // Bounded; whole frames are queued or dropped
+		uint32_t events = 0;			// Events registered with the loop
+		bluetooth::TelemetryEncoder telemetry;
+		bool subscribed = false;
+		bool telemetryDue = false; // A change has not been sent yet
+	};
+
+	Config m_config;
+	int m_ttyFd = -1;
+	int m_unixFd = -1;
+	int m_tcpFd = -1;
+	int m_tcpPort = -1;
+	int m_wakeFd = -1; // Signalled by notifyChange()
+
+	// Loop the descriptors are registered with; clients belong to its thread
+	EventLoop *m_loop = nullptr;
+	std::unique_ptr<EventLoop> m_ownLoop;
+	std::unique_ptr<std::thread> m_serverThread;
+	std::map<int, std::unique_ptr<Client>> m_clients;
+	std::atomic<size_t> m_clientCount{0};
+	std::atomic<int> m_subscribers{0};
+	std::atomic<bool> m_changePending{false};
+
+	RequestHandler m_requestHandler;
+	TelemetrySource m_telemetrySource;
+	ErrorCallback m_errorCallback;
+
+	struct ServerMetrics
+	{
+		Counter &accepted;
+		Counter &rejected;
+		Counter &requests;
+		Counter &bytes;
+		Counter &checksumErrors;
+		Counter &droppedReplyBytes;
+		Counter &telemetryFrames;
+		Counter &telemetryCoalesced;
+		Histogram &requestTime;
+	};
+	ServerMetrics m_metrics;
+
+	/**
+	 * @brief Open the rfcomm tty in raw mode
+	 * @return true if successful
+	 */
+	bool openTty();
+
+	/**
+	 * @brief Bind and listen on the Unix socket
+	 * @return true if successful
+	 */
+	bool openUnix();
+
+	/**
+	 * @brief Bind and listen on the loopback TCP port
+	 * @return true if successful
+	 */
+	bool openTcp();
+
+	/**
+	 * @brief Register a connected client with the loop
+	 * @param fd Client descriptor, owned by the server from now on
+	 * @param transport Transport it arrived on
+	 * @return true if the client was added
+	 */
+	bool addClient(int fd, Transport transport);
+
+	/**
+	 * @brief Disconnect a client
+	 * @param fd Client descriptor
+	 */
+	void removeClient(int fd);
+
+	/**
+	 * @brief Accept pending connections on a listening socket
+	 * @param listenFd Listening descriptor
+	 * @param transport Transport of the socket
+	 */
+	void acceptClients(int listenFd, Transport transport);
+
+	/**
+	 * @brief Handle readiness of a client
+	 * @param fd Client descriptor
+	 * @param events epoll event mask
+	 */
+	void serviceClient(int fd, uint32_t events);
+
+	/**
+	 * @brief Read one budget of input and dispatch its frames
+	 * @param client Client to read
+	 * @return false if the client disconnected
+	 */
+	bool readClient(Client &client);
+
+	/**
+	 * @brief Answer SUBSCRIBE for one client
+	 * @param client Requesting client
+	 * @param request Received frame
+	 */
+	void subscribe(Client &client, const bluetooth::Frame &request);
+
+	/**
+	 * @brief Queue a frame for a client, or drop it if the queue is full
+	 * @param client Destination
+	 * @param command Frame command
+	 * @param payload Payload bytes
+	 * @param length Payload length
+	 * @return false if the frame was dropped
+	 */
+	bool queueFrame(Client &client, bluetooth::Command command, const uint8_t *payload, size_t length);
+
+	/**
+	 * @brief Write as much of a client's queue as it takes without blocking
+	 * @param client Client to flush
+	 * @return false if the client disconnected
+	 */
+	bool flush(Client &client);
+
+	/**
+	 * @brief Flush a client and, once its queue is empty, send telemetry that is due
+	 * @param client Client to serve
+	 * @return false if the client disconnected
+	 */
+	bool pump(Client &client);
+
+	/**
+	 * @brief Register the events a client's queue calls for
+	 * @param client Client to update
+	 */
+	void updateEvents(Client &client);
+
+	/**
+	 * @brief Mark telemetry due for every subscriber; called when notifyChange() was signalled
+	 */
+	void dispatchChange();
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef CYCLIC_EXECUTIVE_H
+#define CYCLIC_EXECUTIVE_H
+
+#include "Clock.h"
+#include "Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Time-triggered scheduler running device work from a static frame table
+ * Time is cut into minor frames of fixed length and the table repeats every major
+ * frame, the least common multiple of the task periods. Shared tasks run one
+ * after another in their frames, which must fit the sum of their budgets; an
+ * exclusive window owns one or more whole frames, nothing else is placed in them,
+ * and windowLock() is held exclusively while it runs so components outside the
+ * table can stay off the GPIO chip. The table is checked as tasks are added, so
+ * a schedule that starts is one where no two pieces of work ever overlap.
+ *
+ * A window is violated when it is skipped, when the frame before it runs into it
+ * or when it runs past its frames. Frames that passed entirely while earlier work
+ * overran are skipped rather than run in a burst. On a virtual clock the frames
+ * are on virtual time and the executive thread is attached.
+ */
+class CyclicExecutive
+{
+public:
+	using Body = std::function<void()>;
+	using ErrorCallback = std::function<void(const std::string &error)>;
+
+	// Accounting of one task since start()
+	struct TaskStats
+	{
+		std::string name;
+		bool exclusive;
+		uint32_t period;										// Frames between releases
+		uint32_t offset;										// Frame of the first release within the period
+		uint32_t frames;										// Frames the task owns, 0 for a shared task
+		std::chrono::microseconds budget;		// Time it may run each release
+		uint64_t runs;
+		uint64_t missed;										// Releases in frames that were skipped
+		uint64_t overruns;									// Runs longer than the budget
+		uint64_t violations;								// Windows that were not kept, exclusive tasks only
+		std::chrono::microseconds maxRunTime;
+		double utilization;									// Share of the elapsed time spent running it
+	};
+
+	// Schedule accounting since start()
+	struct Stats
+	{
+		uint64_t frames;										// Minor frames elapsed
+		uint64_t skippedFrames;							// Frames passed over after an overrun
+		uint64_t windowViolations;					// Sum over the exclusive tasks
+		double utilization;									// Busy share of the elapsed frames
+		double peakFrameUtilization;				// Busiest frame, above 1.0 when one overran
+		std::chrono::microseconds maxLateness; // Worst frame start behind its release
+		std::vector<TaskStats> tasks;				// In the order they were added
+	};
+
+	// Frame length suited to keypad scans and a DHT11 read spanning a few frames
+	static constexpr std::chrono::milliseconds DEFAULT_MINOR_FRAME{10};
+	// Largest major frame the table may grow to, in minor frames
+	static constexpr uint32_t MAX_MAJOR_FRAME = 6000;
+
+	/**
+	 * @brief Constructor
+	 * @param name Executive name; metrics are registered as <name>_*
+	 * @param minorFrame Length of one frame
+	 * @param clock Clock the frames are scheduled on
+	 */
+	explicit CyclicExecutive(const std::string &name = "cyclic",
+													 std::chrono::nanoseconds minorFrame = DEFAULT_MINOR_FRAME,
+													 Clock &clock = Clock::system());
+
+	/**
+	 * @brief Destructor
+	 */
+	~CyclicExecutive();
+
+	CyclicExecutive(const CyclicExecutive &) = delete;
+	CyclicExecutive &operator=(const CyclicExecutive &) = delete;
+
+	/**
+	 * @brief Place a shared task in the table; only before start()
+	 * @param name Task name; metrics are registered as <executive>_<name>_*
+	 * @param period Frames between releases
+	 * @param offset Frame of the first release, below period
+	 * @param budget Time the task may run each release
+	 * @param body Work done at each release
+	 * @return false if a frame it lands in is reserved or would exceed the frame length
+	 */
+	bool addTask(const std::string &name, uint32_t period, uint32_t offset, std::chrono::nanoseconds budget, Body body);
+
+	/**
+	 * @brief Reserve an exclusive window at the first offset where it fits; only before start()
+	 * @param name Task name; metrics are registered as <executive>_<name>_*
+	 * @param period Frames between windows
+	 * @param length Time the window must cover; it owns enough whole frames for it
+	 * @param body Work done in each window
+	 * @return Offset of the window within the period, -1 if no offset is free of other work
+	 */
+	int reserveWindow(const std::string &name, uint32_t period, std::chrono::nanoseconds length, Body body);
+
+	/**
+	 * @brief Start the executive thread
+	 * @return false if running already or no task was added
+	 */
+	bool start();
+
+	/**
+	 * @brief Stop after the frame in progress
+	 */
+	void stop();
+
+	/**
+	 * @brief Check if the executive thread is running
+	 * @return true between start() and stop()
+	 */
+	bool isRunning() const;
+
+	/**
+	 * @brief Get schedule accounting
+	 * @return Stats published after every frame
+	 */
+	Stats getStats() const;
+
+	/**
+	 * @brief Get the length of a minor frame
+	 * @return Frame length
+	 */
+	std::chrono::nanoseconds getMinorFrame() const;
+
+	/**
+	 * @brief Get the length of the table
+	 * @return Major frame in minor frames
+	 */
+	uint32_t getMajorFrame() const;
+
+	/**
+	 * @brief Get the lock held exclusively for every window
+	 * Work outside the table that must not overlap a window takes it shared.
+	 * @return Window lock
+	 */
+	std::shared_timed_mutex &windowLock();
+
+	/**
+	 * @brief Set SCHED_FIFO priority of the executive thread
+	 * @param priority 1-99, or 0 to keep the default scheduler
+	 */
+	void setRealtimePriority(int priority);
+
+	/**
+	 * @brief Register callback for error handling
+	 * @param callback Function to call when errors occur
+	 */
+	void registerErrorCallback(ErrorCallback callback);
+
+private:
+	struct Task
+	{
+		std::string name;
+		uint32_t period;
+		uint32_t offset;
+		uint32_t frames; // 0 for a shared task
+		std::chrono::nanoseconds budget;
+		Body body;
+		Counter *overrunCount;
+		Histogram *runTime;
+		// Written by the executive thread under m_statsMutex
+		uint64_t runs;
+		uint64_t missed;
+		uint64_t overruns;
+		uint64_t violations;
+		int64_t maxRunNs;
+		int64_t busyNs;
+	};
+
+	// What one frame of the table does
+	struct Frame
+	{
+		std::vector<size_t> shared; // Tasks run in this frame, in order
+		int window = -1;						// Task owning the frame
+		bool windowStart = false;		// The window's body runs in this frame
+	};
+
+	std::string m_name;
+	std::chrono::nanoseconds m_minorFrame;
+	Clock &m_clock;
+	std::vector<Task> m_tasks;
+	std::vector<Frame> m_table; // One major frame
+	int m_rtPriority = 0;
+	std::shared_timed_mutex m_windowLock;
+
+	std::atomic<bool> m_running{false};
+	std::atomic<bool> m_stopRequested{false};
+	std::unique_ptr<std::thread> m_thread;
+
+	mutable std::mutex m_statsMutex;
+	uint64_t m_frames = 0;
+	uint64_t m_skippedFrames = 0;
+	int64_t m_busyNs = 0;
+	double m_peakFrameUtilization = 0.0;
+	int64_t m_maxLatenessNs = 0;
+
+	Counter &m_frameCount;
+	Counter &m_skippedCount;
+	Counter &m_violationCount;
+	Histogram &m_lateness;
+	Histogram &m_frameUtilization;
+
+	ErrorCallback m_errorCallback;
+
+	/**
+	 * @brief Build the table for a set of tasks
+	 * @param tasks Tasks to place
+	 * @param table Receives one major frame
+	 * @return false if two tasks collide or a frame is over budget
+	 */
+	bool buildTable(const std::vector<Task> &tasks, std::vector<Frame> &table) const;
+
+	/**
+	 * @brief Add a task if the table still builds with it
+	 * @param task Task to add
+	 * @return true if added
+	 */
+	bool place(Task task);
+
+	/**
+	 * @brief Executive thread function; runs the table frame by frame
+	 */
+	void executiveThread();
+
+	/**
+	 * @brief Run one task and account for it
+	 * @param task Task to run
+	 * @param limitNs Run time above which it overran
+	 * @return Time it ran in nanoseconds
+	 */
+	int64_t runTask(Task &task, int64_t limitNs);
+
+	/**
+	 * @brief Read the executive's clock
+	 * @return Current time in nanoseconds
+	 */
+	int64_t nowNs();
+
+	/**
+	 * @brief Apply the configured real-time priority to the calling thread
+	 */
+	void applyRealtimePriority();
+};
+
+#endif
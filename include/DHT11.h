@@ -1,7 +1,6 @@
 #ifndef DHT11_H
 #define DHT11_H
 
-#include <gpiod.hpp>
 #include <chrono>
 #include <thread>
 #include <iostream>
@@ -13,12 +12,20 @@
 #include <mutex>
 #include <atomic>
 #include <string>
+#include <vector>
+#include "Clock.h"
+#include "SeqLock.h"
+#include "Metrics.h"
+#include "PeriodicTask.h"
+#include "Gpio.h"
 
 /**
  * @brief DHT11 Temperature and Humidity Sensor Class
  * Provides real-time sensor data with callback-based event handling
+ * @tparam Gpio GPIO backend policy from Gpio.h
  */
-class DHT11Sensor
+template <typename Gpio>
+class BasicDHT11Sensor
 {
 public:
 	// Callback types for sensor events
@@ -34,17 +41,44 @@ public:
 		std::chrono::steady_clock::time_point timestamp;
 	};
 
+	// Strategy used to recover the 40-bit frame from the data line
+	enum class ReadMode
+	{
+		POLLING,		// Busy-wait on the line level and time pulses in user space
+		EDGE_EVENTS // Rebuild the frame from kernel-timestamped edge events
+	};
+
+	// Single transition captured on the data line
+	struct EdgeEvent
+	{
+		std::chrono::nanoseconds timestamp;
+		bool rising;
+	};
+
+	// Timing of the host-to-sensor handover during the last read
+	struct ResponseTiming
+	{
+		std::chrono::nanoseconds directionSwitch; // Time spent handing the line over after the start pulse
+		std::chrono::nanoseconds turnaround;			// Line release to first sensor edge, negative if not seen
+	};
+
+	// Response preamble (2 edges), 40 bits (2 edges each), end-of-frame pulse (2 edges)
+	static constexpr size_t FRAME_EDGE_COUNT = 84;
+
 	/**
 	 * @brief Constructor
 	 * @param chipName GPIO chip name
 	 * @param pin GPIO pin number for DHT11 data line
+	 * @param mode Frame decoding strategy
+	 * @param clock Clock for timing the frame and scheduling reads
 	 */
-	DHT11Sensor(const std::string &chipName, int pin);
+	BasicDHT11Sensor(const std::string &chipName, int pin, ReadMode mode = ReadMode::POLLING,
+									 Clock &clock = Clock::system());
 
 	/**
 	 * @brief Destructor
 	 */
-	~DHT11Sensor();
+	~BasicDHT11Sensor();
 
 	/**
 	 * @brief Initialize the sensor
@@ -63,6 +97,49 @@ public:
 	 */
 	void stopMonitoring();
 
+	/**
+	 * @brief Perform a single blocking measurement and publish it to callbacks
+	 * @return true if a valid reading was obtained
+	 */
+	bool readOnce();
+
+	/**
+	 * @brief Select the frame decoding strategy used by subsequent reads
+	 * @param mode Polling or edge-event decoding
+	 */
+	void setReadMode(ReadMode mode);
+
+	/**
+	 * @brief Get the active frame decoding strategy
+	 * @return Current ReadMode
+	 */
+	ReadMode getReadMode() const;
+
+	/**
+	 * @brief Decode a DHT11 frame from captured edge timestamps
+	 * @param edges Edges in capture order
+	 * @param data Output array [humidity_high, humidity_low, temp_high, temp_low, checksum]
+	 * @return true if enough high pulses were found to rebuild all 40 bits
+	 */
+	static bool decodeEdges(const std::vector<EdgeEvent> &edges, std::array<uint8_t, 5> &data);
+
+	/**
+	 * @brief Measure the time from line release to the sensor's first falling edge
+	 * @param edges Edges in capture order
+	 * @param releaseTime Monotonic timestamp at which the host released the line
+	 * @param turnaround Output turnaround time
+	 * @return true if a falling edge was found after the release
+	 */
+	static bool measureTurnaround(const std::vector<EdgeEvent> &edges,
+																std::chrono::nanoseconds releaseTime,
+																std::chrono::nanoseconds &turnaround);
+
+	/**
+	 * @brief Get handover timing measured during the last read
+	 * @return ResponseTiming of the last start signal
+	 */
+	ResponseTiming getLastResponseTiming() const;
+
 	/**
 	 * @brief Get latest sensor reading
 	 * @return SensorData structure with latest values
@@ -70,7 +147,8 @@ public:
 	SensorData getLatestReading() const;
 
 	/**
-	 * @brief Register callback for sensor data updates
+	 * @brief Register callback for sensor data updates; may be called while monitoring
+	 * The callback runs on the reading thread and delays the next read, so slow work belongs on an EventBus.
 	 * @param callback Function to call when new data is available
 	 */
 	void registerDataCallback(SensorDataCallback callback);
@@ -90,24 +168,69 @@ public:
 private:
 	std::string m_chipName;
 	int m_pin;
-	std::unique_ptr<gpiod::chip> m_chip;
-	std::unique_ptr<gpiod::line> m_dataLine;
+	Clock &m_clock;
+	std::unique_ptr<typename Gpio::chip> m_chip;
+	std::unique_ptr<typename Gpio::line> m_dataLine;
+
+	// Written only by the reading thread, read lock-free by everyone else
+	SeqLock<SensorData> m_latestData;
 
-	mutable std::mutex m_dataMutex;
-	SensorData m_latestData;
+	std::atomic<ReadMode> m_readMode;
+	std::vector<EdgeEvent> m_edgeBuffer;
+	bool m_lineHoldsEvents = false;
+	std::chrono::steady_clock::time_point m_releaseTime;
+	ResponseTiming m_timing;
+	SeqLock<ResponseTiming> m_lastTiming;
 
 	std::atomic<bool> m_monitoring{false};
 	std::unique_ptr<std::thread> m_monitorThread;
+	std::unique_ptr<PeriodicTask> m_monitorTask;
 
+	// Held while the data callback runs, so registering never races with an invocation
+	std::mutex m_callbackMutex;
 	SensorDataCallback m_dataCallback;
 	ErrorCallback m_errorCallback;
 
+	// Registered as dht11_pin<N>_* so sensors on a bus report separately
+	struct SensorMetrics
+	{
+		Counter &reads;
+		Counter &successes;
+		Counter &checksumErrors;
+		Counter &startSignalErrors;
+		Counter &responseTimeouts;
+		Counter &bitTimeouts;
+		Counter &incompleteFrames;
+		Histogram &readTime;
+		Histogram &callbackTime;
+	};
+	SensorMetrics m_metrics;
+
+	/**
+	 * @brief Look up the metrics of a sensor pin
+	 * @param pin GPIO pin number
+	 * @return References into the process-wide registry
+	 */
+	static SensorMetrics resolveMetrics(int pin);
+
 	/**
 	 * @brief Internal method to read sensor data
 	 * @return Array containing [humidity_high, humidity_low, temp_high, temp_low, checksum]
 	 */
 	std::array<uint8_t, 5> readRawData();
 
+	/**
+	 * @brief Read sensor data by polling the line level
+	 * @return Raw frame bytes
+	 */
+	std::array<uint8_t, 5> readRawDataPolling();
+
+	/**
+	 * @brief Read sensor data from kernel edge events
+	 * @return Raw frame bytes
+	 */
+	std::array<uint8_t, 5> readRawDataEdges();
+
 	/**
 	 * @brief Validate checksum of sensor data
 	 * @param data Raw sensor data array
@@ -116,15 +239,21 @@ private:
 	bool validateChecksum(const std::array<uint8_t, 5> &data) const;
 
 	/**
-	 * @brief Background monitoring thread function
-	 * @param intervalMs Measurement interval in milliseconds
+	 * @brief Background monitoring thread function; reads once per m_monitorTask period
+	 */
+	void monitoringThread();
+
+	/**
+	 * @brief Hold the data line in the configuration a read mode needs
+	 * @param mode EDGE_EVENTS claims an event request, POLLING an open-drain line
 	 */
-	void monitoringThread(int intervalMs);
+	void claimLine(ReadMode mode);
 
 	/**
 	 * @brief Send timing pulse to DHT11
+	 * @param mode Decoding strategy the line is handed over to afterwards
 	 */
-	bool sendStartSignal();
+	bool sendStartSignal(ReadMode mode);
 
 	/**
 	 * @brief Wait for DHT11 response
@@ -136,4 +265,16 @@ private:
 	 */
 	int readBit();
 };
+
+template <typename Gpio>
+constexpr size_t BasicDHT11Sensor<Gpio>::FRAME_EDGE_COUNT;
+
+using DHT11Sensor = BasicDHT11Sensor<gpio::Default>;
+
+// Instantiated in DHT11.cpp for every available backend
+extern template class BasicDHT11Sensor<gpio::Simulated>;
+#ifdef SMART_CURTAIN_HAVE_LIBGPIOD
+extern template class BasicDHT11Sensor<gpio::Libgpiod>;
+#endif
+
 #endif
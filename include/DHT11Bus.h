@@ -0,0 +1,166 @@
+#ifndef DHT11_BUS_H
+#define DHT11_BUS_H
+
+#include "DHT11.h"
+#include "Clock.h"
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/**
+ * @brief Manager for several DHT11 sensors sharing one scheduling thread
+ * Reads are staggered across the interval so only one sensor is bit-banged at a time
+ * @tparam Gpio GPIO backend policy from Gpio.h
+ */
+template <typename Gpio>
+class BasicDHT11Bus
+{
+public:
+	using Sensor = BasicDHT11Sensor<Gpio>;
+	using SensorDataCallback = typename Sensor::SensorDataCallback;
+	using ErrorCallback = typename Sensor::ErrorCallback;
+
+	// Per-sensor read statistics
+	struct SensorStats
+	{
+		int pin;
+		uint64_t reads;
+		uint64_t successes;
+		uint64_t failures;
+		double successRate; // 0.0 - 1.0
+	};
+
+	/**
+	 * @brief Constructor
+	 * @param chipName GPIO chip name shared by all sensors
+	 * @param mode Frame decoding strategy used by every sensor
+	 * @param clock Clock the reads are scheduled and timed on
+	 */
+	explicit BasicDHT11Bus(const std::string &chipName,
+												 typename Sensor::ReadMode mode = Sensor::ReadMode::POLLING,
+												 Clock &clock = Clock::system());
+
+	/**
+	 * @brief Destructor
+	 */
+	~BasicDHT11Bus();
+
+	/**
+	 * @brief Add a sensor to the bus
+	 * @param pin GPIO pin number of the sensor data line
+	 * @param callback Function to call when the sensor produces data
+	 * @return Sensor index, or -1 if the bus is already running
+	 */
+	int addSensor(int pin, SensorDataCallback callback);
+
+	/**
+	 * @brief Initialize all sensors
+	 * @return true if every sensor initialized
+	 */
+	bool initialize();
+
+	/**
+	 * @brief Start the scheduling thread
+	 * @param intervalMs Measurement interval per sensor in milliseconds
+	 */
+	void start(int intervalMs = 2000);
+
+	/**
+	 * @brief Stop the scheduling thread
+	 */
+	void stop();
+
+	/**
+	 * @brief Check if the bus is running
+	 * @return true if the scheduling thread is active
+	 */
+	bool isRunning() const;
+
+	/**
+	 * @brief Get number of sensors on the bus
+	 * @return Sensor count
+	 */
+	size_t sensorCount() const;
+
+	/**
+	 * @brief Get read statistics for one sensor
+	 * @param index Sensor index returned by addSensor()
+	 * @return SensorStats for the sensor
+	 */
+	SensorStats getSensorStats(size_t index) const;
+
+	/**
+	 * @brief Get latest reading of one sensor
+	 * @param index Sensor index returned by addSensor()
+	 * @return SensorData with latest values
+	 */
+	typename Sensor::SensorData getLatestReading(size_t index) const;
+
+	/**
+	 * @brief Register callback for error handling
+	 * @param callback Function to call when any sensor reports an error
+	 */
+	void registerErrorCallback(ErrorCallback callback);
+
+	/**
+	 * @brief Set SCHED_FIFO priority of the scheduling thread
+	 * @param priority 1-99, or 0 to keep the default scheduler
+	 */
+	void setRealtimePriority(int priority);
+
+	/**
+	 * @brief Compute the read offset of a sensor within the interval
+	 * @param index Sensor index
+	 * @param count Number of sensors
+	 * @param intervalMs Measurement interval in milliseconds
+	 * @return Offset from the start of each interval
+	 */
+	static std::chrono::microseconds staggerOffset(size_t index, size_t count, int intervalMs);
+
+private:
+	struct Slot
+	{
+		int pin;
+		std::unique_ptr<Sensor> sensor;
+		std::atomic<uint64_t> reads{0};
+		std::atomic<uint64_t> successes{0};
+		std::chrono::steady_clock::time_point nextRead;
+	};
+
+	std::string m_chipName;
+	typename Sensor::ReadMode m_readMode;
+	Clock &m_clock;
+	std::vector<std::unique_ptr<Slot>> m_slots;
+	int m_rtPriority = 50;
+	bool m_initialized = false;
+
+	std::atomic<bool> m_running{false};
+	std::atomic<bool> m_stopRequested{false};
+	std::unique_ptr<std::thread> m_busThread;
+
+	ErrorCallback m_errorCallback;
+
+	/**
+	 * @brief Background scheduling thread function
+	 * @param intervalMs Measurement interval per sensor in milliseconds
+	 */
+	void schedulingThread(int intervalMs);
+
+	/**
+	 * @brief Apply the configured real-time priority to the calling thread
+	 */
+	void applyRealtimePriority();
+};
+
+using DHT11Bus = BasicDHT11Bus<gpio::Default>;
+
+// Instantiated in DHT11Bus.cpp for every available backend
+extern template class BasicDHT11Bus<gpio::Simulated>;
+#ifdef SMART_CURTAIN_HAVE_LIBGPIOD
+extern template class BasicDHT11Bus<gpio::Libgpiod>;
+#endif
+
+#endif
@@ -1,14 +1,63 @@
 #ifndef Delay_H
 #define Delay_H
 
+#include "Clock.h"
 #include <cstdint>
 #include <chrono>
 #include <unistd.h>
 
-void delay_us(int n);
+// Measured cost of the delay building blocks on this machine
+struct DelayCalibration
+{
+	int64_t clockReadNs;		 // One CLOCK_MONOTONIC read
+	int64_t sleepOvershootNs; // Typical lateness of an absolute clock_nanosleep
+	int64_t spinThresholdNs;	 // Final part of every delay that is spun; follows observed wakeups
+};
 
-void delay_ms(int n);
+// Achieved accuracy of all delays so far (error = wakeup - deadline, never negative)
+struct DelayStats
+{
+	uint64_t count;
+	int64_t meanErrorNs;
+	int64_t p99ErrorNs;
+	int64_t maxErrorNs;
+};
 
-void delay_s(int n);
+/**
+ * @brief Delay by sleeping for the coarse part and spinning on CLOCK_MONOTONIC for the rest
+ * The first call calibrates; timer slack of the calling thread is reduced to 1ns on its first delay.
+ * On a virtual clock the same split applies to virtual time: the sleep lets other attached
+ * threads run and the final 200us are spun on the clock, or slept if its reads are free.
+ */
+void delay_us(int n, Clock &clock = Clock::system());
 
-#endif 
+void delay_ms(int n, Clock &clock = Clock::system());
+
+void delay_s(int n, Clock &clock = Clock::system());
+
+/**
+ * @brief Delay until an absolute time of a clock; returns at once if it has passed
+ * @param deadline Time to return at
+ * @param clock Clock the deadline belongs to
+ */
+void delay_until(std::chrono::steady_clock::time_point deadline, Clock &clock = Clock::system());
+
+/**
+ * @brief Measure clock read cost and sleep overshoot; runs automatically before the first delay
+ * @return New calibration
+ */
+DelayCalibration delay_calibrate();
+
+/**
+ * @brief Get the calibration in use
+ * @return Calibration, calibrating first if needed
+ */
+DelayCalibration delay_get_calibration();
+
+/**
+ * @brief Get achieved delay accuracy
+ * @return Error statistics over every delay since start
+ */
+DelayStats delay_get_stats();
+
+#endif
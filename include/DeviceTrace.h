@@ -0,0 +1,246 @@
+#ifndef DEVICE_TRACE_H
+#define DEVICE_TRACE_H
+
+#include "BluetoothProtocol.h"
+#include "Clock.h"
+#include "ControlServer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SystemController;
+
+/**
+ * @brief One device callback delivered to SystemController
+ * Only the fields of its kind are meaningful.
+ */
+struct TraceEvent
+{
+	enum class Kind : uint8_t
+	{
+		SENSOR = 1,
+		KEY,
+		CONTROL
+	};
+
+	Kind kind;
+	std::chrono::microseconds offset; // Since the recording started
+	// SENSOR
+	int temperature;
+	int humidity;
+	bool valid;
+	// KEY
+	int row;
+	int col;
+	char key;
+	// CONTROL
+	ControlServer::Transport transport;
+	bluetooth::Frame frame;
+};
+
+/**
+ * @brief Records device callbacks into a compact binary trace file
+ * Each event is a kind byte, the varint microseconds since the previous event
+ * and its fields, about 7 bytes for a reading. Events are encoded into a buffer
+ * under a short lock from whichever thread delivers them, and the buffer is
+ * written to the file when it fills and on close().
+ */
+class TraceRecorder
+{
+public:
+	using ErrorCallback = std::function<void(const std::string &error)>;
+
+	/**
+	 * @brief Constructor
+	 * @param clock Clock the event times are read from
+	 */
+	explicit TraceRecorder(Clock &clock = Clock::system());
+
+	/**
+	 * @brief Destructor; writes out the buffered events
+	 */
+	~TraceRecorder();
+
+	TraceRecorder(const TraceRecorder &) = delete;
+	TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+	/**
+	 * @brief Start a new trace; event offsets count from now
+	 * @param path Trace file, replaced if it exists
+	 * @return true if successful
+	 */
+	bool open(const std::string &path);
+
+	/**
+	 * @brief Write out the buffered events and close the file
+	 */
+	void close();
+
+	/**
+	 * @brief Check if events are being recorded
+	 * @return true between open() and close()
+	 */
+	bool isOpen() const;
+
+	/**
+	 * @brief Record a DHT11 data callback
+	 * @param temperature Temperature reading
+	 * @param humidity Humidity reading
+	 * @param valid Data validity
+	 */
+	void recordSensor(int temperature, int humidity, bool valid);
+
+	/**
+	 * @brief Record a keypad callback
+	 * @param row Key row
+	 * @param col Key column
+	 * @param key Key character
+	 */
+	void recordKey(int row, int col, char key);
+
+	/**
+	 * @brief Record a control request
+	 * @param frame Received frame
+	 * @param transport Transport it arrived on
+	 */
+	void recordControl(const bluetooth::Frame &frame, ControlServer::Transport transport);
+
+	/**
+	 * @brief Get number of events recorded since open()
+	 * @return Event count
+	 */
+	uint64_t getEventCount() const;
+
+	/**
+	 * @brief Register callback for error handling
+	 * @param callback Function to call when errors occur
+	 */
+	void registerErrorCallback(ErrorCallback callback);
+
+private:
+	Clock &m_clock;
+	std::atomic<bool> m_open{false};
+	mutable std::mutex m_mutex;
+	int m_fd = -1;
+	std::vector<uint8_t> m_buffer;
+	Clock::time_point m_last; // Time of the previous event
+	uint64_t m_eventCount = 0;
+	ErrorCallback m_errorCallback;
+
+	/**
+	 * @brief Start an event: kind byte and time delta; caller holds m_mutex
+	 * @param kind Event kind
+	 */
+	void beginEvent(TraceEvent::Kind kind);
+
+	/**
+	 * @brief Finish an event and write the buffer out once it is full; caller holds m_mutex
+	 */
+	void endEvent();
+
+	/**
+	 * @brief Write the buffer to the file; caller holds m_mutex
+	 * @return true if successful
+	 */
+	bool writeBuffer();
+};
+
+/**
+ * @brief Reads the events of a trace file in order
+ */
+class TraceReader
+{
+public:
+	/**
+	 * @brief Load a trace
+	 * @param path Trace file written by TraceRecorder
+	 * @return false if the file is missing or is not a trace
+	 */
+	bool open(const std::string &path);
+
+	/**
+	 * @brief Get the next event
+	 * @param event Receives the event
+	 * @return false at the end of the trace, or at an event cut short by a crash while recording
+	 */
+	bool next(TraceEvent &event);
+
+	/**
+	 * @brief Go back to the first event
+	 */
+	void rewind();
+
+	/**
+	 * @brief Get the wall-clock time the recording started
+	 * @return Start time
+	 */
+	std::chrono::system_clock::time_point getStartTime() const;
+
+private:
+	std::vector<uint8_t> m_data;
+	size_t m_position = 0;
+	std::chrono::microseconds m_offset{0};
+	std::chrono::system_clock::time_point m_startTime;
+};
+
+/**
+ * @brief Feeds a trace back through SystemController's device handlers
+ * Events are delivered on the calling thread, either at their recorded offsets
+ * on the given clock or back to back. Control replies are collected instead of
+ * sent, so the controller does not need to be started or to have any device.
+ */
+class TraceReplayer
+{
+public:
+	enum class Speed
+	{
+		ORIGINAL,		// Each event at its recorded offset from the start of run()
+		AS_FAST_AS_POSSIBLE
+	};
+
+	struct Stats
+	{
+		uint64_t events;
+		uint64_t sensorEvents;
+		uint64_t keyEvents;
+		uint64_t controlRequests;
+		uint64_t replyFrames;
+		std::chrono::nanoseconds elapsed;			// On the replay clock
+		std::chrono::microseconds maxLateness; // Behind the recorded offset, ORIGINAL only
+	};
+
+	using ReplyCallback = std::function<void(const bluetooth::Frame &reply)>;
+
+	/**
+	 * @brief Constructor
+	 * @param controller Controller to drive
+	 * @param clock Clock an ORIGINAL replay waits on; a virtual clock replays in virtual time
+	 */
+	explicit TraceReplayer(SystemController &controller, Clock &clock = Clock::system());
+
+	/**
+	 * @brief Replay every remaining event of a trace
+	 * @param reader Trace to replay
+	 * @param speed Pacing
+	 * @return Replay accounting
+	 */
+	Stats run(TraceReader &reader, Speed speed);
+
+	/**
+	 * @brief Register callback for the replies to replayed control requests
+	 * @param callback Function to call with each reply frame
+	 */
+	void registerReplyCallback(ReplyCallback callback);
+
+private:
+	SystemController &m_controller;
+	Clock &m_clock;
+	ReplyCallback m_replyCallback;
+	std::vector<bluetooth::Frame> m_replies; // Reused for every request
+};
+
+#endif
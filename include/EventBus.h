@@ -0,0 +1,436 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include "Clock.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Typed publish/subscribe bus that keeps device threads clear of slow handlers
+ * Every subscriber has its own bounded lock-free queue and worker thread. publish()
+ * copies the event into the queue of each subscriber of its type and returns; it
+ * never takes a lock or waits for a handler, so a slow subscriber cannot delay the
+ * next sensor read or key scan, nor another subscriber. When a queue is full the
+ * subscriber's overflow policy decides what it loses. Subscribers may come and go
+ * while events are published. On a VirtualClock the workers hold virtual time
+ * from the moment an event wakes them until they are idle again, so an event is
+ * handled at the virtual instant it was published.
+ */
+class EventBus
+{
+public:
+	enum class OverflowPolicy
+	{
+		DROP_OLDEST,		// Keep the newest `capacity` events
+		COALESCE_LATEST // Keep only the latest event; for state that supersedes itself
+	};
+
+	struct Stats
+	{
+		uint64_t published;
+		uint64_t delivered;
+		uint64_t dropped;		// Discarded by DROP_OLDEST
+		uint64_t coalesced; // Replaced by a newer event under COALESCE_LATEST
+	};
+
+	class Subscription;
+
+	static constexpr size_t MAX_EVENT_TYPES = 16;
+	static constexpr size_t MAX_SUBSCRIBERS = 8; // Per event type
+	static constexpr size_t DEFAULT_CAPACITY = 64;
+
+	/**
+	 * @brief Constructor
+	 * @param clock Clock the workers hold while they handle events
+	 */
+	explicit EventBus(Clock &clock = Clock::system());
+
+	/**
+	 * @brief Destructor; handles what is queued and stops every worker
+	 */
+	~EventBus();
+
+	EventBus(const EventBus &) = delete;
+	EventBus &operator=(const EventBus &) = delete;
+
+	/**
+	 * @brief Start delivering events of one type to a handler on its own worker
+	 * @param name Subscriber name, for the worker thread and its metrics
+	 * @param handler Called with each event, in publish order per publishing thread
+	 * @param policy What to lose when the handler falls behind
+	 * @param capacity Events queued before the policy applies, rounded up to a power of two
+	 * @return Subscription, valid until unsubscribe() or the bus is destroyed
+	 * @throws std::length_error if there are too many event types or subscribers of the type
+	 * @throws std::system_error if the worker's wakeup descriptor cannot be created
+	 */
+	template <typename Event>
+	Subscription &subscribe(const std::string &name, std::function<void(const Event &event)> handler,
+													OverflowPolicy policy = OverflowPolicy::DROP_OLDEST, size_t capacity = DEFAULT_CAPACITY);
+
+	/**
+	 * @brief Stop a subscription once its queued events are handled
+	 * Must not be called from the subscription's own handler.
+	 * @param subscription Subscription returned by subscribe()
+	 */
+	void unsubscribe(Subscription &subscription);
+
+	/**
+	 * @brief Queue an event for every subscriber of its type; lock-free and never blocks
+	 * @param event Event to deliver
+	 * @return Number of subscribers it was queued for
+	 */
+	template <typename Event>
+	size_t publish(const Event &event);
+
+	/**
+	 * @brief Block until every event published before the call has been handled or discarded
+	 * Must not be called from a handler.
+	 */
+	void flush();
+
+	/**
+	 * @brief Base of the per-type subscriptions: queue accounting and the worker
+	 */
+	class Subscription
+	{
+	public:
+		virtual ~Subscription();
+
+		Subscription(const Subscription &) = delete;
+		Subscription &operator=(const Subscription &) = delete;
+
+		/**
+		 * @brief Get delivery accounting
+		 * @return Counts since subscribe()
+		 */
+		Stats getStats() const;
+
+		/**
+		 * @brief Get the subscriber name
+		 * @return Name given to subscribe()
+		 */
+		const std::string &getName() const;
+
+	protected:
+		Subscription(Clock &clock, const std::string &name, OverflowPolicy policy, size_t typeIndex);
+
+		/**
+		 * @brief Pop and handle one event
+		 * @return false if the queue was empty
+		 */
+		virtual bool deliverOne() = 0;
+
+		/**
+		 * @brief Check for queued events
+		 * @return true if the worker has events to handle
+		 */
+		virtual bool hasPending() const = 0;
+
+		/**
+		 * @brief Wake the worker if it is waiting; called after each push
+		 */
+		void signal();
+
+		/**
+		 * @brief Count an event discarded by the overflow policy
+		 */
+		void countDiscarded();
+
+		const OverflowPolicy m_policy;
+		std::atomic<uint64_t> m_published{0};
+		std::atomic<uint64_t> m_delivered{0};
+		std::atomic<uint64_t> m_discarded{0};
+		Histogram &m_latency; // Publish to end of handler, us
+
+	private:
+		friend class EventBus;
+
+		Clock &m_clock;
+		std::string m_name;
+		size_t m_typeIndex;
+		Counter &m_discardedTotal;
+		int m_wakeFd = -1;
+		std::atomic<bool> m_sleeping{false}; // Cleared by whoever wakes the worker
+		std::atomic<bool> m_stopRequested{false};
+		std::unique_ptr<std::thread> m_worker;
+
+		// Flush waiters sleep on the bus; set while the subscription is registered
+		std::mutex *m_flushMutex = nullptr;
+		std::condition_variable *m_flushCondition = nullptr;
+
+		/**
+		 * @brief Start the worker thread
+		 */
+		void start();
+
+		/**
+		 * @brief Handle what is queued, stop the worker and join it
+		 */
+		void stop();
+
+		/**
+		 * @brief Deliver events until stopped
+		 */
+		void workerThread();
+
+		/**
+		 * @brief Sleep until signalled
+		 */
+		void wait();
+	};
+
+private:
+	/**
+	 * @brief Subscription to one event type, with a bounded multi-producer queue
+	 * The queue is Vyukov's: each cell carries a sequence number that tells
+	 * producers and consumers whether it is free or filled for their position, so
+	 * both sides claim cells with one compare-and-swap. Publishers that find it full
+	 * pop the oldest event themselves and count it against the policy.
+	 */
+	template <typename Event>
+	class TypedSubscription : public Subscription
+	{
+	public:
+		TypedSubscription(Clock &clock, const std::string &name, std::function<void(const Event &)> handler,
+											OverflowPolicy policy, size_t capacity, size_t typeIndex)
+				: Subscription(clock, name, policy, typeIndex),
+					m_handler(std::move(handler)),
+					m_limit(policy == OverflowPolicy::COALESCE_LATEST ? 1 : std::max<size_t>(capacity, 1)),
+					m_mask(roundUp(std::max<size_t>(m_limit, 2)) - 1),
+					m_cells(new Cell[m_mask + 1])
+		{
+			for (size_t i = 0; i <= m_mask; ++i)
+			{
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		void push(const Event &event)
+		{
+			m_published.fetch_add(1, std::memory_order_relaxed);
+			auto now = std::chrono::steady_clock::now();
+			Event discarded;
+			std::chrono::steady_clock::time_point discardedAt;
+			while (size() >= m_limit || !tryPush(event, now))
+			{
+				if (tryPop(discarded, discardedAt))
+				{
+					countDiscarded();
+				}
+			}
+			signal();
+		}
+
+	protected:
+		bool deliverOne() override
+		{
+			Event event;
+			std::chrono::steady_clock::time_point publishedAt;
+			if (!tryPop(event, publishedAt))
+			{
+				return false;
+			}
+			m_handler(event);
+			m_latency.recordSince(publishedAt);
+			m_delivered.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		bool hasPending() const override
+		{
+			return size() > 0;
+		}
+
+	private:
+		struct Cell
+		{
+			std::atomic<uint64_t> sequence;
+			Event event;
+			std::chrono::steady_clock::time_point publishedAt;
+		};
+
+		std::function<void(const Event &)> m_handler;
+		const size_t m_limit; // Queued events before the policy discards one
+		const size_t m_mask;
+		std::unique_ptr<Cell[]> m_cells;
+		char m_padEnqueue[64];
+		std::atomic<uint64_t> m_enqueue{0}; // Next position producers fill
+		char m_padDequeue[64];
+		std::atomic<uint64_t> m_dequeue{0}; // Next position consumers take
+
+		static size_t roundUp(size_t value)
+		{
+			size_t power = 1;
+			while (power < value)
+			{
+				power <<= 1;
+			}
+			return power;
+		}
+
+		size_t size() const
+		{
+			uint64_t dequeue = m_dequeue.load(std::memory_order_acquire);
+			uint64_t enqueue = m_enqueue.load(std::memory_order_acquire);
+			return enqueue > dequeue ? static_cast<size_t>(enqueue - dequeue) : 0;
+		}
+
+		bool tryPush(const Event &event, std::chrono::steady_clock::time_point publishedAt)
+		{
+			uint64_t position = m_enqueue.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Cell &cell = m_cells[position & m_mask];
+				int64_t lag = static_cast<int64_t>(cell.sequence.load(std::memory_order_acquire) - position);
+				if (lag == 0)
+				{
+					if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						cell.event = event;
+						cell.publishedAt = publishedAt;
+						cell.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (lag < 0)
+				{
+					return false; // Full: the cell still holds the event from one lap ago
+				}
+				else
+				{
+					position = m_enqueue.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool tryPop(Event &event, std::chrono::steady_clock::time_point &publishedAt)
+		{
+			uint64_t position = m_dequeue.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Cell &cell = m_cells[position & m_mask];
+				int64_t lag = static_cast<int64_t>(cell.sequence.load(std::memory_order_acquire) - (position + 1));
+				if (lag == 0)
+				{
+					if (m_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						event = cell.event;
+						publishedAt = cell.publishedAt;
+						cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (lag < 0)
+				{
+					return false; // Empty
+				}
+				else
+				{
+					position = m_dequeue.load(std::memory_order_relaxed);
+				}
+			}
+		}
+	};
+
+	// Subscribers of one event type; publishers count themselves in so unsubscribe() can wait them out
+	struct Topic
+	{
+		std::array<std::atomic<Subscription *>, MAX_SUBSCRIBERS> subscribers;
+		std::atomic<int> publishing{0};
+
+		Topic()
+		{
+			for (auto &subscriber : subscribers)
+			{
+				subscriber.store(nullptr, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	Clock &m_clock;
+	std::array<Topic, MAX_EVENT_TYPES> m_topics;
+	std::mutex m_mutex; // Serializes subscribe() and unsubscribe()
+	std::vector<std::unique_ptr<Subscription>> m_subscriptions;
+	std::mutex m_flushMutex;
+	std::condition_variable m_flushCondition;
+
+	/**
+	 * @brief Get the process-wide index of an event type
+	 * @return Index, the same for every bus
+	 */
+	template <typename Event>
+	static size_t typeIndex()
+	{
+		static const size_t index = nextTypeIndex();
+		return index;
+	}
+
+	/**
+	 * @brief Hand out the next event type index
+	 * @return Index
+	 */
+	static size_t nextTypeIndex();
+
+	/**
+	 * @brief Register a subscription in a free slot of its topic and start its worker
+	 * @param subscription New subscription
+	 * @return The registered subscription
+	 */
+	Subscription &add(std::unique_ptr<Subscription> subscription);
+};
+
+template <typename Event>
+EventBus::Subscription &EventBus::subscribe(const std::string &name, std::function<void(const Event &event)> handler,
+																						OverflowPolicy policy, size_t capacity)
+{
+	// Queued events are copied without locks or allocation
+	static_assert(std::is_trivially_copyable<Event>::value, "events must be trivially copyable");
+	size_t index = typeIndex<Event>();
+	if (index >= MAX_EVENT_TYPES)
+	{
+		throw std::length_error("EventBus: too many event types");
+	}
+	return add(std::unique_ptr<Subscription>(new TypedSubscription<Event>(m_clock, name, std::move(handler), policy, capacity, index)));
+}
+
+template <typename Event>
+size_t EventBus::publish(const Event &event)
+{
+	size_t index = typeIndex<Event>();
+	if (index >= MAX_EVENT_TYPES)
+	{
+		return 0;
+	}
+	Topic &topic = m_topics[index];
+	// Sequentially consistent with unsubscribe(): it either sees us here or we see its cleared slot
+	topic.publishing.fetch_add(1);
+	size_t queued = 0;
+	for (auto &slot : topic.subscribers)
+	{
+		Subscription *subscription = slot.load();
+		if (subscription)
+		{
+			static_cast<TypedSubscription<Event> *>(subscription)->push(event);
+			++queued;
+		}
+	}
+	topic.publishing.fetch_sub(1, std::memory_order_release);
+	return queued;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <functional>
+#include <memory>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Single-threaded epoll reactor
+ * Drives file descriptors and timerfds from one thread. Ready sources are
+ * dispatched in registration order so the same set of events always runs the
+ * same way, and an eventfd lets any thread stop the loop or post work to it.
+ * Sources are added and removed from the loop thread, or before run().
+ */
+class EventLoop
+{
+public:
+	// Called with the epoll event mask of a ready descriptor
+	using FdHandler = std::function<void(uint32_t events)>;
+	// Called with the number of timer expirations since the last dispatch
+	using TimerHandler = std::function<void(uint64_t expirations)>;
+
+	/**
+	 * @brief Constructor
+	 */
+	EventLoop();
+
+	/**
+	 * @brief Destructor
+	 */
+	~EventLoop();
+
+	EventLoop(const EventLoop &) = delete;
+	EventLoop &operator=(const EventLoop &) = delete;
+
+	/**
+	 * @brief Create the epoll instance and wakeup eventfd
+	 * @return true if initialization successful
+	 */
+	bool initialize();
+
+	/**
+	 * @brief Watch a descriptor owned by the caller
+	 * @param fd File descriptor
+	 * @param events epoll event mask (EPOLLIN, EPOLLOUT, ...)
+	 * @param handler Function to call when the descriptor is ready
+	 * @return true if the descriptor was added
+	 */
+	bool addFd(int fd, uint32_t events, FdHandler handler);
+
+	/**
+	 * @brief Change the event mask of a watched descriptor
+	 * @param fd File descriptor
+	 * @param events New epoll event mask
+	 * @return true if the descriptor was updated
+	 */
+	bool modifyFd(int fd, uint32_t events);
+
+	/**
+	 * @brief Stop watching a descriptor; safe to call from a handler
+	 * @param fd File descriptor
+	 */
+	void removeFd(int fd);
+
+	/**
+	 * @brief Add a periodic monotonic timer owned by the loop
+	 * @param period Interval between expirations
+	 * @param handler Function to call on expiration
+	 * @param initialDelay Delay before the first expiration, defaults to one period
+	 * @return timerfd of the new timer, or -1 on failure
+	 */
+	int addTimer(std::chrono::nanoseconds period, TimerHandler handler,
+							 std::chrono::nanoseconds initialDelay = std::chrono::nanoseconds::zero());
+
+	/**
+	 * @brief Remove and close a timer created by addTimer()
+	 * @param timerFd timerfd returned by addTimer()
+	 */
+	void removeTimer(int timerFd);
+
+	/**
+	 * @brief Run a task on the loop thread; safe to call from any thread
+	 * @param task Function to run before the next batch of events
+	 */
+	void post(std::function<void()> task);
+
+	/**
+	 * @brief Dispatch events until stop() is called
+	 */
+	void run();
+
+	/**
+	 * @brief Request the loop to exit; safe to call from any thread
+	 */
+	void stop();
+
+	/**
+	 * @brief Check if the loop is dispatching
+	 * @return true while run() is active
+	 */
+	bool isRunning() const;
+
+	/**
+	 * @brief Get number of times the loop returned from epoll_wait
+	 * @return Wakeup count
+	 */
+	uint64_t getWakeupCount() const;
+
+private:
+	struct Source
+	{
+		int fd;
+		uint64_t order;
+		bool ownsFd;
+		FdHandler handler;
+	};
+
+	int m_epollFd = -1;
+	int m_wakeFd = -1;
+	uint64_t m_nextOrder = 0;
+	std::map<int, std::shared_ptr<Source>> m_sources;
+
+	std::atomic<bool> m_running{false};
+	std::atomic<bool> m_stopRequested{false};
+	std::atomic<uint64_t> m_wakeups{0};
+
+	std::mutex m_taskMutex;
+	std::vector<std::function<void()>> m_tasks;
+
+	/**
+	 * @brief Register a source with epoll
+	 * @param fd File descriptor
+	 * @param events epoll event mask
+	 * @param ownsFd Close the descriptor when the source is removed
+	 * @param handler Function to call when ready
+	 * @return true if successful
+	 */
+	bool addSource(int fd, uint32_t events, bool ownsFd, FdHandler handler);
+
+	/**
+	 * @brief Drain the wakeup eventfd and run posted tasks
+	 */
+	void runPostedTasks();
+};
+
+#endif
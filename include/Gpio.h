@@ -0,0 +1,49 @@
+#ifndef GPIO_H
+#define GPIO_H
+
+#include "SimulatedGpio.h"
+#ifdef SMART_CURTAIN_HAVE_LIBGPIOD
+#include <gpiod.hpp>
+#endif
+
+/**
+ * @brief Compile-time GPIO backends
+ * Device classes take one of these as a template parameter and name every GPIO
+ * type through it, so each backend gets its own instantiation and calls into
+ * libgpiod stay direct, inlinable calls with no virtual dispatch in the read loops.
+ */
+namespace gpio
+{
+#ifdef SMART_CURTAIN_HAVE_LIBGPIOD
+	// Character device access through libgpiod's C++ bindings
+	struct Libgpiod
+	{
+		using chip = ::gpiod::chip;
+		using line = ::gpiod::line;
+		using line_bulk = ::gpiod::line_bulk;
+		using line_request = ::gpiod::line_request;
+		using line_event = ::gpiod::line_event;
+		static constexpr bool simulated = false;
+	};
+#endif
+
+	// In-process lines driven by scripted devices, see SimulatedGpio.h
+	struct Simulated
+	{
+		using chip = sim::chip;
+		using line = sim::line;
+		using line_bulk = sim::line_bulk;
+		using line_request = sim::line_request;
+		using line_event = sim::line_event;
+		static constexpr bool simulated = true;
+	};
+
+	// Backend of the DHT11Sensor, MatrixKeypad, stepper and buzzer used by the application
+#if defined(SMART_CURTAIN_GPIO_SIMULATED) || !defined(SMART_CURTAIN_HAVE_LIBGPIOD)
+	using Default = Simulated;
+#else
+	using Default = Libgpiod;
+#endif
+}
+
+#endif
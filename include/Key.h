@@ -2,7 +2,10 @@
 #define KEY_H
 
 #include <Delay.h>
-#include <gpiod.hpp>
+#include "Clock.h"
+#include "Metrics.h"
+#include "PeriodicTask.h"
+#include "Gpio.h"
 #include <iostream>
 #include <vector>
 #include <functional>
@@ -16,13 +19,20 @@
 /**
  * @brief 4x4 Matrix Keypad Class
  * Provides real-time keypad scanning with callback-based event handling
+ * @tparam Gpio GPIO backend policy from Gpio.h
  */
-class MatrixKeypad
+template <typename Gpio>
+class BasicMatrixKeypad
 {
 public:
-	// Callback type for key press events
-	using KeyPressCallback = std::function<void(int row, int col, char key)>;
-	using ErrorCallback = std::function<void(const std::string &error)>;
+	// Kind of transition reported by the key state machine
+	enum class KeyEvent
+	{
+		PRESS,
+		RELEASE,
+		LONG_PRESS,
+		REPEAT
+	};
 
 	// Key data structure
 	struct KeyData
@@ -32,6 +42,33 @@ public:
 		char keyChar;
 		std::chrono::steady_clock::time_point timestamp;
 		bool isPressed;
+		KeyEvent event;
+		std::chrono::milliseconds heldFor; // Time since the debounced press
+	};
+
+	// Callback type for key press events (PRESS only)
+	using KeyPressCallback = std::function<void(int row, int col, char key)>;
+	// Callback type for every key event, including release, long press and repeat
+	using KeyEventCallback = std::function<void(const KeyData &key)>;
+	using ErrorCallback = std::function<void(const std::string &error)>;
+
+	// Debounce and hold timing of the per-key state machine
+	struct KeyTiming
+	{
+		std::chrono::milliseconds pressDebounce;
+		std::chrono::milliseconds releaseDebounce;
+		std::chrono::milliseconds longPress;
+		std::chrono::milliseconds repeatInterval; // 0 disables auto-repeat
+
+		KeyTiming()
+				: pressDebounce(20), releaseDebounce(20), longPress(800), repeatInterval(200) {}
+	};
+
+	// How the keypad notices a key press while idle
+	enum class ScanMode
+	{
+		POLLING,	// Scan the whole matrix every interval
+		INTERRUPT // Drive all columns, sleep on row edges, scan only after an edge
 	};
 
 	/**
@@ -39,15 +76,19 @@ public:
 	 * @param chipName GPIO chip name
 	 * @param colPins Array of column pin numbers
 	 * @param rowPins Array of row pin numbers
+	 * @param mode Idle detection strategy; INTERRUPT falls back to POLLING on a virtual clock
+	 * @param clock Clock for scan timing and key timestamps
 	 */
-	MatrixKeypad(const std::string &chipName,
-							 const std::array<int, 4> &colPins,
-							 const std::array<int, 4> &rowPins);
+	BasicMatrixKeypad(const std::string &chipName,
+										const std::array<int, 4> &colPins,
+										const std::array<int, 4> &rowPins,
+										ScanMode mode = ScanMode::POLLING,
+										Clock &clock = Clock::system());
 
 	/**
 	 * @brief Destructor
 	 */
-	~MatrixKeypad();
+	~BasicMatrixKeypad();
 
 	/**
 	 * @brief Initialize the keypad
@@ -66,6 +107,72 @@ public:
 	 */
 	void stopScanning();
 
+	/**
+	 * @brief Scan the matrix once and advance every key state machine; never blocks on a held key
+	 * @return true while any key is pressed or still debouncing
+	 */
+	bool scanOnce();
+
+	/**
+	 * @brief Advance the key state machines with one raw scan result
+	 * @param pressedMask Bit (row * 4 + col) set for every key read as closed
+	 * @param now Time of the scan
+	 * @return true while any key is pressed or still debouncing
+	 */
+	bool processScan(uint16_t pressedMask, std::chrono::steady_clock::time_point now);
+
+	/**
+	 * @brief Get the idle detection strategy
+	 * @return Current ScanMode
+	 */
+	ScanMode getScanMode() const;
+
+	/**
+	 * @brief Get row edge event descriptors for an external event loop
+	 * @return One fd per row in INTERRUPT mode, empty otherwise
+	 */
+	std::vector<int> getRowEventFds() const;
+
+	/**
+	 * @brief Handle readable row event descriptors with one scan
+	 * @return true if the keypad stays active and needs scanOnce() ticks until it is idle
+	 */
+	bool processRowEvents();
+
+	/**
+	 * @brief Get the time until the next scan of an active keypad is due
+	 * While a key is debouncing the tick lands where its debounce window ends, so a
+	 * press is reported after the debounce time rather than a full scan interval.
+	 * Call from the context that runs the scans.
+	 * @param scanInterval Tick used while keys are only held
+	 * @return Remaining time of the shortest debounce window, at least 1ms, or scanInterval
+	 */
+	std::chrono::milliseconds activeTickInterval(std::chrono::milliseconds scanInterval) const;
+
+	/**
+	 * @brief Select bulk line-set access or one ioctl per line
+	 * @param enable true to read all rows and write all columns in one call each (default)
+	 */
+	void setBulkIo(bool enable);
+
+	/**
+	 * @brief Set how long a driven column settles before the rows are sampled
+	 * @param settleUs Settle time in microseconds
+	 */
+	void setSettleTimeUs(int settleUs);
+
+	/**
+	 * @brief Get number of GPIO value ioctls issued by scans so far
+	 * @return Call count
+	 */
+	uint64_t getGpioCallCount() const;
+
+	/**
+	 * @brief Get time from the last row edge to its key press callback
+	 * @return Latency in microseconds, negative if no edge-triggered press yet
+	 */
+	std::chrono::microseconds getLastPressLatency() const;
+
 	/**
 	 * @brief Get last key press data
 	 * @return KeyData structure with last key press information
@@ -73,11 +180,30 @@ public:
 	KeyData getLastKeyPress() const;
 
 	/**
-	 * @brief Register callback for key press events
+	 * @brief Register callback for key press events; may be called while scanning
+	 * The callback runs on the scanning thread and delays the next scan, so slow work belongs on an EventBus.
 	 * @param callback Function to call when key is pressed
 	 */
 	void registerKeyPressCallback(KeyPressCallback callback);
 
+	/**
+	 * @brief Register callback for all key events
+	 * @param callback Function to call on press, release, long press and repeat
+	 */
+	void registerKeyEventCallback(KeyEventCallback callback);
+
+	/**
+	 * @brief Configure debounce windows, long-press threshold and repeat rate
+	 * @param timing New timing, applied from the next scan
+	 */
+	void setKeyTiming(const KeyTiming &timing);
+
+	/**
+	 * @brief Get the state machine timing
+	 * @return Current KeyTiming
+	 */
+	KeyTiming getKeyTiming() const;
+
 	/**
 	 * @brief Register callback for error handling
 	 * @param callback Function to call when errors occur
@@ -102,20 +228,71 @@ private:
 	std::string m_chipName;
 	std::array<int, 4> m_colPins;
 	std::array<int, 4> m_rowPins;
+	Clock &m_clock;
 
-	std::unique_ptr<gpiod::chip> m_chip;
-	std::vector<std::unique_ptr<gpiod::line>> m_colLines;
-	std::vector<std::unique_ptr<gpiod::line>> m_rowLines;
+	std::unique_ptr<typename Gpio::chip> m_chip;
+	typename Gpio::line_bulk m_colLines;
+	typename Gpio::line_bulk m_rowLines;
+	std::vector<int> m_rowEventFds;
+	std::atomic<bool> m_bulkIo{true};
+	std::atomic<int> m_settleUs{20};
+	std::atomic<uint64_t> m_gpioCalls{0};
 
 	mutable std::mutex m_dataMutex;
 	KeyData m_lastKeyData;
 
+	ScanMode m_scanMode;
+	int m_stopFd = -1;
+	std::chrono::nanoseconds m_lastEdgeTime{0};
+	std::atomic<int64_t> m_lastPressLatencyUs{-1};
+
 	std::atomic<bool> m_scanning{false};
 	std::unique_ptr<std::thread> m_scanThread;
+	std::unique_ptr<PeriodicTask> m_scanTask;
 
+	// Held while the key callbacks run, so registering never races with an invocation
+	std::mutex m_callbackMutex;
 	KeyPressCallback m_keyPressCallback;
+	KeyEventCallback m_keyEventCallback;
 	ErrorCallback m_errorCallback;
 
+	// Per-key debounce state machine, advanced once per scan
+	enum class KeyPhase
+	{
+		IDLE,
+		PRESS_DEBOUNCE,
+		HELD,
+		RELEASE_DEBOUNCE
+	};
+	struct KeyState
+	{
+		KeyPhase phase;
+		std::chrono::steady_clock::time_point changedAt;
+		std::chrono::steady_clock::time_point pressedAt;
+		std::chrono::steady_clock::time_point nextRepeat;
+		bool longPressSent;
+	};
+	std::array<KeyState, 16> m_keyStates;
+	KeyTiming m_timing;
+
+	// Registered as keypad_*
+	struct ScanMetrics
+	{
+		Counter &scans;
+		Counter &scanErrors;
+		Counter &events;
+		Histogram &scanTime;
+		Histogram &callbackTime;
+		Histogram &pressLatency;
+	};
+	ScanMetrics m_metrics;
+
+	/**
+	 * @brief Look up the keypad metrics
+	 * @return References into the process-wide registry
+	 */
+	static ScanMetrics resolveMetrics();
+
 	// Keypad layout
 	static constexpr std::array<std::array<char, 4>, 4> KEYPAD_LAYOUT = {{{{'1', '2', '3', 'A'}},
 																																				{{'4', '5', '6', 'B'}},
@@ -123,24 +300,53 @@ private:
 																																				{{'*', '0', '#', 'D'}}}};
 
 	/**
-	 * @brief Background scanning thread function
-	 * @param scanIntervalMs Scan interval in milliseconds
+	 * @brief Background scanning thread function; scans once per m_scanTask period
 	 */
-	void scanningThread(int scanIntervalMs);
+	void scanningThread();
 
 	/**
-	 * @brief Scan the keypad matrix once
-	 * @return KeyData if key pressed, empty KeyData if no key pressed
+	 * @brief Edge-driven scanning loop used in INTERRUPT mode
+	 * @param scanIntervalMs Scan interval while a key is active
 	 */
-	KeyData scanMatrix();
+	void interruptScanningThread(int scanIntervalMs);
 
 	/**
-	 * @brief Debounce key press
-	 * @param row Row of key
-	 * @param col Column of key
-	 * @return true if key press is valid after debouncing
+	 * @brief Drive every column line to the same level
+	 * @param value 1 to arm row edges, 0 before a matrix scan
 	 */
-	bool debounceKey(int row, int col);
+	void setAllColumns(int value);
+
+	/**
+	 * @brief Discard queued row edge events
+	 * @param recordEdge Remember the earliest edge timestamp for latency measurement
+	 */
+	void drainRowEvents(bool recordEdge);
+
+	/**
+	 * @brief Read the raw state of all 16 keys
+	 * Without per-key diodes three keys on a rectangle's corners ghost the fourth.
+	 * @return Bit (row * 4 + col) set for every closed key
+	 */
+	uint16_t scanMatrix();
+
+	/**
+	 * @brief Publish one key event to the last-key record and callbacks
+	 * @param index Key index (row * 4 + col)
+	 * @param event Event type
+	 * @param now Time of the event
+	 */
+	void emitKeyEvent(int index, KeyEvent event, std::chrono::steady_clock::time_point now);
 };
 
+template <typename Gpio>
+constexpr std::array<std::array<char, 4>, 4> BasicMatrixKeypad<Gpio>::KEYPAD_LAYOUT;
+
+using MatrixKeypad = BasicMatrixKeypad<gpio::Default>;
+
+// Instantiated in Key.cpp for every available backend
+extern template class BasicMatrixKeypad<gpio::Simulated>;
+#ifdef SMART_CURTAIN_HAVE_LIBGPIOD
+extern template class BasicMatrixKeypad<gpio::Libgpiod>;
+#endif
+
 #endif
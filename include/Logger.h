@@ -0,0 +1,332 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+
+/**
+ * @brief Asynchronous logger for device threads
+ * Each producing thread owns a lock-free single-producer ring of fixed-size
+ * binary records. A log call copies its arguments into a slot and returns;
+ * a background thread formats the records printf-style and writes them in
+ * batches. When a ring is full the record is dropped and counted instead of
+ * blocking the producer. A thread's ring is released once the thread has
+ * exited and its last records are written.
+ *
+ * Tags and format strings are stored by pointer and must be string literals.
+ * String arguments are copied into the record and truncated if they do not fit.
+ */
+class Logger
+{
+public:
+	enum class Level : uint8_t
+	{
+		DEBUG,
+		INFO,
+		WARN,
+		ERROR
+	};
+
+	/**
+	 * @brief Constructor; starts the formatting thread
+	 * @param fd Descriptor the formatted lines are written to (not closed)
+	 */
+	explicit Logger(int fd = STDOUT_FILENO);
+
+	/**
+	 * @brief Destructor; writes all pending records before returning
+	 */
+	~Logger();
+
+	Logger(const Logger &) = delete;
+	Logger &operator=(const Logger &) = delete;
+
+	/**
+	 * @brief Get the process-wide logger writing to stdout
+	 * @return Shared logger instance
+	 */
+	static Logger &instance();
+
+	/**
+	 * @brief Queue a record; never blocks
+	 * @param level Severity, records below the minimum level are discarded
+	 * @param tag Component name literal, printed in brackets
+	 * @param format printf-style format literal
+	 * @param args Integer, floating point, character or string arguments
+	 */
+	template <typename... Args>
+	void log(Level level, const char *tag, const char *format, const Args &...args)
+	{
+		if (static_cast<uint8_t>(level) < m_minLevel.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+		Ring *ring = localRing();
+		if (!ring)
+		{
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+		if (tail - ring->head.load(std::memory_order_acquire) >= RING_CAPACITY)
+		{
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		Record &record = ring->slots[tail & (RING_CAPACITY - 1)];
+		record.timestamp = std::chrono::system_clock::now().time_since_epoch().count();
+		record.tag = tag;
+		record.format = format;
+		record.level = level;
+		record.argCount = 0;
+		record.textUsed = 0;
+		encodeArgs(record, args...);
+		ring->tail.store(tail + 1, std::memory_order_release);
+		wakeConsumer();
+	}
+
+	template <typename... Args>
+	void debug(const char *tag, const char *format, const Args &...args)
+	{
+		log(Level::DEBUG, tag, format, args...);
+	}
+
+	template <typename... Args>
+	void info(const char *tag, const char *format, const Args &...args)
+	{
+		log(Level::INFO, tag, format, args...);
+	}
+
+	template <typename... Args>
+	void warn(const char *tag, const char *format, const Args &...args)
+	{
+		log(Level::WARN, tag, format, args...);
+	}
+
+	template <typename... Args>
+	void error(const char *tag, const char *format, const Args &...args)
+	{
+		log(Level::ERROR, tag, format, args...);
+	}
+
+	/**
+	 * @brief Set the minimum level that is recorded
+	 * @param level Lowest level kept (default INFO)
+	 */
+	void setLevel(Level level);
+
+	/**
+	 * @brief Get the minimum level that is recorded
+	 * @return Current minimum level
+	 */
+	Level getLevel() const;
+
+	/**
+	 * @brief Block until every record queued before the call has been written
+	 */
+	void flush();
+
+	/**
+	 * @brief Get number of records dropped because a ring was full
+	 * @return Drop count
+	 */
+	uint64_t getDroppedCount() const;
+
+	/**
+	 * @brief Get number of records formatted and written
+	 * @return Written count
+	 */
+	uint64_t getWrittenCount() const;
+
+	/**
+	 * @brief Get number of producer rings held by the logger
+	 * @return Rings of live threads plus those of exited threads not yet drained
+	 */
+	size_t getRingCount();
+
+	// Records each producer thread can queue before dropping
+	static constexpr size_t RING_CAPACITY = 256;
+
+private:
+	static constexpr size_t MAX_ARGS = 6;
+	static constexpr size_t TEXT_BYTES = 96;
+
+	struct Arg
+	{
+		enum class Type : uint8_t
+		{
+			INT,
+			UINT,
+			DOUBLE,
+			TEXT
+		};
+		Type type;
+		union
+		{
+			int64_t i;
+			uint64_t u;
+			double d;
+			uint16_t textOffset;
+		};
+	};
+
+	struct Record
+	{
+		int64_t timestamp; // system_clock ticks
+		const char *tag;
+		const char *format;
+		Level level;
+		uint8_t argCount;
+		uint16_t textUsed;
+		Arg args[MAX_ARGS];
+		char text[TEXT_BYTES];
+	};
+
+	// Single-producer single-consumer ring; head and tail sit on separate cache lines
+	struct Ring
+	{
+		std::array<Record, RING_CAPACITY> slots;
+		char padHead[64];
+		std::atomic<uint64_t> head{0}; // Next record the formatter reads
+		char padTail[64];
+		std::atomic<uint64_t> tail{0}; // Next slot the producer fills
+		char padWritten[64];
+		std::atomic<uint64_t> written{0}; // Records whose text reached the descriptor
+		std::atomic<bool> retired{false};	// Owning thread exited; dropped once drained
+	};
+
+	int m_fd;
+	uint64_t m_id;
+	std::atomic<uint8_t> m_minLevel{static_cast<uint8_t>(Level::INFO)};
+	std::atomic<uint64_t> m_dropped{0};
+	std::atomic<uint64_t> m_written{0};
+
+	std::mutex m_ringsMutex;
+	std::vector<std::shared_ptr<Ring>> m_rings;
+
+	int m_wakeFd = -1;
+	std::atomic<bool> m_consumerSleeping{false};
+	std::atomic<bool> m_stopRequested{false};
+	std::unique_ptr<std::thread> m_consumerThread;
+
+	std::mutex m_flushMutex;
+	std::condition_variable m_flushCondition;
+
+	/**
+	 * @brief Get the calling thread's ring, registering it on first use
+	 * @return Ring, or nullptr if it could not be allocated
+	 */
+	Ring *localRing();
+
+	/**
+	 * @brief Wake the formatting thread if it is sleeping
+	 */
+	void wakeConsumer()
+	{
+		// Pairs with the fence in consumerThread(): either the consumer sees the new tail or we see it sleeping
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_consumerSleeping.load(std::memory_order_relaxed) && m_consumerSleeping.exchange(false))
+		{
+			signalConsumer();
+		}
+	}
+
+	/**
+	 * @brief Write to the wakeup eventfd
+	 */
+	void signalConsumer();
+
+	/**
+	 * @brief Format and write records until stopped
+	 */
+	void consumerThread();
+
+	/**
+	 * @brief Append one record's text to a batch
+	 * @param record Record to format
+	 * @param out Batch buffer
+	 */
+	static void formatRecord(const Record &record, std::string &out);
+
+	void encodeArgs(Record &)
+	{
+	}
+
+	template <typename T, typename... Rest>
+	void encodeArgs(Record &record, const T &value, const Rest &...rest)
+	{
+		if (record.argCount < MAX_ARGS)
+		{
+			encodeArg(record, record.args[record.argCount++], value);
+		}
+		encodeArgs(record, rest...);
+	}
+
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+	encodeArg(Record &, Arg &arg, const T &value)
+	{
+		arg.type = Arg::Type::INT;
+		arg.i = value;
+	}
+
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+	encodeArg(Record &, Arg &arg, const T &value)
+	{
+		arg.type = Arg::Type::UINT;
+		arg.u = value;
+	}
+
+	template <typename T>
+	typename std::enable_if<std::is_enum<T>::value>::type
+	encodeArg(Record &, Arg &arg, const T &value)
+	{
+		arg.type = Arg::Type::INT;
+		arg.i = static_cast<int64_t>(value);
+	}
+
+	void encodeArg(Record &, Arg &arg, double value)
+	{
+		arg.type = Arg::Type::DOUBLE;
+		arg.d = value;
+	}
+
+	void encodeArg(Record &record, Arg &arg, const char *value)
+	{
+		arg.type = Arg::Type::TEXT;
+		arg.textOffset = record.textUsed;
+		size_t room = TEXT_BYTES - record.textUsed;
+		if (room == 0)
+		{
+			return;
+		}
+		char *out = record.text + record.textUsed;
+		size_t length = 0;
+		while (value && value[length] && length + 1 < room)
+		{
+			out[length] = value[length];
+			++length;
+		}
+		record.text[record.textUsed + length] = '\0';
+		record.textUsed = static_cast<uint16_t>(record.textUsed + length + 1);
+	}
+
+	void encodeArg(Record &record, Arg &arg, const std::string &value)
+	{
+		encodeArg(record, arg, value.c_str());
+	}
+};
+
+#endif
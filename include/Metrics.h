@@ -0,0 +1,261 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <ctime>
+
+/**
+ * @brief Monotonic event counter; increments are a single relaxed atomic add
+ */
+class Counter
+{
+public:
+	void increment(uint64_t n = 1)
+	{
+		m_value.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	uint64_t value() const
+	{
+		return m_value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint64_t> m_value{0};
+};
+
+/**
+ * @brief Log-linear histogram with fixed buckets (HDR-style)
+ * Every power of two is split into 8 linear sub-buckets, so any recorded value is
+ * reported within 12.5% across the full 64-bit range. Recording is lock-free.
+ */
+class Histogram
+{
+public:
+	static constexpr int SUB_BUCKET_BITS = 3;
+	static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+	static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	/**
+	 * @brief Constructor
+	 */
+	Histogram();
+
+	/**
+	 * @brief Add one sample
+	 * @param value Sample value
+	 */
+	void record(uint64_t value)
+	{
+		m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		m_sum.fetch_add(value, std::memory_order_relaxed);
+		uint64_t max = m_max.load(std::memory_order_relaxed);
+		while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	/**
+	 * @brief Add the time elapsed since a start point in microseconds
+	 * @param start Start of the measured interval
+	 */
+	void recordSince(std::chrono::steady_clock::time_point start)
+	{
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		record(elapsed.count() > 0 ? static_cast<uint64_t>(elapsed.count()) : 0);
+	}
+
+	uint64_t count() const;
+	uint64_t sum() const;
+	uint64_t max() const;
+
+	/**
+	 * @brief Get the value below which a fraction of samples fall
+	 * @param quantile Fraction between 0 and 1
+	 * @return Upper bound of the bucket holding that sample, 0 if empty
+	 */
+	uint64_t percentile(double quantile) const;
+
+	/**
+	 * @brief Map a value to its bucket
+	 * @param value Sample value
+	 * @return Bucket index
+	 */
+	static size_t bucketIndex(uint64_t value)
+	{
+		if (value < SUB_BUCKETS)
+		{
+			return static_cast<size_t>(value);
+		}
+		int msb = 63 - __builtin_clzll(value);
+		int shift = msb - SUB_BUCKET_BITS;
+		return static_cast<size_t>(shift + 1) * SUB_BUCKETS + static_cast<size_t>((value >> shift) - SUB_BUCKETS);
+	}
+
+	/**
+	 * @brief Get the largest value that maps to a bucket
+	 * @param index Bucket index
+	 * @return Inclusive upper bound
+	 */
+	static uint64_t bucketUpperBound(size_t index);
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets;
+	std::atomic<uint64_t> m_count{0};
+	std::atomic<uint64_t> m_sum{0};
+	std::atomic<uint64_t> m_max{0};
+};
+
+/**
+ * @brief Process-wide registry of named counters, histograms and thread CPU clocks
+ * Looking up a metric takes a lock, so components resolve their metrics once and
+ * keep the references; updating them afterwards never locks. Metrics live as long
+ * as the registry and are rendered as plain "name value" lines.
+ */
+class MetricsRegistry
+{
+public:
+	/**
+	 * @brief Registers the calling thread for CPU time reporting while in scope
+	 */
+	class ThreadScope
+	{
+	public:
+		/**
+		 * @brief Constructor
+		 * @param name Thread name used in the report
+		 */
+		explicit ThreadScope(const std::string &name);
+
+		/**
+		 * @brief Destructor; keeps the thread's CPU time in the report under its name
+		 */
+		~ThreadScope();
+
+		ThreadScope(const ThreadScope &) = delete;
+		ThreadScope &operator=(const ThreadScope &) = delete;
+	};
+
+	/**
+	 * @brief Get the process-wide registry
+	 * @return Registry instance
+	 */
+	static MetricsRegistry &instance();
+
+	/**
+	 * @brief Get or create a counter
+	 * @param name Metric name, by convention ending in _total
+	 * @return Counter that stays valid for the registry's lifetime
+	 */
+	Counter &counter(const std::string &name);
+
+	/**
+	 * @brief Get or create a histogram
+	 * @param name Metric name, by convention ending in its unit (_us)
+	 * @return Histogram that stays valid for the registry's lifetime
+	 */
+	Histogram &histogram(const std::string &name);
+
+	/**
+	 * @brief Start reporting CPU time of the calling thread
+	 * @param name Thread name used in the report
+	 */
+	void registerThread(const std::string &name);
+
+	/**
+	 * @brief Stop sampling the calling thread and keep its final CPU time
+	 */
+	void unregisterThread();
+
+	/**
+	 * @brief Render every metric as plain text
+	 * @return One "name value" line per counter, histogram statistic and thread
+	 */
+	std::string render() const;
+
+private:
+	struct ThreadEntry
+	{
+		std::string name;
+		clockid_t clock;
+	};
+
+	mutable std::mutex m_mutex;
+	std::map<std::string, std::unique_ptr<Counter>> m_counters;
+	std::map<std::string, std::unique_ptr<Histogram>> m_histograms;
+	std::map<std::thread::id, ThreadEntry> m_threads;
+	std::map<std::string, uint64_t> m_exitedThreadCpuUs;
+};
+
+/**
+ * @brief Serves the metrics report on a local Unix socket
+ * Each client that connects receives one report and is disconnected, e.g.
+ * `socat - UNIX-CONNECT:/tmp/smart_curtain_metrics.sock`.
+ */
+class MetricsServer
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param registry Registry to render
+	 * @param socketPath Filesystem path of the socket
+	 */
+	MetricsServer(MetricsRegistry &registry, const std::string &socketPath);
+
+	/**
+	 * @brief Destructor
+	 */
+	~MetricsServer();
+
+	/**
+	 * @brief Bind and listen without starting a thread, for use from an event loop
+	 * @return true if the socket is listening
+	 */
+	bool open();
+
+	/**
+	 * @brief Bind, listen and serve clients from a background thread
+	 * @return true if the server is running
+	 */
+	bool start();
+
+	/**
+	 * @brief Stop the server thread and remove the socket
+	 */
+	void stop();
+
+	/**
+	 * @brief Get the listening descriptor
+	 * @return Descriptor that becomes readable when a client connects, -1 if closed
+	 */
+	int getListenFd() const;
+
+	/**
+	 * @brief Accept pending clients and send each one the report
+	 * @return Number of clients served
+	 */
+	int servePending();
+
+private:
+	MetricsRegistry &m_registry;
+	std::string m_socketPath;
+	int m_listenFd = -1;
+	int m_stopFd = -1;
+	std::unique_ptr<std::thread> m_serverThread;
+
+	/**
+	 * @brief Wait for clients until stopped
+	 */
+	void serverThread();
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef PERIODIC_TASK_H
+#define PERIODIC_TASK_H
+
+#include "Clock.h"
+#include "SeqLock.h"
+#include "Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * @brief Runs a function on a fixed CLOCK_MONOTONIC grid
+ * Release times are start + k * period, so the period holds regardless of how
+ * long the body takes. A body that runs past the next release is an overrun;
+ * the late release then runs immediately and any releases that passed entirely
+ * are skipped and counted as missed deadlines instead of being run in a burst.
+ * On a virtual clock the grid is on virtual time and the running thread is attached.
+ */
+class PeriodicTask
+{
+public:
+	// Schedule accounting since run() started
+	struct Stats
+	{
+		uint64_t activations;
+		uint64_t missedDeadlines;							 // Releases skipped because a later one was already due
+		uint64_t overruns;										 // Activations that ended after the next release
+		std::chrono::microseconds lastJitter;	 // Wakeup after the release time
+		std::chrono::microseconds maxJitter;
+		std::chrono::microseconds maxRunTime;
+	};
+
+	/**
+	 * @brief Constructor
+	 * @param name Task name; metrics are registered as <name>_task_*
+	 * @param period Interval between releases
+	 * @param clock Clock the releases are scheduled on
+	 */
+	PeriodicTask(const std::string &name, std::chrono::nanoseconds period, Clock &clock = Clock::system());
+
+	/**
+	 * @brief Destructor
+	 */
+	~PeriodicTask();
+
+	PeriodicTask(const PeriodicTask &) = delete;
+	PeriodicTask &operator=(const PeriodicTask &) = delete;
+
+	/**
+	 * @brief Run the body once per period on the calling thread until stop()
+	 * @param body Work done at each release
+	 */
+	void run(const std::function<void()> &body);
+
+	/**
+	 * @brief Make run() return after the current activation; safe from any thread
+	 * A stopped task stays stopped, including one stopped before run() was called.
+	 */
+	void stop();
+
+	/**
+	 * @brief Check if stop() was called
+	 * @return true once stopped
+	 */
+	bool isStopped() const;
+
+	/**
+	 * @brief Get schedule accounting
+	 * @return Stats published after every activation
+	 */
+	Stats getStats() const;
+
+	/**
+	 * @brief Get the release interval
+	 * @return Period
+	 */
+	std::chrono::nanoseconds getPeriod() const;
+
+private:
+	std::string m_name;
+	std::chrono::nanoseconds m_period;
+	Clock &m_clock;
+	std::atomic<bool> m_stopRequested{false};
+	std::atomic<bool> m_slotTaken{false}; // Clock slot from the constructor bound by run() or given back
+	int m_timerFd = -1;
+	int m_stopFd = -1;
+	SeqLock<Stats> m_stats;
+
+	Counter &m_activationCount;
+	Counter &m_missedCount;
+	Counter &m_overrunCount;
+	Histogram &m_jitter;
+	Histogram &m_runTime;
+
+	/**
+	 * @brief Read the task's clock
+	 * @return Current time in nanoseconds
+	 */
+	int64_t nowNs();
+
+	/**
+	 * @brief Sleep until an absolute time of the task's clock
+	 * @param releaseNs Wakeup time in nanoseconds
+	 * @return false if woken by stop()
+	 */
+	bool waitUntil(int64_t releaseNs);
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef SENSOR_HISTORY_H
+#define SENSOR_HISTORY_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Fixed-size history of temperature and humidity readings
+ * Keeps the latest raw samples and min/max/mean buckets of one minute, one
+ * hour and one local calendar day. Each tier is a ring of buckets whose
+ * running sums and monotonic min/max queues are updated as buckets complete
+ * and expire, so a tier's current bucket and its whole retained window are
+ * both answered in constant time. All storage is allocated by the
+ * constructor; adding samples never allocates.
+ */
+class SensorHistory
+{
+public:
+	enum class Tier
+	{
+		MINUTE,
+		HOUR,
+		DAY
+	};
+	static constexpr size_t TIER_COUNT = 3;
+
+	struct Config
+	{
+		size_t rawSamples; // Latest readings kept as they arrived
+		size_t minutes;		 // Minute buckets kept, the window of the MINUTE tier
+		size_t hours;			 // Hour buckets kept
+		size_t days;			 // Day buckets kept
+
+		// An hour of readings at the default 2 s interval; a day of minutes; a month of days
+		Config()
+				: rawSamples(1800), minutes(60), hours(24), days(31) {}
+	};
+
+	struct Sample
+	{
+		std::chrono::system_clock::time_point time;
+		int temperature;
+		int humidity;
+	};
+
+	// Aggregate over a bucket or window; the other fields are 0 when count is 0
+	struct Summary
+	{
+		uint64_t count;
+		int minTemperature;
+		int maxTemperature;
+		double meanTemperature;
+		int minHumidity;
+		int maxHumidity;
+		double meanHumidity;
+	};
+
+	/**
+	 * @brief Constructor; allocates every ring
+	 * @param config Capacity of each tier, each at least 1
+	 */
+	explicit SensorHistory(const Config &config = Config());
+
+	SensorHistory(const SensorHistory &) = delete;
+	SensorHistory &operator=(const SensorHistory &) = delete;
+
+	/**
+	 * @brief Record a reading
+	 * A reading older than the current bucket (wall clock set back) is counted in the current bucket.
+	 * @param time Wall-clock time of the reading
+	 * @param temperature Temperature in °C
+	 * @param humidity Relative humidity in %
+	 */
+	void add(std::chrono::system_clock::time_point time, int temperature, int humidity);
+
+	/**
+	 * @brief Summarize the bucket holding the latest reading, e.g. "today" on the DAY tier
+	 * @param tier Tier to read
+	 * @return Bucket summary
+	 */
+	Summary current(Tier tier) const;
+
+	/**
+	 * @brief Summarize every bucket the tier keeps, ending at the latest reading
+	 * With the default config the MINUTE window is the last hour and the HOUR window the last day.
+	 * @param tier Tier to read
+	 * @return Window summary
+	 */
+	Summary window(Tier tier) const;
+
+	/**
+	 * @brief Summarize an earlier bucket
+	 * @param tier Tier to read
+	 * @param ago Buckets back from the current one, 0 for the current bucket
+	 * @return Bucket summary, count 0 if nothing was recorded then or it has expired
+	 */
+	Summary bucket(Tier tier, size_t ago) const;
+
+	/**
+	 * @brief Copy the latest raw readings
+	 * @param out Receives the readings, oldest first
+	 * @param max Capacity of out
+	 * @return Number of readings copied
+	 */
+	size_t rawSamples(Sample *out, size_t max) const;
+
+	/**
+	 * @brief Get number of readings recorded since construction
+	 * @return Sample count
+	 */
+	uint64_t getSampleCount() const;
+
+	/**
+	 * @brief Get the memory the history occupies; fixed at construction
+	 * @return Bytes
+	 */
+	size_t memoryFootprint() const;
+
+private:
+	struct Bucket
+	{
+		int64_t index; // Absolute bucket number; a slot holding another number is empty
+		uint64_t count;
+		int64_t temperatureSum;
+		int64_t humiditySum;
+		int minTemperature;
+		int maxTemperature;
+		int minHumidity;
+		int maxHumidity;
+	};
+
+	// Fixed-capacity deque of bucket numbers whose values are monotonic, for sliding-window min or max
+	struct MonotonicQueue
+	{
+		std::vector<int64_t> slots;
+		size_t head = 0;
+		size_t size = 0;
+	};
+
+	enum Extreme
+	{
+		MIN_TEMPERATURE,
+		MAX_TEMPERATURE,
+		MIN_HUMIDITY,
+		MAX_HUMIDITY,
+		EXTREME_COUNT
+	};
+
+	struct TierState
+	{
+		std::vector<Bucket> buckets;
+		int64_t current = INT64_MIN; // Bucket number of the latest reading
+		std::chrono::system_clock::time_point start;
+		std::chrono::system_clock::time_point end; // Readings before end go to the current bucket
+		// Totals over completed buckets still in the window
+		uint64_t count = 0;
+		int64_t temperatureSum = 0;
+		int64_t humiditySum = 0;
+		std::array<MonotonicQueue, EXTREME_COUNT> extremes;
+	};
+
+	mutable std::mutex m_mutex;
+	std::vector<Sample> m_raw;
+	size_t m_rawNext = 0;
+	uint64_t m_sampleCount = 0;
+	std::array<TierState, TIER_COUNT> m_tiers;
+
+	/**
+	 * @brief Find the bucket a time falls in
+	 * @param tier Tier
+	 * @param time Wall-clock time
+	 * @param start Receives the bucket start
+	 * @param end Receives the bucket end
+	 * @return Absolute bucket number
+	 */
+	static int64_t locate(Tier tier, std::chrono::system_clock::time_point time,
+												std::chrono::system_clock::time_point &start, std::chrono::system_clock::time_point &end);
+
+	/**
+	 * @brief Close the current bucket and open a later one, expiring buckets that leave the window
+	 * @param state Tier state; caller holds m_mutex
+	 * @param next Bucket number to open
+	 */
+	void advance(TierState &state, int64_t next);
+
+	/**
+	 * @brief Get a bucket's value for one of the tracked extremes
+	 * @param bucket Bucket
+	 * @param extreme Which extreme
+	 * @return Value
+	 */
+	static int extremeOf(const Bucket &bucket, Extreme extreme);
+
+	/**
+	 * @brief Summarize one bucket
+	 * @param bucket Bucket
+	 * @return Summary
+	 */
+	static Summary summarize(const Bucket &bucket);
+};
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef SENSOR_LOG_H
+#define SENSOR_LOG_H
+
+#include "Metrics.h"
+#include "PeriodicTask.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Persistent, append-only log of sensor readings and curtain events
+ * Records are delta and varint encoded into fixed-size segment files that are
+ * preallocated and memory-mapped, so appending is a copy into the mapping. A
+ * background task commits on a fixed cadence: it closes the batch of records
+ * appended since the last commit by filling in the batch's length and CRC, then
+ * msyncs the new pages in one call, so the SD card sees each page written once
+ * per sync instead of once per record. Readers and recovery stop at the first
+ * batch that is unfinished or fails its CRC, so a crash loses at most one sync
+ * interval. The segment header is written when the segment is created and once
+ * more when it is sealed full. Segments are scanned in place through read-only
+ * mappings; records are decoded without copying the file.
+ */
+class SensorLog
+{
+public:
+	enum class Kind : uint8_t
+	{
+		SENSOR = 1, // values: temperature °C, humidity %
+		CURTAIN,		// values: opening %
+		MODE,				// values: SystemController::SystemState
+		ALARM,			// values: minutes after midnight, -1 when disabled
+		BUZZER			// values: 1 on, 0 off
+	};
+
+	struct Record
+	{
+		Kind kind;
+		std::chrono::system_clock::time_point time; // Stored to the millisecond
+		int32_t values[2];													// Unused values are 0
+	};
+
+	struct Config
+	{
+		std::string directory;										// Holds the segment files, empty to disable
+		size_t segmentSize;												// Bytes per segment file, header included
+		size_t maxSegments;												// Oldest segments are deleted beyond this
+		std::chrono::milliseconds syncInterval; // Cadence of msync and header commits
+
+		// About five days of readings at the default 2 s interval per segment, ten months in all
+		Config()
+				: segmentSize(1 << 20), maxSegments(64), syncInterval(5000) {}
+	};
+
+	// Byte accounting since open(), for write amplification
+	struct Stats
+	{
+		uint64_t records;
+		uint64_t recordBytes; // Encoded record bytes appended
+		uint64_t syncs;
+		uint64_t syncedBytes; // Page bytes passed to msync, headers included
+		uint64_t segments;		// Segment files created
+	};
+
+	// Return false to stop the scan
+	using RecordCallback = std::function<bool(const Record &record)>;
+	using ErrorCallback = std::function<void(const std::string &error)>;
+
+	/**
+	 * @brief Constructor
+	 * @param config Directory, segment geometry and sync cadence
+	 */
+	explicit SensorLog(const Config &config);
+
+	/**
+	 * @brief Destructor; commits everything appended
+	 */
+	~SensorLog();
+
+	SensorLog(const SensorLog &) = delete;
+	SensorLog &operator=(const SensorLog &) = delete;
+
+	/**
+	 * @brief Recover the newest segment and start the sync task
+	 * Creates the directory if needed and removes segments left half-created by a crash.
+	 * @return true if the log accepts records
+	 */
+	bool open();
+
+	/**
+	 * @brief Commit everything appended, stop the sync task and unmap the segment
+	 */
+	void close();
+
+	/**
+	 * @brief Check if the log accepts records
+	 * @return true between open() and close()
+	 */
+	bool isOpen() const;
+
+	/**
+	 * @brief Append a record; never waits for the storage except when a segment is created
+	 * @param record Record to store
+	 * @return false if the log is not open or a new segment could not be created
+	 */
+	bool append(const Record &record);
+
+	/**
+	 * @brief Flush appended records and commit them now instead of at the next sync
+	 * @return true if everything appended is committed
+	 */
+	bool sync();
+
+	/**
+	 * @brief Get byte accounting
+	 * @return Stats since open()
+	 */
+	Stats getStats() const;
+
+	/**
+	 * @brief Register callback for error handling
+	 * @param callback Function to call when errors occur
+	 */
+	void registerErrorCallback(ErrorCallback callback);
+
+	/**
+	 * @brief Visit committed records in the order they were appended; works on a live log and needs no SensorLog instance
+	 * Segments are mapped read-only one at a time and decoded in place.
+	 * @param directory Log directory
+	 * @param from First time of interest
+	 * @param to Last time of interest
+	 * @param callback Called for each record in [from, to]
+	 * @return Number of records passed to the callback
+	 */
+	static uint64_t scan(const std::string &directory, std::chrono::system_clock::time_point from,
+											 std::chrono::system_clock::time_point to, const RecordCallback &callback);
+
+private:
+	struct Segment;
+
+	Config m_config;
+	size_t m_pageSize;
+	mutable std::mutex m_mutex; // Guards the segments' write state and the stats
+	std::mutex m_syncMutex;			// Serializes sync(); msync runs without m_mutex so appends go on
+	std::shared_ptr<Segment> m_active;
+	std::vector<std::shared_ptr<Segment>> m_sealed; // Full segments the next sync commits and unmaps
+	uint64_t m_firstSequence = 0;	 // Oldest segment kept
+	uint64_t m_nextSequence = 0;
+	bool m_open = false;
+	Stats m_stats = {};
+
+	std::unique_ptr<PeriodicTask> m_syncTask;
+	std::unique_ptr<std::thread> m_syncThread;
+	ErrorCallback m_errorCallback;
+
+	struct LogMetrics
+	{
+		Counter &records;
+		Counter &recordBytes;
+		Counter &syncedBytes;
+		Histogram &syncTime;
+	};
+	LogMetrics m_metrics;
+
+	/**
+	 * @brief Run the sync task until close()
+	 */
+	void syncThread();
+
+	/**
+	 * @brief Reopen the newest segment at its last valid batch
+	 * @param sequence Segment number
+	 * @return false if the segment is damaged
+	 */
+	bool recover(uint64_t sequence);
+
+	/**
+	 * @brief Create, preallocate and map the next segment; caller holds m_mutex
+	 * @param baseTimeMs Time of the first record, the base of its delta
+	 * @return true if successful
+	 */
+	bool createSegment(int64_t baseTimeMs);
+
+	/**
+	 * @brief Close a segment's open batch and msync the pages written since its last commit
+	 * @param segment Segment to commit; caller holds m_syncMutex
+	 * @param seal Also record the segment's final length and time range in its header
+	 * @return true if successful
+	 */
+	bool commit(Segment &segment, bool seal);
+
+	/**
+	 * @brief Delete the oldest segments beyond maxSegments; caller holds m_mutex
+	 */
+	void enforceRetention();
+
+	/**
+	 * @brief Get the path of a segment file
+	 * @param sequence Segment number
+	 * @return Path in the log directory
+	 */
+	std::string segmentPath(uint64_t sequence) const;
+
+	/**
+	 * @brief Report an error to the registered callback
+	 * @param error Message
+	 */
+	void reportError(const std::string &error);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief Sequence lock publishing a trivially copyable value
+ * Readers never block or write shared memory; they retry if a store overlapped.
+ * Writers must be serialized by the caller.
+ */
+template <typename T>
+class SeqLock
+{
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+public:
+	/**
+	 * @brief Constructor
+	 * @param initial Value visible before the first store, at version 0
+	 */
+	explicit SeqLock(const T &initial = T())
+	{
+		std::array<uint64_t, WORDS> buffer{};
+		std::memcpy(buffer.data(), &initial, sizeof(T));
+		for (size_t i = 0; i < WORDS; ++i)
+		{
+			m_words[i].store(buffer[i], std::memory_order_relaxed);
+		}
+	}
+
+	SeqLock(const SeqLock &) = delete;
+	SeqLock &operator=(const SeqLock &) = delete;
+
+	/**
+	 * @brief Publish a new value and bump the version
+	 * @param value Value to publish
+	 */
+	void store(const T &value)
+	{
+		std::array<uint64_t, WORDS> buffer{};
+		std::memcpy(buffer.data(), &value, sizeof(T));
+		uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+		m_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < WORDS; ++i)
+		{
+			m_words[i].store(buffer[i], std::memory_order_relaxed);
+		}
+		m_sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Read a consistent copy of the value
+	 * @param version Optional output for the version the copy belongs to
+	 * @return Copy of the last published value
+	 */
+	T load(uint64_t *version = nullptr) const
+	{
+		std::array<uint64_t, WORDS> buffer;
+		uint64_t before;
+		uint64_t after;
+		do
+		{
+			before = m_sequence.load(std::memory_order_acquire);
+			for (size_t i = 0; i < WORDS; ++i)
+			{
+				buffer[i] = m_words[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = m_sequence.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+
+		T value;
+		std::memcpy(static_cast<void *>(&value), buffer.data(), sizeof(T));
+		if (version)
+		{
+			*version = before / 2;
+		}
+		return value;
+	}
+
+	/**
+	 * @brief Get number of completed stores
+	 * @return Current version
+	 */
+	uint64_t version() const
+	{
+		return m_sequence.load(std::memory_order_acquire) / 2;
+	}
+
+private:
+	static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	std::atomic<uint64_t> m_sequence{0};
+	std::array<std::atomic<uint64_t>, WORDS> m_words;
+};
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef SIMULATED_GPIO_H
+#define SIMULATED_GPIO_H
+
+#include "Clock.h"
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief In-process GPIO chips with the subset of the libgpiod C++ API the devices use
+ * Lines are evaluated lazily against scripted waveforms: a read returns the level
+ * at the current CLOCK_MONOTONIC time and edge events carry the scripted
+ * timestamps, so µs-scale timing holds however late the reader is scheduled.
+ * Event descriptors are timerfds armed for the next scripted change, so they
+ * work with poll() and epoll like the kernel's line event fds.
+ * On a virtual clock (Board::setClock) lines follow virtual time, event_wait()
+ * sleeps on the clock and event fds only signal events already queued.
+ * Unknown chip names are created on first use with LINE_COUNT floating lines.
+ * As with libgpiod, requests end when the last chip and line object of the
+ * opening are destroyed.
+ */
+namespace gpio
+{
+	namespace sim
+	{
+		namespace detail
+		{
+			struct ChipState;
+			struct ChipHandle;
+		}
+
+		// Number of lines on every simulated chip
+		constexpr unsigned int LINE_COUNT = 64;
+
+		struct line_request
+		{
+			enum : int
+			{
+				DIRECTION_AS_IS = 1,
+				DIRECTION_INPUT,
+				DIRECTION_OUTPUT,
+				EVENT_FALLING_EDGE,
+				EVENT_RISING_EDGE,
+				EVENT_BOTH_EDGES
+			};
+
+			static const std::bitset<32> FLAG_ACTIVE_LOW;
+			static const std::bitset<32> FLAG_OPEN_SOURCE;
+			static const std::bitset<32> FLAG_OPEN_DRAIN;
+
+			std::string consumer;
+			int request_type;
+			std::bitset<32> flags;
+		};
+
+		struct line_event
+		{
+			enum : int
+			{
+				RISING_EDGE = 1,
+				FALLING_EDGE
+			};
+
+			std::chrono::nanoseconds timestamp; // CLOCK_MONOTONIC time of the scripted edge
+			int event_type;
+		};
+
+		class line
+		{
+		public:
+			line();
+
+			unsigned int offset() const;
+			void request(const line_request &config, int default_val = 0) const;
+			void release() const;
+			bool is_requested() const;
+			int get_value() const;
+			void set_value(int val) const;
+			void set_direction_input() const;
+			void set_direction_output(int val = 0) const;
+			bool event_wait(const std::chrono::nanoseconds &timeout) const;
+			line_event event_read() const;
+			std::vector<line_event> event_read_multiple() const;
+			int event_get_fd() const;
+
+		private:
+			friend class chip;
+			friend class line_bulk;
+
+			line(std::shared_ptr<detail::ChipHandle> chip, unsigned int offset);
+
+			std::shared_ptr<detail::ChipHandle> m_chip;
+			unsigned int m_offset;
+		};
+
+		class line_bulk
+		{
+		public:
+			line_bulk() = default;
+			explicit line_bulk(const std::vector<line> &lines);
+
+			void append(const line &new_line);
+			line &operator[](unsigned int index);
+			unsigned int size() const;
+			bool empty() const;
+			void request(const line_request &config, const std::vector<int> &default_vals = std::vector<int>()) const;
+			void release() const;
+			std::vector<int> get_values() const;
+			void set_values(const std::vector<int> &values) const;
+
+		private:
+			std::vector<line> m_lines;
+		};
+
+		class chip
+		{
+		public:
+			explicit chip(const std::string &name);
+
+			std::string name() const;
+			unsigned int num_lines() const;
+			line get_line(unsigned int offset) const;
+			line_bulk get_lines(const std::vector<unsigned int> &offsets) const;
+
+		private:
+			std::shared_ptr<detail::ChipHandle> m_chip;
+		};
+
+		/**
+		 * @brief Process-wide wiring of simulated chips to scripted devices
+		 * Times are steady_clock points, so scripts can be laid out relative to now().
+		 */
+		class Board
+		{
+		public:
+			using time_point = std::chrono::steady_clock::time_point;
+
+			/**
+			 * @brief Get the board shared by every simulated chip
+			 * @return Board, never destroyed
+			 */
+			static Board &instance();
+
+			/**
+			 * @brief Detach all devices, start every chip afresh and go back to the system clock
+			 * Line objects opened before keep their old, now unwired, chip.
+			 */
+			void reset();
+
+			/**
+			 * @brief Select the clock lines are evaluated against
+			 * @param clock Clock shared with the devices under test; must outlive its use here
+			 */
+			void setClock(Clock &clock);
+
+			/**
+			 * @brief Set the level an undriven line floats to
+			 * @param chipName Chip name
+			 * @param offset Line offset
+			 * @param level 1 for a pull-up, 0 for a pull-down (default)
+			 */
+			void setPull(const std::string &chipName, unsigned int offset, int level);
+
+			/**
+			 * @brief Drive a line from outside the host from a given time on
+			 * @param chipName Chip name
+			 * @param offset Line offset
+			 * @param at Time of the transition
+			 * @param level Level driven from then on
+			 */
+			void drive(const std::string &chipName, unsigned int offset, time_point at, int level);
+
+			/**
+			 * @brief Connect a DHT11 that answers every start signal of at least 18ms
+			 * @param chipName Chip name
+			 * @param offset Data line offset; gets a pull-up
+			 * @param responseDelay Release-to-first-edge time of the sensor (20-40us on real parts)
+			 */
+			void attachDHT11(const std::string &chipName, unsigned int offset,
+											 std::chrono::microseconds responseDelay = std::chrono::microseconds(30));
+
+			/**
+			 * @brief Set the reading the DHT11 reports, with a valid checksum
+			 * @param chipName Chip name
+			 * @param offset Data line offset
+			 * @param humidity Relative humidity in percent
+			 * @param temperature Temperature in degrees Celsius
+			 */
+			void setDHT11Reading(const std::string &chipName, unsigned int offset, int humidity, int temperature);
+
+			/**
+			 * @brief Set the raw frame the DHT11 sends, e.g. with a bad checksum
+			 * @param chipName Chip name
+			 * @param offset Data line offset
+			 * @param frame [humidity_high, humidity_low, temp_high, temp_low, checksum]
+			 */
+			void setDHT11Frame(const std::string &chipName, unsigned int offset, const std::array<uint8_t, 5> &frame);
+
+			/**
+			 * @brief Get the number of start signals the DHT11 answered
+			 * @param chipName Chip name
+			 * @param offset Data line offset
+			 * @return Response count
+			 */
+			uint64_t getDHT11ResponseCount(const std::string &chipName, unsigned int offset) const;
+
+			/**
+			 * @brief Connect a 4x4 matrix keypad; a row reads high while a closed key joins it to a driven column
+			 * @param chipName Chip name
+			 * @param colPins Column line offsets
+			 * @param rowPins Row line offsets
+			 */
+			void attachKeypad(const std::string &chipName, const std::array<int, 4> &colPins, const std::array<int, 4> &rowPins);
+
+			/**
+			 * @brief Open or close one key contact at a given time
+			 * @param chipName Chip name
+			 * @param row Key row (0-3)
+			 * @param col Key column (0-3)
+			 * @param at Time of the transition
+			 * @param closed true to close the contact
+			 */
+			void setKey(const std::string &chipName, int row, int col, time_point at, bool closed);
+
+			/**
+			 * @brief Script a full key press with contact bounce on both edges
+			 * @param chipName Chip name
+			 * @param row Key row (0-3)
+			 * @param col Key column (0-3)
+			 * @param at Time of the first contact
+			 * @param hold Time from the first contact to the final release
+			 * @param bounces Extra open/close pairs right after the first contact and after the release
+			 * @param bounceInterval Duration of each bounce phase
+			 */
+			void pressKey(const std::string &chipName, int row, int col, time_point at,
+										std::chrono::microseconds hold, int bounces = 0,
+										std::chrono::microseconds bounceInterval = std::chrono::microseconds(500));
+
+			/**
+			 * @brief Get the level the host drives onto a line
+			 * @param chipName Chip name
+			 * @param offset Line offset
+			 * @return 0 or 1, or -1 if the host is not driving the line
+			 */
+			int getOutput(const std::string &chipName, unsigned int offset) const;
+
+			/**
+			 * @brief Get the number of value writes the host made to a line
+			 * @param chipName Chip name
+			 * @param offset Line offset
+			 * @return Write count since the chip was created
+			 */
+			uint64_t getWriteCount(const std::string &chipName, unsigned int offset) const;
+
+		private:
+			friend class chip;
+
+			Board() = default;
+
+			/**
+			 * @brief Find or create a chip
+			 * @param chipName Chip name
+			 * @return Shared chip state
+			 */
+			std::shared_ptr<detail::ChipState> open(const std::string &chipName);
+		};
+	}
+}
+
+#endif
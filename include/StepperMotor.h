@@ -0,0 +1,334 @@
+#ifndef STEPPER_MOTOR_H
+#define STEPPER_MOTOR_H
+
+#include "Gpio.h"
+#include <array>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <cstdint>
+
+/**
+ * @brief 28BYJ-48 Stepper Motor Class (ULN2003 driver, half-step drive)
+ * Executes trapezoidal moves from a precomputed acceleration table, timing
+ * every step against an absolute CLOCK_MONOTONIC deadline. Moves run on a
+ * motion thread; a new target blends into the current motion.
+ */
+class StepperMotor
+{
+public:
+	// How a move ended
+	enum class MoveResult
+	{
+		COMPLETED,	// Reached its target
+		RETARGETED, // Superseded by a newer move before reaching its target
+		CANCELLED,	// Decelerated to a stop on cancel()
+		FAILED			// GPIO error or motor not initialized
+	};
+
+	using ErrorCallback = std::function<void(const std::string &error)>;
+	// Called once per move on the motion thread with the position where it ended
+	using CompletionCallback = std::function<void(MoveResult result, int32_t position)>;
+
+	// Speed and acceleration limits in half-steps
+	struct MotionProfile
+	{
+		int startStepRate; // steps/s the motor can start from standstill
+		int maxStepRate;	 // steps/s cruise speed
+		int acceleration;	 // steps/s^2
+
+		MotionProfile()
+				: startStepRate(300), maxStepRate(900), acceleration(1500) {}
+	};
+
+	// Timing statistics of the last finished move
+	struct MoveStats
+	{
+		int32_t steps;
+		std::chrono::microseconds duration;
+		std::chrono::microseconds maxLateness; // Worst step issued after its deadline
+	};
+
+	class MoveHandle;
+
+	// Half-steps per output shaft revolution (64 half-steps x 1:64 gearbox)
+	static constexpr int32_t STEPS_PER_REVOLUTION = 4096;
+
+	/**
+	 * @brief Constructor
+	 * @param chipName GPIO chip name
+	 * @param pins IN1-IN4 pin numbers
+	 * @param profile Motion limits used to build the step timing table
+	 */
+	StepperMotor(const std::string &chipName,
+							 const std::array<int, 4> &pins,
+							 const MotionProfile &profile = MotionProfile());
+
+	/**
+	 * @brief Destructor
+	 */
+	~StepperMotor();
+
+	/**
+	 * @brief Initialize the coil lines and start the motion thread
+	 * @return true if initialization successful
+	 */
+	bool initialize();
+
+	/**
+	 * @brief Start a move to an absolute position and return immediately
+	 * A move already in progress ends as RETARGETED and the motor blends into the new target.
+	 * @param targetStep Target position in half-steps
+	 * @param callback Function to call when the move ends
+	 * @return Handle to cancel, retarget or wait for the move
+	 */
+	MoveHandle moveToAsync(int32_t targetStep, CompletionCallback callback = nullptr);
+
+	/**
+	 * @brief Move to an absolute position, blocking until the move ends
+	 * @param targetStep Target position in half-steps
+	 * @return true if the move completed
+	 */
+	bool moveTo(int32_t targetStep);
+
+	/**
+	 * @brief Get current position
+	 * @return Position in half-steps
+	 */
+	int32_t getPosition() const;
+
+	/**
+	 * @brief Redefine the current position without moving (homing); only while idle
+	 * @param step New position in half-steps
+	 */
+	void setPosition(int32_t step);
+
+	/**
+	 * @brief Check if a move is in progress
+	 * @return true while stepping
+	 */
+	bool isMoving() const;
+
+	/**
+	 * @brief De-energise all coils
+	 */
+	void releaseCoils();
+
+	/**
+	 * @brief Get timing statistics of the last finished move
+	 * @return MoveStats of the last move
+	 */
+	MoveStats getLastMoveStats() const;
+
+	/**
+	 * @brief Get time from the command that started the motor from rest to its first step
+	 * @return Latency in microseconds, negative before the first move
+	 */
+	std::chrono::microseconds getLastStartLatency() const;
+
+	/**
+	 * @brief Get the delay before a step of a trapezoidal move
+	 * @param stepIndex Index of the step within the move (0-based)
+	 * @param totalSteps Number of steps in the move
+	 * @return Interval between this step and the next
+	 */
+	std::chrono::nanoseconds stepInterval(size_t stepIndex, size_t totalSteps) const;
+
+	/**
+	 * @brief Choose the ramp level of the next step toward a target
+	 * Speeds up, cruises or brakes by at most one ramp level per step, overshooting
+	 * and coming back when a new target is closer than the stopping distance.
+	 * @param level Ramp level of the previous step, -1 when stopped
+	 * @param direction Direction of the previous step (+1/-1), 0 when stopped
+	 * @param remaining Signed steps from the current position to the target
+	 * @param nextDirection Receives the direction of the next step
+	 * @return Ramp level of the next step, -1 if the motor stops here
+	 */
+	int planStep(int level, int direction, int32_t remaining, int &nextDirection) const;
+
+	/**
+	 * @brief Get number of entries in the acceleration table
+	 * @return Steps needed to reach the cruise rate
+	 */
+	size_t rampLength() const;
+
+	/**
+	 * @brief Keep steps out of windows where another component needs the GPIO chip to itself
+	 * A step that falls due inside a window is held until it closes and the step
+	 * grid restarts from there, so the motor never bursts to catch up.
+	 * @param windows Lock held exclusively for each window, e.g. CyclicExecutive::windowLock(); nullptr to step freely
+	 */
+	void setExclusiveWindows(std::shared_timed_mutex *windows);
+
+	/**
+	 * @brief Register callback for error handling
+	 * @param callback Function to call when errors occur
+	 */
+	void registerErrorCallback(ErrorCallback callback);
+
+private:
+	struct MoveState
+	{
+		uint64_t id;
+		int32_t target;
+		std::chrono::steady_clock::time_point issuedAt;
+		bool cancelled;
+		bool stopping; // Target already replaced by the stopping point after cancel()
+		bool done;
+		MoveResult result;
+		int32_t finalPosition;
+		CompletionCallback callback;
+	};
+
+	// Shared with handles so they stay safe to use after the motor is gone
+	struct MotionControl
+	{
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::shared_ptr<MoveState> active;
+		uint64_t nextId = 1;
+		bool stopRequested = false;
+	};
+
+	std::string m_chipName;
+	std::array<int, 4> m_pins;
+	MotionProfile m_profile;
+
+	std::unique_ptr<gpio::Default::chip> m_chip;
+	gpio::Default::line_bulk m_coils;
+
+	// Interval of each step while accelerating; deceleration reads it backwards
+	std::vector<uint32_t> m_rampTable;
+	uint32_t m_cruiseIntervalNs = 0;
+
+	std::atomic<int32_t> m_position{0};
+	std::atomic<bool> m_moving{false};
+	std::atomic<int64_t> m_lastStartLatencyUs{-1};
+	std::atomic<std::shared_timed_mutex *> m_windows{nullptr};
+
+	std::shared_ptr<MotionControl> m_control;
+	std::unique_ptr<std::thread> m_motionThread;
+
+	mutable std::mutex m_statsMutex;
+	MoveStats m_lastMoveStats;
+
+	ErrorCallback m_errorCallback;
+
+	/**
+	 * @brief Build the acceleration table from the motion profile
+	 */
+	void buildRampTable();
+
+	/**
+	 * @brief Get the step interval at a ramp level
+	 * @param level Ramp level (0 = start rate)
+	 * @return Interval after a step at this level
+	 */
+	std::chrono::nanoseconds intervalForLevel(size_t level) const;
+
+	/**
+	 * @brief Energise the coils for a position
+	 * @param step Position in half-steps
+	 */
+	void writePhase(int32_t step);
+
+	/**
+	 * @brief Step toward the active move's target until stopped
+	 */
+	void motionThread();
+
+	/**
+	 * @brief Mark a move finished, record its stats and run its callback unlocked
+	 * @param lock Lock on the motion control mutex, held on entry and return
+	 * @param move Move to finish
+	 * @param result How the move ended
+	 * @param position Position where it ended
+	 * @param stats Timing of the move
+	 */
+	void finishMove(std::unique_lock<std::mutex> &lock, const std::shared_ptr<MoveState> &move,
+									MoveResult result, int32_t position, const MoveStats &stats);
+};
+
+/**
+ * @brief Handle to a move started by StepperMotor::moveToAsync()
+ */
+class StepperMotor::MoveHandle
+{
+public:
+	/**
+	 * @brief Construct an empty handle that is already done
+	 */
+	MoveHandle();
+
+	/**
+	 * @brief Check if the handle refers to a move
+	 * @return true if returned by moveToAsync()
+	 */
+	bool valid() const;
+
+	/**
+	 * @brief Get the move's sequence number
+	 * @return Move id, 0 for an empty handle
+	 */
+	uint64_t id() const;
+
+	/**
+	 * @brief Change the target of this move without restarting it
+	 * @param targetStep New target in half-steps
+	 * @return true if the move was still active
+	 */
+	bool retarget(int32_t targetStep);
+
+	/**
+	 * @brief Decelerate to a stop along the ramp
+	 * @return true if the move was still active
+	 */
+	bool cancel();
+
+	/**
+	 * @brief Block until the move ends
+	 */
+	void wait() const;
+
+	/**
+	 * @brief Block until the move ends or the timeout expires
+	 * @param timeout Maximum time to wait
+	 * @return true if the move ended
+	 */
+	bool waitFor(std::chrono::milliseconds timeout) const;
+
+	/**
+	 * @brief Check if the move has ended
+	 * @return true once a result is available
+	 */
+	bool isDone() const;
+
+	/**
+	 * @brief Get how the move ended
+	 * @return MoveResult, meaningful once isDone()
+	 */
+	MoveResult getResult() const;
+
+	/**
+	 * @brief Get the position where the move ended
+	 * @return Position in half-steps, meaningful once isDone()
+	 */
+	int32_t getFinalPosition() const;
+
+private:
+	friend class StepperMotor;
+
+	MoveHandle(std::shared_ptr<MotionControl> control, std::shared_ptr<MoveState> move);
+
+	std::shared_ptr<MotionControl> m_control;
+	std::shared_ptr<MoveState> m_move;
+};
+
+#endif
@@ -1,15 +1,31 @@
 #ifndef SYSTEM_CONTROLLER_H
 #define SYSTEM_CONTROLLER_H
 
+#include "AlarmScheduler.h"
+#include "BluetoothProtocol.h"
+#include "Clock.h"
+#include "ControlServer.h"
+#include "CyclicExecutive.h"
+#include "DeviceTrace.h"
 #include "DHT11.h"
+#include "EventBus.h"
 #include "Key.h"
+#include "SeqLock.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "StepperMotor.h"
+#include "Metrics.h"
+#include "PeriodicTask.h"
+#include "SensorHistory.h"
+#include "SensorLog.h"
 #include <memory>
 #include <atomic>
 #include <functional>
 #include <chrono>
 #include <mutex>
 #include <thread>
-#include <gpiod.hpp>
+#include <condition_variable>
+#include "Gpio.h"
 
 /**
  * @brief Main System Controller Class
@@ -31,29 +47,59 @@ public:
 		OPEN = 1
 	};
 
+	// Consistent view of the whole system, republished on every change
+	struct SystemSnapshot
+	{
+		uint64_t version;
+		DHT11Sensor::SensorData sensorData;
+		CurtainState curtainState;
+		int curtainPosition; // % open
+		SystemState systemState;
+		bool alarmEnabled;
+		int alarmHour; // Armed alarm, meaningful while alarmEnabled
+		int alarmMinute;
+		int pendingAlarmHour; // Keypad entry edited with '5'/'6', scheduled only when '7' arms it
+		int pendingAlarmMinute;
+		bool buzzerOn;
+	};
+
 	// System configuration
 	struct SystemConfig
 	{
 		std::string gpioChipName;
 		int dht11Pin;
+		DHT11Sensor::ReadMode dht11ReadMode; // POLLING keeps one open-drain request; EDGE_EVENTS re-requests the line every read
 		int buzzerPin;
+		std::array<int, 4> stepperPins; // ULN2003 IN1-IN4
+		int curtainTravelSteps;					// Half-steps from fully closed to fully open
 		std::array<int, 4> keypadCols;
 		std::array<int, 4> keypadRows;
 		int sensorReadInterval; // ms
 		int keypadScanInterval; // ms
 		int tempThreshold;			// °C
 		int humidityThreshold;	// %
+		bool useReactor;				// Drive all devices from one epoll loop instead of per-component threads
+		bool useCyclicExecutive; // Scan the keypad and read the DHT11 from one frame table, each read in an exclusive window
+		MatrixKeypad::ScanMode keypadScanMode;
+		std::string metricsSocketPath; // Unix socket serving the metrics report, empty to disable
+		std::string bluetoothDevice;	 // rfcomm tty of the phone link, empty to disable
+		std::string controlSocketPath; // Unix socket for local control clients, empty to disable
+		int controlTcpPort;						 // Loopback TCP port for control clients, 0 for any free port, -1 to disable
+		SensorHistory::Config history; // Capacity of the reading history
+		SensorLog::Config sensorLog;	 // Persistent log of readings and state changes, disabled without a directory
+		std::string tracePath;				 // Device callbacks are recorded here for TraceReplayer, empty to disable
 
 		// Default constructor
 		SystemConfig()
-				: gpioChipName("gpiochip0"), dht11Pin(17), buzzerPin(18), keypadCols({{26, 19, 13, 6}}), keypadRows({{21, 20, 16, 12}}), sensorReadInterval(2000), keypadScanInterval(50), tempThreshold(27), humidityThreshold(40) {}
+				: gpioChipName("gpiochip0"), dht11Pin(17), dht11ReadMode(DHT11Sensor::ReadMode::POLLING), buzzerPin(18), stepperPins({{27, 22, 24, 25}}), curtainTravelSteps(2 * StepperMotor::STEPS_PER_REVOLUTION), keypadCols({{26, 19, 13, 6}}), keypadRows({{21, 20, 16, 12}}), sensorReadInterval(2000), keypadScanInterval(50), tempThreshold(27), humidityThreshold(40), useReactor(false), useCyclicExecutive(false), keypadScanMode(MatrixKeypad::ScanMode::POLLING), metricsSocketPath("/tmp/smart_curtain_metrics.sock"), bluetoothDevice("/dev/rfcomm0"), controlSocketPath("/tmp/smart_curtain_control.sock"), controlTcpPort(-1) {}
 	};
 
 	/**
 	 * @brief Constructor
 	 * @param config System configuration
+	 * @param clock Clock every device loop and the alarm run on; a virtual clock uses component threads
 	 */
-	explicit SystemController(const SystemConfig &config = SystemConfig());
+	explicit SystemController(const SystemConfig &config = SystemConfig(), Clock &clock = Clock::system());
 
 	/**
 	 * @brief Destructor
@@ -94,12 +140,71 @@ public:
 	 */
 	CurtainState getCurtainState() const;
 
+	/**
+	 * @brief Start moving the curtain to a partial opening and return immediately
+	 * A move in progress blends into the new target instead of finishing first.
+	 * @param percent Target opening (0 = closed, 100 = fully open)
+	 * @param callback Function to call on the motion thread when the move ends
+	 * @return Handle to cancel, retarget or wait for the move; empty without a stepper
+	 */
+	StepperMotor::MoveHandle moveTo(int percent, StepperMotor::CompletionCallback callback = nullptr);
+
+	/**
+	 * @brief Get current curtain opening from the stepper position
+	 * @return Opening in percent
+	 */
+	int getCurtainPosition() const;
+
 	/**
 	 * @brief Get latest sensor data
 	 * @return DHT11 sensor data
 	 */
 	DHT11Sensor::SensorData getLatestSensorData() const;
 
+	/**
+	 * @brief Get a consistent snapshot of sensor, curtain, mode and alarm state
+	 * @return Latest published SystemSnapshot (lock-free)
+	 */
+	SystemSnapshot getSnapshot() const;
+
+	/**
+	 * @brief Get slot utilization and window violations of the cyclic executive
+	 * @return Stats of the running executive, all zero without one
+	 */
+	CyclicExecutive::Stats getScheduleStats() const;
+
+	/**
+	 * @brief Get the history of valid sensor readings
+	 * @return History with raw readings and minute, hour and day summaries
+	 */
+	const SensorHistory &getSensorHistory() const;
+
+	/**
+	 * @brief Block until a snapshot newer than lastVersion is published
+	 * @param lastVersion Version the caller has already seen
+	 * @param timeout Maximum time to wait
+	 * @return Latest snapshot; its version equals lastVersion on timeout
+	 */
+	SystemSnapshot waitForChange(uint64_t lastVersion, std::chrono::milliseconds timeout) const;
+
+	/**
+	 * @brief Get the TCP port control clients connect to
+	 * @return Port number, -1 if TCP control is not open
+	 */
+	int getControlTcpPort() const;
+
+	/**
+	 * @brief Get number of connected control clients, the rfcomm link included
+	 * @return Client count
+	 */
+	size_t getControlClientCount() const;
+
+	/**
+	 * @brief Get number of reactor wakeups since start
+	 * @return Wakeup count, 0 when not running in reactor mode
+	 */
+	uint64_t getReactorWakeupCount() const;
+
 	/**
 	 * @brief Set alarm time
 	 * @param hours Hour (0-23)
@@ -112,30 +217,105 @@ public:
 	 */
 	void clearAlarm();
 
+	/**
+	 * @brief Add a named alarm, replacing any alarm of the same name
+	 * @param alarm Time, weekdays and actions; "keypad" is the alarm set by setAlarmTime()
+	 * @return false if the alarm is invalid
+	 */
+	bool addAlarm(const AlarmScheduler::Alarm &alarm);
+
+	/**
+	 * @brief Remove a named alarm
+	 * @param name Alarm name
+	 * @return true if the alarm existed
+	 */
+	bool removeAlarm(const std::string &name);
+
+	/**
+	 * @brief Get all scheduled alarms
+	 * @return Alarms in trigger order
+	 */
+	std::vector<AlarmScheduler::Alarm> getAlarms() const;
+
 private:
+	// Drives the device handlers directly
+	friend class TraceReplayer;
+
 	SystemConfig m_config;
+	Clock &m_clock;
+	Logger &m_log;
 
 	// Hardware components
 	std::unique_ptr<DHT11Sensor> m_dht11Sensor;
 	std::unique_ptr<MatrixKeypad> m_keypad;
-	std::unique_ptr<gpiod::chip> m_gpioChip;
-	std::unique_ptr<gpiod::line> m_buzzerLine;
+	std::unique_ptr<StepperMotor> m_stepper;
+	std::unique_ptr<gpio::Default::chip> m_gpioChip;
+	std::unique_ptr<gpio::Default::line> m_buzzerLine;
 
 	// System state
 	std::atomic<bool> m_running{false};
 	std::atomic<SystemState> m_systemState{SystemState::MANUAL_MODE};
 	std::atomic<CurtainState> m_curtainState{CurtainState::CLOSED};
+	std::atomic<int> m_curtainTarget{0}; // % open of the last move commanded
+	std::atomic<bool> m_buzzerOn{false};
+
+	// Published snapshot; writers serialize on m_publishMutex, readers take no lock
+	std::mutex m_publishMutex;
+	SystemSnapshot m_pendingSnapshot;
+	SeqLock<SystemSnapshot> m_snapshot;
+	mutable std::mutex m_changeMutex;
+	mutable std::condition_variable m_changeCondition;
+
+	// Valid readings, fed from the sensor callback
+	SensorHistory m_history;
+	// Readings and published state changes, kept on storage
+	SensorLog m_sensorLog;
+	// Device callbacks as they arrive, for replay
+	TraceRecorder m_trace;
+
+	// Device callbacks only publish; the handlers run on the bus workers
+	struct KeyPress
+	{
+		int row;
+		int col;
+		char key;
+	};
+	std::unique_ptr<EventBus> m_events;
 
-	// Alarm system
+	// Alarm system; hour and minute are the keypad entry, which '7' turns into the "keypad" alarm
 	mutable std::mutex m_alarmMutex;
-	bool m_alarmEnabled = false;
 	int m_alarmHour = 0;
 	int m_alarmMinute = 0;
-	std::unique_ptr<std::thread> m_alarmThread;
-
-	// Bluetooth communication
-	int m_bluetoothFd = -1;
-	std::unique_ptr<std::thread> m_bluetoothThread;
+	std::unique_ptr<AlarmScheduler> m_alarms;
+
+	// Remote control over rfcomm, Unix socket and TCP; exists for the controller's lifetime so publishing can notify it
+	std::unique_ptr<ControlServer> m_controlServer;
+
+	// Reactor mode
+	std::unique_ptr<EventLoop> m_eventLoop;
+	std::unique_ptr<std::thread> m_reactorThread;
+	int m_keypadTimerFd = -1;
+	std::chrono::milliseconds m_keypadTickInterval{0}; // Period m_keypadTimerFd was armed with
+	// A DHT11 read blocks for ~25ms, so the reactor's sensor timer hands it to this worker
+	std::unique_ptr<std::thread> m_sensorWorker;
+	std::mutex m_sensorWorkMutex;
+	std::condition_variable m_sensorWork;
+	bool m_sensorReadRequested = false; // Under m_sensorWorkMutex
+	bool m_sensorWorkerStop = false;		// Under m_sensorWorkMutex
+	bool m_sensorReadPending = false;		// Loop thread only: requested and not yet reported back
+
+	// Keypad scans and DHT11 reads when useCyclicExecutive is set; the stepper keeps out of its windows
+	std::unique_ptr<CyclicExecutive> m_executive;
+
+	// Metrics export; served from the reactor in reactor mode, otherwise from its own thread
+	std::unique_ptr<MetricsServer> m_metricsServer;
+	struct ControllerMetrics
+	{
+		Counter &unknownCommands;
+		Counter &curtainMoves;
+		Counter &alarmTriggers;
+	};
+	ControllerMetrics m_metrics;
 
 	/**
 	 * @brief Initialize GPIO components
@@ -156,10 +336,10 @@ private:
 	bool initializeKeypad();
 
 	/**
-	 * @brief Initialize Bluetooth communication
+	 * @brief Initialize the curtain stepper motor
 	 * @return true if successful
 	 */
-	bool initializeBluetooth();
+	bool initializeMotor();
 
 	/**
 	 * @brief Handle sensor data updates
@@ -178,16 +358,54 @@ private:
 	void handleKeypadInput(int row, int col, char key);
 
 	/**
-	 * @brief Handle Bluetooth commands
-	 * @param command Received command
+	 * @brief Handle a control request and queue its reply
+	 * @param frame Received frame
+	 * @param replies Reply queue of the requesting client
+	 */
+	void handleControlRequest(const bluetooth::Frame &frame, ControlServer::Replies &replies);
+
+	/**
+	 * @brief Build the STATUS fields from the current snapshot
+	 * @return Fields in STATUS payload order
+	 */
+	bluetooth::StatusFields statusFields() const;
+
+	/**
+	 * @brief Switch to auto mode and apply it to the latest reading at once
 	 */
-	void handleBluetoothCommand(char command);
+	void enterAutoMode();
 
 	/**
-	 * @brief Control curtain state
+	 * @brief Control curtain state without waiting for the motor
 	 * @param newState Desired curtain state
+	 * @return Handle of the move started, empty if nothing had to move
+	 */
+	StepperMotor::MoveHandle setCurtainState(CurtainState newState);
+
+	/**
+	 * @brief Publish the curtain opening reached by the motor
+	 * @param position Stepper position in half-steps
 	 */
-	void setCurtainState(CurtainState newState);
+	void publishCurtainPosition(int32_t position);
+
+	/**
+	 * @brief Change system mode and publish it
+	 * @param newState Desired system state
+	 */
+	void setSystemState(SystemState newState);
+
+	/**
+	 * @brief Apply a change to the snapshot and wake waiting readers
+	 * @param mutation Function updating the fields that changed
+	 */
+	void publishChange(const std::function<void(SystemSnapshot &)> &mutation);
+
+	/**
+	 * @brief Append the curtain, mode, alarm and buzzer changes between two snapshots to the sensor log
+	 * @param previous Snapshot before the change, null to append every field
+	 * @param current Snapshot after the change
+	 */
+	void logChanges(const SystemSnapshot *previous, const SystemSnapshot &current);
 
 	/**
 	 * @brief Control buzzer
@@ -203,14 +421,44 @@ private:
 	void evaluateAutoMode(int temperature, int humidity);
 
 	/**
-	 * @brief Bluetooth receiver thread
+	 * @brief Register all components with the event loop and start it
+	 * @return true if the reactor is running
+	 */
+	bool startReactor();
+
+	/**
+	 * @brief Stop the event loop and release its timers
+	 */
+	void stopReactor();
+
+	/**
+	 * @brief Reactor sensor worker; runs each requested DHT11 read and posts its completion to the loop
+	 */
+	void sensorWorkerThread();
+
+	/**
+	 * @brief Keep the reactor's keypad tick on the keypad's active tick interval
+	 * @param active Result of the last scan; the tick is removed once every key is idle
+	 */
+	void armKeypadTick(bool active);
+
+	/**
+	 * @brief Build the frame table for the keypad and DHT11 and start it
+	 * @return true if the schedule fits and is running
+	 */
+	bool startExecutive();
+
+	/**
+	 * @brief Stop the executive and let the stepper step freely again
 	 */
-	void bluetoothReceiverThread();
+	void stopExecutive();
 
 	/**
-	 * @brief Alarm monitoring thread
+	 * @brief Run the actions of a triggered alarm
+	 * @param alarm Alarm that triggered
+	 * @param missed true if the trigger was skipped for being too late
 	 */
-	void alarmMonitoringThread();
+	void handleAlarm(const AlarmScheduler::Alarm &alarm, bool missed);
 
 	/**
 	 * @brief Handle system errors
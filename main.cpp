@@ -1,4 +1,5 @@
 #include "SystemController.h"
+#include "Delay.h"
 #include <iostream>
 #include <csignal>
 #include <memory>
@@ -17,6 +18,7 @@ void signalHandler(int signal)
 	{
 		g_systemController->stop();
 	}
+	Logger::instance().flush();
 	exit(0);
 }
 
@@ -25,9 +27,15 @@ void signalHandler(int signal)
  */
 int main()
 {
-	std::cout << "[Main] Smart Curtain Control System Starting..." << std::endl;
+	Logger::instance().info("Main", "Smart Curtain Control System Starting...");
 	signal(SIGINT, signalHandler);
 	signal(SIGTERM, signalHandler);
+	// Calibrate before the device threads start so their first delays are already accurate
+	DelayCalibration calibration = delay_calibrate();
+	Logger::instance().info("Main", "Delay calibration: sleep overshoot %lld us, spin threshold %lld us, clock read %lld ns",
+													static_cast<long long>(calibration.sleepOvershootNs / 1000),
+													static_cast<long long>(calibration.spinThresholdNs / 1000),
+													static_cast<long long>(calibration.clockReadNs));
 	try
 	{
 		// System configuration
@@ -41,54 +49,64 @@ int main()
 		config.keypadScanInterval = 50;		// 50ms
 		config.tempThreshold = 27;				// 27°C
 		config.humidityThreshold = 40;		// 40%
+		config.sensorLog.directory = "/var/lib/smart_curtain";
 
 		// Create and initialize system controller
 		g_systemController = std::make_unique<SystemController>(config);
 		if (!g_systemController->initialize())
 		{
-			std::cerr << "[Main] Failed to initialize system controller" << std::endl;
+			Logger::instance().error("Main", "Failed to initialize system controller");
+			g_systemController.reset();
+			Logger::instance().flush();
 			return -1;
 		}
 		// Start the system
 		g_systemController->start();
-		std::cout << "[Main] System running. Press Ctrl+C to stop." << std::endl;
-		// Main event loop
+		Logger::instance().info("Main", "System running. Press Ctrl+C to stop.");
+		// Main event loop: wake only when the published snapshot changes
+		uint64_t lastVersion = g_systemController->getSnapshot().version;
 		while (g_systemController->isRunning())
 		{
-			// Display system status periodically
-			auto sensorData = g_systemController->getLatestSensorData();
-			if (sensorData.isValid)
+			auto snapshot = g_systemController->waitForChange(lastVersion, std::chrono::seconds(5));
+			if (snapshot.version == lastVersion)
 			{
-				std::cout << "[Main] Status - Temp: " << sensorData.temperature
-									<< "°C, Humidity: " << sensorData.humidity << "%, "
-									<< "Curtain: " << (g_systemController->getCurtainState() == SystemController::CurtainState::OPEN ? "OPEN" : "CLOSED")
-									<< ", Mode: ";
-
-				switch (g_systemController->getSystemState())
+				continue;
+			}
+			lastVersion = snapshot.version;
+			// Display system status from one consistent snapshot
+			if (snapshot.sensorData.isValid)
+			{
+				const char *mode = "MANUAL";
+				switch (snapshot.systemState)
 				{
 				case SystemController::SystemState::MANUAL_MODE:
-					std::cout << "MANUAL";
+					mode = "MANUAL";
 					break;
 				case SystemController::SystemState::AUTO_MODE:
-					std::cout << "AUTO";
+					mode = "AUTO";
 					break;
 				case SystemController::SystemState::ALARM_MODE:
-					std::cout << "ALARM";
+					mode = "ALARM";
 					break;
 				}
-				std::cout << std::endl;
+				Logger::instance().info("Main", "Status - Temp: %d°C, Humidity: %d%%, Curtain: %s (%d%%), Mode: %s",
+																snapshot.sensorData.temperature, snapshot.sensorData.humidity,
+																snapshot.curtainState == SystemController::CurtainState::OPEN ? "OPEN" : "CLOSED",
+																snapshot.curtainPosition, mode);
 			}
-			// Sleep to reduce CPU usage
-			std::this_thread::sleep_for(std::chrono::seconds(5));
 		}
 	}
 	catch (const std::exception &e)
 	{
-		std::cerr << "[Main] Exception: " << e.what() << std::endl;
+		Logger::instance().error("Main", "Exception: %s", e.what());
+		g_systemController.reset();
+		Logger::instance().flush();
 		return -1;
 	}
 
-	std::cout << "[Main] System shutdown complete." << std::endl;
+	g_systemController.reset();
+	Logger::instance().info("Main", "System shutdown complete.");
+	Logger::instance().flush();
 	return 0;
 }
 
@@ -1,10 +1,101 @@
 #include "../include/DHT11.h"
+#include "../include/DHT11Bus.h"
 #include "../include/Key.h"
 #include "../include/SystemController.h"
+#include "../include/EventLoop.h"
+#include "../include/StepperMotor.h"
+#include "../include/Logger.h"
+#include "../include/Metrics.h"
+#include "../include/PeriodicTask.h"
+#include "../include/Delay.h"
+#include "../include/SimulatedGpio.h"
+#include "DHT11Waveform.h"
+#include "../include/Clock.h"
+#include "../include/AlarmScheduler.h"
+#include "../include/BluetoothProtocol.h"
+#include "../include/SensorHistory.h"
+#include "../include/SensorLog.h"
+#include "../include/DeviceTrace.h"
+#include "../include/EventBus.h"
+#include "../include/CyclicExecutive.h"
 #include <iostream>
 #include <cassert>
 #include <thread>
 #include <chrono>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <cstring>
+#include <system_error>
+
+/**
+ * @brief Create an empty scratch directory under /tmp
+ * @param prefix Start of the directory name
+ * @return Directory path
+ */
+static std::string makeScratchDirectory(const std::string &prefix)
+{
+	std::string path = "/tmp/" + prefix + "XXXXXX";
+	if (!mkdtemp(&path[0]))
+	{
+		throw std::system_error(errno, std::generic_category(), "mkdtemp");
+	}
+	return path;
+}
+
+/**
+ * @brief Delete a scratch directory and the files in it
+ * @param path Directory path
+ */
+static void removeScratchDirectory(const std::string &path)
+{
+	if (DIR *dir = opendir(path.c_str()))
+	{
+		while (dirent *entry = readdir(dir))
+		{
+			if (entry->d_name[0] != '.')
+			{
+				unlink((path + "/" + entry->d_name).c_str());
+			}
+		}
+		closedir(dir);
+	}
+	rmdir(path.c_str());
+}
+
+/**
+ * @brief Count the threads of this process
+ * @return Entries in /proc/self/task
+ */
+static size_t countThreads()
+{
+	size_t threads = 0;
+	if (DIR *dir = opendir("/proc/self/task"))
+	{
+		while (dirent *entry = readdir(dir))
+		{
+			if (entry->d_name[0] != '.')
+			{
+				++threads;
+			}
+		}
+		closedir(dir);
+	}
+	return threads;
+}
 
 /**
  * @brief Test suite for the Smart Curtain System
@@ -23,8 +114,30 @@ public:
 		bool allPassed = true;
 
 		allPassed &= testDHT11Sensor();
+		allPassed &= testDHT11EdgeDecoder();
+		allPassed &= testDHT11ResponseTurnaround();
+		allPassed &= testDHT11Bus();
 		allPassed &= testMatrixKeypad();
+		allPassed &= testKeyStateMachine();
+		allPassed &= testSimulatedGpio();
+		allPassed &= testVirtualClock();
+		allPassed &= testAlarmScheduler();
+		allPassed &= testSensorHistory();
+		allPassed &= testSensorLog();
+		allPassed &= testDeviceTrace();
+		allPassed &= testStepperProfile();
 		allPassed &= testSystemController();
+		allPassed &= testBluetoothProtocol();
+		allPassed &= testBluetoothTelemetry();
+		allPassed &= testControlServer();
+		allPassed &= testSystemSnapshot();
+		allPassed &= testEventLoop();
+		allPassed &= testEventBus();
+		allPassed &= testLogger();
+		allPassed &= testMetrics();
+		allPassed &= testPeriodicTask();
+		allPassed &= testCyclicExecutive();
+		allPassed &= testDelay();
 		allPassed &= testEventDrivenArchitecture();
 		allPassed &= testMemoryManagement();
 
@@ -62,6 +175,7 @@ private:
 																	 { std::cout << "DHT11 Error: " << error << std::endl; });
 			// Test initial state
 			auto initialData = sensor.getLatestReading();
+			assert(!initialData.isValid);
 			assert(!sensor.isMonitoring());
 			std::cout << "DHT11Sensor constructor and basic methods work" << std::endl;
 			std::cout << "Hardware-dependent tests skipped (requires actual DHT11 sensor)" << std::endl;
@@ -75,6 +189,169 @@ private:
 		}
 	}
 
+	/**
+	 * @brief Test frame reconstruction from edge timestamps
+	 */
+	bool testDHT11EdgeDecoder()
+	{
+		std::cout << "\n--- Testing DHT11 Edge Decoder ---" << std::endl;
+		try
+		{
+			std::array<uint8_t, 5> expected = {{55, 0, 24, 0, 79}};
+			std::array<uint8_t, 5> decoded = {{0}};
+			auto edges = makeDHT11Frame(expected, std::chrono::microseconds(1000));
+			assert(edges.size() == DHT11Sensor::FRAME_EDGE_COUNT);
+			assert(DHT11Sensor::decodeEdges(edges, decoded));
+			assert(decoded == expected);
+			// Response edges lost while the line was being re-requested
+			std::vector<DHT11Sensor::EdgeEvent> late(edges.begin() + 2, edges.end());
+			decoded = {{0}};
+			assert(DHT11Sensor::decodeEdges(late, decoded));
+			assert(decoded == expected);
+			// Truncated frame must be rejected
+			std::vector<DHT11Sensor::EdgeEvent> truncated(edges.begin(), edges.begin() + 40);
+			assert(!DHT11Sensor::decodeEdges(truncated, decoded));
+
+			DHT11Sensor sensor("gpiochip0", 17, DHT11Sensor::ReadMode::EDGE_EVENTS);
+			assert(sensor.getReadMode() == DHT11Sensor::ReadMode::EDGE_EVENTS);
+			sensor.setReadMode(DHT11Sensor::ReadMode::POLLING);
+			assert(sensor.getReadMode() == DHT11Sensor::ReadMode::POLLING);
+			std::cout << "Edge decoder rebuilds frames from timestamps" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "DHT11 edge decoder test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test start-signal-to-first-edge turnaround against a simulated line
+	 */
+	bool testDHT11ResponseTurnaround()
+	{
+		std::cout << "\n--- Testing DHT11 Response Turnaround ---" << std::endl;
+		try
+		{
+			std::array<uint8_t, 5> frame = {{40, 0, 22, 0, 62}};
+			std::chrono::nanoseconds release(5000000);
+			std::chrono::nanoseconds turnaround(-1);
+			// Sensor answers 30us after the host lets go of the line
+			auto edges = makeDHT11Frame(frame, release + std::chrono::microseconds(30));
+			assert(DHT11Sensor::measureTurnaround(edges, release, turnaround));
+			assert(turnaround == std::chrono::microseconds(30));
+			// A line handover slower than the response window loses the preamble edge
+			std::vector<DHT11Sensor::EdgeEvent> late(edges.begin() + 1, edges.end());
+			assert(DHT11Sensor::measureTurnaround(late, release, turnaround));
+			assert(turnaround > std::chrono::microseconds(40));
+			// No sensor edges at all
+			assert(!DHT11Sensor::measureTurnaround({}, release, turnaround));
+
+			DHT11Sensor sensor("gpiochip0", 17);
+			auto timing = sensor.getLastResponseTiming();
+			assert(timing.turnaround < std::chrono::nanoseconds::zero());
+			std::cout << "Turnaround measured from line release to first falling edge" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "DHT11 turnaround test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test multi-sensor bus bookkeeping and read staggering
+	 */
+	bool testDHT11Bus()
+	{
+		std::cout << "\n--- Testing DHT11Bus Class ---" << std::endl;
+		try
+		{
+			DHT11Bus bus("gpiochip0");
+			const int pins[] = {17, 5, 23};
+			for (int i = 0; i < 3; ++i)
+			{
+				assert(bus.addSensor(pins[i], [](int, int, bool) {}) == i);
+			}
+			assert(bus.sensorCount() == 3);
+			assert(!bus.isRunning());
+			auto stats = bus.getSensorStats(1);
+			assert(stats.pin == 5);
+			assert(stats.reads == 0 && stats.successRate == 0.0);
+			// Reads are spread evenly over the interval
+			assert(DHT11Bus::staggerOffset(0, 4, 2000) == std::chrono::milliseconds(0));
+			assert(DHT11Bus::staggerOffset(1, 4, 2000) == std::chrono::milliseconds(500));
+			assert(DHT11Bus::staggerOffset(3, 4, 2000) == std::chrono::milliseconds(1500));
+
+			// Three simulated sensors on a virtual clock: one thread reads each at its own offset
+			{
+				using SimBus = BasicDHT11Bus<gpio::Simulated>;
+				using std::chrono::milliseconds;
+				gpio::sim::Board &board = gpio::sim::Board::instance();
+				board.reset();
+				VirtualClock clock;
+				board.setClock(clock);
+				SimBus simBus("simchip", SimBus::Sensor::ReadMode::EDGE_EVENTS, clock);
+				simBus.setRealtimePriority(0);
+				std::vector<Clock::time_point> readAt[3];
+				for (int i = 0; i < 3; ++i)
+				{
+					board.attachDHT11("simchip", pins[i]);
+					board.setDHT11Reading("simchip", pins[i], 40 + i, 20 + i);
+					assert(simBus.addSensor(pins[i], [&readAt, &clock, i](int, int, bool valid)
+																	{
+                    if (valid)
+                    {
+                        readAt[i].push_back(clock.now());
+                    } }) == i);
+				}
+				assert(simBus.initialize());
+				size_t threadsBefore = countThreads();
+				{
+					VirtualClock::Scope driver(clock);
+					auto start = clock.now();
+					simBus.start(2000);
+					assert(simBus.isRunning());
+					assert(countThreads() == threadsBefore + 1);
+					// Two intervals: reads due at 0, 666, 1333, 2000, 2666 and 3333ms
+					clock.sleepUntil(start + milliseconds(3900));
+					simBus.stop();
+					for (size_t i = 0; i < 3; ++i)
+					{
+						assert(readAt[i].size() == 2);
+						for (size_t k = 0; k < 2; ++k)
+						{
+							// Each callback follows its due time by one read: the 18ms start signal and the frame
+							auto due = start + SimBus::staggerOffset(i, 3, 2000) + milliseconds(2000 * k);
+							assert(readAt[i][k] >= due && readAt[i][k] < due + milliseconds(30));
+						}
+						auto simStats = simBus.getSensorStats(i);
+						assert(simStats.reads == 2 && simStats.successes == 2 && simStats.failures == 0);
+						assert(simStats.successRate == 1.0);
+						auto reading = simBus.getLatestReading(i);
+						assert(reading.isValid && reading.humidity == 40 + static_cast<int>(i) &&
+									 reading.temperature == 20 + static_cast<int>(i));
+					}
+				}
+				assert(countThreads() == threadsBefore);
+				board.reset();
+			}
+
+			std::cout << "DHT11Bus sensor registration and staggering work" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "DHT11Bus test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
 	/**
 	 * @brief Test Matrix Keypad class functionality
 	 */
@@ -104,6 +381,13 @@ private:
 			assert(!keypad.isScanning());
 			auto lastKey = keypad.getLastKeyPress();
 			assert(!lastKey.isPressed);
+			assert(keypad.getScanMode() == MatrixKeypad::ScanMode::POLLING);
+			assert(keypad.getRowEventFds().empty());
+			// Interrupt mode exposes no row fds until the lines are requested
+			MatrixKeypad idleKeypad("gpiochip0", cols, rows, MatrixKeypad::ScanMode::INTERRUPT);
+			assert(idleKeypad.getScanMode() == MatrixKeypad::ScanMode::INTERRUPT);
+			assert(idleKeypad.getRowEventFds().empty());
+			assert(idleKeypad.getLastPressLatency().count() < 0);
 
 			std::cout << "MatrixKeypad constructor and character mapping work" << std::endl;
 			std::cout << "Hardware-dependent tests skipped (requires actual keypad)" << std::endl;
@@ -118,41 +402,2260 @@ private:
 	}
 
 	/**
-	 * @brief Test System Controller functionality
+	 * @brief Test non-blocking debounce, rollover, long press and repeat
 	 */
-	bool testSystemController()
+	bool testKeyStateMachine()
 	{
-		std::cout << "\n--- Testing SystemController Class ---" << std::endl;
+		std::cout << "\n--- Testing Keypad State Machine ---" << std::endl;
 		try
 		{
-			// System configuration
+			using std::chrono::milliseconds;
+			std::array<int, 4> cols = {{26, 19, 13, 6}};
+			std::array<int, 4> rows = {{21, 20, 16, 12}};
+			MatrixKeypad keypad("gpiochip0", cols, rows);
+			MatrixKeypad::KeyTiming timing;
+			timing.pressDebounce = milliseconds(20);
+			timing.releaseDebounce = milliseconds(20);
+			timing.longPress = milliseconds(100);
+			timing.repeatInterval = milliseconds(50);
+			keypad.setKeyTiming(timing);
+
+			std::string events;
+			int presses = 0;
+			keypad.registerKeyEventCallback([&events](const MatrixKeypad::KeyData &key)
+																			{
+                const char names[] = {'P', 'R', 'L', 'T'};
+                events += key.keyChar;
+                events += names[static_cast<int>(key.event)]; });
+			keypad.registerKeyPressCallback([&presses](int, int, char)
+																			{ presses++; });
+
+			const uint16_t key5 = 1u << (1 * 4 + 1);
+			auto t0 = std::chrono::steady_clock::now();
+			// Glitch shorter than the debounce window is ignored
+			keypad.processScan(key5, t0);
+			keypad.processScan(0, t0 + milliseconds(10));
+			assert(events.empty());
+			// Held key: press, long press, repeat, then release with a bounce in between
+			assert(keypad.processScan(key5, t0 + milliseconds(100)));
+			keypad.processScan(key5, t0 + milliseconds(125));
+			keypad.processScan(key5, t0 + milliseconds(230));
+			keypad.processScan(key5, t0 + milliseconds(285));
+			keypad.processScan(0, t0 + milliseconds(300));
+			keypad.processScan(key5, t0 + milliseconds(305));
+			keypad.processScan(0, t0 + milliseconds(310));
+			assert(keypad.processScan(0, t0 + milliseconds(320)));
+			assert(!keypad.processScan(0, t0 + milliseconds(335)));
+			assert(events == "5P5L5T5R");
+			assert(presses == 1);
+			assert(keypad.getLastKeyPress().keyChar == '5');
+
+			// Two keys at once are both reported
+			events.clear();
+			const uint16_t both = (1u << 0) | (1u << 15);
+			keypad.processScan(both, t0 + milliseconds(400));
+			keypad.processScan(both, t0 + milliseconds(425));
+			assert(events == "1PDP");
+			std::cout << "Key state machine debounces and reports rollover, long press and repeat" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Keypad state machine test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test the DHT11 and keypad drivers against scripted devices on the simulated GPIO backend
+	 */
+	bool testSimulatedGpio()
+	{
+		std::cout << "\n--- Testing Simulated GPIO ---" << std::endl;
+		try
+		{
+			using std::chrono::microseconds;
+			using std::chrono::milliseconds;
+			using SimDHT11 = BasicDHT11Sensor<gpio::Simulated>;
+			using SimKeypad = BasicMatrixKeypad<gpio::Simulated>;
+			gpio::sim::Board &board = gpio::sim::Board::instance();
+			board.reset();
+
+			// Scripted waveform comes back with the scripted edge timestamps
+			{
+				gpio::sim::chip chip("simchip");
+				auto input = chip.get_line(5);
+				input.request({"test", gpio::sim::line_request::EVENT_BOTH_EDGES, 0});
+				auto t0 = std::chrono::steady_clock::now() + milliseconds(2);
+				board.drive("simchip", 5, t0, 1);
+				board.drive("simchip", 5, t0 + microseconds(30), 0);
+				assert(input.event_wait(milliseconds(100)));
+				auto rising = input.event_read();
+				assert(input.event_wait(milliseconds(100)));
+				auto falling = input.event_read();
+				assert(rising.event_type == gpio::sim::line_event::RISING_EDGE);
+				assert(falling.event_type == gpio::sim::line_event::FALLING_EDGE);
+				assert(falling.timestamp - rising.timestamp == microseconds(30));
+				assert(input.get_value() == 0);
+				bool busy = false;
+				try
+				{
+					chip.get_line(5).request({"test", gpio::sim::line_request::DIRECTION_INPUT, 0});
+				}
+				catch (const std::system_error &)
+				{
+					busy = true;
+				}
+				assert(busy);
+			}
+			// Dropping the last chip and line object released the request
+			gpio::sim::chip reopened("simchip");
+			reopened.get_line(5).request({"test", gpio::sim::line_request::DIRECTION_INPUT, 0});
+
+			// Both read modes decode a frame sent in answer to the start signal. On a virtual clock the
+			// polling loop cannot be stalled by the scheduler, so every read must succeed exactly
+			VirtualClock sensorClock;
+			board.setClock(sensorClock);
+			board.attachDHT11("simchip", 17);
+			board.setDHT11Reading("simchip", 17, 55, 24);
+			const SimDHT11::ReadMode modes[] = {SimDHT11::ReadMode::POLLING, SimDHT11::ReadMode::EDGE_EVENTS};
+			for (auto mode : modes)
+			{
+				SimDHT11 sensor("simchip", 17, mode, sensorClock);
+				assert(sensor.initialize());
+				int temperature = -1;
+				int humidity = -1;
+				sensor.registerDataCallback([&](int temp, int hum, bool valid)
+																		{
+                if (valid)
+                {
+                    temperature = temp;
+                    humidity = hum;
+                } });
+				for (int read = 0; read < 3; ++read)
+				{
+					temperature = humidity = -1;
+					assert(sensor.readOnce());
+					assert(temperature == 24 && humidity == 55);
+				}
+				assert(sensor.getLastResponseTiming().turnaround > std::chrono::nanoseconds::zero());
+			}
+			assert(board.getDHT11ResponseCount("simchip", 17) == 6);
+			board.setClock(Clock::system());
+
+			// Polled scans debounce a bouncing press into one press and one release
+			std::array<int, 4> cols = {{26, 19, 13, 6}};
+			std::array<int, 4> rows = {{21, 20, 16, 12}};
+			board.attachKeypad("simchip", cols, rows);
+			{
+				SimKeypad keypad("simchip", cols, rows);
+				assert(keypad.initialize());
+				std::string events;
+				keypad.registerKeyEventCallback([&events](const SimKeypad::KeyData &key)
+																				{
+                events += key.keyChar;
+                events += key.event == SimKeypad::KeyEvent::PRESS ? 'P' : 'R'; });
+				auto pressAt = std::chrono::steady_clock::now();
+				board.pressKey("simchip", 1, 2, pressAt, milliseconds(60), 3, microseconds(300));
+				while (std::chrono::steady_clock::now() < pressAt + milliseconds(150))
+				{
+					keypad.scanOnce();
+					std::this_thread::sleep_for(milliseconds(5));
+				}
+				assert(events == "6P6R");
+			}
+
+			// Interrupt mode sleeps on the row fds until the scripted edge
+			{
+				SimKeypad keypad("simchip", cols, rows, SimKeypad::ScanMode::INTERRUPT);
+				std::atomic<int> presses{0};
+				std::atomic<char> lastKey{'\0'};
+				keypad.registerKeyPressCallback([&](int, int, char key)
+																				{
+                presses++;
+                lastKey = key; });
+				assert(keypad.initialize());
+				assert(keypad.getRowEventFds().size() == 4);
+				// A scan interval far above the debounce time: a debouncing key must not wait for it
+				keypad.startScanning(200);
+				board.pressKey("simchip", 3, 1, std::chrono::steady_clock::now() + milliseconds(5), milliseconds(60), 2);
+				std::this_thread::sleep_for(milliseconds(150));
+				keypad.stopScanning();
+				assert(presses == 1 && lastKey == '0');
+				// Measured from the edge timestamp, so it includes the 20ms press debounce but no scan interval
+				assert(keypad.getLastPressLatency() >= milliseconds(20));
+				assert(keypad.getLastPressLatency() < milliseconds(100));
+			}
+
+			board.reset();
+			std::cout << "Simulated DHT11 and keypad drive the real decoding and scan paths" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Simulated GPIO test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test faster-than-real-time runs on a virtual clock
+	 */
+	bool testVirtualClock()
+	{
+		std::cout << "\n--- Testing Virtual Clock ---" << std::endl;
+		try
+		{
+			using std::chrono::hours;
+			using std::chrono::minutes;
+			using std::chrono::seconds;
+			auto realStart = std::chrono::steady_clock::now();
+
+			// An hour of a 1s task: time jumps from release to release while the driver sleeps
+			{
+				VirtualClock clock;
+				PeriodicTask task("test_virtual", seconds(1), clock);
+				int runs = 0;
+				std::thread runner([&task, &runs]
+													 { task.run([&runs]
+																			{ ++runs; }); });
+				{
+					VirtualClock::Scope driver(clock);
+					clock.sleepFor(hours(1));
+					// The release at exactly one hour is due after the driver, which slept first
+					assert(runs == 3600);
+					assert(clock.elapsed() >= hours(1) && clock.elapsed() < hours(1) + seconds(1));
+				}
+				task.stop();
+				runner.join();
+
+				// An unattached thread's delay moves time by itself, spinning the last part
+				auto before = clock.elapsed();
+				delay_ms(18, clock);
+				assert(clock.elapsed() - before >= std::chrono::milliseconds(18));
+			}
+
+			// With free reads a spin would never see time pass; the delay steps the clock instead
+			{
+				VirtualClock clock(std::chrono::system_clock::now(), std::chrono::nanoseconds(0));
+				delay_us(150, clock);
+				delay_ms(18, clock);
+				assert(clock.elapsed() >= std::chrono::microseconds(18150));
+			}
+
+			// A whole day of the controller: sensor reads, a keypad press and the alarm
+			gpio::sim::Board &board = gpio::sim::Board::instance();
+			board.reset();
+			std::tm morning = {};
+			morning.tm_year = 2024 - 1900;
+			morning.tm_mon = 0;
+			morning.tm_mday = 15;
+			morning.tm_hour = 6;
+			morning.tm_isdst = -1;
+			VirtualClock clock(std::chrono::system_clock::from_time_t(std::mktime(&morning)));
+			board.setClock(clock);
+
 			SystemController::SystemConfig config;
-			config.gpioChipName = "gpiochip0";
-			config.dht11Pin = 17;
-			config.buzzerPin = 18;
-			config.keypadCols = {{26, 19, 13, 6}};
-			config.keypadRows = {{21, 20, 16, 12}};
-			config.sensorReadInterval = 1000;
-			config.keypadScanInterval = 50;
-			config.tempThreshold = 27;
-			config.humidityThreshold = 40;
-			// Test constructor
-			SystemController controller(config);
-			// Test initial states
-			assert(!controller.isRunning());
-			assert(controller.getSystemState() == SystemController::SystemState::MANUAL_MODE);
-			assert(controller.getCurtainState() == SystemController::CurtainState::CLOSED);
-			// Test alarm functionality
-			controller.setAlarmTime(12, 30);
-			controller.clearAlarm();
-			std::cout << "SystemController constructor and basic methods work" << std::endl;
-			std::cout << "Hardware-dependent initialization skipped" << std::endl;
+			config.sensorReadInterval = 60000;
+			config.keypadScanInterval = 1000; // Coarse scans keep the day cheap; the press is held across two of them
+			config.curtainTravelSteps = 64;
+			config.metricsSocketPath = "";
+			config.sensorLog.directory = makeScratchDirectory("smart_curtain_test_day_");
+			config.tracePath = config.sensorLog.directory + "/device.trace";
+			board.attachDHT11(config.gpioChipName, config.dht11Pin);
+			board.setDHT11Reading(config.gpioChipName, config.dht11Pin, 55, 24);
+			board.attachKeypad(config.gpioChipName, config.keypadCols, config.keypadRows);
+			Counter &alarms = MetricsRegistry::instance().counter("alarm_triggers_total");
+			Counter &reads = MetricsRegistry::instance().counter("dht11_pin17_success_total");
+			uint64_t alarmsBefore = alarms.value();
+			uint64_t readsBefore = reads.value();
+			Logger::Level level = Logger::instance().getLevel();
+			Logger::instance().setLevel(Logger::Level::WARN);
+			{
+				SystemController controller(config, clock);
+				assert(controller.initialize());
+				{
+					VirtualClock::Scope driver(clock);
+					auto start = clock.now();
+					controller.setAlarmTime(7, 30);
+					// '4' at noon switches to auto mode, which opens the curtain for 24C/55%
+					board.pressKey(config.gpioChipName, 1, 0, start + hours(6), std::chrono::milliseconds(2500), 2);
+					controller.start();
+
+					clock.sleepUntil(start + minutes(89) + seconds(30));
+					assert(controller.getSnapshot().alarmEnabled);
+					assert(alarms.value() == alarmsBefore);
+					clock.sleepUntil(start + minutes(90) + seconds(30));
+					assert(!controller.getSnapshot().alarmEnabled);
+					assert(alarms.value() == alarmsBefore + 1);
+
+					clock.sleepUntil(start + hours(6) + seconds(5));
+					assert(controller.getSystemState() == SystemController::SystemState::AUTO_MODE);
+					assert(controller.getCurtainState() == SystemController::CurtainState::OPEN);
+
+					clock.sleepUntil(start + hours(24));
+					// One read a minute from the start; the one at exactly 24h comes after the driver
+					assert(board.getDHT11ResponseCount(config.gpioChipName, config.dht11Pin) == 1440);
+					assert(reads.value() - readsBefore == 1440);
+					DHT11Sensor::SensorData latest = controller.getLatestSensorData();
+					assert(latest.isValid && latest.temperature == 24);
+					assert(start + hours(24) - latest.timestamp < minutes(1));
+					// The history follows the virtual wall clock: one reading per minute bucket, a day of hours
+					const SensorHistory &history = controller.getSensorHistory();
+					assert(history.getSampleCount() == 1440);
+					SensorHistory::Summary lastHour = history.window(SensorHistory::Tier::MINUTE);
+					assert(lastHour.count >= 59 && lastHour.count <= 61 && lastHour.maxTemperature == 24);
+					assert(history.window(SensorHistory::Tier::HOUR).count >= 1380);
+				}
+				// Stopping joins the device threads, so the driver gives up the clock first
+				controller.stop();
+			}
+			Logger::instance().setLevel(level);
+			board.reset();
+
+			// Stopping committed the log: the state at start, every reading and the changes, on virtual time
+			std::vector<SensorLog::Record> logged;
+			SensorLog::scan(config.sensorLog.directory, std::chrono::system_clock::time_point::min(), std::chrono::system_clock::time_point::max(),
+											[&logged](const SensorLog::Record &record)
+											{ logged.push_back(record); return true; });
+			auto ofKind = [&logged](SensorLog::Kind kind)
+			{
+				std::vector<SensorLog::Record> matching;
+				std::copy_if(logged.begin(), logged.end(), std::back_inserter(matching), [kind](const SensorLog::Record &record)
+										 { return record.kind == kind; });
+				return matching;
+			};
+			std::vector<SensorLog::Record> readings = ofKind(SensorLog::Kind::SENSOR);
+			assert(readings.size() >= 1440 && readings.size() <= 1441);
+			assert(readings.front().values[0] == 24 && readings.front().values[1] == 55);
+			assert(readings.back().time - readings.front().time >= hours(23));
+			std::vector<SensorLog::Record> alarmChanges = ofKind(SensorLog::Kind::ALARM);
+			assert(alarmChanges.size() == 2 && alarmChanges[0].values[0] == 7 * 60 + 30 && alarmChanges[1].values[0] == -1);
+			assert(alarmChanges[1].time - alarmChanges[0].time >= minutes(89));
+			std::vector<SensorLog::Record> modes = ofKind(SensorLog::Kind::MODE);
+			assert(modes.size() == 2 && modes[0].values[0] == static_cast<int32_t>(SystemController::SystemState::MANUAL_MODE));
+			assert(modes[1].values[0] == static_cast<int32_t>(SystemController::SystemState::AUTO_MODE));
+			assert(ofKind(SensorLog::Kind::CURTAIN).back().values[0] == 100);
+
+			// The day's device callbacks replayed back to back rebuild the same state in a fresh controller
+			{
+				TraceReader trace;
+				assert(trace.open(config.tracePath));
+				VirtualClock replayClock(trace.getStartTime());
+				SystemController::SystemConfig replayConfig = config;
+				replayConfig.sensorLog.directory = "";
+				replayConfig.tracePath = "";
+				Logger::instance().setLevel(Logger::Level::WARN);
+				SystemController replayed(replayConfig, replayClock);
+				TraceReplayer::Stats stats = TraceReplayer(replayed, replayClock).run(trace, TraceReplayer::Speed::AS_FAST_AS_POSSIBLE);
+				Logger::instance().setLevel(level);
+				assert(stats.sensorEvents == readings.size() && stats.keyEvents == 1 && stats.controlRequests == 0);
+				assert(replayed.getSystemState() == SystemController::SystemState::AUTO_MODE);
+				assert(replayed.getCurtainState() == SystemController::CurtainState::OPEN);
+				DHT11Sensor::SensorData replayedData = replayed.getSnapshot().sensorData;
+				assert(replayedData.isValid && replayedData.temperature == 24 && replayedData.humidity == 55);
+				assert(replayed.getSensorHistory().getSampleCount() == readings.size());
+			}
+			removeScratchDirectory(config.sensorLog.directory);
+
+			auto realElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - realStart);
+			std::cout << "25 virtual hours in " << realElapsed.count() << " ms; alarm, keypad and 1440 reads on schedule" << std::endl;
 
 			return true;
 		}
 		catch (const std::exception &e)
 		{
-			std::cout << "SystemController test failed: " << e.what() << std::endl;
+			std::cout << "Virtual clock test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test history tiers against brute-force aggregates, gaps and local day boundaries
+	 */
+	bool testSensorHistory()
+	{
+		std::cout << "\n--- Testing Sensor History ---" << std::endl;
+		try
+		{
+			using std::chrono::minutes;
+			using std::chrono::seconds;
+			using Tier = SensorHistory::Tier;
+			SensorHistory::Config config;
+			config.rawSamples = 10;
+			config.minutes = 5;
+			config.hours = 3;
+			config.days = 2;
+			SensorHistory history(config);
+			size_t footprint = history.memoryFootprint();
+
+			// Readings every 10 s for 40 minutes; every window is checked against a full recount
+			auto t0 = std::chrono::system_clock::from_time_t(1700000000 - 1700000000 % 3600);
+			std::vector<SensorHistory::Sample> samples;
+			for (int i = 0; i < 240; ++i)
+			{
+				SensorHistory::Sample sample = {t0 + seconds(10 * i), 15 + (i * 7) % 13, 30 + (i * 5) % 41};
+				samples.push_back(sample);
+				history.add(sample.time, sample.temperature, sample.humidity);
+
+				int64_t currentMinute = std::chrono::duration_cast<minutes>(sample.time.time_since_epoch()).count();
+				SensorHistory::Summary expected = {};
+				int64_t temperatureSum = 0;
+				for (const auto &earlier : samples)
+				{
+					int64_t minute = std::chrono::duration_cast<minutes>(earlier.time.time_since_epoch()).count();
+					if (minute <= currentMinute - 5)
+					{
+						continue;
+					}
+					expected.minTemperature = expected.count ? std::min(expected.minTemperature, earlier.temperature) : earlier.temperature;
+					expected.maxHumidity = expected.count ? std::max(expected.maxHumidity, earlier.humidity) : earlier.humidity;
+					temperatureSum += earlier.temperature;
+					++expected.count;
+				}
+				SensorHistory::Summary actual = history.window(Tier::MINUTE);
+				assert(actual.count == expected.count);
+				assert(actual.minTemperature == expected.minTemperature && actual.maxHumidity == expected.maxHumidity);
+				assert(std::abs(actual.meanTemperature - static_cast<double>(temperatureSum) / expected.count) < 1e-9);
+			}
+			assert(history.current(Tier::MINUTE).count == 6 && history.bucket(Tier::MINUTE, 1).count == 6);
+			assert(history.bucket(Tier::MINUTE, 5).count == 0); // Beyond the configured window
+			assert(history.window(Tier::HOUR).count == 240);
+
+			SensorHistory::Sample raw[16];
+			assert(history.rawSamples(raw, 16) == 10);
+			assert(raw[0].time == samples[230].time && raw[9].temperature == samples[239].temperature);
+
+			// A gap longer than the window leaves only the new reading
+			history.add(t0 + minutes(60), 40, 90);
+			SensorHistory::Summary afterGap = history.window(Tier::MINUTE);
+			assert(afterGap.count == 1 && afterGap.minTemperature == 40 && afterGap.maxHumidity == 90);
+			assert(history.bucket(Tier::MINUTE, 1).count == 0);
+			assert(history.window(Tier::HOUR).count == 241);
+
+			// Days turn over at local midnight
+			std::time_t noon = 1700000000;
+			std::tm local = {};
+			localtime_r(&noon, &local);
+			local.tm_mday += 1;
+			local.tm_hour = 0;
+			local.tm_min = 0;
+			local.tm_sec = 0;
+			local.tm_isdst = -1;
+			auto midnight = std::chrono::system_clock::from_time_t(std::mktime(&local));
+			SensorHistory days(config);
+			days.add(midnight - seconds(10), 30, 50);
+			days.add(midnight - seconds(5), 10, 50);
+			days.add(midnight + seconds(5), 20, 60);
+			assert(days.current(Tier::DAY).count == 1 && days.current(Tier::DAY).maxTemperature == 20);
+			assert(days.bucket(Tier::DAY, 1).count == 2 && days.bucket(Tier::DAY, 1).maxTemperature == 30);
+			SensorHistory::Summary twoDays = days.window(Tier::DAY);
+			assert(twoDays.count == 3 && twoDays.minTemperature == 10 && twoDays.maxTemperature == 30);
+			assert(std::abs(twoDays.meanHumidity - 160.0 / 3) < 1e-9);
+
+			assert(history.memoryFootprint() == footprint);
+			std::cout << "Tier windows match a full recount; " << footprint << " bytes for the test configuration, "
+								<< SensorHistory().memoryFootprint() << " bytes by default" << std::endl;
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Sensor history test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test log round trips, crash recovery, torn batches and segment retention
+	 */
+	bool testSensorLog()
+	{
+		std::cout << "\n--- Testing Sensor Log ---" << std::endl;
+		std::string directory = makeScratchDirectory("smart_curtain_test_log_");
+		try
+		{
+			using std::chrono::milliseconds;
+			using Kind = SensorLog::Kind;
+			auto t0 = std::chrono::system_clock::from_time_t(1700000000);
+			auto everything = [&directory]
+			{
+				std::vector<SensorLog::Record> records;
+				SensorLog::scan(directory, std::chrono::system_clock::time_point::min(), std::chrono::system_clock::time_point::max(),
+												[&records](const SensorLog::Record &record)
+												{ records.push_back(record); return true; });
+				return records;
+			};
+			auto sameRecord = [](const SensorLog::Record &a, const SensorLog::Record &b)
+			{
+				return a.kind == b.kind && a.time == b.time && a.values[0] == b.values[0] && a.values[1] == b.values[1];
+			};
+
+			SensorLog::Config config;
+			config.directory = directory;
+			config.segmentSize = 8192;
+			config.maxSegments = 3;
+			config.syncInterval = std::chrono::hours(1); // Commits only when the test syncs
+			std::vector<SensorLog::Record> written;
+			{
+				SensorLog log(config);
+				assert(log.open());
+				// A reading every 2 s with the odd state change, as the controller writes them
+				for (int i = 0; i < 300; ++i)
+				{
+					written.push_back({Kind::SENSOR, t0 + milliseconds(2000 * i + i % 7), {20 + (i / 50) % 3 - (i % 11 == 0), 40 + i % 5}});
+					if (i % 60 == 0)
+					{
+						written.push_back({Kind::CURTAIN, t0 + milliseconds(2000 * i + 1), {i % 120 ? 0 : 100, 0}});
+						written.push_back({Kind::ALARM, t0 + milliseconds(2000 * i + 2), {i % 120 ? -1 : 7 * 60 + 30, 0}});
+					}
+				}
+				written.push_back({Kind::MODE, t0 - milliseconds(5000), {2, 0}}); // Wall clock set back
+				for (const auto &record : written)
+				{
+					assert(log.append(record));
+				}
+				assert(everything().empty()); // Nothing committed yet
+				assert(log.sync());
+				SensorLog::Stats stats = log.getStats();
+				assert(stats.records == written.size() && stats.syncs == 1 && stats.segments == 1);
+				// Deltas keep a reading every 2 s to a handful of bytes
+				assert(stats.recordBytes < 6 * written.size());
+			}
+			std::vector<SensorLog::Record> scanned = everything();
+			assert(scanned.size() == written.size());
+			for (size_t i = 0; i < written.size(); ++i)
+			{
+				assert(sameRecord(scanned[i], written[i]));
+			}
+
+			// Range scans and early stop
+			uint64_t inRange = SensorLog::scan(directory, t0 + milliseconds(100000), t0 + milliseconds(199999),
+																				 [](const SensorLog::Record &record)
+																				 { return record.kind != Kind::MODE; });
+			assert(inRange == static_cast<uint64_t>(std::count_if(written.begin(), written.end(), [&t0](const SensorLog::Record &record)
+																															 { return record.time >= t0 + milliseconds(100000) && record.time <= t0 + milliseconds(199999); })));
+			assert(SensorLog::scan(directory, t0, t0 + std::chrono::hours(1), [](const SensorLog::Record &)
+														 { return false; }) == 1);
+
+			// A crash loses only what was appended after the last commit, and appending resumes the deltas
+			{
+				SensorLog log(config);
+				assert(log.open());
+				pid_t child = fork();
+				if (child == 0)
+				{
+					for (int i = 0; i < 50; ++i)
+					{
+						log.append({Kind::SENSOR, t0 + std::chrono::hours(1) + milliseconds(2000 * i), {-5, 99}});
+					}
+					_exit(0);
+				}
+				int status = 0;
+				waitpid(child, &status, 0);
+				assert(WIFEXITED(status));
+			}
+			assert(everything().size() == written.size());
+			{
+				SensorLog log(config);
+				assert(log.open());
+				written.push_back({Kind::SENSOR, t0 + std::chrono::hours(2), {21, 41}});
+				written.push_back({Kind::BUZZER, t0 + std::chrono::hours(2) + milliseconds(1), {1, 0}});
+				assert(log.append(written[written.size() - 2]) && log.append(written.back()));
+				assert(log.sync());
+				assert(log.getStats().segments == 0); // Continued in the recovered segment
+				written.push_back({Kind::SENSOR, t0 + std::chrono::hours(3), {22, 42}});
+				assert(log.append(written.back()));
+			}
+			scanned = everything();
+			assert(scanned.size() == written.size());
+			for (size_t i = 0; i < written.size(); ++i)
+			{
+				assert(sameRecord(scanned[i], written[i]));
+			}
+
+			// A batch that reached the card torn ends the data; the log continues in its place
+			std::string torn = makeScratchDirectory("smart_curtain_test_torn_");
+			SensorLog::Config tornConfig = config;
+			tornConfig.directory = torn;
+			size_t firstBatch;
+			{
+				SensorLog log(tornConfig);
+				assert(log.open());
+				for (int i = 0; i < 10; ++i)
+				{
+					assert(log.append(written[i]));
+					if (i == 4)
+					{
+						assert(log.sync());
+						firstBatch = log.getStats().recordBytes;
+					}
+				}
+			}
+			{
+				// Data follows a 128-byte header; each batch is its 8-byte length and CRC, then its records
+				int fd = ::open((torn + "/segment-0000000000000000.log").c_str(), O_RDWR);
+				assert(fd >= 0);
+				uint8_t garbage = 0x5A;
+				assert(pwrite(fd, &garbage, 1, static_cast<off_t>(128 + 8 + firstBatch + 8)) == 1);
+				::close(fd);
+			}
+			auto countIn = [](const std::string &path)
+			{
+				return SensorLog::scan(path, std::chrono::system_clock::time_point::min(), std::chrono::system_clock::time_point::max(),
+															 [](const SensorLog::Record &)
+															 { return true; });
+			};
+			assert(countIn(torn) == 5);
+			{
+				SensorLog log(tornConfig);
+				assert(log.open());
+				assert(log.append(written[10]));
+			}
+			assert(countIn(torn) == 6);
+			removeScratchDirectory(torn);
+
+			// Full segments roll over and the oldest are deleted; a half-created one is cleaned up
+			::close(::open((directory + "/segment-00000000000000ff.log.tmp").c_str(), O_CREAT | O_WRONLY, 0644));
+			{
+				SensorLog log(config);
+				assert(log.open());
+				for (int i = 0; i < 6000; ++i)
+				{
+					assert(log.append({Kind::SENSOR, t0 + std::chrono::hours(4) + milliseconds(2000 * i), {20 + i % 3, 50}}));
+				}
+				assert(log.getStats().segments >= 3);
+			}
+			size_t files = 0;
+			DIR *dir = opendir(directory.c_str());
+			while (dirent *entry = readdir(dir))
+			{
+				assert(std::string(entry->d_name).find(".tmp") == std::string::npos);
+				files += entry->d_name[0] != '.';
+			}
+			closedir(dir);
+			assert(files == config.maxSegments);
+			assert(::access((directory + "/segment-0000000000000000.log").c_str(), F_OK) != 0);
+			scanned = everything();
+			assert(!scanned.empty() && scanned.back().time == t0 + std::chrono::hours(4) + milliseconds(2000 * 5999));
+			for (size_t i = 1; i < scanned.size(); ++i)
+			{
+				assert(scanned[i].time - scanned[i - 1].time == milliseconds(2000));
+			}
+
+			removeScratchDirectory(directory);
+			std::cout << "Round trip, crash recovery, torn batch and retention verified; " << scanned.size()
+								<< " readings kept in " << files << " segments" << std::endl;
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			removeScratchDirectory(directory);
+			std::cout << "Sensor log test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test trace encoding round trip, truncation and replay at the recorded pace into a fresh controller
+	 */
+	bool testDeviceTrace()
+	{
+		std::cout << "\n--- Testing Device Trace ---" << std::endl;
+		std::string directory = makeScratchDirectory("smart_curtain_test_trace_");
+		try
+		{
+			using std::chrono::microseconds;
+			using std::chrono::milliseconds;
+			using std::chrono::seconds;
+			std::string path = directory + "/device.trace";
+			auto wallStart = std::chrono::system_clock::from_time_t(1700000000);
+
+			// Record on a virtual clock so the offsets are known to the microsecond it costs to read it
+			{
+				VirtualClock clock(wallStart);
+				TraceRecorder recorder(clock);
+				assert(!recorder.isOpen());
+				recorder.recordSensor(1, 2, true); // Ignored until open()
+				assert(recorder.open(path) && recorder.isOpen());
+				recorder.recordSensor(24, 55, true);
+				clock.sleepFor(seconds(2));
+				recorder.recordSensor(-3, 200, false);
+				clock.sleepFor(milliseconds(150));
+				recorder.recordKey(1, 0, '4');
+				clock.sleepFor(seconds(1));
+				bluetooth::Frame manual = {bluetooth::Command::SET_MODE, 1, {{0}}};
+				recorder.recordControl(manual, ControlServer::Transport::TCP);
+				bluetooth::Frame status = {bluetooth::Command::GET_STATUS, 0, {{0}}};
+				recorder.recordControl(status, ControlServer::Transport::RFCOMM);
+				clock.sleepFor(milliseconds(500));
+				recorder.recordSensor(26, 50, true);
+				assert(recorder.getEventCount() == 6);
+				recorder.close();
+				assert(!recorder.isOpen());
+			}
+			struct stat info;
+			assert(stat(path.c_str(), &info) == 0);
+			// 16 byte header; a reading is 6-8 bytes and a request 6-7 with the delta
+			assert(info.st_size <= 16 + 48);
+
+			TraceReader reader;
+			assert(!reader.open(directory + "/missing.trace"));
+			assert(reader.open(path));
+			assert(reader.getStartTime() == wallStart);
+			std::vector<TraceEvent> events;
+			TraceEvent event;
+			while (reader.next(event))
+			{
+				events.push_back(event);
+			}
+			assert(events.size() == 6);
+			auto near = [](microseconds actual, microseconds expected)
+			{
+				return actual >= expected && actual < expected + microseconds(100);
+			};
+			assert(events[0].kind == TraceEvent::Kind::SENSOR && events[0].temperature == 24 && events[0].humidity == 55 && events[0].valid);
+			assert(near(events[0].offset, microseconds(0)));
+			assert(events[1].temperature == -3 && events[1].humidity == 200 && !events[1].valid);
+			assert(near(events[1].offset, seconds(2)));
+			assert(events[2].kind == TraceEvent::Kind::KEY && events[2].row == 1 && events[2].col == 0 && events[2].key == '4');
+			assert(near(events[2].offset, milliseconds(2150)));
+			assert(events[3].kind == TraceEvent::Kind::CONTROL && events[3].transport == ControlServer::Transport::TCP);
+			assert(events[3].frame.command == bluetooth::Command::SET_MODE && events[3].frame.length == 1 && events[3].frame.payload[0] == 0);
+			assert(events[4].frame.command == bluetooth::Command::GET_STATUS && events[4].transport == ControlServer::Transport::RFCOMM);
+			assert(near(events[5].offset, milliseconds(3650)) && events[5].temperature == 26);
+
+			// A crash mid-write leaves a partial last event, which is not returned
+			assert(truncate(path.c_str(), info.st_size - 1) == 0);
+			TraceReader truncated;
+			assert(truncated.open(path));
+			size_t complete = 0;
+			while (truncated.next(event))
+			{
+				++complete;
+			}
+			assert(complete == 5);
+
+			// Replay into a controller that was never initialized, at the recorded pace on a virtual clock
+			Logger::Level level = Logger::instance().getLevel();
+			Logger::instance().setLevel(Logger::Level::WARN);
+			{
+				VirtualClock clock(wallStart);
+				SystemController::SystemConfig config;
+				config.metricsSocketPath = "";
+				SystemController controller(config, clock);
+				TraceReplayer replayer(controller, clock);
+				std::vector<bluetooth::Command> replies;
+				replayer.registerReplyCallback([&replies](const bluetooth::Frame &reply)
+																			 { replies.push_back(reply.command); });
+				reader.rewind();
+				TraceReplayer::Stats stats = replayer.run(reader, TraceReplayer::Speed::ORIGINAL);
+				assert(stats.events == 6 && stats.sensorEvents == 3 && stats.keyEvents == 1 && stats.controlRequests == 2);
+				assert(stats.replyFrames == 2 && replies.size() == 2);
+				assert(replies[0] == bluetooth::Command::ACK && replies[1] == bluetooth::Command::STATUS);
+				assert(stats.elapsed >= events[5].offset && stats.elapsed < events[5].offset + milliseconds(1));
+				assert(stats.maxLateness < microseconds(100));
+				// '4' entered auto mode and the remote request switched back
+				assert(controller.getSystemState() == SystemController::SystemState::MANUAL_MODE);
+				DHT11Sensor::SensorData latest = controller.getSnapshot().sensorData;
+				assert(latest.isValid && latest.temperature == 26 && latest.humidity == 50);
+				assert(controller.getSensorHistory().getSampleCount() == 2);
+
+				// Nothing is left to replay until the reader is rewound
+				assert(replayer.run(reader, TraceReplayer::Speed::AS_FAST_AS_POSSIBLE).events == 0);
+			}
+			Logger::instance().setLevel(level);
+
+			removeScratchDirectory(directory);
+			std::cout << "Trace of " << events.size() << " events in " << info.st_size << " bytes, replayed on schedule" << std::endl;
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			removeScratchDirectory(directory);
+			std::cout << "Device trace test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test recurring alarm computation, on-time triggers and wakeups only when due
+	 */
+	bool testAlarmScheduler()
+	{
+		std::cout << "\n--- Testing Alarm Scheduler ---" << std::endl;
+		try
+		{
+			using std::chrono::hours;
+			using std::chrono::seconds;
+			using std::chrono::system_clock;
+			// Local time in January 2024; the 15th is a Monday
+			auto localAt = [](int day, int hour, int minute)
+			{
+				std::tm local = {};
+				local.tm_year = 2024 - 1900;
+				local.tm_mon = 0;
+				local.tm_mday = day;
+				local.tm_hour = hour;
+				local.tm_min = minute;
+				local.tm_isdst = -1;
+				return system_clock::from_time_t(std::mktime(&local));
+			};
+
+			AlarmScheduler::Alarm weekday;
+			weekday.name = "weekday";
+			weekday.hour = 7;
+			weekday.days = AlarmScheduler::WEEKDAYS;
+			weekday.buzzer = false;
+			weekday.curtainPercent = 100;
+			assert(AlarmScheduler::nextOccurrence(weekday, localAt(15, 6, 0)) == localAt(15, 7, 0));
+			assert(AlarmScheduler::nextOccurrence(weekday, localAt(15, 7, 0)) == localAt(16, 7, 0));
+			assert(AlarmScheduler::nextOccurrence(weekday, localAt(19, 8, 0)) == localAt(22, 7, 0));
+			AlarmScheduler::Alarm weekend = weekday;
+			weekend.days = AlarmScheduler::WEEKENDS;
+			assert(AlarmScheduler::nextOccurrence(weekend, localAt(15, 6, 0)) == localAt(20, 7, 0));
+			AlarmScheduler::Alarm once;
+			once.name = "once";
+			once.hour = 6;
+			once.minute = 30;
+			assert(AlarmScheduler::nextOccurrence(once, localAt(15, 8, 0)) == localAt(16, 6, 30));
+
+			// Friday 06:00 to Monday 08:00 on a virtual clock
+			VirtualClock clock(localAt(19, 6, 0));
+			AlarmScheduler scheduler(clock);
+			std::vector<std::pair<std::string, system_clock::time_point>> triggers;
+			scheduler.registerTriggerCallback([&triggers, &clock](const AlarmScheduler::Alarm &alarm, bool missed)
+																				{
+				assert(!missed);
+				triggers.emplace_back(alarm.name, clock.wallNow()); });
+			AlarmScheduler::Alarm evening;
+			evening.name = "evening";
+			evening.hour = 22;
+			evening.days = AlarmScheduler::DAILY;
+			assert(scheduler.setAlarm(weekday) && scheduler.setAlarm(evening) && scheduler.setAlarm(once));
+			AlarmScheduler::Alarm invalid = once;
+			invalid.hour = 24;
+			assert(!scheduler.setAlarm(invalid));
+			assert(scheduler.getAlarms().size() == 3 && scheduler.getAlarms().front().name == "once");
+
+			uint64_t wakeups = 0;
+			scheduler.start();
+			{
+				VirtualClock::Scope driver(clock);
+				clock.sleepFor(hours(74));
+				wakeups = scheduler.getWakeupCount();
+				// Stopping cancels the scheduler's sleep, so it exits without time moving
+				scheduler.stop();
+			}
+			std::vector<std::pair<std::string, system_clock::time_point>> expected = {
+					{"once", localAt(19, 6, 30)},
+					{"weekday", localAt(19, 7, 0)},
+					{"evening", localAt(19, 22, 0)},
+					{"evening", localAt(20, 22, 0)},
+					{"evening", localAt(21, 22, 0)},
+					{"weekday", localAt(22, 7, 0)}};
+			assert(triggers.size() == expected.size());
+			for (size_t i = 0; i < expected.size(); ++i)
+			{
+				assert(triggers[i].first == expected[i].first);
+				assert(triggers[i].second >= expected[i].second && triggers[i].second - expected[i].second < seconds(1));
+			}
+			// One wakeup per trigger time, nothing in between
+			assert(wakeups == expected.size());
+			AlarmScheduler::Alarm found;
+			assert(!scheduler.getAlarm("once", found));
+			assert(scheduler.getAlarm("weekday", found) && found.curtainPercent == 100);
+			assert(scheduler.getNextTrigger("weekday") == localAt(23, 7, 0));
+			assert(scheduler.removeAlarm("evening") && !scheduler.removeAlarm("evening"));
+
+			// In real time the timerfd stays quiet until an alarm is due, and stop() wakes it at once
+			AlarmScheduler realtime;
+			assert(realtime.initialize() && realtime.getTimerFd() >= 0);
+			realtime.start();
+			assert(realtime.setAlarm(evening));
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			auto stopStart = std::chrono::steady_clock::now();
+			realtime.stop();
+			assert(std::chrono::steady_clock::now() - stopStart < std::chrono::milliseconds(100));
+			assert(realtime.getWakeupCount() <= 1);
+
+			// The controller keeps the keypad alarm in the snapshot next to named alarms
+			SystemController controller;
+			assert(controller.addAlarm(weekday));
+			controller.setAlarmTime(6, 45);
+			assert(controller.getSnapshot().alarmEnabled && controller.getAlarms().size() == 2);
+			assert(!controller.addAlarm(invalid));
+			assert(controller.removeAlarm("keypad") && !controller.getSnapshot().alarmEnabled);
+			assert(controller.removeAlarm("weekday") && controller.getAlarms().empty());
+
+			std::cout << "Recurring alarms trigger on time over 74 virtual hours with " << wakeups << " wakeups" << std::endl;
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Alarm scheduler test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test the stepper's precomputed trapezoidal step timing
+	 */
+	bool testStepperProfile()
+	{
+		std::cout << "\n--- Testing Stepper Motion Profile ---" << std::endl;
+		try
+		{
+			using std::chrono::nanoseconds;
+			StepperMotor::MotionProfile profile;
+			profile.startStepRate = 200;
+			profile.maxStepRate = 1000;
+			profile.acceleration = 2000;
+			StepperMotor motor("gpiochip0", {{27, 22, 24, 25}}, profile);
+			assert(motor.getPosition() == 0);
+			assert(!motor.isMoving());
+			// v^2 = v0^2 + 2ak reaches 1000 steps/s after (1000^2 - 200^2) / 4000 = 240 steps
+			assert(motor.rampLength() == 240);
+
+			// Long move: accelerate from the start rate, cruise, mirror the ramp down
+			const size_t total = 1000;
+			assert(motor.stepInterval(0, total) == nanoseconds(5000000));
+			assert(motor.stepInterval(total - 1, total) == nanoseconds(5000000));
+			assert(motor.stepInterval(500, total) == nanoseconds(1000000));
+			for (size_t i = 1; i < motor.rampLength(); ++i)
+			{
+				assert(motor.stepInterval(i, total) < motor.stepInterval(i - 1, total));
+				assert(motor.stepInterval(total - 1 - i, total) == motor.stepInterval(i, total));
+			}
+			// Short move: triangular profile peaks halfway and never reaches cruise
+			const size_t shortMove = 100;
+			assert(motor.stepInterval(49, shortMove) == motor.stepInterval(50, shortMove));
+			assert(motor.stepInterval(50, shortMove) > nanoseconds(1000000));
+
+			// Moving without hardware fails cleanly and keeps the position
+			assert(!motor.moveTo(100));
+			assert(motor.getPosition() == 0);
+			StepperMotor::MoveResult asyncResult = StepperMotor::MoveResult::COMPLETED;
+			auto handle = motor.moveToAsync(100, [&asyncResult](StepperMotor::MoveResult result, int32_t)
+																			{ asyncResult = result; });
+			assert(handle.valid() && handle.isDone());
+			assert(handle.getResult() == StepperMotor::MoveResult::FAILED);
+			assert(asyncResult == StepperMotor::MoveResult::FAILED);
+			assert(!handle.cancel() && !handle.retarget(50));
+
+			// Retarget mid-move: speed changes by at most one ramp level per step and ends at rest on the new target
+			int32_t position = 0;
+			int direction = 0;
+			int level = -1;
+			int32_t target = 1000;
+			int maxLevel = 0;
+			bool reversed = false;
+			for (int step = 0; step < 5000; ++step)
+			{
+				if (step == 400)
+				{
+					target = 300; // Behind the motor once it has braked
+				}
+				int nextDirection = 0;
+				int next = motor.planStep(level, direction, target - position, nextDirection);
+				if (next < 0)
+				{
+					break;
+				}
+				assert(next <= level + 1 && next >= level - 1);
+				reversed |= (direction != 0 && nextDirection != direction);
+				assert(nextDirection == direction || level <= 0);
+				position += nextDirection;
+				direction = nextDirection;
+				level = next;
+				maxLevel = std::max(maxLevel, level);
+			}
+			assert(position == 300);
+			assert(level <= 0);
+			assert(reversed);
+			assert(maxLevel == static_cast<int>(motor.rampLength()));
+			motor.setPosition(-8);
+			assert(motor.getPosition() == -8);
+			std::cout << "Step table ramps, cruises and decelerates symmetrically" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Stepper profile test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test System Controller functionality
+	 */
+	bool testSystemController()
+	{
+		std::cout << "\n--- Testing SystemController Class ---" << std::endl;
+		try
+		{
+			// System configuration
+			SystemController::SystemConfig config;
+			config.gpioChipName = "gpiochip0";
+			config.dht11Pin = 17;
+			config.buzzerPin = 18;
+			config.keypadCols = {{26, 19, 13, 6}};
+			config.keypadRows = {{21, 20, 16, 12}};
+			config.sensorReadInterval = 1000;
+			config.keypadScanInterval = 50;
+			config.tempThreshold = 27;
+			config.humidityThreshold = 40;
+			// Test constructor
+			SystemController controller(config);
+			// Test initial states
+			assert(!controller.isRunning());
+			assert(controller.getSystemState() == SystemController::SystemState::MANUAL_MODE);
+			assert(controller.getCurtainState() == SystemController::CurtainState::CLOSED);
+			// Test alarm functionality
+			controller.setAlarmTime(12, 30);
+			controller.clearAlarm();
+			// Without a stepper the position is tracked but not driven, and nothing blocks
+			auto handle = controller.moveTo(40);
+			assert(!handle.valid() && handle.isDone());
+			assert(controller.getCurtainState() == SystemController::CurtainState::OPEN);
+			assert(controller.getCurtainPosition() == 40);
+			controller.moveTo(150);
+			assert(controller.getSnapshot().curtainPosition == 100);
+			controller.moveTo(0);
+			assert(controller.getCurtainState() == SystemController::CurtainState::CLOSED);
+			std::cout << "SystemController constructor and basic methods work" << std::endl;
+			std::cout << "Hardware-dependent initialization skipped" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "SystemController test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test frame decoding across split, coalesced and corrupted input, and the controller over a pty
+	 */
+	bool testBluetoothProtocol()
+	{
+		std::cout << "\n--- Testing Bluetooth Protocol ---" << std::endl;
+		try
+		{
+			using bluetooth::Command;
+			using bluetooth::Frame;
+			AlarmScheduler::Alarm dusk;
+			dusk.name = "dusk";
+			dusk.hour = 19;
+			dusk.minute = 45;
+			dusk.days = AlarmScheduler::DAILY;
+			dusk.buzzer = false;
+			dusk.curtainPercent = 0;
+			std::vector<uint8_t> stream;
+			uint8_t percent = 40;
+			assert(bluetooth::encodeFrame(Command::MOVE_TO, &percent, 1, stream));
+			assert(bluetooth::encodeFrame(Command::GET_STATUS, nullptr, 0, stream));
+			assert(bluetooth::encodeFrame(bluetooth::encodeAlarm(Command::SET_ALARM, dusk), stream));
+			std::vector<uint8_t> tooLong(bluetooth::MAX_PAYLOAD + 1);
+			assert(!bluetooth::encodeFrame(Command::SET_ALARM, tooLong.data(), tooLong.size(), stream));
+
+			std::vector<Frame> frames;
+			auto collect = [&frames](const Frame &frame)
+			{ frames.push_back(frame); };
+			// One byte at a time and all at once decode the same frames
+			bluetooth::FrameParser split;
+			for (uint8_t byte : stream)
+			{
+				split.feed(&byte, 1, collect);
+			}
+			bluetooth::FrameParser whole;
+			assert(whole.feed(stream.data(), stream.size(), collect) == 3);
+			assert(frames.size() == 6);
+			assert(frames[0].command == Command::MOVE_TO && frames[0].length == 1 && frames[0].payload[0] == 40);
+			assert(frames[1].command == Command::GET_STATUS && frames[1].length == 0);
+			AlarmScheduler::Alarm decoded;
+			assert(bluetooth::decodeAlarm(frames[5], decoded));
+			assert(decoded.name == "dusk" && decoded.hour == 19 && decoded.minute == 45 &&
+						 decoded.days == AlarmScheduler::DAILY && !decoded.buzzer && decoded.curtainPercent == 0);
+
+			// Noise, a false START and a corrupted frame cost only themselves
+			std::vector<uint8_t> noisy = {0x00, 0x13, bluetooth::FRAME_START, 0xFF};
+			noisy.insert(noisy.end(), stream.begin(), stream.end());
+			std::vector<uint8_t> corrupted = stream;
+			corrupted[3] ^= 0x01;
+			noisy.insert(noisy.end(), corrupted.begin(), corrupted.end());
+			noisy.insert(noisy.end(), stream.begin(), stream.end());
+			frames.clear();
+			bluetooth::FrameParser parser;
+			parser.feed(noisy.data(), noisy.size(), collect);
+			assert(frames.size() == 8);
+			assert(parser.getStats().checksumErrors >= 1 && parser.getStats().discardedBytes >= 4);
+
+			// Against the controller through a pty standing in for /dev/rfcomm0
+			int master = posix_openpt(O_RDWR | O_NOCTTY);
+			assert(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+			gpio::sim::Board::instance().reset();
+			SystemController::SystemConfig config;
+			config.sensorReadInterval = 60000;
+			config.curtainTravelSteps = 64;
+			config.metricsSocketPath = "";
+			config.bluetoothDevice = ptsname(master);
+			gpio::sim::Board::instance().attachDHT11(config.gpioChipName, config.dht11Pin);
+			gpio::sim::Board::instance().setDHT11Reading(config.gpioChipName, config.dht11Pin, 50, 22);
+			Logger::Level level = Logger::instance().getLevel();
+			Logger::instance().setLevel(Logger::Level::ERROR);
+			{
+				SystemController controller(config);
+				assert(controller.initialize());
+				controller.start();
+
+				std::vector<uint8_t> burst;
+				uint8_t autoMode = 1;
+				uint8_t unknown = 0x33;
+				percent = 30;
+				bluetooth::encodeFrame(Command::SET_MODE, &autoMode, 1, burst);
+				bluetooth::encodeFrame(Command::MOVE_TO, &percent, 1, burst);
+				bluetooth::encodeFrame(bluetooth::encodeAlarm(Command::SET_ALARM, dusk), burst);
+				bluetooth::encodeFrame(Command::LIST_ALARMS, nullptr, 0, burst);
+				bluetooth::encodeFrame(Command::GET_STATUS, nullptr, 0, burst);
+				bluetooth::encodeFrame(static_cast<Command>(unknown), nullptr, 0, burst);
+				// Two writes that cut the alarm frame in half
+				size_t cut = 12;
+				assert(write(master, burst.data(), cut) == static_cast<ssize_t>(cut));
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+				assert(write(master, burst.data() + cut, burst.size() - cut) == static_cast<ssize_t>(burst.size() - cut));
+
+				std::vector<Frame> replies;
+				bluetooth::FrameParser replyParser;
+				auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+				while (replies.size() < 7 && std::chrono::steady_clock::now() < deadline)
+				{
+					pollfd pfd = {master, POLLIN, 0};
+					if (poll(&pfd, 1, 100) > 0)
+					{
+						uint8_t buffer[256];
+						ssize_t len = read(master, buffer, sizeof(buffer));
+						if (len > 0)
+						{
+							replyParser.feed(buffer, static_cast<size_t>(len), [&replies](const Frame &frame)
+															 { replies.push_back(frame); });
+						}
+					}
+				}
+				controller.stop();
+
+				assert(replies.size() == 7);
+				auto isAck = [](const Frame &frame, Command command, bluetooth::Status status)
+				{
+					return frame.command == Command::ACK && frame.length == 2 && frame.payload[0] == static_cast<uint8_t>(command) &&
+								 frame.payload[1] == static_cast<uint8_t>(status);
+				};
+				assert(isAck(replies[0], Command::SET_MODE, bluetooth::Status::OK));
+				assert(isAck(replies[1], Command::MOVE_TO, bluetooth::Status::OK));
+				assert(isAck(replies[2], Command::SET_ALARM, bluetooth::Status::OK));
+				assert(replies[3].command == Command::ALARM && bluetooth::decodeAlarm(replies[3], decoded) && decoded.name == "dusk");
+				assert(isAck(replies[4], Command::LIST_ALARMS, bluetooth::Status::OK));
+				assert(replies[5].command == Command::STATUS && replies[5].length == 7);
+				assert((replies[5].payload[2] & bluetooth::STATUS_CURTAIN_OPEN) != 0);
+				assert(replies[5].payload[4] == static_cast<uint8_t>(SystemController::SystemState::AUTO_MODE));
+				assert(isAck(replies[6], static_cast<Command>(unknown), bluetooth::Status::UNKNOWN_COMMAND));
+				assert(controller.getSystemState() == SystemController::SystemState::AUTO_MODE);
+				assert(controller.getAlarms().size() == 1);
+			}
+			Logger::instance().setLevel(level);
+			close(master);
+			gpio::sim::Board::instance().reset();
+
+			std::cout << "Split, coalesced and corrupted frames decode; pty round trip answered all 6 requests" << std::endl;
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Bluetooth protocol test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test telemetry deltas and coalescing against a client that stops reading
+	 */
+	bool testBluetoothTelemetry()
+	{
+		std::cout << "\n--- Testing Bluetooth Telemetry ---" << std::endl;
+		try
+		{
+			using bluetooth::Command;
+			using bluetooth::Frame;
+			bluetooth::TelemetryEncoder encoder;
+			bluetooth::StatusFields sent = {{22, 50, 0, 0, 0, 7, 30}};
+			bluetooth::StatusFields received = {};
+			Frame frame;
+			assert(encoder.encode(sent, frame) && frame.payload[0] == 0x7F && frame.length == 8);
+			assert(bluetooth::applyTelemetry(frame, received) && received == sent);
+			assert(!encoder.encode(sent, frame));
+			sent[3] = 100;
+			sent[6] = 45;
+			assert(encoder.encode(sent, frame) && frame.payload[0] == 0x48 && frame.length == 3);
+			assert(bluetooth::applyTelemetry(frame, received) && received == sent);
+			frame.length = 2;
+			assert(!bluetooth::applyTelemetry(frame, received));
+
+			Counter &frames = MetricsRegistry::instance().counter("control_telemetry_frames_total");
+			Counter &coalesced = MetricsRegistry::instance().counter("control_telemetry_coalesced_total");
+			Logger::Level level = Logger::instance().getLevel();
+			Logger::instance().setLevel(Logger::Level::ERROR);
+			const int changes = 20000;
+			for (bool reactor : {false, true})
+			{
+				int master = posix_openpt(O_RDWR | O_NOCTTY);
+				assert(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+				gpio::sim::Board::instance().reset();
+				SystemController::SystemConfig config;
+				config.sensorReadInterval = 60000;
+				config.curtainTravelSteps = 64;
+				config.metricsSocketPath = "";
+				config.useReactor = reactor;
+				config.bluetoothDevice = ptsname(master);
+				gpio::sim::Board::instance().attachDHT11(config.gpioChipName, config.dht11Pin);
+				{
+					SystemController controller(config);
+					assert(controller.initialize());
+					controller.start();
+
+					bluetooth::FrameParser parser;
+					std::vector<Frame> replies;
+					auto readUntilQuiet = [&](int quietMs)
+					{
+						pollfd pfd = {master, POLLIN, 0};
+						while (poll(&pfd, 1, quietMs) > 0)
+						{
+							uint8_t buffer[256];
+							ssize_t len = read(master, buffer, sizeof(buffer));
+							if (len <= 0)
+							{
+								break;
+							}
+							parser.feed(buffer, static_cast<size_t>(len), [&replies](const Frame &reply)
+													{ replies.push_back(reply); });
+						}
+					};
+					std::vector<uint8_t> request;
+					uint8_t on = 1;
+					bluetooth::encodeFrame(Command::SUBSCRIBE, &on, 1, request);
+					assert(write(master, request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+					readUntilQuiet(200);
+					// Sensor readings may already have followed the keyframe with deltas
+					assert(replies.size() >= 2 && replies[0].command == Command::ACK && replies[0].payload[1] == 0);
+					assert(replies[1].command == Command::TELEMETRY && replies[1].payload[0] == 0x7F);
+
+					// The client stops reading while the state changes far faster than the link drains
+					uint64_t framesBefore = frames.value();
+					uint64_t coalescedBefore = coalesced.value();
+					auto start = std::chrono::steady_clock::now();
+					for (int i = 0; i < changes; ++i)
+					{
+						controller.setAlarmTime(i % 24, i % 60);
+					}
+					auto elapsed = std::chrono::steady_clock::now() - start;
+					readUntilQuiet(300);
+					controller.stop();
+
+					bluetooth::StatusFields state = {};
+					for (const auto &reply : replies)
+					{
+						assert(reply.command != Command::TELEMETRY || bluetooth::applyTelemetry(reply, state));
+					}
+					auto snapshot = controller.getSnapshot();
+					assert(state[5] == snapshot.alarmHour && state[6] == snapshot.alarmMinute);
+					assert(snapshot.alarmHour == (changes - 1) % 24 && snapshot.alarmMinute == (changes - 1) % 60);
+					assert(frames.value() - framesBefore < static_cast<uint64_t>(changes));
+					assert(coalesced.value() > coalescedBefore);
+					std::cout << (reactor ? "Reactor" : "Threads") << ": " << changes << " changes in "
+										<< std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms sent as "
+										<< frames.value() - framesBefore << " telemetry frames" << std::endl;
+				}
+				close(master);
+			}
+			Logger::instance().setLevel(level);
+			gpio::sim::Board::instance().reset();
+
+			std::cout << "Telemetry deltas rebuild the final state; a stalled client never blocks publishing" << std::endl;
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Bluetooth telemetry test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test many control clients over rfcomm, Unix and TCP at once
+	 */
+	bool testControlServer()
+	{
+		std::cout << "\n--- Testing Control Server ---" << std::endl;
+		try
+		{
+			using bluetooth::Command;
+			using bluetooth::Frame;
+			int master = posix_openpt(O_RDWR | O_NOCTTY);
+			assert(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+			gpio::sim::Board::instance().reset();
+			SystemController::SystemConfig config;
+			config.sensorReadInterval = 60000;
+			config.curtainTravelSteps = 64;
+			config.metricsSocketPath = "";
+			config.useReactor = true;
+			config.bluetoothDevice = ptsname(master);
+			config.controlSocketPath = "/tmp/smart_curtain_test_control_" + std::to_string(getpid()) + ".sock";
+			config.controlTcpPort = 0;
+			gpio::sim::Board::instance().attachDHT11(config.gpioChipName, config.dht11Pin);
+			Logger::Level level = Logger::instance().getLevel();
+			Logger::instance().setLevel(Logger::Level::ERROR);
+			{
+				SystemController controller(config);
+				assert(controller.initialize());
+				controller.start();
+				assert(controller.getControlTcpPort() > 0);
+
+				auto connectTo = [&config, &controller](bool tcp)
+				{
+					int fd;
+					if (tcp)
+					{
+						fd = socket(AF_INET, SOCK_STREAM, 0);
+						sockaddr_in address = {};
+						address.sin_family = AF_INET;
+						address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+						address.sin_port = htons(static_cast<uint16_t>(controller.getControlTcpPort()));
+						assert(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+					}
+					else
+					{
+						fd = socket(AF_UNIX, SOCK_STREAM, 0);
+						sockaddr_un address = {};
+						address.sun_family = AF_UNIX;
+						strncpy(address.sun_path, config.controlSocketPath.c_str(), sizeof(address.sun_path) - 1);
+						assert(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+					}
+					return fd;
+				};
+				// Reads until the expected number of frames arrived or a second passed
+				auto receive = [](int fd, size_t expected)
+				{
+					std::vector<Frame> frames;
+					bluetooth::FrameParser parser;
+					auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+					while (frames.size() < expected && std::chrono::steady_clock::now() < deadline)
+					{
+						pollfd pfd = {fd, POLLIN, 0};
+						if (poll(&pfd, 1, 50) <= 0)
+						{
+							continue;
+						}
+						uint8_t buffer[256];
+						ssize_t len = read(fd, buffer, sizeof(buffer));
+						if (len <= 0)
+						{
+							break;
+						}
+						parser.feed(buffer, static_cast<size_t>(len), [&frames](const Frame &frame)
+												{ frames.push_back(frame); });
+					}
+					return frames;
+				};
+
+				// Every client sends its request first, then all replies are collected
+				std::vector<int> clients;
+				for (int i = 0; i < 40; ++i)
+				{
+					clients.push_back(connectTo(i % 2 == 1));
+				}
+				clients.push_back(master);
+				std::vector<uint8_t> request;
+				bluetooth::encodeFrame(Command::GET_STATUS, nullptr, 0, request);
+				for (int fd : clients)
+				{
+					assert(write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+				}
+				for (int fd : clients)
+				{
+					std::vector<Frame> replies = receive(fd, 1);
+					assert(replies.size() == 1 && replies[0].command == Command::STATUS);
+				}
+				assert(controller.getControlClientCount() == clients.size());
+
+				// A client that floods requests and never reads is throttled, and the others are still served
+				int flooder = connectTo(false);
+				fcntl(flooder, F_SETFL, fcntl(flooder, F_GETFL) | O_NONBLOCK);
+				size_t flooded = 0;
+				for (int i = 0; i < 200000; ++i)
+				{
+					ssize_t written = write(flooder, request.data(), request.size());
+					if (written <= 0)
+					{
+						break;
+					}
+					flooded += static_cast<size_t>(written);
+				}
+				assert(flooded > 0);
+				auto sentAt = std::chrono::steady_clock::now();
+				assert(write(clients[1], request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+				std::vector<Frame> replies = receive(clients[1], 1);
+				auto roundTrip = std::chrono::steady_clock::now() - sentAt;
+				assert(replies.size() == 1 && replies[0].command == Command::STATUS);
+				assert(roundTrip < std::chrono::milliseconds(500));
+
+				// Telemetry only goes to the clients that subscribed
+				uint8_t on = 1;
+				request.clear();
+				bluetooth::encodeFrame(Command::SUBSCRIBE, &on, 1, request);
+				assert(write(clients[0], request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+				replies = receive(clients[0], 2);
+				assert(replies.size() == 2 && replies[0].command == Command::ACK && replies[1].command == Command::TELEMETRY);
+				controller.setAlarmTime(6, 15);
+				replies = receive(clients[0], 1);
+				bluetooth::StatusFields fields = {};
+				assert(replies.size() == 1 && bluetooth::applyTelemetry(replies[0], fields));
+				assert(fields[5] == 6 && fields[6] == 15);
+				pollfd quiet = {clients[2], POLLIN, 0};
+				assert(poll(&quiet, 1, 50) == 0);
+
+				close(flooder);
+				for (size_t i = 0; i + 1 < clients.size(); ++i)
+				{
+					close(clients[i]);
+				}
+				auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+				while (controller.getControlClientCount() > 1 && std::chrono::steady_clock::now() < deadline)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+				assert(controller.getControlClientCount() == 1);
+				controller.stop();
+				assert(access(config.controlSocketPath.c_str(), F_OK) != 0);
+				std::cout << "40 socket clients and the rfcomm link served; a flooding client left the others a "
+									<< std::chrono::duration_cast<std::chrono::microseconds>(roundTrip).count() << " us round trip" << std::endl;
+			}
+			Logger::instance().setLevel(level);
+			close(master);
+			gpio::sim::Board::instance().reset();
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Control server test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test seqlock consistency and snapshot change notification
+	 */
+	bool testSystemSnapshot()
+	{
+		std::cout << "\n--- Testing System Snapshot ---" << std::endl;
+		try
+		{
+			// Readers must never observe a half-written value
+			struct Pair
+			{
+				uint64_t first;
+				uint64_t second;
+			};
+			SeqLock<Pair> pair(Pair{0, 0});
+			std::atomic<bool> writing{true};
+			std::thread writer([&pair, &writing]
+												 {
+                for (uint64_t i = 1; i <= 200000; ++i)
+                {
+                    pair.store({i, i});
+                }
+                writing.store(false); });
+			bool torn = false;
+			while (writing.load())
+			{
+				Pair value = pair.load();
+				torn |= (value.first != value.second);
+			}
+			writer.join();
+			assert(!torn);
+			assert(pair.version() == 200000);
+
+			SystemController controller;
+			auto initial = controller.getSnapshot();
+			assert(initial.version == 0);
+			assert(initial.curtainState == SystemController::CurtainState::CLOSED);
+			// Timeout leaves the version unchanged
+			auto unchanged = controller.waitForChange(initial.version, std::chrono::milliseconds(10));
+			assert(unchanged.version == initial.version);
+			// A change wakes the waiter with a consistent alarm state
+			std::thread setter([&controller]
+												 {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                controller.setAlarmTime(7, 30); });
+			auto changed = controller.waitForChange(initial.version, std::chrono::seconds(2));
+			setter.join();
+			assert(changed.version > initial.version);
+			assert(changed.alarmEnabled && changed.alarmHour == 7 && changed.alarmMinute == 30);
+			controller.clearAlarm();
+			assert(!controller.getSnapshot().alarmEnabled);
+
+			// Keypad edits of the alarm time are published apart from the armed alarm until '7' arms them
+			{
+				using std::chrono::milliseconds;
+				using std::chrono::seconds;
+				gpio::sim::Board &board = gpio::sim::Board::instance();
+				board.reset();
+				VirtualClock clock;
+				board.setClock(clock);
+				SystemController::SystemConfig config;
+				config.sensorReadInterval = 60000;
+				config.metricsSocketPath = "";
+				config.bluetoothDevice = "";
+				config.controlSocketPath = "/tmp/smart_curtain_test_snapshot_" + std::to_string(getpid()) + ".sock";
+				board.attachDHT11(config.gpioChipName, config.dht11Pin);
+				board.attachKeypad(config.gpioChipName, config.keypadCols, config.keypadRows);
+				Logger::Level level = Logger::instance().getLevel();
+				Logger::instance().setLevel(Logger::Level::WARN);
+				{
+					SystemController keypadController(config, clock);
+					assert(keypadController.initialize());
+					{
+						VirtualClock::Scope driver(clock);
+						auto start = clock.now();
+						keypadController.setAlarmTime(7, 30);
+						// '5' moves the entry to 8:30, '6' on to 8:00
+						board.pressKey(config.gpioChipName, 1, 1, start + seconds(1), milliseconds(200), 1);
+						board.pressKey(config.gpioChipName, 1, 2, start + seconds(2), milliseconds(200), 1);
+						keypadController.start();
+						clock.sleepUntil(start + seconds(3));
+						auto edited = keypadController.getSnapshot();
+						assert(edited.pendingAlarmHour == 8 && edited.pendingAlarmMinute == 0);
+						assert(edited.alarmEnabled && edited.alarmHour == 7 && edited.alarmMinute == 30);
+					}
+					keypadController.stop();
+				}
+				Logger::instance().setLevel(level);
+				board.reset();
+			}
+			std::cout << "Snapshots are consistent and waiters wake on change" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "System snapshot test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test reactor dispatch order, timers and idle behaviour
+	 */
+	bool testEventLoop()
+	{
+		std::cout << "\n--- Testing EventLoop Reactor ---" << std::endl;
+		try
+		{
+			EventLoop loop;
+			assert(loop.initialize());
+			int first[2];
+			int second[2];
+			assert(pipe(first) == 0 && pipe(second) == 0);
+			std::string order;
+			loop.addFd(first[0], EPOLLIN, [&](uint32_t)
+								 {
+                char c;
+                ssize_t n = read(first[0], &c, 1);
+                (void)n;
+                order += 'A'; });
+			loop.addFd(second[0], EPOLLIN, [&](uint32_t)
+								 {
+                char c;
+                ssize_t n = read(second[0], &c, 1);
+                (void)n;
+                order += 'B';
+                loop.stop(); });
+			// Make the later-registered source ready first; dispatch must still follow registration
+			assert(write(second[1], "x", 1) == 1);
+			assert(write(first[1], "x", 1) == 1);
+			loop.run();
+			assert(order == "AB");
+
+			int ticks = 0;
+			loop.removeFd(first[0]);
+			loop.removeFd(second[0]);
+			loop.addTimer(std::chrono::milliseconds(5), [&](uint64_t expirations)
+										{
+                ticks += static_cast<int>(expirations);
+                if (ticks >= 3)
+                {
+                    loop.stop();
+                } });
+			loop.run();
+			assert(ticks >= 3);
+			for (int fd : {first[0], first[1], second[0], second[1]})
+			{
+				close(fd);
+			}
+
+			// Without devices the reactor only holds the alarm timerfd and idle sockets, and stays asleep
+			SystemController::SystemConfig config;
+			config.useReactor = true;
+			SystemController controller(config);
+			controller.start();
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			assert(controller.getReactorWakeupCount() <= 1);
+			controller.stop();
+
+			// DHT11 reads run off the loop: control requests are answered while a read is in progress
+			{
+				gpio::sim::Board::instance().reset();
+				SystemController::SystemConfig sensorConfig;
+				sensorConfig.useReactor = true;
+				sensorConfig.sensorReadInterval = 30;
+				// Edge reads sleep between edges, so a loaded CPU cannot make the simulated frame fail
+				sensorConfig.dht11ReadMode = DHT11Sensor::ReadMode::EDGE_EVENTS;
+				sensorConfig.metricsSocketPath = "";
+				sensorConfig.bluetoothDevice = "";
+				sensorConfig.controlSocketPath = "/tmp/smart_curtain_test_reactor_" + std::to_string(getpid()) + ".sock";
+				gpio::sim::Board::instance().attachDHT11(sensorConfig.gpioChipName, sensorConfig.dht11Pin);
+				Logger::Level level = Logger::instance().getLevel();
+				Logger::instance().setLevel(Logger::Level::ERROR);
+				{
+					SystemController sensing(sensorConfig);
+					assert(sensing.initialize());
+					sensing.start();
+					int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+					sockaddr_un address = {};
+					address.sun_family = AF_UNIX;
+					strncpy(address.sun_path, sensorConfig.controlSocketPath.c_str(), sizeof(address.sun_path) - 1);
+					assert(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+					std::vector<uint8_t> request;
+					bluetooth::encodeFrame(bluetooth::Command::GET_STATUS, nullptr, 0, request);
+					// A read takes most of the 30ms interval, so a blocked loop would answer most requests late
+					std::vector<double> latenciesMs;
+					for (int i = 0; i < 40; ++i)
+					{
+						auto sent = std::chrono::steady_clock::now();
+						assert(write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+						bluetooth::FrameParser parser;
+						bool replied = false;
+						while (!replied)
+						{
+							pollfd pfd = {fd, POLLIN, 0};
+							assert(poll(&pfd, 1, 1000) > 0);
+							uint8_t buffer[256];
+							ssize_t len = read(fd, buffer, sizeof(buffer));
+							assert(len > 0);
+							parser.feed(buffer, static_cast<size_t>(len), [&replied](const bluetooth::Frame &frame)
+													{ replied |= frame.command == bluetooth::Command::STATUS; });
+						}
+						latenciesMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+						std::this_thread::sleep_for(std::chrono::milliseconds(7));
+					}
+					close(fd);
+					assert(sensing.getLatestSensorData().isValid);
+					sensing.stop();
+					std::sort(latenciesMs.begin(), latenciesMs.end());
+					assert(latenciesMs[latenciesMs.size() / 2] < 5.0);
+				}
+				Logger::instance().setLevel(level);
+				gpio::sim::Board::instance().reset();
+			}
+			std::cout << "Reactor dispatches deterministically and idles without wakeups" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "EventLoop test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test fan-out, overflow policies, unsubscribing under load and delivery on a virtual clock
+	 */
+	bool testEventBus()
+	{
+		std::cout << "\n--- Testing Event Bus ---" << std::endl;
+		try
+		{
+			using Policy = EventBus::OverflowPolicy;
+			struct Reading
+			{
+				int producer;
+				int sequence;
+			};
+			struct Press
+			{
+				char key;
+			};
+
+			// Two subscribers of one type and one of another; each sees every event of its type in per-producer order
+			{
+				EventBus bus;
+				std::vector<Reading> first;
+				std::vector<Reading> second;
+				std::vector<char> keys;
+				EventBus::Subscription &a = bus.subscribe<Reading>("test_first", [&first](const Reading &reading)
+																													 { first.push_back(reading); }, Policy::DROP_OLDEST, 4096);
+				bus.subscribe<Reading>("test_second", [&second](const Reading &reading)
+															 { second.push_back(reading); }, Policy::DROP_OLDEST, 4096);
+				bus.subscribe<Press>("test_keys", [&keys](const Press &press)
+														 { keys.push_back(press.key); });
+				std::vector<std::thread> producers;
+				for (int producer = 0; producer < 2; ++producer)
+				{
+					producers.emplace_back([&bus, producer]
+																 {
+						for (int i = 0; i < 500; ++i)
+						{
+							bus.publish(Reading{producer, i});
+						} });
+				}
+				for (auto &thread : producers)
+				{
+					thread.join();
+				}
+				assert(bus.publish(Press{'4'}) == 1);
+				bus.flush();
+				assert(first.size() == 1000 && second.size() == 1000 && keys.size() == 1 && keys[0] == '4');
+				int next[2] = {0, 0};
+				for (const Reading &reading : first)
+				{
+					assert(reading.sequence == next[reading.producer]++);
+				}
+				EventBus::Stats stats = a.getStats();
+				assert(stats.published == 1000 && stats.delivered == 1000 && stats.dropped == 0 && stats.coalesced == 0);
+			}
+
+			// A blocked handler never blocks the publisher; its policy decides what it gets afterwards
+			for (Policy policy : {Policy::DROP_OLDEST, Policy::COALESCE_LATEST})
+			{
+				EventBus bus;
+				std::atomic<bool> entered{false};
+				std::atomic<bool> release{false};
+				std::vector<int> handled;
+				EventBus::Subscription &slow = bus.subscribe<Reading>("test_slow", [&](const Reading &reading)
+																															{
+					entered.store(true);
+					while (!release.load())
+					{
+						std::this_thread::yield();
+					}
+					handled.push_back(reading.sequence); }, policy, 4);
+				bus.publish(Reading{0, 0});
+				while (!entered.load())
+				{
+					std::this_thread::yield();
+				}
+				auto start = std::chrono::steady_clock::now();
+				for (int i = 1; i <= 1000; ++i)
+				{
+					bus.publish(Reading{0, i});
+				}
+				assert(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+				release.store(true);
+				bus.flush();
+				EventBus::Stats stats = slow.getStats();
+				assert(stats.published == 1001);
+				if (policy == Policy::DROP_OLDEST)
+				{
+					assert(handled == std::vector<int>({0, 997, 998, 999, 1000}));
+					assert(stats.delivered == 5 && stats.dropped == 996 && stats.coalesced == 0);
+				}
+				else
+				{
+					assert(handled == std::vector<int>({0, 1000}));
+					assert(stats.delivered == 2 && stats.coalesced == 999 && stats.dropped == 0);
+				}
+			}
+
+			// Unsubscribing while another thread publishes: queued events are handled, later ones not queued
+			{
+				EventBus bus;
+				std::atomic<int> handled{0};
+				std::atomic<bool> done{false};
+				EventBus::Subscription &counted = bus.subscribe<Reading>("test_leaving", [&handled](const Reading &)
+																																 { handled.fetch_add(1); });
+				std::thread publisher([&bus, &done]
+															{
+					for (int i = 0; !done.load(); ++i)
+					{
+						bus.publish(Reading{0, i});
+					} });
+				while (handled.load() < 1000)
+				{
+					std::this_thread::yield();
+				}
+				bus.unsubscribe(counted);
+				int after = handled.load();
+				assert(bus.publish(Reading{0, -1}) == 0);
+				done.store(true);
+				publisher.join();
+				assert(handled.load() == after);
+			}
+
+			// On a virtual clock the worker holds time from the publish, so it handles the event at that instant
+			{
+				VirtualClock clock;
+				EventBus bus(clock);
+				std::vector<std::chrono::nanoseconds> delays;
+				bus.subscribe<Clock::time_point>("test_virtual", [&clock, &delays](const Clock::time_point &published)
+																				 { delays.push_back(clock.now() - published); });
+				{
+					VirtualClock::Scope driver(clock);
+					for (int i = 0; i < 100; ++i)
+					{
+						bus.publish(clock.now());
+						clock.sleepFor(std::chrono::seconds(1));
+					}
+				}
+				bus.flush();
+				assert(delays.size() == 100);
+				for (auto delay : delays)
+				{
+					assert(delay < std::chrono::milliseconds(1));
+				}
+			}
+
+			std::cout << "Fan-out, drop-oldest, coalesce-latest, unsubscribe under load and virtual time verified" << std::endl;
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Event bus test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test asynchronous log formatting, level filtering and drop accounting
+	 */
+	bool testLogger()
+	{
+		std::cout << "\n--- Testing Async Logger ---" << std::endl;
+		try
+		{
+			int fds[2];
+			assert(pipe(fds) == 0);
+			{
+				Logger logger(fds[1]);
+				std::string name = "keypad";
+				logger.info("Test", "T=%d°C, H=%d%%, %s ok, key %c, %.1f", 25, 40, name, '5', 2.5);
+				logger.debug("Test", "filtered out");
+				logger.setLevel(Logger::Level::DEBUG);
+				logger.debug("Test", "%u/%x, missing %d", 7u, 255u);
+				logger.flush();
+				assert(logger.getWrittenCount() == 2);
+			}
+			close(fds[1]);
+			std::string output;
+			char buffer[512];
+			ssize_t n;
+			while ((n = read(fds[0], buffer, sizeof(buffer))) > 0)
+			{
+				output.append(buffer, static_cast<size_t>(n));
+			}
+			close(fds[0]);
+			assert(output.find("INFO  [Test] T=25°C, H=40%, keypad ok, key 5, 2.5\n") != std::string::npos);
+			assert(output.find("filtered out") == std::string::npos);
+			assert(output.find("DEBUG [Test] 7/ff, missing %d\n") != std::string::npos);
+
+			// Under overload every record is either written or counted as dropped, never blocked
+			int devNull = open("/dev/null", O_WRONLY);
+			assert(devNull >= 0);
+			{
+				Logger logger(devNull);
+				const int perThread = 20000;
+				auto produce = [&logger, perThread]
+				{
+					for (int i = 0; i < perThread; ++i)
+					{
+						logger.info("Load", "record %d of %d", i, perThread);
+					}
+				};
+				std::thread first(produce);
+				std::thread second(produce);
+				first.join();
+				second.join();
+				logger.flush();
+				assert(logger.getWrittenCount() + logger.getDroppedCount() == 2 * perThread);
+				std::cout << "Written " << logger.getWrittenCount() << ", dropped " << logger.getDroppedCount() << std::endl;
+
+				// Rings of exited threads are released once drained, so short-lived threads do not accumulate them
+				for (int i = 0; i < 50; ++i)
+				{
+					std::thread([&logger, i]
+											{ logger.info("Short", "thread %d", i); })
+							.join();
+				}
+				logger.flush();
+				auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+				while (logger.getRingCount() > 1 && std::chrono::steady_clock::now() < giveUp)
+				{
+					// Each log wakes the consumer, which drops whatever rings have retired since its last pass;
+					// the one left is this thread's own
+					logger.info("Short", "main");
+					logger.flush();
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				assert(logger.getRingCount() <= 1);
+			}
+			close(devNull);
+			std::cout << "Logger formats records off-thread and accounts for every call" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Logger test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test metrics registry, histogram quantiles and socket export
+	 */
+	bool testMetrics()
+	{
+		std::cout << "\n--- Testing Metrics ---" << std::endl;
+		try
+		{
+			// Buckets are contiguous and every value lands in a bucket that covers it
+			for (uint64_t value : {0ull, 7ull, 8ull, 15ull, 16ull, 100ull, 1000ull, 123456789ull, ~0ull})
+			{
+				size_t index = Histogram::bucketIndex(value);
+				assert(index < Histogram::BUCKET_COUNT);
+				assert(Histogram::bucketUpperBound(index) >= value);
+				assert(index == 0 || Histogram::bucketUpperBound(index - 1) < value);
+			}
+
+			Histogram histogram;
+			assert(histogram.percentile(0.5) == 0);
+			for (uint64_t value = 1; value <= 1000; ++value)
+			{
+				histogram.record(value);
+			}
+			assert(histogram.count() == 1000);
+			assert(histogram.sum() == 500500);
+			assert(histogram.max() == 1000);
+			// Within one sub-bucket (12.5%) of the exact quantile
+			uint64_t p50 = histogram.percentile(0.5);
+			uint64_t p99 = histogram.percentile(0.99);
+			assert(p50 >= 500 && p50 <= 563);
+			assert(p99 >= 990 && p99 <= 1000);
+			assert(histogram.percentile(1.0) == 1000);
+
+			MetricsRegistry &registry = MetricsRegistry::instance();
+			Counter &counter = registry.counter("test_events_total");
+			assert(&counter == &registry.counter("test_events_total"));
+			std::thread first([&counter]
+												{ for (int i = 0; i < 10000; ++i) counter.increment(); });
+			std::thread second([&counter]
+												 { for (int i = 0; i < 10000; ++i) counter.increment(); });
+			first.join();
+			second.join();
+			assert(counter.value() == 20000);
+			registry.histogram("test_latency_us").record(42);
+
+			DHT11Sensor sensor("gpiochip0", 99);
+			std::thread worker([]
+												 {
+				MetricsRegistry::ThreadScope scope("test_worker");
+				volatile uint64_t spin = 0;
+				for (int i = 0; i < 1000000; ++i)
+				{
+					spin = spin + i;
+				} });
+			worker.join();
+
+			std::string report = registry.render();
+			assert(report.find("test_events_total 20000\n") != std::string::npos);
+			assert(report.find("test_latency_us_count 1\n") != std::string::npos);
+			assert(report.find("test_latency_us{quantile=\"0.99\"} 42\n") != std::string::npos);
+			assert(report.find("dht11_pin99_reads_total 0\n") != std::string::npos);
+			assert(report.find("thread_cpu_us{thread=\"test_worker\"}") != std::string::npos);
+
+			std::string path = "/tmp/smart_curtain_test_metrics_" + std::to_string(getpid()) + ".sock";
+			MetricsServer server(registry, path);
+			assert(server.start());
+			int client = socket(AF_UNIX, SOCK_STREAM, 0);
+			sockaddr_un address = {};
+			address.sun_family = AF_UNIX;
+			strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+			assert(connect(client, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+			std::string received;
+			char buffer[1024];
+			ssize_t n;
+			while ((n = read(client, buffer, sizeof(buffer))) > 0)
+			{
+				received.append(buffer, static_cast<size_t>(n));
+			}
+			close(client);
+			server.stop();
+			assert(received.find("test_events_total 20000\n") != std::string::npos);
+			assert(access(path.c_str(), F_OK) != 0);
+			std::cout << "Metrics report served over " << path << " (" << received.size() << " bytes)" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Metrics test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test absolute-deadline scheduling and overrun accounting
+	 */
+	bool testPeriodicTask()
+	{
+		std::cout << "\n--- Testing PeriodicTask ---" << std::endl;
+		try
+		{
+			// 5ms of work every 10ms: sleep-after-work would take 150ms for 10 runs, the grid holds 90ms
+			PeriodicTask task("test_periodic", std::chrono::milliseconds(10));
+			int runs = 0;
+			auto start = std::chrono::steady_clock::now();
+			task.run([&task, &runs]
+							 {
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				if (++runs == 10)
+				{
+					task.stop();
+				} });
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+			PeriodicTask::Stats stats = task.getStats();
+			assert(stats.activations == 10);
+			assert(elapsed >= std::chrono::milliseconds(90) && elapsed < std::chrono::milliseconds(130));
+			std::cout << "10 activations in " << elapsed.count() << " ms, max jitter " << stats.maxJitter.count() << " us" << std::endl;
+
+			// One 25ms activation overruns and passes two releases; the late one runs, the other is skipped
+			// (more may be skipped if the test machine stalls, so only lower bounds are checked)
+			PeriodicTask late("test_overrun", std::chrono::milliseconds(10));
+			runs = 0;
+			late.run([&late, &runs]
+							 {
+				if (++runs == 2)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(25));
+				}
+				if (runs == 4)
+				{
+					late.stop();
+				} });
+			stats = late.getStats();
+			assert(stats.activations == 4);
+			assert(stats.overruns >= 1);
+			assert(stats.missedDeadlines >= 1);
+			assert(stats.maxRunTime >= std::chrono::milliseconds(25));
+			assert(MetricsRegistry::instance().counter("test_overrun_task_overruns_total").value() == stats.overruns);
+
+			// stop() from another thread wakes a long sleep immediately
+			PeriodicTask slow("test_stop", std::chrono::seconds(10));
+			std::thread runner([&slow]
+												 { slow.run([] {}); });
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			start = std::chrono::steady_clock::now();
+			slow.stop();
+			runner.join();
+			assert(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+			assert(slow.getStats().activations == 1);
+			std::cout << "Overruns and skipped releases are counted, stop() interrupts the wait" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "PeriodicTask test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test the frame table, exclusive windows, overrun accounting and the controller on the executive
+	 */
+	bool testCyclicExecutive()
+	{
+		std::cout << "\n--- Testing Cyclic Executive ---" << std::endl;
+		try
+		{
+			using std::chrono::milliseconds;
+			using std::chrono::microseconds;
+			using std::chrono::seconds;
+
+			// Scans every 5th frame leave frames 1-3 free for a 30ms window; nothing else may land there
+			{
+				CyclicExecutive table("test_table");
+				assert(table.addTask("scan", 5, 0, milliseconds(2), [] {}));
+				assert(table.reserveWindow("read", 200, milliseconds(30), [] {}) == 1);
+				assert(table.getMajorFrame() == 200);
+				assert(!table.addTask("late", 200, 2, microseconds(100), [] {}));
+				assert(!table.addTask("heavy", 5, 0, milliseconds(9), [] {}));
+				assert(table.addTask("light", 5, 0, milliseconds(8), [] {}));
+				assert(table.reserveWindow("second", 200, milliseconds(30), [] {}) == 6);
+
+				CyclicExecutive busy("test_busy");
+				assert(busy.addTask("scan", 1, 0, milliseconds(1), [] {}));
+				assert(busy.reserveWindow("read", 100, milliseconds(5), [] {}) < 0);
+				assert(!busy.addTask("offset", 4, 4, milliseconds(1), [] {}));
+			}
+
+			// Two seconds of 0.5ms scans and one 26ms read, run on virtual time
+			{
+				VirtualClock clock;
+				CyclicExecutive executive("test_cyclic", CyclicExecutive::DEFAULT_MINOR_FRAME, clock);
+				int scans = 0;
+				int overrunAt = -1;
+				int windowLockedFromOutside = 0;
+				int windowFreeFromOutside = 0;
+				auto probe = [&executive]
+				{
+					bool locked = false;
+					std::thread outside([&executive, &locked]
+															{
+						locked = executive.windowLock().try_lock_shared();
+						if (locked)
+						{
+							executive.windowLock().unlock_shared();
+						} });
+					outside.join();
+					return locked;
+				};
+				assert(executive.addTask("scan", 5, 0, milliseconds(2), [&]
+																 {
+					if (++scans == 1)
+					{
+						windowFreeFromOutside += probe() ? 1 : 0;
+					}
+					clock.sleepFor(scans == overrunAt ? milliseconds(15) : microseconds(500)); }));
+				assert(executive.reserveWindow("read", 200, milliseconds(30), [&]
+																			 {
+					windowLockedFromOutside += probe() ? 0 : 1;
+					clock.sleepFor(milliseconds(26)); }) == 1);
+				{
+					VirtualClock::Scope driver(clock);
+					auto start = clock.now();
+					assert(executive.start());
+					clock.sleepUntil(start + seconds(2) + milliseconds(5));
+					CyclicExecutive::Stats stats = executive.getStats();
+					assert(stats.frames == 201);
+					assert(stats.windowViolations == 0 && stats.skippedFrames == 0);
+					assert(stats.tasks.size() == 2 && stats.tasks[0].runs == 41 && stats.tasks[1].runs == 1);
+					assert(stats.tasks[1].exclusive && stats.tasks[1].frames == 3 && stats.tasks[1].overruns == 0);
+					assert(stats.peakFrameUtilization > 0.85 && stats.peakFrameUtilization < 0.9);
+					assert(stats.utilization > 0.02 && stats.utilization < 0.03);
+					assert(windowLockedFromOutside == 1 && windowFreeFromOutside == 1);
+
+					// A scan overrunning into the window's first frame breaks the window
+					overrunAt = scans + 40;
+					clock.sleepUntil(start + seconds(4) + milliseconds(45));
+					stats = executive.getStats();
+					assert(stats.tasks[0].overruns == 1 && stats.tasks[1].violations == 1);
+					assert(stats.windowViolations == 1 && stats.skippedFrames == 0);
+					assert(stats.maxLateness >= milliseconds(5));
+				}
+				executive.stop();
+				assert(MetricsRegistry::instance().counter("test_cyclic_window_violations_total").value() == 1);
+				assert(MetricsRegistry::instance().counter("test_cyclic_scan_overruns_total").value() == 1);
+				std::cout << "Windows keep their frames to themselves; overruns into them are reported" << std::endl;
+			}
+
+			// The controller on the executive: reads and scans in their frames, a key press opens the curtain
+			gpio::sim::Board &board = gpio::sim::Board::instance();
+			board.reset();
+			VirtualClock clock;
+			board.setClock(clock);
+			SystemController::SystemConfig config;
+			config.useCyclicExecutive = true;
+			config.curtainTravelSteps = 64;
+			config.metricsSocketPath = "";
+			board.attachDHT11(config.gpioChipName, config.dht11Pin);
+			board.setDHT11Reading(config.gpioChipName, config.dht11Pin, 55, 24);
+			board.attachKeypad(config.gpioChipName, config.keypadCols, config.keypadRows);
+			Logger::Level level = Logger::instance().getLevel();
+			Logger::instance().setLevel(Logger::Level::WARN);
+			{
+				SystemController controller(config, clock);
+				assert(controller.initialize());
+				{
+					VirtualClock::Scope driver(clock);
+					auto start = clock.now();
+					board.pressKey(config.gpioChipName, 1, 0, start + seconds(3), milliseconds(200), 1);
+					controller.start();
+					clock.sleepUntil(start + seconds(10) + milliseconds(5));
+					CyclicExecutive::Stats stats = controller.getScheduleStats();
+					assert(stats.tasks.size() == 2 && stats.tasks[0].name == "keypad" && stats.tasks[1].name == "dht11");
+					assert(stats.tasks[0].runs >= 200 && stats.tasks[0].runs <= 201);
+					assert(stats.tasks[1].runs == 5 && stats.windowViolations == 0);
+					assert(board.getDHT11ResponseCount(config.gpioChipName, config.dht11Pin) == 5);
+					assert(controller.getSystemState() == SystemController::SystemState::AUTO_MODE);
+				}
+				controller.stop();
+				assert(controller.getScheduleStats().frames == 0);
+				assert(controller.getCurtainState() == SystemController::CurtainState::OPEN);
+			}
+			Logger::instance().setLevel(level);
+			board.reset();
+			std::cout << "Controller reads the DHT11 in exclusive windows between keypad scans" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Cyclic executive test failed: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	/**
+	 * @brief Test calibrated hybrid delays
+	 */
+	bool testDelay()
+	{
+		std::cout << "\n--- Testing Calibrated Delay ---" << std::endl;
+		try
+		{
+			DelayCalibration calibration = delay_get_calibration();
+			assert(calibration.clockReadNs > 0 && calibration.clockReadNs < 10000);
+			assert(calibration.sleepOvershootNs >= 0);
+			assert(calibration.spinThresholdNs > 0);
+
+			DelayStats before = delay_get_stats();
+			const int requestsUs[] = {1, 30, 200, 2000};
+			for (int us : requestsUs)
+			{
+				auto start = std::chrono::steady_clock::now();
+				delay_us(us);
+				// Never early, whatever the scheduler does
+				assert(std::chrono::steady_clock::now() - start >= std::chrono::microseconds(us));
+			}
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(3);
+			delay_until(deadline);
+			assert(std::chrono::steady_clock::now() >= deadline);
+			// A deadline in the past returns at once
+			delay_until(deadline - std::chrono::milliseconds(1));
+
+			DelayStats after = delay_get_stats();
+			assert(after.count == before.count + 6);
+			assert(after.maxErrorNs >= after.meanErrorNs && after.meanErrorNs >= 0);
+			std::cout << "Spin threshold " << calibration.spinThresholdNs / 1000 << " us, mean error "
+								<< after.meanErrorNs << " ns, max " << after.maxErrorNs << " ns" << std::endl;
+
+			return true;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Delay test failed: " << e.what() << std::endl;
 			return false;
 		}
 	}